@@ -27,17 +27,31 @@
 
 #include "benchmark/backendbench.h"
 
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "benchmark/benchmark.h"
 #include "chess/board.h"
 #include "mcts/node.h"
 #include "neural/factory.h"
+#include "utils/histogram.h"
 #include "utils/optionsparser.h"
 
 namespace lczero {
 namespace {
 const int kDefaultThreads = 1;
 
-const OptionId kThreadsOptionId{"threads", "Threads",
-                                "Number of (CPU) worker threads to use.", 't'};
+const OptionId kThreadsOptionId{
+    "threads", "Threads",
+    "Number of threads running computations concurrently.", 't'};
+const OptionId kThreadSweepId{
+    "thread-sweep", "",
+    "Run every batch size with 1, 2, 4, ... up to --threads threads."};
 const OptionId kBatchesId{"batches", "",
                           "Number of batches to run as a benchmark."};
 const OptionId kStartBatchSizeId{"start-batch-size", "",
@@ -47,9 +61,163 @@ const OptionId kMaxBatchSizeId{"max-batch-size", "",
 const OptionId kBatchStepId{"batch-step", "",
                             "Step of batch size in benchmark."};
 const OptionId kFenId{"fen", "", "Benchmark initial position FEN."};
+const OptionId kPositionsId{
+    "positions", "",
+    "Positions to evaluate: 'fen' repeats the --fen position, 'mix' cycles "
+    "through opening, middlegame and endgame positions with varied history."};
+const OptionId kOutputFormatId{
+    "output-format", "",
+    "Format of the results on stdout: text, csv or json. With csv and json "
+    "the progress messages go to stderr."};
 
 const OptionId kClippyId{"clippy", "", "Enable helpful assistant."};
 
+// Latencies are recorded in ms from 1us to 10^6 ms, 2.3% apart.
+const int kLatencyMinExp = -3;
+const int kLatencyMaxExp = 5;
+const int kLatencyMinorScales = 100;
+
+// Number of positions taken from each benchmark position in the 'mix' mode.
+const int kMixPliesPerPosition = 8;
+
+struct BatchResult {
+  int threads;
+  int batch_size;
+  int batches;
+  double average_ms;
+  double first_batch_ms;
+  double p50_ms;
+  double p90_ms;
+  double p99_ms;
+  double nps;
+};
+
+std::vector<InputPlanes> MakeInputs(pblczero::NetworkFormat::InputFormat format,
+                                    const std::string& fen, bool mix) {
+  std::vector<InputPlanes> inputs;
+  auto encode = [&](const PositionHistory& history) {
+    inputs.push_back(EncodePositionForNN(format, history, 8,
+                                         FillEmptyHistory::ALWAYS, nullptr));
+  };
+  if (!mix) {
+    NodeTree tree;
+    tree.ResetToPosition(fen, {});
+    encode(tree.GetPositionHistory());
+    return inputs;
+  }
+  // Every benchmark position followed by a few random moves, so that the
+  // batches have varied material and history planes.
+  std::mt19937 gen(42);
+  for (const auto& position : Benchmark().positions) {
+    NodeTree tree;
+    tree.ResetToPosition(position, {});
+    PositionHistory history = tree.GetPositionHistory();
+    for (int ply = 0; ply < kMixPliesPerPosition; ply++) {
+      encode(history);
+      const auto moves = history.Last().GetBoard().GenerateLegalMoves();
+      if (moves.empty()) break;
+      history.Append(moves[gen() % moves.size()]);
+    }
+  }
+  return inputs;
+}
+
+// Runs @batches computations of @batch_size from @threads threads at once.
+BatchResult RunBatches(Network* network, const std::vector<InputPlanes>& inputs,
+                       int threads, int batch_size, int batches) {
+  Histogram latencies(kLatencyMinExp, kLatencyMaxExp, kLatencyMinorScales);
+  double total_ms = 0.0;
+  double first_batch_ms = 0.0;
+  std::exception_ptr exception;
+  std::mutex mutex;
+  std::atomic<int> next_batch{0};
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&]() {
+      try {
+        for (int batch = next_batch++; batch < batches; batch = next_batch++) {
+          const auto batch_start = std::chrono::steady_clock::now();
+          auto computation = network->NewComputation();
+          for (int k = 0; k < batch_size; k++) {
+            size_t idx = (static_cast<size_t>(batch) * batch_size + k) %
+                         inputs.size();
+            computation->AddInput(InputPlanes(inputs[idx]));
+          }
+          computation->ComputeBlocking();
+          const double ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - batch_start)
+                                .count();
+          std::lock_guard<std::mutex> lock(mutex);
+          latencies.Add(ms);
+          total_ms += ms;
+          // The first batch of a new size shows the cost of creating
+          // primitives or compiling for it, if the backend didn't do it up
+          // front.
+          if (batch == 0) first_batch_ms = ms;
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!exception) exception = std::current_exception();
+        next_batch = batches;
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  if (exception) std::rethrow_exception(exception);
+  const std::chrono::duration<double> time =
+      std::chrono::steady_clock::now() - start;
+
+  BatchResult result;
+  result.threads = threads;
+  result.batch_size = batch_size;
+  result.batches = batches;
+  result.average_ms = total_ms / batches;
+  result.first_batch_ms = first_batch_ms;
+  result.p50_ms = latencies.GetPercentile(0.50);
+  result.p90_ms = latencies.GetPercentile(0.90);
+  result.p99_ms = latencies.GetPercentile(0.99);
+  result.nps = batch_size * batches / time.count();
+  return result;
+}
+
+void PrintText(const BatchResult& r) {
+  std::cout << "Benchmark batch size " << r.batch_size;
+  if (r.threads > 1) std::cout << " on " << r.threads << " threads";
+  std::cout << " with inference average time " << r.average_ms
+            << "ms - throughput " << r.nps << " nps (first batch "
+            << r.first_batch_ms << "ms, latency p50 " << r.p50_ms << "ms p90 "
+            << r.p90_ms << "ms p99 " << r.p99_ms << "ms)." << std::endl;
+}
+
+const char kCsvHeader[] =
+    "threads,batch_size,batches,average_ms,first_batch_ms,p50_ms,p90_ms,"
+    "p99_ms,nps";
+
+void PrintCsv(const BatchResult& r) {
+  std::printf("%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f\n", r.threads,
+              r.batch_size, r.batches, r.average_ms, r.first_batch_ms,
+              r.p50_ms, r.p90_ms, r.p99_ms, r.nps);
+  std::fflush(stdout);
+}
+
+void PrintJson(const std::string& positions,
+               const std::vector<BatchResult>& results) {
+  std::printf("{\n  \"positions\": \"%s\",\n  \"results\": [",
+              positions.c_str());
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    std::printf(
+        "%s\n    {\"threads\": %d, \"batch_size\": %d, \"batches\": %d, "
+        "\"average_ms\": %.4f, \"first_batch_ms\": %.4f, \"p50_ms\": %.4f, "
+        "\"p90_ms\": %.4f, \"p99_ms\": %.4f, \"nps\": %.1f}",
+        i == 0 ? "" : ",", r.threads, r.batch_size, r.batches, r.average_ms,
+        r.first_batch_ms, r.p50_ms, r.p90_ms, r.p99_ms, r.nps);
+  }
+  std::printf("\n  ]\n}\n");
+}
+
 void Clippy(std::string title,
             std::string msg3,  std::string best3, std::string msg2,
             std::string best2, std::string msg,   std::string best) {
@@ -80,63 +248,87 @@ void BackendBenchmark::Run() {
   OptionsParser options;
   NetworkFactory::PopulateOptions(&options);
   options.Add<IntOption>(kThreadsOptionId, 1, 128) = kDefaultThreads;
+  options.Add<BoolOption>(kThreadSweepId) = false;
 
   options.Add<IntOption>(kBatchesId, 1, 999999999) = 100;
   options.Add<IntOption>(kStartBatchSizeId, 1, 1024) = 1;
   options.Add<IntOption>(kMaxBatchSizeId, 1, 1024) = 256;
   options.Add<IntOption>(kBatchStepId, 1, 256) = 1;
   options.Add<StringOption>(kFenId) = ChessBoard::kStartposFen;
+  options.Add<ChoiceOption>(kPositionsId,
+                            std::vector<std::string>{"fen", "mix"}) = "fen";
+  options.Add<ChoiceOption>(kOutputFormatId, std::vector<std::string>{
+                                                 "text", "csv", "json"}) =
+      "text";
   options.Add<BoolOption>(kClippyId) = false;
 
   if (!options.ProcessAllFlags()) return;
 
   try {
     auto option_dict = options.GetOptionsDict();
+    const std::string output_format = option_dict.Get<std::string>(
+        kOutputFormatId);
+    const bool text = output_format == "text";
+    std::ostream& log = text ? std::cout : std::cerr;
 
+    const auto load_start = std::chrono::steady_clock::now();
     auto network = NetworkFactory::LoadNetwork(option_dict);
+    const auto load_end = std::chrono::steady_clock::now();
 
-    NodeTree tree;
-    tree.ResetToPosition(option_dict.Get<std::string>(kFenId), {});
+    const std::string positions = option_dict.Get<std::string>(kPositionsId);
+    const auto inputs = MakeInputs(network->GetCapabilities().input_format,
+                                   option_dict.Get<std::string>(kFenId),
+                                   positions == "mix");
 
     // Do any backend initialization outside the loop.
+    const auto warmup_start = std::chrono::steady_clock::now();
     auto warmup = network->NewComputation();
-    warmup->AddInput(EncodePositionForNN(
-        network->GetCapabilities().input_format, tree.GetPositionHistory(), 8,
-        FillEmptyHistory::ALWAYS, nullptr));
+    warmup->AddInput(InputPlanes(inputs[0]));
     warmup->ComputeBlocking();
+    const auto warmup_end = std::chrono::steady_clock::now();
+    log << "Network loaded in "
+        << std::chrono::duration<double, std::milli>(load_end - load_start)
+               .count()
+        << "ms, first batch in "
+        << std::chrono::duration<double, std::milli>(warmup_end -
+                                                     warmup_start)
+               .count()
+        << "ms." << std::endl;
 
     const int batches = option_dict.Get<int>(kBatchesId);
+    const int max_threads = option_dict.Get<int>(kThreadsOptionId);
+    std::vector<int> thread_counts;
+    if (option_dict.Get<bool>(kThreadSweepId)) {
+      for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    }
+    thread_counts.push_back(max_threads);
 
     int best = 1; int best2 = 1; int best3 = 1;
     float best_nps = 0.0f; float best_nps2 = 0.0f; float best_nps3 = 0.0f;
     std::optional<std::chrono::time_point<std::chrono::steady_clock>> pending;
+    std::vector<BatchResult> results;
+    if (output_format == "csv") std::cout << kCsvHeader << std::endl;
 
     for (int i = option_dict.Get<int>(kStartBatchSizeId);
          i <= option_dict.Get<int>(kMaxBatchSizeId);
          i += option_dict.Get<int>(kBatchStepId)) {
-      const auto start = std::chrono::steady_clock::now();
-      // TODO: support threads not equal to 1 to be able to more sensibly test
-      // multiplexing backend.
-      for (int j = 0; j < batches; j++) {
-        // Put i copies of tree root node into computation and compute.
-        auto computation = network->NewComputation();
-        for (int k = 0; k < i; k++) {
-          computation->AddInput(EncodePositionForNN(
-              network->GetCapabilities().input_format,
-              tree.GetPositionHistory(), 8, FillEmptyHistory::ALWAYS, nullptr));
+      BatchResult result{};
+      for (int threads : thread_counts) {
+        result = RunBatches(network.get(), inputs, threads, i, batches);
+        results.push_back(result);
+        if (text) {
+          PrintText(result);
+        } else if (output_format == "csv") {
+          PrintCsv(result);
+        } else {
+          std::cerr << "Batch size " << i << " on " << threads
+                    << " threads: " << result.nps << " nps." << std::endl;
         }
-        computation->ComputeBlocking();
       }
 
-      const auto end = std::chrono::steady_clock::now();
-      std::chrono::duration<double> time = end - start;
-      const auto nps = i * batches / time.count();
-      std::cout << "Benchmark batch size " << i
-                << " with inference average time "
-                << time.count() / batches * 1000 << "ms - throughput " << nps
-                << " nps." << std::endl;
-
-      if (option_dict.Get<bool>(kClippyId)) {
+      // The assistant goes by the throughput with the most threads.
+      const auto nps = result.nps;
+      if (text && option_dict.Get<bool>(kClippyId)) {
         float nps_ingame  = std::pow((nps + best_nps)  / 2, 1.085);
         float nps_ingame2 = std::pow((nps + best_nps2) / 2, 1.085);
         float nps_ingame3 = std::pow((nps + best_nps3) / 2, 1.085);
@@ -163,7 +355,8 @@ void BackendBenchmark::Run() {
           }
         }
         if (pending) {
-          time = std::chrono::steady_clock::now() - *pending;
+          std::chrono::duration<double> time =
+              std::chrono::steady_clock::now() - *pending;
           if (time.count() > 10) {
             Clippy(
                 "Recommended minibatch-size for this net (so far):",
@@ -175,7 +368,8 @@ void BackendBenchmark::Run() {
         }
       }
     }
-    if (option_dict.Get<bool>(kClippyId)) {
+    if (output_format == "json") PrintJson(positions, results);
+    if (text && option_dict.Get<bool>(kClippyId)) {
         Clippy(
             "Recommended minibatch-size for this net:",
             "1s/move   (Bullet):     ", std::to_string(best3),
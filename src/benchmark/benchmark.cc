@@ -27,11 +27,25 @@
 
 #include "benchmark/benchmark.h"
 
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <numeric>
+#include <sstream>
 
+#include "mcts/memory_report.h"
 #include "mcts/search.h"
 #include "mcts/stoppers/factory.h"
 #include "mcts/stoppers/stoppers.h"
+#include "utils/cpu_features.h"
+#include "utils/memory_usage.h"
+#include "utils/random.h"
+#include "utils/string.h"
+#include "version.h"
 
 namespace lczero {
 namespace {
@@ -45,9 +59,388 @@ const OptionId kMovetimeId{"movetime", "",
 const OptionId kFenId{"fen", "", "Benchmark position FEN."};
 const OptionId kNumPositionsId{"num-positions", "",
                                "The number of benchmark positions to test."};
+const OptionId kRunsId{"runs", "", "Number of times to search every position."};
+const OptionId kSeedId{
+    "seed", "",
+    "Seed of the random generator, reset before every search. Together with "
+    "--threads=1 and --nodes this makes the searches reproducible. -1 keeps "
+    "the generator random."};
+const OptionId kVisitMilestonesId{
+    "visit-milestones", "",
+    "Comma separated visit counts to report the time to reach."};
+const OptionId kJsonId{"json", "", "Write the results to this JSON file."};
+const OptionId kCompareId{
+    "compare", "",
+    "Compare the nps with a baseline JSON file written by --json, and exit "
+    "with an error on a statistically significant regression."};
+const OptionId kRegressionThresholdId{
+    "regression-threshold", "",
+    "Smallest nps loss, in percent, that --compare reports as a regression."};
+const OptionId kMemoryReportId{
+    "memory-report", "",
+    "Print where the memory goes after every search: tree, NN cache, backend "
+    "buffers and resident size."};
+const OptionId kMemoryBudgetId{
+    "memory-budget", "",
+    "Memory in GiB to estimate the maximum number of tree nodes for."};
+
+// Records when the search first reached every depth and visit milestone.
+struct SearchProgress {
+  // Time to reach the average depth of the index, in ms, or -1.
+  std::vector<int64_t> time_to_depth;
+  // Time to reach every visit milestone, in ms, or -1.
+  std::vector<int64_t> time_to_visits;
+};
+
+class ProgressRecorder : public SearchStopper {
+ public:
+  ProgressRecorder(const std::vector<int>& milestones, SearchProgress* progress)
+      : milestones_(milestones), progress_(progress) {
+    progress_->time_to_depth.assign(1, 0);
+    progress_->time_to_visits.assign(milestones_.size(), -1);
+  }
+
+  bool ShouldStop(const IterationStats& stats, StoppersHints*) override {
+    Record(stats);
+    return false;
+  }
+  void OnSearchDone(const IterationStats& stats) override { Record(stats); }
+
+ private:
+  void Record(const IterationStats& stats) {
+    auto& depths = progress_->time_to_depth;
+    while (static_cast<int>(depths.size()) <= stats.average_depth) {
+      depths.push_back(stats.time_since_movestart);
+    }
+    for (size_t i = 0; i < milestones_.size(); i++) {
+      if (progress_->time_to_visits[i] < 0 &&
+          stats.nodes_since_movestart >= milestones_[i]) {
+        progress_->time_to_visits[i] = stats.time_since_movestart;
+      }
+    }
+  }
+
+  const std::vector<int> milestones_;
+  SearchProgress* const progress_;
+};
+
+struct RunResult {
+  int64_t time_ms;
+  int64_t nodes;
+  SearchProgress progress;
+
+  double GetNps() const { return 1000.0 * nodes / (time_ms + 1); }
+};
+
+double Mean(const std::vector<double>& values) {
+  return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+double Variance(const std::vector<double>& values) {
+  if (values.size() < 2) return 0.0;
+  const double mean = Mean(values);
+  double sum = 0.0;
+  for (double x : values) sum += (x - mean) * (x - mean);
+  return sum / (values.size() - 1);
+}
+
+// Two sided 95% critical value of Student's t distribution.
+double CriticalT(double degrees_of_freedom) {
+  static const double kTable[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  const int df = static_cast<int>(degrees_of_freedom);
+  if (df < 1) return std::numeric_limits<double>::infinity();
+  if (df <= 30) return kTable[df - 1];
+  return 1.96 + 2.4 / df;
+}
+
+// Welch's t-test. Returns whether the means of @a and @b differ
+// significantly.
+bool SignificantlyDifferent(const std::vector<double>& a,
+                            const std::vector<double>& b) {
+  if (a.size() < 2 || b.size() < 2) return false;
+  const double va = Variance(a) / a.size();
+  const double vb = Variance(b) / b.size();
+  if (va + vb == 0.0) return Mean(a) != Mean(b);
+  const double t = std::abs(Mean(a) - Mean(b)) / std::sqrt(va + vb);
+  const double df = (va + vb) * (va + vb) /
+                    (va * va / (a.size() - 1) + vb * vb / (b.size() - 1));
+  return t > CriticalT(df);
+}
+
+// Just enough JSON to read back the files written by --json.
+struct JsonValue {
+  std::string string;
+  double number = 0.0;
+  std::vector<JsonValue> array;
+  std::vector<std::string> keys;
+  std::vector<JsonValue> values;
+
+  const JsonValue* Find(const std::string& key) const {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] == key) return &values[i];
+    }
+    return nullptr;
+  }
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& text) : text_(text) {}
+
+  JsonValue Parse() {
+    JsonValue value = ParseValue();
+    SkipSpace();
+    if (pos_ != text_.size()) Fail();
+    return value;
+  }
+
+ private:
+  [[noreturn]] void Fail() const {
+    throw Exception("Invalid JSON at offset " + std::to_string(pos_));
+  }
+
+  void SkipSpace() {
+    while (pos_ < text_.size() &&
+           std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+      pos_++;
+    }
+  }
+
+  char Peek() {
+    SkipSpace();
+    if (pos_ >= text_.size()) Fail();
+    return text_[pos_];
+  }
+
+  bool Consume(char c) {
+    if (Peek() != c) return false;
+    pos_++;
+    return true;
+  }
+
+  void Expect(char c) {
+    if (!Consume(c)) Fail();
+  }
+
+  std::string ParseString() {
+    Expect('"');
+    std::string result;
+    while (true) {
+      if (pos_ >= text_.size()) Fail();
+      char c = text_[pos_++];
+      if (c == '"') break;
+      if (c == '\\') {
+        if (pos_ >= text_.size()) Fail();
+        c = text_[pos_++];
+        if (c == 'n') c = '\n';
+        if (c == 't') c = '\t';
+      }
+      result += c;
+    }
+    return result;
+  }
+
+  JsonValue ParseValue() {
+    JsonValue value;
+    const char c = Peek();
+    if (c == '{') {
+      pos_++;
+      if (Consume('}')) return value;
+      do {
+        value.keys.push_back(ParseString());
+        Expect(':');
+        value.values.push_back(ParseValue());
+      } while (Consume(','));
+      Expect('}');
+    } else if (c == '[') {
+      pos_++;
+      if (Consume(']')) return value;
+      do {
+        value.array.push_back(ParseValue());
+      } while (Consume(','));
+      Expect(']');
+    } else if (c == '"') {
+      value.string = ParseString();
+    } else {
+      for (const char* literal : {"true", "false", "null"}) {
+        if (text_.compare(pos_, strlen(literal), literal) == 0) {
+          pos_ += strlen(literal);
+          value.number = literal[0] == 't' ? 1.0 : 0.0;
+          return value;
+        }
+      }
+      const char* start = text_.c_str() + pos_;
+      char* end;
+      value.number = std::strtod(start, &end);
+      if (end == start) Fail();
+      pos_ += end - start;
+    }
+    return value;
+  }
+
+  const std::string& text_;
+  size_t pos_ = 0;
+};
+
+std::string JsonString(const std::string& str) {
+  std::string result = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') result += '\\';
+    result += c;
+  }
+  return result + "\"";
+}
+
+template <typename T>
+std::string JsonArray(const std::vector<T>& values) {
+  std::ostringstream oss;
+  oss.precision(10);
+  oss << "[";
+  for (size_t i = 0; i < values.size(); i++) {
+    oss << (i == 0 ? "" : ", ") << values[i];
+  }
+  oss << "]";
+  return oss.str();
+}
+
+std::vector<double> Nps(const std::vector<RunResult>& runs) {
+  std::vector<double> result;
+  for (const auto& run : runs) result.push_back(run.GetNps());
+  return result;
+}
+
+std::vector<double> TotalNps(
+    const std::vector<std::vector<RunResult>>& results) {
+  std::vector<double> result;
+  for (size_t run = 0; run < results[0].size(); run++) {
+    int64_t nodes = 0;
+    int64_t time_ms = 0;
+    for (const auto& position : results) {
+      nodes += position[run].nodes;
+      time_ms += position[run].time_ms;
+    }
+    result.push_back(1000.0 * nodes / (time_ms + 1));
+  }
+  return result;
+}
+
+void WriteJson(const std::string& filename, const OptionsDict& options,
+               const std::vector<std::string>& positions,
+               const std::vector<int>& milestones,
+               const std::vector<std::vector<RunResult>>& results,
+               const MemoryReport& memory) {
+  std::ofstream file(filename);
+  file.precision(10);
+  file << "{\n  \"version\": " << JsonString(GetVersionStr())
+       << ",\n  \"cpu\": " << JsonString(GetCpuModelName())
+       << ",\n  \"threads\": " << options.Get<int>(kThreadsOptionId)
+       << ",\n  \"nodes\": " << options.Get<int>(kNodesId)
+       << ",\n  \"movetime\": " << options.Get<int>(kMovetimeId)
+       << ",\n  \"seed\": " << options.Get<int>(kSeedId)
+       << ",\n  \"visit_milestones\": " << JsonArray(milestones)
+       << ",\n  \"peak_rss_bytes\": " << GetPeakResidentMemory()
+       << ",\n  \"bytes_per_node\": " << memory.GetBytesPerNode()
+       << ",\n  \"nn_cache_bytes\": " << memory.cache_bytes
+       << ",\n  \"total_nps\": " << JsonArray(TotalNps(results))
+       << ",\n  \"positions\": [";
+  for (size_t i = 0; i < positions.size(); i++) {
+    file << (i == 0 ? "" : ",") << "\n    {\"fen\": "
+         << JsonString(positions[i])
+         << ", \"nps\": " << JsonArray(Nps(results[i])) << ", \"runs\": [";
+    for (size_t run = 0; run < results[i].size(); run++) {
+      const auto& r = results[i][run];
+      file << (run == 0 ? "" : ",") << "\n      {\"time_ms\": " << r.time_ms
+           << ", \"nodes\": " << r.nodes
+           << ", \"time_to_depth_ms\": "
+           << JsonArray(r.progress.time_to_depth)
+           << ", \"time_to_visits_ms\": "
+           << JsonArray(r.progress.time_to_visits) << "}";
+    }
+    file << "]}";
+  }
+  file << "\n  ]\n}\n";
+  if (!file) throw Exception("Cannot write " + filename);
+}
+
+std::string FormatPercent(double fraction) {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%+.1f%%", fraction * 100.0);
+  return buffer;
+}
+
+std::vector<double> JsonNumbers(const JsonValue* value) {
+  std::vector<double> result;
+  if (!value) return result;
+  for (const auto& x : value->array) result.push_back(x.number);
+  return result;
+}
+
+// Prints the comparison with the baseline file and returns whether there was
+// a significant regression.
+bool CompareWithBaseline(const std::string& filename,
+                         const std::vector<std::string>& positions,
+                         const std::vector<std::vector<RunResult>>& results,
+                         double threshold_percent) {
+  std::ifstream file(filename);
+  if (!file) throw Exception("Cannot read " + filename);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  const std::string text = buffer.str();
+  const JsonValue baseline = JsonParser(text).Parse();
+  const JsonValue* baseline_positions = baseline.Find("positions");
+  if (!baseline_positions) throw Exception("No positions in " + filename);
+
+  bool regression = false;
+  std::vector<double> log_ratios;
+  std::cout << "\nComparison with " << filename << ":" << std::endl;
+  for (size_t i = 0; i < positions.size(); i++) {
+    const JsonValue* base = nullptr;
+    for (const auto& candidate : baseline_positions->array) {
+      const JsonValue* fen = candidate.Find("fen");
+      if (fen && fen->string == positions[i]) base = &candidate;
+    }
+    if (!base) continue;
+    const auto base_nps = JsonNumbers(base->Find("nps"));
+    const auto nps = Nps(results[i]);
+    if (base_nps.empty() || Mean(base_nps) <= 0.0) continue;
+    const double ratio = Mean(nps) / Mean(base_nps);
+    log_ratios.push_back(std::log(ratio));
+    const bool flagged = (1.0 - ratio) * 100.0 > threshold_percent &&
+                         SignificantlyDifferent(nps, base_nps);
+    regression |= flagged;
+    std::cout << "Position " << i + 1 << ": " << std::lround(Mean(nps))
+              << " nps vs " << std::lround(Mean(base_nps)) << " ("
+              << FormatPercent(ratio - 1.0) << ")"
+              << (flagged ? " REGRESSION" : "") << std::endl;
+  }
+  if (log_ratios.empty()) {
+    std::cout << "No common positions." << std::endl;
+    return false;
+  }
+
+  // Over all positions, a paired test on the log of the nps ratios.
+  const double mean = Mean(log_ratios);
+  const double error = std::sqrt(Variance(log_ratios) / log_ratios.size());
+  const double change = std::exp(mean) - 1.0;
+  const bool significant =
+      log_ratios.size() > 1 &&
+      (error == 0.0 ? mean != 0.0
+                    : std::abs(mean) / error >
+                          CriticalT(log_ratios.size() - 1));
+  const bool flagged = -change * 100.0 > threshold_percent && significant;
+  regression |= flagged;
+  std::cout << "Overall: " << FormatPercent(change)
+            << " nps (geometric mean over " << log_ratios.size()
+            << " positions, " << (significant ? "" : "not ") << "significant)"
+            << (flagged ? " REGRESSION" : "") << std::endl;
+  return regression;
+}
 }  // namespace
 
-void Benchmark::Run() {
+int Benchmark::Run() {
   OptionsParser options;
   NetworkFactory::PopulateOptions(&options);
   options.Add<IntOption>(kThreadsOptionId, 1, 128) = kDefaultThreads;
@@ -58,8 +451,17 @@ void Benchmark::Run() {
   options.Add<IntOption>(kMovetimeId, -1, 999999999) = 10000;
   options.Add<StringOption>(kFenId) = "";
   options.Add<IntOption>(kNumPositionsId, 1, 34) = 34;
+  options.Add<IntOption>(kRunsId, 1, 1000) = 1;
+  options.Add<IntOption>(kSeedId, -1, 999999999) = -1;
+  options.Add<StringOption>(kVisitMilestonesId) = "1000,10000,100000";
+  options.Add<StringOption>(kJsonId) = "";
+  options.Add<StringOption>(kCompareId) = "";
+  options.Add<FloatOption>(kRegressionThresholdId, 0.0f, 100.0f) = 2.0f;
+  options.Add<BoolOption>(kMemoryReportId) = false;
+  options.Add<FloatOption>(kMemoryBudgetId, 0.0f, 1048576.0f) =
+      kDefaultMemoryBudgetGib;
 
-  if (!options.ProcessAllFlags()) return;
+  if (!options.ProcessAllFlags()) return 1;
 
   try {
     auto option_dict = options.GetOptionsDict();
@@ -70,10 +472,15 @@ void Benchmark::Run() {
     const int movetime = option_dict.Get<int>(kMovetimeId);
     const std::string fen = option_dict.Get<std::string>(kFenId);
     int num_positions = option_dict.Get<int>(kNumPositionsId);
-
-    std::vector<std::double_t> times;
-    std::vector<std::int64_t> playouts;
-    std::uint64_t cnt = 1;
+    const int runs = option_dict.Get<int>(kRunsId);
+    const int seed = option_dict.Get<int>(kSeedId);
+    const std::string milestones_str =
+        option_dict.Get<std::string>(kVisitMilestonesId);
+    const auto milestones = milestones_str.empty()
+                                ? std::vector<int>()
+                                : ParseIntList(milestones_str);
+    const bool memory_report = option_dict.Get<bool>(kMemoryReportId);
+    const double memory_budget = option_dict.Get<float>(kMemoryBudgetId);
 
     if (fen.length() > 0) {
       positions = {fen};
@@ -81,57 +488,133 @@ void Benchmark::Run() {
     }
     std::vector<std::string> testing_positions(
         positions.cbegin(), positions.cbegin() + num_positions);
+    std::vector<std::vector<RunResult>> results(testing_positions.size());
+    // Taken after the search that built the largest tree.
+    MemoryReport memory;
+
+    for (int run = 0; run < runs; run++) {
+      for (size_t cnt = 0; cnt < testing_positions.size(); cnt++) {
+        const auto& position = testing_positions[cnt];
+        std::cout << "\nPosition: " << cnt + 1 << "/"
+                  << testing_positions.size() << " " << position;
+        if (runs > 1) std::cout << " (run " << run + 1 << "/" << runs << ")";
+        std::cout << std::endl;
 
-    for (std::string position : testing_positions) {
-      std::cout << "\nPosition: " << cnt++ << "/" << testing_positions.size()
-                << " " << position << std::endl;
+        RunResult result;
+        auto stopper = std::make_unique<ChainedSearchStopper>();
+        stopper->AddStopper(
+            std::make_unique<ProgressRecorder>(milestones, &result.progress));
+        if (movetime > -1) {
+          stopper->AddStopper(std::make_unique<TimeLimitStopper>(movetime));
+        }
+        if (visits > -1) {
+          stopper->AddStopper(std::make_unique<VisitsStopper>(visits, false));
+        }
 
-      auto stopper = std::make_unique<ChainedSearchStopper>();
-      if (movetime > -1) {
-        stopper->AddStopper(std::make_unique<TimeLimitStopper>(movetime));
+        NNCache cache;
+        cache.SetCapacity(option_dict.Get<int>(kNNCacheSizeId));
+
+        NodeTree tree;
+        tree.ResetToPosition(position, {});
+
+        if (seed >= 0) Random::Get().Seed(seed);
+        const auto start = std::chrono::steady_clock::now();
+        auto search = std::make_unique<Search>(
+            tree, network.get(),
+            std::make_unique<CallbackUciResponder>(
+                std::bind(&Benchmark::OnBestMove, this, std::placeholders::_1),
+                std::bind(&Benchmark::OnInfo, this, std::placeholders::_1)),
+            MoveList(), start, std::move(stopper), false, false, option_dict,
+            &cache, nullptr);
+        search->StartThreads(option_dict.Get<int>(kThreadsOptionId));
+        search->Wait();
+        const auto end = std::chrono::steady_clock::now();
+
+        result.time_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+                .count();
+        result.nodes = search->GetTotalPlayouts();
+        // The search has to be gone before the progress is read.
+        search.reset();
+        results[cnt].push_back(std::move(result));
+
+        const auto report = GetMemoryReport(&cache, network.get(),
+                                            tree.GetCurrentHead()->GetN());
+        if (memory_report) {
+          for (const auto& line : report.Format(memory_budget)) {
+            std::cout << "Memory: " << line << std::endl;
+          }
+        }
+        if (report.nodes.nodes >= memory.nodes.nodes) memory = report;
       }
-      if (visits > -1) {
-        stopper->AddStopper(std::make_unique<VisitsStopper>(visits, false));
+    }
+
+    std::cout << "\n===========================" << std::endl;
+    for (size_t i = 0; i < testing_positions.size(); i++) {
+      const auto nps = Nps(results[i]);
+      const auto& progress = results[i][0].progress;
+      std::cout << "Position " << i + 1 << ": " << std::lround(Mean(nps))
+                << " nps";
+      if (runs > 1) {
+        std::cout << " (sd " << std::lround(std::sqrt(Variance(nps))) << ")";
       }
+      std::cout << ", time to depth";
+      for (size_t d = 1; d < progress.time_to_depth.size(); d++) {
+        std::cout << (d == 1 ? " " : "/") << progress.time_to_depth[d];
+      }
+      std::cout << " ms";
+      for (size_t m = 0; m < milestones.size(); m++) {
+        if (progress.time_to_visits[m] < 0) continue;
+        std::cout << ", " << milestones[m] << " visits in "
+                  << progress.time_to_visits[m] << " ms";
+      }
+      std::cout << std::endl;
+    }
 
-      NNCache cache;
-      cache.SetCapacity(option_dict.Get<int>(kNNCacheSizeId));
-
-      NodeTree tree;
-      tree.ResetToPosition(position, {});
-
-      const auto start = std::chrono::steady_clock::now();
-      auto search = std::make_unique<Search>(
-          tree, network.get(),
-          std::make_unique<CallbackUciResponder>(
-              std::bind(&Benchmark::OnBestMove, this, std::placeholders::_1),
-              std::bind(&Benchmark::OnInfo, this, std::placeholders::_1)),
-          MoveList(), start, std::move(stopper), false, false, option_dict,
-          &cache, nullptr);
-      search->StartThreads(option_dict.Get<int>(kThreadsOptionId));
-      search->Wait();
-      const auto end = std::chrono::steady_clock::now();
-
-      const auto time =
-          std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-      times.push_back(time.count());
-      playouts.push_back(search->GetTotalPlayouts());
-    }
-
-    const auto total_playouts =
-        std::accumulate(playouts.begin(), playouts.end(), 0);
-    const auto total_time = std::accumulate(times.begin(), times.end(), 0);
+    int64_t total_playouts = 0;
+    int64_t total_time = 0;
+    for (const auto& position : results) {
+      for (const auto& r : position) {
+        total_playouts += r.nodes;
+        total_time += r.time_ms;
+      }
+    }
     std::cout << "\n==========================="
               << "\nTotal time (ms) : " << total_time
               << "\nNodes searched  : " << total_playouts
               << "\nNodes/second    : "
               << std::lround(1000.0 * total_playouts / (total_time + 1))
-              << std::endl;
+              << "\nPeak RSS (MiB)  : " << GetPeakResidentMemory() / 1048576
+              << "\nBytes/node      : " << std::lround(memory.GetBytesPerNode())
+              << "\nNN cache (MiB)  : " << memory.cache_bytes / 1048576
+              << "\nMax nodes       : "
+              << memory.EstimateMaxNodes(
+                     static_cast<size_t>(memory_budget * (1 << 30)))
+              << " in " << memory_budget << " GiB" << std::endl;
+    if (memory_report) {
+      std::cout << "\nLargest tree:" << std::endl;
+      for (const auto& line : memory.Format(memory_budget)) {
+        std::cout << "  " << line << std::endl;
+      }
+    }
+
+    const std::string json = option_dict.Get<std::string>(kJsonId);
+    if (!json.empty()) {
+      WriteJson(json, option_dict, testing_positions, milestones, results,
+                memory);
+    }
+    const std::string compare = option_dict.Get<std::string>(kCompareId);
+    if (!compare.empty() &&
+        CompareWithBaseline(compare, testing_positions, results,
+                            option_dict.Get<float>(kRegressionThresholdId))) {
+      return 1;
+    }
   } catch (Exception& ex) {
     std::cerr << ex.what() << std::endl;
+    return 1;
   }
+  return 0;
 }
-
 void Benchmark::OnBestMove(const BestMoveInfo& move) {
   std::cout << "bestmove " << move.bestmove.as_string() << std::endl;
 }
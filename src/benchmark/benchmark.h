@@ -78,7 +78,9 @@ class Benchmark{
       "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40"
   };
 
-  void Run();
+  // Returns the exit code of the process, which is non-zero when --compare
+  // found a significant regression.
+  int Run();
   void OnBestMove(const BestMoveInfo& move);
   void OnInfo(const std::vector<ThinkingInfo>& infos);
 };
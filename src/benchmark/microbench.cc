@@ -0,0 +1,77 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "benchmark/microbench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace lczero {
+
+MicroBenchmarks* MicroBenchmarks::Get() {
+  static MicroBenchmarks benchmarks;
+  return &benchmarks;
+}
+
+MicroBenchmarks::Register::Register(const std::string& name, Func func) {
+  MicroBenchmarks::Get()->benchmarks_.push_back({name, std::move(func)});
+}
+
+void MicroBenchmarks::Run(const std::string& filter, int min_time_ms) const {
+  auto benchmarks = benchmarks_;
+  std::sort(benchmarks.begin(), benchmarks.end(),
+            [](const Benchmark& a, const Benchmark& b) {
+              return a.name < b.name;
+            });
+  std::printf("%-48s %14s %14s\n", "Benchmark", "ns/op", "iterations");
+  for (const auto& benchmark : benchmarks) {
+    if (benchmark.name.find(filter) == std::string::npos) continue;
+    // Warm up caches and lazy initialization.
+    benchmark.func(1);
+    size_t iterations = 1;
+    while (true) {
+      const auto start = std::chrono::steady_clock::now();
+      benchmark.func(iterations);
+      const auto end = std::chrono::steady_clock::now();
+      const double ns =
+          std::chrono::duration<double, std::nano>(end - start).count();
+      if (ns >= min_time_ms * 1e6 || iterations >= (size_t{1} << 40)) {
+        std::printf("%-48s %14.2f %14zu\n", benchmark.name.c_str(),
+                    ns / iterations, iterations);
+        break;
+      }
+      // Aim for 1.4x the minimum time, but grow at most 100x per step.
+      const double target = min_time_ms * 1.4e6;
+      const double factor =
+          ns > 0 ? std::min(100.0, std::max(2.0, target / ns)) : 100.0;
+      iterations = static_cast<size_t>(iterations * factor);
+    }
+  }
+}
+
+}  // namespace lczero
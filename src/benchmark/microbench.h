@@ -0,0 +1,90 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace lczero {
+
+// Registry of micro-benchmarks, run by the lc0_microbench binary. A benchmark
+// function performs the measured operation @iterations times; the runner
+// increases @iterations until a run takes long enough to be timed reliably,
+// and reports the time per operation.
+class MicroBenchmarks {
+ public:
+  using Func = std::function<void(size_t iterations)>;
+
+  static MicroBenchmarks* Get();
+
+  class Register {
+   public:
+    Register(const std::string& name, Func func);
+  };
+
+  // Runs all benchmarks whose name contains @filter, each for at least
+  // @min_time_ms milliseconds.
+  void Run(const std::string& filter, int min_time_ms) const;
+
+ private:
+  MicroBenchmarks() = default;
+
+  struct Benchmark {
+    std::string name;
+    Func func;
+  };
+  std::vector<Benchmark> benchmarks_;
+};
+
+// Prevents the compiler from optimizing away the computation of @value.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static const void* volatile sink;
+  sink = &value;
+#endif
+}
+
+#define REGISTER_MICROBENCH_WITH_COUNTER2(name, func, counter)      \
+  namespace {                                                       \
+  static MicroBenchmarks::Register regMb38fhs##counter(name, func); \
+  }
+#define REGISTER_MICROBENCH_WITH_COUNTER(name, func, counter) \
+  REGISTER_MICROBENCH_WITH_COUNTER2(name, func, counter)
+
+// Registers a micro-benchmark.
+// @name -- name shown in the report and matched by --filter.
+// @func -- void(size_t iterations) function running the operation.
+#define REGISTER_MICROBENCH(name, func) \
+  REGISTER_MICROBENCH_WITH_COUNTER(name, func, __LINE__)
+
+}  // namespace lczero
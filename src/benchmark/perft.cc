@@ -0,0 +1,97 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "benchmark/perft.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "chess/board.h"
+#include "chess/perft.h"
+#include "utils/exception.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+namespace {
+const OptionId kFenId{"fen", "", "Position to count the moves from."};
+const OptionId kDepthId{"depth", "", "Depth in plies to count to."};
+const OptionId kThreadsOptionId{
+    "threads", "Threads", "Number of threads to split the root moves over.",
+    't'};
+const OptionId kHashId{
+    "hash", "", "Size of the perft transposition table in MiB, 0 disables it."};
+const OptionId kDivideId{"divide", "", "Show the count of every root move."};
+}  // namespace
+
+void PerftBenchmark::Run() {
+  OptionsParser options;
+  options.Add<StringOption>(kFenId) = ChessBoard::kStartposFen;
+  options.Add<IntOption>(kDepthId, 1, 20) = 5;
+  options.Add<IntOption>(kThreadsOptionId, 1, 256) =
+      std::max(1u, std::thread::hardware_concurrency());
+  options.Add<IntOption>(kHashId, 0, 65536) = 256;
+  options.Add<BoolOption>(kDivideId) = false;
+
+  if (!options.ProcessAllFlags()) return;
+
+  try {
+    const auto option_dict = options.GetOptionsDict();
+    const ChessBoard board(option_dict.Get<std::string>(kFenId));
+    const int depth = option_dict.Get<int>(kDepthId);
+    const int hash_mb = option_dict.Get<int>(kHashId);
+
+    std::unique_ptr<PerftTable> table;
+    if (hash_mb > 0) table = std::make_unique<PerftTable>(hash_mb);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto divide =
+        PerftDivide(board, depth, option_dict.Get<int>(kThreadsOptionId),
+                    table.get());
+    const auto end = std::chrono::steady_clock::now();
+
+    uint64_t nodes = 0;
+    for (const auto& entry : divide) {
+      if (option_dict.Get<bool>(kDivideId)) {
+        std::cout << entry.first.as_string() << ": " << entry.second
+                  << std::endl;
+      }
+      nodes += entry.second;
+    }
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "Perft depth " << depth << ": " << nodes << " nodes in "
+              << std::lround(seconds * 1000) << " ms, "
+              << nodes / std::max(seconds, 1e-9) / 1e6 << " Mnps." << std::endl;
+  } catch (Exception& ex) {
+    std::cerr << ex.what() << std::endl;
+  }
+}
+
+}  // namespace lczero
@@ -0,0 +1,86 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "benchmark/microbench.h"
+#include "chess/board.h"
+#include "chess/position.h"
+
+namespace lczero {
+namespace {
+
+// A middlegame position with many captures, castling and promotions near.
+const char kKiwipeteFen[] =
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+void GenerateLegalMoves(const char* fen, size_t iterations) {
+  const ChessBoard board(fen);
+  for (size_t n = 0; n < iterations; n++) {
+    const auto moves = board.GenerateLegalMoves();
+    DoNotOptimize(moves.size());
+  }
+}
+
+void GenerateStartpos(size_t iterations) {
+  GenerateLegalMoves(ChessBoard::kStartposFen, iterations);
+}
+
+void GenerateKiwipete(size_t iterations) {
+  GenerateLegalMoves(kKiwipeteFen, iterations);
+}
+
+// Copies the board and applies one of the legal moves, as the search does
+// when it walks down the tree.
+void ApplyMove(size_t iterations) {
+  const ChessBoard board(kKiwipeteFen);
+  const auto moves = board.GenerateLegalMoves();
+  for (size_t n = 0; n < iterations; n++) {
+    ChessBoard copy = board;
+    copy.ApplyMove(moves[n % moves.size()]);
+    copy.Mirror();
+    DoNotOptimize(copy);
+  }
+}
+
+void BoardHash(size_t iterations) {
+  const ChessBoard board(kKiwipeteFen);
+  for (size_t n = 0; n < iterations; n++) DoNotOptimize(board.Hash());
+}
+
+void PositionHash(size_t iterations) {
+  const Position position(ChessBoard(kKiwipeteFen), 0, 1);
+  for (size_t n = 0; n < iterations; n++) DoNotOptimize(position.Hash());
+}
+
+}  // namespace
+
+REGISTER_MICROBENCH("ChessBoard/GenerateLegalMoves/startpos", GenerateStartpos)
+REGISTER_MICROBENCH("ChessBoard/GenerateLegalMoves/kiwipete", GenerateKiwipete)
+REGISTER_MICROBENCH("ChessBoard/ApplyMove", ApplyMove)
+REGISTER_MICROBENCH("ChessBoard/Hash", BoardHash)
+REGISTER_MICROBENCH("Position/Hash", PositionHash)
+
+}  // namespace lczero
@@ -0,0 +1,102 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "chess/perft.h"
+
+#include "utils/thread_pool.h"
+
+namespace lczero {
+
+PerftTable::PerftTable(size_t size_mb) {
+  const size_t max_entries = (size_mb << 20) / sizeof(Entry);
+  if (max_entries == 0) return;
+  size_t entries = 1;
+  while (entries * 2 <= max_entries) entries *= 2;
+  entries_ = std::make_unique<Entry[]>(entries);
+  mask_ = entries - 1;
+}
+
+// The data holds the node count above the depth byte. The check is the hash
+// xor the data, so a torn entry doesn't match any hash.
+bool PerftTable::Probe(uint64_t hash, int depth, uint64_t* nodes) const {
+  if (!entries_) return false;
+  const Entry& entry = entries_[hash & mask_];
+  const uint64_t data = entry.data.load(std::memory_order_relaxed);
+  const uint64_t check = entry.check.load(std::memory_order_relaxed);
+  if ((check ^ data) != hash || (data & 0xff) != static_cast<uint64_t>(depth)) {
+    return false;
+  }
+  *nodes = data >> 8;
+  return true;
+}
+
+void PerftTable::Store(uint64_t hash, int depth, uint64_t nodes) {
+  if (!entries_) return;
+  Entry& entry = entries_[hash & mask_];
+  const uint64_t data = (nodes << 8) | static_cast<uint64_t>(depth);
+  entry.data.store(data, std::memory_order_relaxed);
+  entry.check.store(hash ^ data, std::memory_order_relaxed);
+}
+
+uint64_t Perft(const ChessBoard& board, int depth, PerftTable* table) {
+  if (depth == 0) return 1;
+  const auto moves = board.GenerateLegalMoves();
+  // Bulk counting at the last ply.
+  if (depth == 1) return moves.size();
+
+  uint64_t nodes = 0;
+  const uint64_t hash = table ? board.Hash() : 0;
+  if (table && table->Probe(hash, depth, &nodes)) return nodes;
+  for (const auto& move : moves) {
+    ChessBoard child = board;
+    child.ApplyMove(move);
+    child.Mirror();
+    nodes += Perft(child, depth - 1, table);
+  }
+  if (table) table->Store(hash, depth, nodes);
+  return nodes;
+}
+
+std::vector<std::pair<Move, uint64_t>> PerftDivide(const ChessBoard& board,
+                                                   int depth, int threads,
+                                                   PerftTable* table) {
+  const auto moves = board.GenerateLegalMoves();
+  std::vector<std::pair<Move, uint64_t>> result(moves.size());
+  if (depth < 1) return result;
+  ThreadPool pool(threads - 1);
+  pool.ParallelFor(static_cast<int>(moves.size()), [&](int i) {
+    ChessBoard child = board;
+    child.ApplyMove(moves[i]);
+    child.Mirror();
+    Move move = board.GetLegacyMove(moves[i]);
+    if (board.flipped()) move.Mirror();
+    result[i] = {move, Perft(child, depth - 1, table)};
+  });
+  return result;
+}
+
+}  // namespace lczero
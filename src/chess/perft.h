@@ -0,0 +1,71 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "chess/board.h"
+
+namespace lczero {
+
+// Transposition table for perft counts. Lookups and stores don't lock; an
+// entry torn by concurrent writers fails the key check and is ignored.
+class PerftTable {
+ public:
+  // Allocates the largest power of two number of entries in @size_mb MiB.
+  explicit PerftTable(size_t size_mb);
+
+  // Returns whether the count of @hash at @depth was found.
+  bool Probe(uint64_t hash, int depth, uint64_t* nodes) const;
+  void Store(uint64_t hash, int depth, uint64_t nodes);
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check{0};
+    std::atomic<uint64_t> data{0};
+  };
+  std::unique_ptr<Entry[]> entries_;
+  uint64_t mask_ = 0;
+};
+
+// Number of leaf nodes of the legal move tree of @board at @depth.
+// @table can be nullptr.
+uint64_t Perft(const ChessBoard& board, int depth, PerftTable* table);
+
+// Same as Perft(), with separate counts for every root move. The root moves
+// are counted by @threads threads in parallel. The moves are from the point
+// of view of white, and castling uses the king's destination square.
+std::vector<std::pair<Move, uint64_t>> PerftDivide(const ChessBoard& board,
+                                                   int depth, int threads,
+                                                   PerftTable* table);
+
+}  // namespace lczero
@@ -0,0 +1,98 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "chess/perft.h"
+
+#include <gtest/gtest.h>
+
+namespace lczero {
+namespace {
+
+struct PerftCase {
+  const char* fen;
+  int depth;
+  uint64_t nodes;
+};
+
+// From the chessprogramming wiki, they cover castling, en passant,
+// promotions and checks.
+const PerftCase kCases[] = {
+    {ChessBoard::kStartposFen, 4, 197281},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3,
+     97862},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4,
+     422333},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+};
+
+}  // namespace
+
+TEST(Perft, KnownCounts) {
+  for (const auto& c : kCases) {
+    EXPECT_EQ(Perft(ChessBoard(c.fen), c.depth, nullptr), c.nodes) << c.fen;
+  }
+}
+
+TEST(Perft, WithTable) {
+  PerftTable table(16);
+  for (const auto& c : kCases) {
+    EXPECT_EQ(Perft(ChessBoard(c.fen), c.depth, &table), c.nodes) << c.fen;
+    // Again, now mostly from the table.
+    EXPECT_EQ(Perft(ChessBoard(c.fen), c.depth, &table), c.nodes) << c.fen;
+  }
+}
+
+TEST(Perft, DivideInParallel) {
+  PerftTable table(16);
+  for (const auto& c : kCases) {
+    const ChessBoard board(c.fen);
+    const auto divide = PerftDivide(board, c.depth, 4, &table);
+    EXPECT_EQ(divide.size(), board.GenerateLegalMoves().size());
+    uint64_t total = 0;
+    for (const auto& entry : divide) total += entry.second;
+    EXPECT_EQ(total, c.nodes) << c.fen;
+  }
+}
+
+TEST(Perft, DivideMovesAreFromWhitePointOfView) {
+  const ChessBoard board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 0 1");
+  bool found_castling = false;
+  for (const auto& entry : PerftDivide(board, 1, 1, nullptr)) {
+    if (entry.first.as_string() == "e8g8") found_castling = true;
+  }
+  EXPECT_TRUE(found_castling);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  lczero::InitializeMagicBitboards();
+  return RUN_ALL_TESTS();
+}
@@ -61,6 +61,7 @@ const std::unordered_map<std::string, std::unordered_set<std::string>>
         {{"quit"}, {}},
         {{"xyzzy"}, {}},
         {{"fen"}, {}},
+        {{"memory"}, {"gib"}},
 };
 
 std::pair<std::string, std::unordered_map<std::string, std::string>>
@@ -205,6 +206,8 @@ bool UciLoop::DispatchCommand(
     CmdStart();
   } else if (command == "fen") {
     CmdFen();
+  } else if (command == "memory") {
+    CmdMemory(ContainsKey(params, "gib") ? GetNumeric(params, "gib") : 0);
   } else if (command == "xyzzy") {
     SendResponse("Nothing happens.");
   } else if (command == "quit") {
@@ -86,6 +86,11 @@ class UciLoop {
   virtual void CmdStop() { throw Exception("Not supported"); }
   virtual void CmdPonderHit() { throw Exception("Not supported"); }
   virtual void CmdStart() { throw Exception("Not supported"); }
+  // Reports memory use, with an estimate of the nodes fitting in @budget_gib
+  // GiB (0 for the default).
+  virtual void CmdMemory(int /*budget_gib*/) {
+    throw Exception("Not supported");
+  }
 
  private:
   bool DispatchCommand(
@@ -193,6 +193,12 @@ void EngineController::SetPosition(const std::string& fen,
   search_.reset();
 }
 
+MemoryReport EngineController::GetMemoryReport() const {
+  const Node* head = tree_ ? tree_->GetCurrentHead() : nullptr;
+  return lczero::GetMemoryReport(&cache_, network_.get(),
+                                 head ? head->GetN() : 0);
+}
+
 Position EngineController::ApplyPositionMoves() {
   ChessBoard board;
   int no_capture_ply;
@@ -386,4 +392,12 @@ void EngineLoop::CmdPonderHit() { engine_.PonderHit(); }
 
 void EngineLoop::CmdStop() { engine_.Stop(); }
 
+void EngineLoop::CmdMemory(int budget_gib) {
+  const auto lines = engine_.GetMemoryReport().Format(
+      budget_gib > 0 ? budget_gib : kDefaultMemoryBudgetGib);
+  std::vector<std::string> responses;
+  for (const auto& line : lines) responses.push_back("info string " + line);
+  SendResponses(responses);
+}
+
 }  // namespace lczero
@@ -30,6 +30,7 @@
 #include <optional>
 
 #include "chess/uciloop.h"
+#include "mcts/memory_report.h"
 #include "mcts/search.h"
 #include "neural/cache.h"
 #include "neural/factory.h"
@@ -76,6 +77,9 @@ class EngineController {
 
   Position ApplyPositionMoves();
 
+  // Reports the memory used by the tree, the cache and the backend.
+  MemoryReport GetMemoryReport() const;
+
  private:
   void UpdateFromUciOptions();
 
@@ -132,6 +136,7 @@ class EngineLoop : public UciLoop {
   void CmdGo(const GoParams& params) override;
   void CmdPonderHit() override;
   void CmdStop() override;
+  void CmdMemory(int budget_gib) override;
 
  private:
   OptionsParser options_;
@@ -25,8 +25,13 @@
   Program grant you additional permission to convey the resulting work.
 */
 
+#include <algorithm>
 #include <fstream>
+#include <utility>
+#include <vector>
 
+#include "neural/calibration.h"
+#include "neural/factory.h"
 #include "neural/loader.h"
 #include "neural/onnx/converter.h"
 #include "utils/files.h"
@@ -55,6 +60,26 @@ const OptionId kOutputMlh{"mlh-head-name", "MlhHeadName",
                           "ONNX name to use for the MLH head output node."};
 const OptionId kOnnxToPytorch{"onnx2pytorch", "Onnx2Pytorch",
                           "Only use layer definitions supported by onnx2pytorch."};
+const OptionId kFusedAttention{
+    "fused-attention", "FusedAttention",
+    "Emit the encoder attention as the onnxruntime Attention contrib "
+    "operator."};
+const OptionId kFusedLayerNorm{
+    "fused-layer-norm", "FusedLayerNorm",
+    "Emit the layer normalizations after the encoder skip connections as the "
+    "onnxruntime SkipLayerNormalization contrib operator."};
+const OptionId kInt8{"int8", "Int8",
+                     "Quantize the dense layers of the encoders to int8, with "
+                     "the activations quantized at run time."};
+const OptionId kInt8Calibration{
+    "int8-calibration", "Int8Calibration",
+    "File with the positions to calibrate the int8 quantization on, one FEN "
+    "per line. Built in positions if empty."};
+const OptionId kInt8MaxQError{
+    "int8-max-q-error", "Int8MaxQError",
+    "Keep the encoder layers most sensitive to quantization in floating point "
+    "until the mean Q error on the calibration positions is at most this. 0 "
+    "quantizes all layers without calibration. Needs the onnx-cpu backend."};
 
 bool ProcessParameters(OptionsParser* options) {
   options->Add<StringOption>(kInputFilenameId);
@@ -66,6 +91,11 @@ bool ProcessParameters(OptionsParser* options) {
   options->Add<StringOption>(kOutputValue) = "/output/value";
   options->Add<StringOption>(kOutputMlh) = "/output/mlh";
   options->Add<BoolOption>(kOnnxToPytorch) = false;
+  options->Add<BoolOption>(kFusedAttention) = false;
+  options->Add<BoolOption>(kFusedLayerNorm) = false;
+  options->Add<BoolOption>(kInt8) = false;
+  options->Add<StringOption>(kInt8Calibration) = "";
+  options->Add<FloatOption>(kInt8MaxQError, 0.0f, 1.0f) = 0.01f;
   if (!options->ProcessAllFlags()) return false;
 
   const OptionsDict& dict = options->GetOptionsDict();
@@ -75,6 +105,55 @@ bool ProcessParameters(OptionsParser* options) {
   return true;
 }
 
+// Converts @weights with int8 encoder layers, keeping in floating point the
+// layers most sensitive to quantization until the mean Q error on the
+// positions of @fen_file is at most @max_q_error.
+pblczero::Net ConvertCalibratedInt8(const WeightsFile& weights,
+                                    WeightsToOnnxConverterOptions options,
+                                    const std::string& fen_file,
+                                    float max_q_error) {
+  const auto positions = LoadCalibrationPositions(
+      fen_file, weights.format().network_format().input());
+  const OptionsDict backend_options;
+  auto evaluate = [&](const WeightsToOnnxConverterOptions& onnx_options) {
+    auto network = NetworkFactory::Get()->Create(
+        "onnx-cpu", ConvertWeightsToOnnx(weights, onnx_options),
+        backend_options);
+    return EvaluateCalibrationPositions(network.get(), positions);
+  };
+  auto reference_options = options;
+  reference_options.int8 = false;
+  const auto reference = evaluate(reference_options);
+  auto measure = [&](const WeightsToOnnxConverterOptions& onnx_options) {
+    return CompareCalibrationOutputs(reference, evaluate(onnx_options));
+  };
+
+  auto error = measure(options);
+  COUT << "Int8 vs float on " << positions.size()
+       << " positions: " << error.ToString() << ".";
+  if (error.mean_q <= max_q_error) return ConvertWeightsToOnnx(weights, options);
+
+  // The error with every layer quantized alone.
+  const int layers = weights.weights().encoder_size();
+  std::vector<std::pair<float, int>> sensitivity;
+  for (int i = 0; i < layers; i++) {
+    auto layer_options = options;
+    for (int j = 0; j < layers; j++) {
+      if (j != i) layer_options.float_encoder_layers.insert(j);
+    }
+    sensitivity.emplace_back(measure(layer_options).mean_q, i);
+  }
+  std::sort(sensitivity.rbegin(), sensitivity.rend());
+  for (const auto& [layer_error, layer] : sensitivity) {
+    options.float_encoder_layers.insert(layer);
+    error = measure(options);
+    COUT << "Keeping encoder layer " << layer << " in floating point: "
+         << error.ToString() << ".";
+    if (error.mean_q <= max_q_error) break;
+  }
+  return ConvertWeightsToOnnx(weights, options);
+}
+
 }  // namespace
 
 void ConvertLeelaToOnnx() {
@@ -100,7 +179,26 @@ void ConvertLeelaToOnnx() {
     // onnx2pytorch only needs an alternate layernorm-implementation, so it's currently
     // only enables that. Might need to be extended in the future.
     onnx_options.alternative_layer_normalization = dict.Get<bool>(kOnnxToPytorch);
-    weights_file = ConvertWeightsToOnnx(weights_file, onnx_options);
+    onnx_options.fused_attention = dict.Get<bool>(kFusedAttention);
+    onnx_options.fused_layer_norm = dict.Get<bool>(kFusedLayerNorm);
+    onnx_options.int8 = dict.Get<bool>(kInt8);
+    const auto backends = NetworkFactory::Get()->GetBackendsList();
+    const bool can_calibrate =
+        std::find(backends.begin(), backends.end(), "onnx-cpu") !=
+        backends.end();
+    if (onnx_options.int8 && dict.Get<float>(kInt8MaxQError) > 0.0f &&
+        !can_calibrate) {
+      COUT << "No onnx-cpu backend to calibrate with, quantizing all encoder "
+              "layers.";
+    }
+    if (onnx_options.int8 && dict.Get<float>(kInt8MaxQError) > 0.0f &&
+        can_calibrate) {
+      weights_file = ConvertCalibratedInt8(
+          weights_file, onnx_options, dict.Get<std::string>(kInt8Calibration),
+          dict.Get<float>(kInt8MaxQError));
+    } else {
+      weights_file = ConvertWeightsToOnnx(weights_file, onnx_options);
+    }
   }
 
   const auto& onnx = weights_file.onnx_model();
@@ -27,6 +27,7 @@
 
 #include "benchmark/backendbench.h"
 #include "benchmark/benchmark.h"
+#include "benchmark/perft.h"
 #include "chess/board.h"
 #include "engine.h"
 #include "lc0ctl/describenet.h"
@@ -34,6 +35,7 @@
 #include "lc0ctl/onnx2leela.h"
 #include "selfplay/loop.h"
 #include "utils/commandline.h"
+#include "utils/cpu_features.h"
 #include "utils/esc_codes.h"
 #include "utils/logging.h"
 #include "version.h"
@@ -46,6 +48,8 @@ int main(int argc, const char** argv) {
   CERR << "|   _ | |";
   CERR << "|_ |_ |_|" << EscCodes::Reset() << " v" << GetVersionStr()
        << " built " << __DATE__;
+  CERR << "CPU features: " << DescribeCpuFeatures()
+       << ", ISPC kernels: " << GetIspcTarget() << ".";
 
   try {
     InitializeMagicBitboards();
@@ -56,6 +60,7 @@ int main(int argc, const char** argv) {
     CommandLine::RegisterMode("benchmark", "Quick benchmark");
     CommandLine::RegisterMode("backendbench",
                               "Quick benchmark of backend only");
+    CommandLine::RegisterMode("perft", "Count move generator nodes");
     CommandLine::RegisterMode("leela2onnx", "Convert Leela network to ONNX.");
     CommandLine::RegisterMode("onnx2leela",
                               "Convert ONNX network to Leela net.");
@@ -69,7 +74,11 @@ int main(int argc, const char** argv) {
     } else if (CommandLine::ConsumeCommand("benchmark")) {
       // Benchmark mode.
       Benchmark benchmark;
-      benchmark.Run();
+      return benchmark.Run();
+    } else if (CommandLine::ConsumeCommand("perft")) {
+      // Move generator benchmark mode.
+      PerftBenchmark perft;
+      perft.Run();
     } else if (CommandLine::ConsumeCommand("backendbench")) {
       // Backend Benchmark mode.
       BackendBenchmark benchmark;
@@ -0,0 +1,127 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "mcts/memory_report.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "utils/memory_usage.h"
+
+namespace lczero {
+namespace {
+
+std::string MiB(double bytes) {
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1) << bytes / (1024 * 1024) << " MiB";
+  return oss.str();
+}
+
+}  // namespace
+
+double MemoryReport::GetBytesPerNode() const {
+  if (nodes.nodes <= 0) return 0.0;
+  return static_cast<double>(tree_bytes) / nodes.nodes;
+}
+
+int64_t MemoryReport::EstimateMaxNodes(size_t budget_bytes) const {
+  const double bytes_per_node = GetBytesPerNode();
+  if (bytes_per_node <= 0.0) return 0;
+  // Whatever the process uses apart from the tree and the cache: the binary,
+  // the weights, the backend and the allocator's free memory.
+  size_t rest = 0;
+  if (resident_bytes > tree_bytes + cache_bytes) {
+    rest = resident_bytes - tree_bytes - cache_bytes;
+  }
+  rest = std::max(rest, backend_bytes);
+  // The table is allocated for the full capacity already, the entries are
+  // assumed to keep their average size.
+  double full_cache = cache_bytes;
+  if (cache_entries > 0 && cache_capacity > cache_entries) {
+    full_cache += static_cast<double>(cache_entry_bytes) *
+                  (cache_capacity - cache_entries) / cache_entries;
+  }
+  const double available = static_cast<double>(budget_bytes) - rest -
+                           full_cache;
+  if (available <= 0.0) return 0;
+  return static_cast<int64_t>(available / bytes_per_node);
+}
+
+std::vector<std::string> MemoryReport::Format(double budget_gib) const {
+  std::vector<std::string> lines;
+  std::ostringstream oss;
+  oss << "Tree: " << nodes.nodes << " nodes (" << nodes.solid_nodes << " in "
+      << nodes.solid_arrays << " solid arrays), " << nodes.edges
+      << " edges, " << MiB(tree_bytes);
+  if (nodes.nodes > 0) {
+    oss << ", " << std::lround(GetBytesPerNode()) << " bytes/node";
+  }
+  if (visits > 0) oss << ", " << tree_bytes / visits << " bytes/visit";
+  lines.push_back(oss.str());
+  lines.push_back("GC backlog: " + std::to_string(nodes.gc_backlog) +
+                  " subtrees");
+  lines.push_back("NN cache: " + std::to_string(cache_entries) + "/" +
+                  std::to_string(cache_capacity) + " entries, " +
+                  MiB(cache_bytes));
+  lines.push_back("Backend buffers: " + MiB(backend_bytes));
+  if (resident_bytes > 0 || peak_resident_bytes > 0) {
+    lines.push_back("Resident: " + MiB(resident_bytes) + ", peak " +
+                    MiB(peak_resident_bytes));
+  }
+  oss.str("");
+  oss << "Max nodes in " << budget_gib << " GiB: ";
+  if (nodes.nodes > 0) {
+    oss << EstimateMaxNodes(static_cast<size_t>(budget_gib * (1 << 30)));
+  } else {
+    oss << "unknown until a search has run";
+  }
+  lines.push_back(oss.str());
+  return lines;
+}
+
+MemoryReport GetMemoryReport(const NNCache* cache, const Network* network,
+                             uint64_t visits) {
+  MemoryReport report;
+  report.nodes = Node::GetMemoryStats();
+  report.tree_bytes = report.nodes.GetBytes();
+  report.visits = visits;
+  if (cache) {
+    const auto usage = GetNNCacheMemoryUsage(*cache);
+    report.cache_bytes = usage.table_bytes + usage.entry_bytes;
+    report.cache_entry_bytes = usage.entry_bytes;
+    report.cache_entries = cache->GetSize();
+    report.cache_capacity = cache->GetCapacity();
+  }
+  if (network) report.backend_bytes = network->GetBufferBytes();
+  report.resident_bytes = GetCurrentResidentMemory();
+  report.peak_resident_bytes = GetPeakResidentMemory();
+  return report;
+}
+
+}  // namespace lczero
@@ -0,0 +1,78 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mcts/node.h"
+#include "neural/cache.h"
+#include "neural/network.h"
+
+namespace lczero {
+
+// Memory budget for the "max nodes" estimate when none is given.
+constexpr double kDefaultMemoryBudgetGib = 16.0;
+
+// Where the memory of the engine goes, for capacity planning: the search
+// tree, the NN cache, the backend buffers and the process as a whole.
+struct MemoryReport {
+  NodeMemoryStats nodes;
+  size_t tree_bytes = 0;
+  // Visits of the searched tree, or 0 if not known.
+  uint64_t visits = 0;
+  // All of the cache, and the part of it that grows with the entries.
+  size_t cache_bytes = 0;
+  size_t cache_entry_bytes = 0;
+  int cache_entries = 0;
+  int cache_capacity = 0;
+  size_t backend_bytes = 0;
+  // 0 where the OS doesn't tell.
+  size_t resident_bytes = 0;
+  size_t peak_resident_bytes = 0;
+
+  // Average tree bytes per node, 0 if there are no nodes.
+  double GetBytesPerNode() const;
+
+  // Estimates how many nodes fit in @budget_bytes, with the cache filled to
+  // its capacity and the rest of the process staying as large as it is now.
+  // Returns 0 if the budget doesn't even cover that.
+  int64_t EstimateMaxNodes(size_t budget_bytes) const;
+
+  // Returns the report as lines of text, ending with the estimate for
+  // @budget_gib GiB.
+  std::vector<std::string> Format(double budget_gib) const;
+};
+
+// Collects the report. @cache and @network may be null.
+MemoryReport GetMemoryReport(const NNCache* cache, const Network* network,
+                             uint64_t visits = 0);
+
+}  // namespace lczero
@@ -0,0 +1,164 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "mcts/memory_report.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "chess/board.h"
+
+namespace lczero {
+namespace {
+
+// Waits for the garbage collector to free what was queued, until the node
+// count drops to @nodes.
+NodeMemoryStats WaitForGc(int64_t nodes) {
+  for (int i = 0; i < 100; i++) {
+    const auto stats = Node::GetMemoryStats();
+    if (stats.gc_backlog == 0 && stats.nodes == nodes) return stats;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return Node::GetMemoryStats();
+}
+
+// Creates the nodes of the first @count edges of @node.
+void SpawnChildren(Node* node, int count) {
+  for (auto& edge : node->Edges()) {
+    if (count-- == 0) break;
+    edge.GetOrSpawnNode(node);
+  }
+}
+
+}  // namespace
+
+TEST(NodeMemoryStats, CountsNodesAndEdges) {
+  const auto before = WaitForGc(Node::GetMemoryStats().nodes);
+  const auto moves = ChessBoard(ChessBoard::kStartposFen).GenerateLegalMoves();
+  auto root = std::make_unique<Node>(nullptr, 0);
+  root->CreateEdges(moves);
+  SpawnChildren(root.get(), 2);
+
+  auto stats = Node::GetMemoryStats();
+  EXPECT_EQ(stats.nodes, before.nodes + 3);
+  EXPECT_EQ(stats.edges, before.edges + 20);
+  EXPECT_EQ(stats.edge_lists, before.edge_lists + 1);
+  EXPECT_GE(stats.GetBytes() - before.GetBytes(),
+            3 * sizeof(Node) + 20 * sizeof(Edge));
+
+  root->ReleaseChildren();
+  stats = WaitForGc(before.nodes + 1);
+  EXPECT_EQ(stats.nodes, before.nodes + 1);
+  EXPECT_EQ(stats.gc_backlog, 0);
+
+  root.reset();
+  stats = WaitForGc(before.nodes);
+  EXPECT_EQ(stats.nodes, before.nodes);
+  EXPECT_EQ(stats.edges, before.edges);
+  EXPECT_EQ(stats.edge_lists, before.edge_lists);
+}
+
+TEST(NodeMemoryStats, CountsSolidArrays) {
+  const auto before = WaitForGc(Node::GetMemoryStats().nodes);
+  const auto moves = ChessBoard(ChessBoard::kStartposFen).GenerateLegalMoves();
+  auto root = std::make_unique<Node>(nullptr, 0);
+  root->CreateEdges(moves);
+  SpawnChildren(root.get(), 2);
+  ASSERT_TRUE(root->MakeSolid());
+
+  // The two old children go to the garbage collector.
+  auto stats = WaitForGc(before.nodes + 21);
+  EXPECT_EQ(stats.nodes, before.nodes + 21);
+  EXPECT_EQ(stats.solid_arrays, before.solid_arrays + 1);
+  EXPECT_EQ(stats.solid_nodes, before.solid_nodes + 20);
+
+  root.reset();
+  stats = WaitForGc(before.nodes);
+  EXPECT_EQ(stats.nodes, before.nodes);
+  EXPECT_EQ(stats.solid_arrays, before.solid_arrays);
+  EXPECT_EQ(stats.solid_nodes, before.solid_nodes);
+}
+
+TEST(NodeMemoryStats, BalancedAfterTreeResets) {
+  const auto before = WaitForGc(Node::GetMemoryStats().nodes);
+  const auto moves = ChessBoard(ChessBoard::kStartposFen).GenerateLegalMoves();
+  {
+    NodeTree tree;
+    for (int i = 0; i < 5; i++) {
+      // Going back to an ancestor of the head trims the tree at the new head,
+      // which has the edges of the previous search.
+      tree.ResetToPosition(ChessBoard::kStartposFen, {});
+      tree.GetCurrentHead()->CreateEdges(moves);
+      tree.ResetToPosition(ChessBoard::kStartposFen, {moves[0]});
+      tree.ResetToPosition(ChessBoard::kStartposFen, {});
+    }
+  }
+  const auto stats = WaitForGc(before.nodes);
+  EXPECT_EQ(stats.nodes, before.nodes);
+  EXPECT_EQ(stats.edges, before.edges);
+  EXPECT_EQ(stats.edge_lists, before.edge_lists);
+}
+
+TEST(MemoryReport, EstimateMaxNodes) {
+  MemoryReport report;
+  report.nodes.nodes = 1000;
+  report.tree_bytes = 100000;
+  report.cache_bytes = 60000;
+  report.cache_entry_bytes = 20000;
+  report.cache_entries = 100;
+  report.cache_capacity = 300;
+  report.resident_bytes = 1160000;
+  // 1 MB for the rest of the process, 100 KB for the full cache, and 100
+  // bytes per node.
+  EXPECT_EQ(report.EstimateMaxNodes(2100000), 10000);
+  EXPECT_EQ(report.EstimateMaxNodes(1000000), 0);
+  report.nodes.nodes = 0;
+  EXPECT_EQ(report.EstimateMaxNodes(2100000), 0);
+}
+
+TEST(MemoryReport, CountsCachePayload) {
+  NNCache cache(10);
+  const auto empty = GetNNCacheMemoryUsage(cache);
+  EXPECT_GT(empty.table_bytes, 0u);
+  EXPECT_EQ(empty.entry_bytes, 0u);
+  cache.Insert(1, std::make_unique<CachedNNRequest>(30));
+  const auto usage = GetNNCacheMemoryUsage(cache);
+  EXPECT_EQ(usage.table_bytes, empty.table_bytes);
+  EXPECT_EQ(usage.entry_bytes,
+            sizeof(CachedNNRequest) + 30 * sizeof(CachedNNRequest::IdxAndProb) +
+                sizeof(uint64_t));
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  lczero::InitializeMagicBitboards();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
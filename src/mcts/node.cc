@@ -64,6 +64,12 @@ class NodeGarbageCollector {
     subtrees_to_gc_solid_size_.push_back(solid_size);
   }
 
+  // Returns the number of subtrees waiting to be released.
+  size_t GetBacklog() const {
+    Mutex::Lock lock(gc_mutex_);
+    return subtrees_to_gc_.size();
+  }
+
   ~NodeGarbageCollector() {
     // Flips stop flag and waits for a worker thread to stop.
     stop_.store(true);
@@ -88,11 +94,7 @@ class NodeGarbageCollector {
       }
       // Solid is a hack...
       if (solid_size != 0) {
-        for (size_t i = 0; i < solid_size; i++) {
-          node_to_gc.get()[i].~Node();
-        }
-        std::allocator<Node> alloc;
-        alloc.deallocate(node_to_gc.release(), solid_size);
+        Node::DeallocateSolidChildren(node_to_gc.release(), solid_size);
       }
     }
   }
@@ -114,8 +116,49 @@ class NodeGarbageCollector {
 };
 
 NodeGarbageCollector gNodeGc;
+
+// Approximate per allocation overhead of the heap (a size header, and
+// rounding to 16 bytes).
+constexpr size_t kAllocationOverhead = 2 * sizeof(void*);
 }  // namespace
 
+/////////////////////////////////////////////////////////////////////////
+// Memory accounting
+/////////////////////////////////////////////////////////////////////////
+
+Node::CounterShard Node::counter_shards_[Node::kCounterShards];
+std::atomic<size_t> Node::next_counter_shard_{0};
+
+size_t NodeMemoryStats::GetBytes() const {
+  // Nodes outside solid arrays are allocated one by one.
+  const int64_t allocations =
+      (nodes - solid_nodes) + solid_arrays + edge_lists;
+  return nodes * sizeof(Node) + edges * sizeof(Edge) +
+         std::max<int64_t>(allocations, 0) * kAllocationOverhead;
+}
+
+NodeMemoryStats Node::GetMemoryStats() {
+  NodeMemoryStats stats;
+  for (const auto& shard : counter_shards_) {
+    stats.nodes += shard.nodes.load(std::memory_order_relaxed);
+    stats.edges += shard.edges.load(std::memory_order_relaxed);
+    stats.edge_lists += shard.edge_lists.load(std::memory_order_relaxed);
+    stats.solid_arrays += shard.solid_arrays.load(std::memory_order_relaxed);
+    stats.solid_nodes += shard.solid_nodes.load(std::memory_order_relaxed);
+  }
+  stats.gc_backlog = gNodeGc.GetBacklog();
+  return stats;
+}
+
+void Node::DeallocateSolidChildren(Node* children, size_t count) {
+  for (size_t i = 0; i < count; i++) children[i].~Node();
+  std::allocator<Node> alloc;
+  alloc.deallocate(children, count);
+  auto& counters = LocalCounters();
+  counters.solid_arrays.fetch_sub(1, std::memory_order_relaxed);
+  counters.solid_nodes.fetch_sub(count, std::memory_order_relaxed);
+}
+
 /////////////////////////////////////////////////////////////////////////
 // Edge
 /////////////////////////////////////////////////////////////////////////
@@ -196,6 +239,7 @@ Node* Node::CreateSingleChildNode(Move move) {
   assert(!child_);
   edges_ = Edge::FromMovelist({move});
   num_edges_ = 1;
+  AddEdgeCount();
   child_ = std::make_unique<Node>(this, 0);
   return child_.get();
 }
@@ -205,6 +249,7 @@ void Node::CreateEdges(const MoveList& moves) {
   assert(!child_);
   edges_ = Edge::FromMovelist(moves);
   num_edges_ = moves.size();
+  AddEdgeCount();
 }
 
 Node::ConstIterator Node::Edges() const {
@@ -283,6 +328,9 @@ bool Node::MakeSolid() {
   // This is a hack.
   child_ = std::unique_ptr<Node>(new_children);
   solid_children_ = true;
+  auto& counters = LocalCounters();
+  counters.solid_arrays.fetch_add(1, std::memory_order_relaxed);
+  counters.solid_nodes.fetch_add(num_edges_, std::memory_order_relaxed);
   return true;
 }
 
@@ -443,6 +491,7 @@ void Node::ReleaseChildrenExceptOne(Node* node_to_save) {
     child_ = std::move(saved_node);
   }
   if (!child_) {
+    if (edges_) ReleaseEdgeCount();
     num_edges_ = 0;
     edges_.reset();  // Clear edges list.
   }
@@ -490,6 +539,8 @@ void NodeTree::TrimTreeAtHead() {
   auto tmp = std::move(current_head_->sibling_);
   // Send dependent nodes for GC instead of destroying them immediately.
   current_head_->ReleaseChildren();
+  // The assignment frees the edges without the destructor.
+  if (current_head_->edges_) current_head_->ReleaseEdgeCount();
   *current_head_ = Node(current_head_->GetParent(), current_head_->index_);
   current_head_->sibling_ = std::move(tmp);
 }
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <memory>
@@ -80,6 +81,24 @@ namespace lczero {
 //                                       | sibling_   | -> nullptr
 //                                       +------------+
 
+// Number of tree objects currently allocated, summed over all trees. Nodes
+// queued for the garbage collector are still counted until it frees them.
+struct NodeMemoryStats {
+  // All nodes, including the ones in solid arrays.
+  int64_t nodes = 0;
+  // Edges, and the lists they are allocated in (one per expanded node).
+  int64_t edges = 0;
+  int64_t edge_lists = 0;
+  // Solid child arrays, and the nodes in them.
+  int64_t solid_arrays = 0;
+  int64_t solid_nodes = 0;
+  // Subtrees waiting for the garbage collector.
+  int64_t gc_backlog = 0;
+
+  // Approximate heap bytes used by the above, including allocator overhead.
+  size_t GetBytes() const;
+};
+
 class Node;
 class Edge {
  public:
@@ -137,11 +156,16 @@ class Node {
         terminal_type_(Terminal::NonTerminal),
         lower_bound_(GameResult::BLACK_WON),
         upper_bound_(GameResult::WHITE_WON),
-        solid_children_(false) {}
+        solid_children_(false) {
+    LocalCounters().nodes.fetch_add(1, std::memory_order_relaxed);
+  }
 
   // We have a custom destructor, but its behavior does not need to be emulated
-  // during move operations so default is fine.
-  Node(Node&& move_from) = default;
+  // during move assignment so default is fine, except that edges_ of the
+  // assigned to node are freed without ReleaseEdgeCount(), which callers have
+  // to do first. Move construction would unbalance the node count, and is not
+  // needed.
+  Node(Node&& move_from) = delete;
   Node& operator=(Node&& move_from) = default;
 
   // Allocates a new edge and a new node. The node has to be no edges before
@@ -262,18 +286,34 @@ class Node {
     if (solid_children_ && child_) {
       // As a hack, solid_children is actually storing an array in here, release
       // so we can correctly invoke the array delete.
-      for (int i = 0; i < num_edges_; i++) {
-        child_.get()[i].~Node();
-      }
-      std::allocator<Node> alloc;
-      alloc.deallocate(child_.release(), num_edges_);
+      DeallocateSolidChildren(child_.release(), num_edges_);
     }
+    if (edges_) ReleaseEdgeCount();
+    LocalCounters().nodes.fetch_sub(1, std::memory_order_relaxed);
   }
 
+  // Destroys and frees a solid array of @count nodes.
+  static void DeallocateSolidChildren(Node* children, size_t count);
+
+  // Returns the number of nodes, edges and solid arrays allocated right now.
+  static NodeMemoryStats GetMemoryStats();
+
  private:
   // For each child, ensures that its parent pointer is pointing to this.
   void UpdateChildrenParents();
 
+  // Updates the edge counters when edges_ is allocated or freed.
+  void AddEdgeCount() {
+    auto& counters = LocalCounters();
+    counters.edges.fetch_add(num_edges_, std::memory_order_relaxed);
+    counters.edge_lists.fetch_add(1, std::memory_order_relaxed);
+  }
+  void ReleaseEdgeCount() {
+    auto& counters = LocalCounters();
+    counters.edges.fetch_sub(num_edges_, std::memory_order_relaxed);
+    counters.edge_lists.fetch_sub(1, std::memory_order_relaxed);
+  }
+
   // To minimize the number of padding bytes and to avoid having unnecessary
   // padding when new fields are added, we arrange the fields by size, largest
   // to smallest.
@@ -328,6 +368,31 @@ class Node {
   // Whether the child_ is actually an array of equal length to edges.
   bool solid_children_ : 1;
 
+  // Counters for GetMemoryStats(), sharded so that search threads don't
+  // contend on one cache line. A node may be freed on another thread than the
+  // one that allocated it, so only the sum over the shards is meaningful.
+  // Updated with relaxed ordering, so they are only exact when no search is
+  // running.
+  struct alignas(64) CounterShard {
+    std::atomic<int64_t> nodes{0};
+    std::atomic<int64_t> edges{0};
+    std::atomic<int64_t> edge_lists{0};
+    std::atomic<int64_t> solid_arrays{0};
+    std::atomic<int64_t> solid_nodes{0};
+  };
+  static constexpr size_t kCounterShards = 16;
+  static CounterShard counter_shards_[kCounterShards];
+  static std::atomic<size_t> next_counter_shard_;
+
+  // The shard of the calling thread, assigned round robin on first use.
+  static CounterShard& LocalCounters() {
+    thread_local CounterShard& shard =
+        counter_shards_[next_counter_shard_.fetch_add(
+                            1, std::memory_order_relaxed) %
+                        kCounterShards];
+    return shard;
+  }
+
   // TODO(mooskagh) Unfriend NodeTree.
   friend class NodeTree;
   friend class Edge_Iterator<true>;
@@ -0,0 +1,72 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <vector>
+
+#include "benchmark/microbench.h"
+#include "chess/board.h"
+#include "mcts/node.h"
+
+namespace lczero {
+namespace {
+
+const char kKiwipeteFen[] =
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+// Expanding a node with the 48 moves of the position, as ExtendNode() does.
+void CreateEdges(size_t iterations) {
+  const auto moves = ChessBoard(kKiwipeteFen).GenerateLegalMoves();
+  for (size_t n = 0; n < iterations; n++) {
+    Node node(nullptr, 0);
+    node.CreateEdges(moves);
+    DoNotOptimize(node.GetNumEdges());
+  }
+}
+
+// Storing a policy prior in the 16 bit edge format and reading it back.
+void SetGetP(size_t iterations) {
+  const auto moves = ChessBoard(kKiwipeteFen).GenerateLegalMoves();
+  auto edges = Edge::FromMovelist(moves);
+  std::vector<float> priors(moves.size());
+  for (size_t i = 0; i < priors.size(); i++) {
+    priors[i] = (i + 1.0f) / (priors.size() + 1.0f);
+  }
+  float sum = 0.0f;
+  for (size_t n = 0; n < iterations; n++) {
+    const size_t i = n % moves.size();
+    edges[i].SetP(priors[i]);
+    sum += edges[i].GetP();
+  }
+  DoNotOptimize(sum);
+}
+
+}  // namespace
+
+REGISTER_MICROBENCH("Node/CreateEdges", CreateEdges)
+REGISTER_MICROBENCH("Edge/SetP_GetP", SetGetP)
+
+}  // namespace lczero
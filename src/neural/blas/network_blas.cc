@@ -19,8 +19,18 @@
 #include <Eigen/Core>
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include "neural/blas/blas.h"
 #include "neural/blas/convolution1.h"
@@ -28,40 +38,132 @@
 #include "neural/blas/fully_connected_layer.h"
 #include "neural/blas/se_unit.h"
 #include "neural/blas/winograd_convolution3.h"
+#include "neural/calibration.h"
 #include "neural/factory.h"
 #include "neural/network.h"
 #include "neural/network_legacy.h"
 #include "neural/shared/activation.h"
+#include "neural/shared/attention.h"
 #include "neural/shared/attention_policy_map.h"
+#include "neural/shared/buffer_pool.h"
+#include "neural/shared/expand_planes.h"
+#include "neural/shared/half_fully_connected.h"
+#include "neural/shared/int8_fully_connected.h"
+#include "neural/shared/packed_gemm.h"
 #include "neural/shared/policy_map.h"
+#include "neural/shared/shared_weights.h"
 #include "neural/shared/winograd_filter.h"
+#include "utils/cpu_features.h"
+#include "utils/hashcat.h"
 #include "utils/numa.h"
+#include "utils/thread_pool.h"
+#include "utils/weights_adapter.h"
 
 #ifdef USE_DNNL
 #include <omp.h>
 #endif
 
-#ifdef USE_ISPC
-#include "activation_ispc.h"
-#endif
-
 namespace lczero {
 namespace {
 
-struct Buffers {
-  std::vector<float> buffer1;
-  std::vector<float> buffer2;
-  std::vector<float> buffer3;
-  std::vector<float> buffer4;
+using Buffer = BufferPool::Vector<float>;
+// Scratch buffers of a computation: three for the tower and one for heads.
+constexpr size_t kBuffersPerSet = 4;
+
+struct {
+  Convolution3Algorithm algorithm;
+  const char* name;
+} constexpr kConvolution3Algorithms[] = {
+    {Convolution3Algorithm::kWinogradF2, "winograd2"},
+    {Convolution3Algorithm::kWinogradF4, "winograd4"},
+    {Convolution3Algorithm::kIm2col, "im2col"},
 };
 
+const char* Convolution3AlgorithmName(Convolution3Algorithm algorithm) {
+  for (const auto& entry : kConvolution3Algorithms) {
+    if (entry.algorithm == algorithm) return entry.name;
+  }
+  return "unknown";
+}
+
+Convolution3Algorithm ParseConvolution3Algorithm(const std::string& name) {
+  for (const auto& entry : kConvolution3Algorithms) {
+    if (name == entry.name) return entry.algorithm;
+  }
+  throw Exception("Unknown conv_algorithm " + name +
+                  ", expected auto, winograd2, winograd4 or im2col.");
+}
+
+// Reads the algorithm stored in @filename, nullopt if the file is missing or
+// not completely written yet.
+std::optional<Convolution3Algorithm> ReadConvolution3Algorithm(
+    const std::string& filename) {
+  std::ifstream input(filename);
+  std::string name;
+  if (!std::getline(input, name) || input.eof()) return std::nullopt;
+  return ParseConvolution3Algorithm(name);
+}
+
+// With shared weights, every process on the host has to prepare the weights
+// for the same algorithm to map the same file, but timing based tuning may
+// pick different ones. So the first process to tune stores its choice in
+// @filename, and all others use it instead of their own @tune result.
+Convolution3Algorithm LoadOrStoreConvolution3Algorithm(
+    const std::string& filename,
+    const std::function<Convolution3Algorithm()>& tune) {
+  auto use_stored = [&](Convolution3Algorithm algorithm) {
+    CERR << "Using the 3x3 convolution algorithm "
+         << Convolution3AlgorithmName(algorithm) << " stored in " << filename
+         << ".";
+    return algorithm;
+  };
+  if (const auto stored = ReadConvolution3Algorithm(filename)) {
+    return use_stored(*stored);
+  }
+  const auto tuned = tune();
+  // Exclusive create, so that only the first process stores its choice.
+  if (FILE* output = std::fopen(filename.c_str(), "wx")) {
+    std::fprintf(output, "%s\n", Convolution3AlgorithmName(tuned));
+    std::fclose(output);
+    return tuned;
+  }
+  // Another process got there first, wait until it has written its choice.
+  for (int i = 0; i < 100; i++) {
+    if (const auto stored = ReadConvolution3Algorithm(filename)) {
+      return use_stored(*stored);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  throw Exception("Cannot read the convolution algorithm from " + filename);
+}
+
+// Packs the @size prepared weights of a 3x3 convolution with @outputs
+// outputs, one matrix per GEMM of @algorithm.
+std::vector<PackedGemmWeights> PackConvolution3(Convolution3Algorithm algorithm,
+                                                const float* weights,
+                                                size_t size, size_t outputs) {
+  using Layout = PackedGemmWeights::Layout;
+  std::vector<PackedGemmWeights> packed;
+  if (algorithm == Convolution3Algorithm::kIm2col) {
+    packed.emplace_back(size / outputs, outputs, weights, Layout::kOutputMajor);
+    return packed;
+  }
+  const size_t tiles = WinogradConvolution3<true>::GemmCount(algorithm);
+  const size_t inputs = size / tiles / outputs;
+  for (size_t t = 0; t < tiles; t++) {
+    packed.emplace_back(inputs, outputs, weights + t * inputs * outputs,
+                        Layout::kInputMajor);
+  }
+  return packed;
+}
+
 template <bool use_eigen>
 class BlasNetwork;
 
 template <bool use_eigen>
 class BlasComputation : public NetworkComputation {
  public:
-  BlasComputation(BlasNetwork<use_eigen>* network, const LegacyWeights& weights,
+  BlasComputation(BlasNetwork<use_eigen>* network, const WeightsView& weights,
                   const size_t max_batch_size, const bool wdl,
                   const bool moves_left, const bool conv_policy,
                   const ActivationFunction default_activation,
@@ -72,7 +174,18 @@ class BlasComputation : public NetworkComputation {
   virtual ~BlasComputation() {}
 
   // Adds a sample to the batch.
-  void AddInput(InputPlanes&& input) override { planes_.emplace_back(input); }
+  void AddInput(InputPlanes&& input) override {
+    planes_.emplace_back(input);
+    policy_moves_.emplace_back();
+  }
+
+  // Only the policy outputs of @moves are computed, if all the samples of a
+  // batch have them.
+  void AddInputWithMoves(InputPlanes&& input,
+                         const std::vector<uint16_t>& moves) override {
+    planes_.emplace_back(input);
+    policy_moves_.emplace_back(moves);
+  }
 
   // Do the computation.
   void ComputeBlocking() override;
@@ -114,12 +227,35 @@ class BlasComputation : public NetworkComputation {
   }
 
  private:
-  void EncodePlanes(const InputPlanes& sample, float* buffer);
-  void MakeEncoderLayer(std::vector<float>& head_buffer,
-                        std::vector<float>& head_buffer2,
-                        std::vector<float>& head_buffer3,
-                        std::vector<float>& head_buffer4, size_t batch_size,
-                        const LegacyWeights::EncoderLayer& layer,
+  // Computes the @count samples starting at @first.
+  void ComputeSlice(size_t first, size_t count);
+
+  // FullyConnectedLayer::Forward1D(), or its int8 or fp16/bf16 version when
+  // the network keeps @weights in a reduced precision. Bias and activation
+  // are applied every kEpilogueRows rows, while the output is in cache.
+  void Dense(size_t batch_size, size_t input_size, size_t output_size,
+             const float* input, const float* weights, const float* biases,
+             ActivationFunction activation, float* output);
+
+  // Dense() followed by LayerNorm2DWithSkipConnection(), kEpilogueRows rows
+  // at a time. With @residual, residual = LayerNorm(residual + alpha * dense)
+  // and @output only holds one block of rows; without, output =
+  // LayerNorm(dense).
+  void DenseLayerNorm(size_t batch_size, size_t input_size, size_t output_size,
+                      const float* input, const float* weights,
+                      const float* biases, ActivationFunction activation,
+                      float* output, float* residual, float alpha,
+                      const float* gammas, const float* betas, float epsilon);
+
+  // Dense() on a single block of rows.
+  void DenseRows(size_t batch_size, size_t input_size, size_t output_size,
+                 const float* input, const float* weights, const float* biases,
+                 ActivationFunction activation, float* output);
+
+  void MakeEncoderLayer(Buffer& head_buffer, Buffer& head_buffer2,
+                        Buffer& head_buffer3, Buffer& head_buffer4,
+                        size_t largest_batch_size, size_t batch_size,
+                        const WeightsView::EncoderLayer& layer,
                         int embedding_size, int heads,
                         ActivationFunction smolgen_activation,
                         ActivationFunction ffn_activation, float alpha);
@@ -131,10 +267,16 @@ class BlasComputation : public NetworkComputation {
   // Number of used planes with convolutional policy.
   // The real number of planes is higher because of padding.
   static constexpr auto kPolicyUsedPlanes = 73;
+  // Rows of a dense layer computed before their epilogue runs. Enough to
+  // amortize the packing of the weights in the GEMM, while the output (1 MiB
+  // for 1024 channels) still fits in L2.
+  static constexpr size_t kEpilogueRows = 4 * kSquares;
 
-  const LegacyWeights& weights_;
+  const WeightsView& weights_;
   size_t max_batch_size_;
   std::vector<InputPlanes> planes_;
+  // Policy outputs to compute for every sample, empty for all.
+  std::vector<std::vector<uint16_t>> policy_moves_;
   std::vector<std::vector<float>> policies_;
   std::vector<float> q_values_;
   std::vector<float> m_values_;
@@ -154,7 +296,7 @@ template <bool use_eigen>
 class BlasNetwork : public Network {
  public:
   BlasNetwork(const WeightsFile& weights, const OptionsDict& options);
-  virtual ~BlasNetwork(){};
+  ~BlasNetwork() override;
 
   std::unique_ptr<NetworkComputation> NewComputation() override {
     return std::make_unique<BlasComputation<use_eigen>>(
@@ -171,46 +313,126 @@ class BlasNetwork : public Network {
 
   bool IsCpu() const override { return true; }
 
+  size_t GetBufferBytes() const override {
+    return buffer_pool_->GetStats().allocated_bytes;
+  }
+
   void InitThread(int id) override { Numa::BindThread(id); }
 
-  std::unique_ptr<Buffers> GetBuffers() {
-    std::lock_guard<std::mutex> lock(buffers_lock_);
-    if (free_buffers_.empty()) {
-      return std::make_unique<Buffers>();
-    } else {
-      auto buffers = std::move(free_buffers_.back());
-      free_buffers_.pop_back();
-      return buffers;
+  Convolution3Algorithm conv_algorithm() const { return conv_algorithm_; }
+
+  // Pool splitting batches across cores, nullptr when single threaded.
+  ThreadPool* GetThreadPool() { return thread_pool_.get(); }
+
+  // Int8 version of the layer with @weights, nullptr if it runs in fp32.
+  const Int8FullyConnectedLayer* GetInt8Layer(const float* weights) const {
+    if (int8_layers_.empty()) return nullptr;
+    auto it = int8_layers_.find(weights);
+    return it == int8_layers_.end() ? nullptr : it->second.get();
+  }
+
+  // Fp16/bf16 version of the layer with @weights, nullptr if it runs in fp32.
+  const HalfFullyConnectedLayer* GetHalfLayer(const float* weights) const {
+    if (half_layers_.empty()) return nullptr;
+    auto it = half_layers_.find(weights);
+    return it == half_layers_.end() ? nullptr : it->second.get();
+  }
+
+  // Pre-packed GEMM operands of the layer or 3x3 convolution with @weights,
+  // one per Winograd tile for the latter. nullptr if not packed.
+  const PackedGemmWeights* GetPackedWeights(const float* weights) const {
+    if (packed_weights_.empty()) return nullptr;
+    auto it = packed_weights_.find(weights);
+    return it == packed_weights_.end() ? nullptr : it->second.data();
+  }
+
+  // Records the input range of the layer with @weights during calibration.
+  void ObserveInput(const float* weights, const float* input, size_t size) {
+    if (!calibrating_) return;
+    float range = 0.0f;
+    for (size_t i = 0; i < size; i++) {
+      range = std::max(range, std::abs(input[i]));
     }
+    std::lock_guard<std::mutex> lock(calibration_lock_);
+    float& max = input_ranges_[weights];
+    max = std::max(max, range);
   }
 
-  void ReleaseBuffers(std::unique_ptr<Buffers> buffers) {
-    std::lock_guard<std::mutex> lock(buffers_lock_);
-    free_buffers_.push_back(std::move(buffers));
+  // Scratch buffers for batches of up to @batch_size.
+  std::unique_ptr<BufferPool::Buffers> GetBuffers(size_t batch_size) {
+    return buffer_pool_->Acquire(batch_size);
+  }
+
+  void ReleaseBuffers(std::unique_ptr<BufferPool::Buffers> buffers) {
+    buffer_pool_->Release(std::move(buffers));
   }
 
  private:
   // A cap on the max batch size since it consumes a lot of memory
   static constexpr auto kHardMaxBatchSize = 2048;
 
+  // Applies the Winograd transform to the 3x3 convolution filters.
+  static void PrepareWeights(LegacyWeights* weights, bool conv_policy,
+                             Convolution3Algorithm algorithm);
+
+  // Times the 3x3 convolution algorithms on a @channels x @channels layer
+  // and returns the fastest.
+  Convolution3Algorithm TuneConvolution3(size_t channels, bool prepack) const;
+
+  // Quantizes the dense layers of the encoders to int8, with input ranges
+  // measured on the positions of @fen_file (or built in ones), and reports
+  // the deviation from the @reference_type weights on the same positions.
+  void QuantizeInt8(const std::string& fen_file,
+                    const std::string& reference_type);
+
+  // Calls @f(weights, output_size) for every layer run through Dense().
+  template <typename F>
+  void ForEachDenseLayer(F&& f) const;
+
+  // Converts the weights of the dense layers to @type, which halves the
+  // memory traffic of the layers that are bound by it.
+  void ConvertDenseWeights(HalfFullyConnectedLayer::Type type);
+
+  // Packs the fp32 weights of the dense layers and of the 3x3 convolutions
+  // for the Eigen version, which would otherwise repack them on every call.
+  void PackWeights();
+
   const NetworkCapabilities capabilities_;
-  LegacyWeights weights_;
+  // Prepared weights are either owned, or mapped from a file shared with
+  // other processes. weights_ points into one of them.
+  std::unique_ptr<LegacyWeights> owned_weights_;
+  std::unique_ptr<SharedWeights> shared_weights_;
+  WeightsView weights_;
   size_t max_batch_size_;
   bool wdl_;
   bool moves_left_;
   bool conv_policy_;
+  Convolution3Algorithm conv_algorithm_ = Convolution3Algorithm::kWinogradF2;
   ActivationFunction default_activation_;
   ActivationFunction smolgen_activation_;
   ActivationFunction ffn_activation_;
   bool attn_policy_;
   bool attn_body_;
-  std::mutex buffers_lock_;
-  std::vector<std::unique_ptr<Buffers>> free_buffers_;
+  std::unique_ptr<BufferPool> buffer_pool_;
+  bool buffer_stats_;
+  std::unique_ptr<ThreadPool> thread_pool_;
+  // Int8 layers, keyed by the fp32 weights they replace.
+  std::unordered_map<const float*, std::unique_ptr<Int8FullyConnectedLayer>>
+      int8_layers_;
+  // Fp16/bf16 layers, keyed the same way.
+  std::unordered_map<const float*, std::unique_ptr<HalfFullyConnectedLayer>>
+      half_layers_;
+  // Pre-packed weights, keyed the same way.
+  std::unordered_map<const float*, std::vector<PackedGemmWeights>>
+      packed_weights_;
+  bool calibrating_ = false;
+  std::mutex calibration_lock_;
+  std::unordered_map<const float*, float> input_ranges_;
 };
 
 template <bool use_eigen>
 BlasComputation<use_eigen>::BlasComputation(
-    BlasNetwork<use_eigen>* network, const LegacyWeights& weights,
+    BlasNetwork<use_eigen>* network, const WeightsView& weights,
     const size_t max_batch_size, const bool wdl, const bool moves_left,
     const bool conv_policy, const ActivationFunction default_activation,
     const ActivationFunction smolgen_activation,
@@ -228,11 +450,7 @@ BlasComputation<use_eigen>::BlasComputation(
       ffn_activation_(ffn_activation),
       attn_policy_(attn_policy),
       attn_body_(attn_body),
-      network_(network) {
-#ifdef USE_DNNL
-  omp_set_num_threads(1);
-#endif
-}
+      network_(network) {}
 
 template <typename T>
 using EigenMatrixMap =
@@ -249,20 +467,116 @@ using ConstEigenStridedMatrixMap =
     Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>, 0,
                Eigen::OuterStride<>>;
 
-void vec_adjust(std::vector<float>& vec, size_t size) {
+// Index into the attention policy logits of every policy output, the inverse
+// of kAttnPolicyMap.
+const std::vector<short>& AttentionPolicyIndices() {
+  static const std::vector<short> indices = [] {
+    std::vector<short> result(1858, -1);
+    for (int i = 0; i < 64 * 64 + 8 * 24; i++) {
+      if (kAttnPolicyMap[i] >= 0) result[kAttnPolicyMap[i]] = i;
+    }
+    return result;
+  }();
+  return indices;
+}
+
+void vec_adjust(Buffer& vec, size_t size) {
   if (vec.size() < size) {
     vec.clear();
     vec.resize(size);
   }
 }
 
+template <bool use_eigen>
+void BlasComputation<use_eigen>::Dense(size_t batch_size, size_t input_size,
+                                       size_t output_size, const float* input,
+                                       const float* weights,
+                                       const float* biases,
+                                       ActivationFunction activation,
+                                       float* output) {
+  for (size_t i = 0; i < batch_size; i += kEpilogueRows) {
+    DenseRows(std::min(kEpilogueRows, batch_size - i), input_size, output_size,
+              input + i * input_size, weights, biases, activation,
+              output + i * output_size);
+  }
+}
+
+template <bool use_eigen>
+void BlasComputation<use_eigen>::DenseLayerNorm(
+    size_t batch_size, size_t input_size, size_t output_size,
+    const float* input, const float* weights, const float* biases,
+    ActivationFunction activation, float* output, float* residual,
+    float alpha, const float* gammas, const float* betas, float epsilon) {
+  for (size_t i = 0; i < batch_size; i += kEpilogueRows) {
+    const size_t rows = std::min(kEpilogueRows, batch_size - i);
+    float* block = residual ? output : output + i * output_size;
+    DenseRows(rows, input_size, output_size, input + i * input_size, weights,
+              biases, activation, block);
+    if (residual) {
+      LayerNorm2DWithSkipConnection(rows, output_size,
+                                    residual + i * output_size, alpha, block,
+                                    gammas, betas, epsilon);
+    } else {
+      LayerNorm2DWithSkipConnection(rows, output_size, block, 0.0f,
+                                    (const float*)nullptr, gammas, betas,
+                                    epsilon);
+    }
+  }
+}
+
+template <bool use_eigen>
+void BlasComputation<use_eigen>::DenseRows(size_t batch_size,
+                                           size_t input_size,
+                                           size_t output_size,
+                                           const float* input,
+                                           const float* weights,
+                                           const float* biases,
+                                           ActivationFunction activation,
+                                           float* output) {
+  if (const auto* layer = network_->GetInt8Layer(weights)) {
+    layer->Forward(batch_size, input, output);
+    if (biases != nullptr) {
+      for (size_t i = 0; i < batch_size; i++) {
+        float* row = output + i * output_size;
+        Activate(output_size, row, biases, row, activation);
+      }
+    }
+    return;
+  }
+  // Before the fp16/bf16 path, so int8 can be calibrated on top of it.
+  network_->ObserveInput(weights, input, batch_size * input_size);
+  if (const auto* layer = network_->GetHalfLayer(weights)) {
+    layer->Forward(batch_size, input, output);
+    if (biases != nullptr) {
+      for (size_t i = 0; i < batch_size; i++) {
+        float* row = output + i * output_size;
+        Activate(output_size, row, biases, row, activation);
+      }
+    }
+    return;
+  }
+  if (const auto* packed = network_->GetPackedWeights(weights)) {
+    packed->Multiply(batch_size, input, output);
+    if (biases != nullptr) {
+      for (size_t i = 0; i < batch_size; i++) {
+        float* row = output + i * output_size;
+        Activate(output_size, row, biases, row, activation);
+      }
+    }
+    return;
+  }
+  FullyConnectedLayer<use_eigen>::Forward1D(batch_size, input_size,
+                                            output_size, input, weights,
+                                            biases, activation, output);
+}
+
 template <bool use_eigen>
 void BlasComputation<use_eigen>::MakeEncoderLayer(
-    std::vector<float>& head_buffer, std::vector<float>& head_buffer2,
-    std::vector<float>& head_buffer3, std::vector<float>& head_buffer4,
-    size_t batch_size, const LegacyWeights::EncoderLayer& layer,
-    int embedding_size, int heads, ActivationFunction smolgen_activation,
-    ActivationFunction ffn_activation, float alpha) {
+    Buffer& head_buffer, Buffer& head_buffer2, Buffer& head_buffer3,
+    Buffer& head_buffer4, size_t largest_batch_size, size_t batch_size,
+    const WeightsView::EncoderLayer& layer, int embedding_size, int heads,
+    ActivationFunction smolgen_activation, ActivationFunction ffn_activation,
+    float alpha) {
   const int d_model = layer.mha.q_b.size();
   const int dff_size = layer.ffn.dense1_b.size();
   const int hidden_channels =
@@ -273,8 +587,6 @@ void BlasComputation<use_eigen>::MakeEncoderLayer(
   const int gen_sz_outputs =
       layer.mha.has_smolgen ? layer.mha.smolgen.dense2_b.size() : 0;
 
-  const int largest_batch_size = std::min(max_batch_size_, planes_.size());
-
   vec_adjust(head_buffer, largest_batch_size * d_model * kSquares);
   vec_adjust(head_buffer2,
              largest_batch_size *
@@ -283,7 +595,10 @@ void BlasComputation<use_eigen>::MakeEncoderLayer(
   vec_adjust(head_buffer3,
              largest_batch_size * std::max(d_model * kSquares, hidden_sz));
   vec_adjust(head_buffer4,
-             batch_size * kSquares * std::max(kSquares * heads, dff_size));
+             batch_size * kSquares *
+                 std::max((layer.mha.has_smolgen ? kSquares * heads : 0) +
+                              d_model,
+                          dff_size));
 
   // Smolgen.
   if (layer.mha.has_smolgen) {
@@ -291,172 +606,105 @@ void BlasComputation<use_eigen>::MakeEncoderLayer(
     float* QK = &head_buffer4[0];
 
     // Compress.
-    FullyConnectedLayer<use_eigen>::Forward1D(
-        batch_size * kSquares, embedding_size, hidden_channels, input,
-        layer.mha.smolgen.compress.data(), (const float*)nullptr,
-        ACTIVATION_NONE, head_buffer2.data());
-
-    // Dense 1.
-    FullyConnectedLayer<use_eigen>::Forward1D(
-        batch_size, kSquares * hidden_channels, hidden_sz, head_buffer2.data(),
-        layer.mha.smolgen.dense1_w.data(), layer.mha.smolgen.dense1_b.data(),
-        smolgen_activation, head_buffer3.data());
-    // Layer Norm + skip connection.
-    LayerNorm2DWithSkipConnection(batch_size, hidden_sz, head_buffer3.data(),
-                                  0.0f, (const float*)nullptr,
-                                  layer.mha.smolgen.ln1_gammas.data(),
-                                  layer.mha.smolgen.ln1_betas.data(), 1e-3);
-
-    // Dense 2.
-    FullyConnectedLayer<use_eigen>::Forward1D(
-        batch_size, hidden_sz, gen_sz_outputs, head_buffer3.data(),
-        layer.mha.smolgen.dense2_w.data(), layer.mha.smolgen.dense2_b.data(),
-        smolgen_activation, head_buffer2.data());
-    // Layer Norm + skip connection.
-    LayerNorm2DWithSkipConnection(
-        batch_size, gen_sz_outputs, head_buffer2.data(), 0.0f,
-        (const float*)nullptr, layer.mha.smolgen.ln2_gammas.data(),
-        layer.mha.smolgen.ln2_betas.data(), 1e-3);
+    Dense(batch_size * kSquares, embedding_size, hidden_channels, input,
+          layer.mha.smolgen.compress.data(), (const float*)nullptr,
+          ACTIVATION_NONE, head_buffer2.data());
+
+    // Dense 1 + Layer Norm.
+    DenseLayerNorm(batch_size, kSquares * hidden_channels, hidden_sz,
+                   head_buffer2.data(), layer.mha.smolgen.dense1_w.data(),
+                   layer.mha.smolgen.dense1_b.data(), smolgen_activation,
+                   head_buffer3.data(), nullptr, 0.0f,
+                   layer.mha.smolgen.ln1_gammas.data(),
+                   layer.mha.smolgen.ln1_betas.data(), 1e-3);
+
+    // Dense 2 + Layer Norm.
+    DenseLayerNorm(batch_size, hidden_sz, gen_sz_outputs, head_buffer3.data(),
+                   layer.mha.smolgen.dense2_w.data(),
+                   layer.mha.smolgen.dense2_b.data(), smolgen_activation,
+                   head_buffer2.data(), nullptr, 0.0f,
+                   layer.mha.smolgen.ln2_gammas.data(),
+                   layer.mha.smolgen.ln2_betas.data(), 1e-3);
 
     // Global smolgen weights.
-    FullyConnectedLayer<use_eigen>::Forward1D(
-        batch_size * heads, gen_sz_outputs / heads, kSquares * kSquares,
-        head_buffer2.data(), weights_.smolgen_w.data(), (const float*)nullptr,
-        ACTIVATION_NONE, QK);
+    Dense(batch_size * heads, gen_sz_outputs / heads, kSquares * kSquares,
+          head_buffer2.data(), weights_.smolgen_w.data(), (const float*)nullptr,
+          ACTIVATION_NONE, QK);
   }
 
   // Q
-  FullyConnectedLayer<use_eigen>::Forward1D(
-      batch_size * kSquares, embedding_size, d_model, head_buffer.data(),
-      layer.mha.q_w.data(), layer.mha.q_b.data(), ACTIVATION_NONE,
-      head_buffer2.data());
+  Dense(batch_size * kSquares, embedding_size, d_model, head_buffer.data(),
+        layer.mha.q_w.data(), layer.mha.q_b.data(), ACTIVATION_NONE,
+        head_buffer2.data());
   // K
-  FullyConnectedLayer<use_eigen>::Forward1D(
-      batch_size * kSquares, embedding_size, d_model, head_buffer.data(),
-      layer.mha.k_w.data(), layer.mha.k_b.data(), ACTIVATION_NONE,
-      head_buffer3.data());
-
-  // MHA (Q, K, V)
+  Dense(batch_size * kSquares, embedding_size, d_model, head_buffer.data(),
+        layer.mha.k_w.data(), layer.mha.k_b.data(), ACTIVATION_NONE,
+        head_buffer3.data());
+
+  // V, stored after the smolgen attention bias.
+  float* V = &head_buffer4[layer.mha.has_smolgen
+                               ? batch_size * kSquares * kSquares * heads
+                               : 0];
+  Dense(batch_size * kSquares, embedding_size, d_model, head_buffer.data(),
+        layer.mha.v_w.data(), layer.mha.v_b.data(), ACTIVATION_NONE, V);
+
+  // MHA (Q, K, V): softmax(QK^T + smolgen) V, computed one row of scores at a
+  // time and written over Q.
   const int depth = d_model / heads;
   const float scaling = 1.0f / sqrtf(depth);
+  FusedAttention(batch_size, heads, depth, scaling, head_buffer2.data(),
+                 head_buffer3.data(), V,
+                 layer.mha.has_smolgen ? head_buffer4.data() : nullptr,
+                 head_buffer2.data());
+
+  // Fully connected final MHA layer + Layer Norm + skip connection.
+  DenseLayerNorm(batch_size * kSquares, d_model, embedding_size,
+                 head_buffer2.data(), layer.mha.dense_w.data(),
+                 layer.mha.dense_b.data(), ACTIVATION_NONE, head_buffer3.data(),
+                 head_buffer.data(), 1.0f / alpha, layer.ln1_gammas.data(),
+                 layer.ln1_betas.data(), 1e-6);
 
-  // MHA is done per batch since there's a fourth dimension introduced.
-  for (auto batch = size_t{0}; batch < batch_size; batch++) {
-    auto batchStart = batch * kSquares * d_model;
-
-    float* QK = &head_buffer4[batch * kSquares * kSquares * heads];
-
-    const float* Q = &head_buffer2[batchStart];
-    const float* K = &head_buffer3[batchStart];
-
-    // matmul(Q, K) for all heads per batch.
-
-    for (auto h = 0; h < heads; h++) {
-      const float* A = &Q[h * depth];
-      const float* B = &K[h * depth];
-      float* C = &QK[h * kSquares * kSquares];
-      const float beta = layer.mha.has_smolgen ? 1.0f : 0.0f;
-      if (use_eigen) {
-        auto C_mat = EigenMatrixMap<float>(C, kSquares, kSquares);
-        C_mat.noalias() =
-            beta * C_mat +
-            scaling *
-                ConstEigenStridedMatrixMap<float>(
-                    B, depth, kSquares, Eigen::OuterStride<>(heads * depth))
-                    .transpose() *
-                ConstEigenStridedMatrixMap<float>(
-                    A, depth, kSquares, Eigen::OuterStride<>(heads * depth));
-      } else {
-#ifdef USE_BLAS
-        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, kSquares, kSquares,
-                    depth, scaling, A, heads * depth, B, heads * depth, beta, C,
-                    kSquares);
-#else
-        // Should never get here.
-        throw Exception("Blas backend internal error");
-#endif
-      }
-    }
-  }
+  // FFN.
+  Dense(batch_size * kSquares, embedding_size, dff_size, head_buffer.data(),
+        layer.ffn.dense1_w.data(), layer.ffn.dense1_b.data(), ffn_activation,
+        head_buffer4.data());
+
+  // FFN output + Layer Norm + skip connection.
+  DenseLayerNorm(batch_size * kSquares, dff_size, layer.ffn.dense2_b.size(),
+                 head_buffer4.data(), layer.ffn.dense2_w.data(),
+                 layer.ffn.dense2_b.data(), ACTIVATION_NONE,
+                 head_buffer3.data(), head_buffer.data(), 1.0f / alpha,
+                 layer.ln2_gammas.data(), layer.ln2_betas.data(), 1e-6);
+}
 
-  // Apply Softmax.
-  float* QK = &head_buffer4[0];
-  for (size_t h = 0; h < batch_size * heads * kSquares * kSquares;
-       h += kSquares) {
-#if defined(USE_ISPC)
-    if (!use_eigen) {
-      ispc::SoftmaxActivation(kSquares, QK + h, QK + h);
-      continue;
-    }
-#endif
-    SoftmaxActivation(kSquares, QK + h, QK + h);
-  }
+template <bool use_eigen>
+void BlasComputation<use_eigen>::ComputeBlocking() {
+  const auto total_batches = planes_.size();
+  q_values_.resize(wdl_ ? 3 * total_batches : total_batches);
+  policies_.resize(total_batches);
+  if (moves_left_) m_values_.resize(total_batches);
 
-  // V
-  FullyConnectedLayer<use_eigen>::Forward1D(
-      batch_size * kSquares, embedding_size, d_model, head_buffer.data(),
-      layer.mha.v_w.data(), layer.mha.v_b.data(), ACTIVATION_NONE,
-      head_buffer3.data());
-
-  for (auto batch = size_t{0}; batch < batch_size; batch++) {
-    auto batchStart = batch * kSquares * d_model;
-    // matmul(softmax(QK), V) for all heads per batch.
-    float* attn = &head_buffer2[batchStart];
-    const float* V = &head_buffer3[batchStart];
-    const float* QK = &head_buffer4[batch * kSquares * kSquares * heads];
-    for (auto h = 0; h < heads; h++) {
-      const float* A = &QK[h * kSquares * kSquares];
-      const float* B = &V[h * depth];
-      float* C = &attn[h * depth];
-      if (use_eigen) {
-        auto C_mat = EigenStridedMatrixMap<float>(
-            C, depth, kSquares, Eigen::OuterStride<>(heads * depth));
-        C_mat.noalias() =
-            ConstEigenStridedMatrixMap<float>(
-                B, depth, kSquares, Eigen::OuterStride<>(heads * depth)) *
-            ConstEigenMatrixMap<float>(A, kSquares, kSquares);
-      } else {
-#ifdef USE_BLAS
-        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, kSquares, depth,
-                    kSquares, 1.0f, A, kSquares, B, heads * depth, 0.0f, C,
-                    heads * depth);
-#endif
-      }
-    }
+  // Split the batch into contiguous slices, one per thread.
+  ThreadPool* pool = network_->GetThreadPool();
+  const size_t slices =
+      pool ? std::min(total_batches, static_cast<size_t>(pool->size() + 1))
+           : 1;
+  if (slices <= 1) {
+    ComputeSlice(0, total_batches);
+    return;
   }
-
-  // Fully connected final MHA layer.
-  FullyConnectedLayer<use_eigen>::Forward1D(
-      batch_size * kSquares, d_model, embedding_size, head_buffer2.data(),
-      layer.mha.dense_w.data(), layer.mha.dense_b.data(), ACTIVATION_NONE,
-      head_buffer3.data());
-
-  // Layer Norm + skip connection.
-  LayerNorm2DWithSkipConnection(batch_size * kSquares, embedding_size,
-                                head_buffer.data(), 1.0f / alpha,
-                                head_buffer3.data(), layer.ln1_gammas.data(),
-                                layer.ln1_betas.data(), 1e-6);
-
-  // FFN.
-  FullyConnectedLayer<use_eigen>::Forward1D(
-      batch_size * kSquares, embedding_size, dff_size, head_buffer.data(),
-      layer.ffn.dense1_w.data(), layer.ffn.dense1_b.data(), ffn_activation,
-      head_buffer4.data());
-
-  FullyConnectedLayer<use_eigen>::Forward1D(
-      batch_size * kSquares, dff_size, layer.ffn.dense2_b.size(),
-      head_buffer4.data(), layer.ffn.dense2_w.data(), layer.ffn.dense2_b.data(),
-      ACTIVATION_NONE, head_buffer3.data());
-
-  // Layer Norm + skip connection.
-  LayerNorm2DWithSkipConnection(batch_size * kSquares, embedding_size,
-                                head_buffer.data(), 1.0f / alpha,
-                                head_buffer3.data(), layer.ln2_gammas.data(),
-                                layer.ln2_betas.data(), 1e-6);
+  pool->ParallelFor(static_cast<int>(slices), [&](int i) {
+    const size_t first = total_batches * i / slices;
+    const size_t last = total_batches * (i + 1) / slices;
+    ComputeSlice(first, last - first);
+  });
 }
 
 template <bool use_eigen>
-void BlasComputation<use_eigen>::ComputeBlocking() {
+void BlasComputation<use_eigen>::ComputeSlice(size_t first, size_t count) {
+#ifdef USE_DNNL
+  omp_set_num_threads(1);
+#endif
   // Retrieve network key dimensions from the weights structure.
   const auto num_value_channels = weights_.ip1_val_b.size();
   const auto num_moves_channels = weights_.ip1_mov_b.size();
@@ -485,8 +733,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
           : output_channels;
 
   // Determine the largest batch for allocations.
-  const auto total_batches = planes_.size();
-  const auto largest_batch_size = std::min(max_batch_size_, total_batches);
+  const auto largest_batch_size = std::min(max_batch_size_, count);
 
   /* Typically
    input_channels = 112
@@ -508,41 +755,48 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
                                weights_.ip_pol_b.size());
   }
 
-  std::unique_ptr<Buffers> buffers = network_->GetBuffers();
+  auto buffers = network_->GetBuffers(largest_batch_size);
 
   // Allocate data for the whole batch.
-  std::vector<float>& buffer1 = buffers->buffer1;
+  Buffer& buffer1 = (*buffers)[0];
   vec_adjust(buffer1, largest_batch_size * max_channels * kSquares);
-  std::vector<float>& buffer2 = buffers->buffer2;
+  Buffer& buffer2 = (*buffers)[1];
   vec_adjust(buffer2, largest_batch_size * max_channels * kSquares);
-  std::vector<float>& buffer3 = buffers->buffer3;
+  Buffer& buffer3 = (*buffers)[2];
   vec_adjust(buffer3, largest_batch_size *
                           std::max(max_channels * kSquares, max_fc_channels));
-  std::vector<float>& head_buffer = buffers->buffer4;
+  Buffer& head_buffer = (*buffers)[3];
   vec_adjust(head_buffer, largest_batch_size * max_head_planes * kSquares);
 
-  // Output values.
-  q_values_.reserve(wdl_ ? 3 * total_batches : total_batches);
-  policies_.reserve(total_batches);
-  if (moves_left_) m_values_.resize(total_batches);
-
   WinogradConvolution3<use_eigen> convolve3(largest_batch_size, max_channels,
-                                            max_output_channels);
-
-  for (size_t start = 0; start < total_batches; start += largest_batch_size) {
-    const auto batch_size = std::min(total_batches - start, largest_batch_size);
+                                            max_output_channels,
+                                            network_->conv_algorithm());
+  // Plane averages of the SE unit inputs.
+  std::vector<float> se_averages(largest_batch_size * output_channels);
+
+  for (size_t start = first; start < first + count;
+       start += largest_batch_size) {
+    const auto batch_size = std::min(first + count - start, largest_batch_size);
+    // The policy head only computes the outputs the search will read, when
+    // every sample of the batch says which ones.
+    const bool sparse_policy =
+        std::none_of(policy_moves_.begin() + start,
+                     policy_moves_.begin() + start + batch_size,
+                     [](const auto& moves) { return moves.empty(); });
     for (size_t j = 0; j < batch_size; j++) {
-      EncodePlanes(planes_[start + j], &buffer1[j * kSquares * kInputPlanes]);
+      ExpandPlanes(planes_[start + j], &buffer1[j * kSquares * kInputPlanes]);
     }
 
     if (num_res_blocks > 0) {
       // Input convolution
+      ConvolutionEpilogue input_epilogue;
+      input_epilogue.biases = weights_.input.biases.data();
+      input_epilogue.activation = default_activation_;
       convolve3.Forward(batch_size, kInputPlanes, output_channels,
                         buffer1.data(), weights_.input.weights.data(),
-                        buffer2.data());
-
-      BiasActivate(batch_size, output_channels, buffer2.data(),
-                   weights_.input.biases.data(), default_activation_);
+                        buffer2.data(), input_epilogue,
+                        network_->GetPackedWeights(
+                            weights_.input.weights.data()));
 
       // Residual tower
       for (auto& residual : weights_.residual) {
@@ -550,26 +804,36 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
         const auto& conv2 = residual.conv2;
         const auto& se = residual.se;
 
+        ConvolutionEpilogue conv1_epilogue;
+        conv1_epilogue.biases = conv1.biases.data();
+        conv1_epilogue.activation = default_activation_;
         convolve3.Forward(batch_size, output_channels, output_channels,
-                          buffer2.data(), conv1.weights.data(), buffer1.data());
-
-        BiasActivate(batch_size, output_channels, buffer1.data(),
-                     conv1.biases.data(), default_activation_);
+                          buffer2.data(), conv1.weights.data(), buffer1.data(),
+                          conv1_epilogue,
+                          network_->GetPackedWeights(conv1.weights.data()));
 
+        ConvolutionEpilogue conv2_epilogue;
+        if (residual.has_se) {
+          // No relu if followed by SE-unit and residual/bias is added later
+          conv2_epilogue.averages = se_averages.data();
+        } else {
+          conv2_epilogue.biases = conv2.biases.data();
+          conv2_epilogue.residual = buffer2.data();
+          conv2_epilogue.activation = default_activation_;
+        }
         convolve3.Forward(batch_size, output_channels, output_channels,
-                          buffer1.data(), conv2.weights.data(), buffer3.data());
+                          buffer1.data(), conv2.weights.data(), buffer3.data(),
+                          conv2_epilogue,
+                          network_->GetPackedWeights(conv2.weights.data()));
 
         if (residual.has_se) {
-          // No relu if followed by SE-unit and residual/bias is added later
           auto se_fc_outputs = se.b1.size();
-          ApplySEUnit<use_eigen>(
-              batch_size, output_channels, se_fc_outputs, buffer3.data(),
-              conv2.biases.data(), buffer2.data(), se.w1.data(), se.b1.data(),
-              se.w2.data(), se.b2.data(), buffer2.data(), default_activation_);
-        } else {
-          BiasResidual(batch_size, output_channels, buffer2.data(),
-                       conv2.biases.data(), buffer3.data(),
-                       default_activation_);
+          ApplySEUnit<use_eigen>(batch_size, output_channels, se_fc_outputs,
+                                 buffer3.data(), se_averages.data(),
+                                 conv2.biases.data(), buffer2.data(),
+                                 se.w1.data(), se.b1.data(), se.w2.data(),
+                                 se.b2.data(), buffer2.data(),
+                                 default_activation_);
         }
       }
     }
@@ -601,10 +865,9 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       }
 
       // Input embedding.
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, input_size, embedding_size, buffer3.data(),
-          weights_.ip_emb_w.data(), weights_.ip_emb_b.data(),
-          default_activation_, buffer1.data());
+      Dense(batch_size * kSquares, input_size, embedding_size, buffer3.data(),
+            weights_.ip_emb_w.data(), weights_.ip_emb_b.data(),
+            default_activation_, buffer1.data());
 
       // Input gating
       if (weights_.ip_mult_gate.size() > 0 && weights_.ip_add_gate.size() > 0) {
@@ -624,8 +887,9 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       // Attention body encoders.
       float alpha = (float)pow(2.0 * weights_.encoder.size(), 0.25);
       for (auto& layer : weights_.encoder) {
-        MakeEncoderLayer(buffer1, buffer2, buffer3, head_buffer, batch_size,
-                         layer, embedding_size, weights_.encoder_head_count,
+        MakeEncoderLayer(buffer1, buffer2, buffer3, head_buffer,
+                         largest_batch_size, batch_size, layer,
+                         embedding_size, weights_.encoder_head_count,
                          smolgen_activation_, ffn_activation_, alpha);
       }
     }
@@ -633,10 +897,9 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
     // Preserve buffer1 and buffer2, used for policy and moves left heads.
     // Value head
     if (attn_body_) {
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, weights_.ip_emb_b.size(),
-          num_value_input_planes, buffer1.data(), weights_.ip_val_w.data(),
-          weights_.ip_val_b.data(), default_activation_, head_buffer.data());
+      Dense(batch_size * kSquares, weights_.ip_emb_b.size(),
+            num_value_input_planes, buffer1.data(), weights_.ip_val_w.data(),
+            weights_.ip_val_b.data(), default_activation_, head_buffer.data());
     } else {
       Convolution1<use_eigen>::Forward(
           batch_size, output_channels, num_value_input_planes, buffer2.data(),
@@ -646,12 +909,11 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
                    weights_.value.biases.data(), default_activation_);
     }
 
-    FullyConnectedLayer<use_eigen>::Forward1D(
-        batch_size, num_value_input_planes * kSquares, num_value_channels,
-        head_buffer.data(), weights_.ip1_val_w.data(),
-        weights_.ip1_val_b.data(),
-        default_activation_,  // Activation On
-        buffer3.data());
+    Dense(batch_size, num_value_input_planes * kSquares, num_value_channels,
+          head_buffer.data(), weights_.ip1_val_w.data(),
+          weights_.ip1_val_b.data(),
+          default_activation_,  // Activation On
+          buffer3.data());
 
     // Now get the score
     if (wdl_) {
@@ -666,9 +928,9 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
         std::vector<float> wdl_softmax(3);
         SoftmaxActivation(3, &wdl[j * 3], wdl_softmax.data());
 
-        q_values_.emplace_back(wdl_softmax[0]);
-        q_values_.emplace_back(wdl_softmax[1]);
-        q_values_.emplace_back(wdl_softmax[2]);
+        q_values_[3 * (start + j) + 0] = wdl_softmax[0];
+        q_values_[3 * (start + j) + 1] = wdl_softmax[1];
+        q_values_[3 * (start + j) + 2] = wdl_softmax[2];
       }
     } else {
       for (size_t j = 0; j < batch_size; j++) {
@@ -677,17 +939,17 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
                              &buffer3[j * num_value_channels]) +
                          weights_.ip2_val_b[0];
 
-        q_values_.emplace_back(std::tanh(winrate));
+        q_values_[start + j] = std::tanh(winrate);
       }
     }
 
     // Moves left head.
     if (moves_left_) {
       if (attn_body_) {
-        FullyConnectedLayer<use_eigen>::Forward1D(
-            batch_size * kSquares, weights_.ip_emb_b.size(),
-            num_moves_input_planes, buffer1.data(), weights_.ip_mov_w.data(),
-            weights_.ip_mov_b.data(), default_activation_, head_buffer.data());
+        Dense(batch_size * kSquares, weights_.ip_emb_b.size(),
+              num_moves_input_planes, buffer1.data(), weights_.ip_mov_w.data(),
+              weights_.ip_mov_b.data(), default_activation_,
+              head_buffer.data());
       } else {
         Convolution1<use_eigen>::Forward(
             batch_size, output_channels, num_moves_input_planes, buffer2.data(),
@@ -697,12 +959,11 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
                      weights_.moves_left.biases.data(), default_activation_);
       }
 
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size, num_moves_input_planes * kSquares, num_moves_channels,
-          head_buffer.data(), weights_.ip1_mov_w.data(),
-          weights_.ip1_mov_b.data(),
-          default_activation_,  // Activation On
-          buffer3.data());
+      Dense(batch_size, num_moves_input_planes * kSquares, num_moves_channels,
+            head_buffer.data(), weights_.ip1_mov_w.data(),
+            weights_.ip1_mov_b.data(),
+            default_activation_,  // Activation On
+            buffer3.data());
 
       std::vector<float> output_moves_left(batch_size);
       FullyConnectedLayer<use_eigen>::Forward1D(
@@ -728,114 +989,152 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       }
       const size_t policy_embedding_size = weights_.ip_pol_b.size();
       // Policy Embedding.
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, output_channels, policy_embedding_size,
-          buffer1.data(), weights_.ip_pol_w.data(), weights_.ip_pol_b.data(),
-          attn_body_
-              ? default_activation_
-              : ACTIVATION_SELU,  // SELU activation hardcoded for apmish nets.
-          buffer2.data());
+      Dense(batch_size * kSquares, output_channels, policy_embedding_size,
+            buffer1.data(), weights_.ip_pol_w.data(), weights_.ip_pol_b.data(),
+            // SELU activation hardcoded for apmish nets.
+            attn_body_ ? default_activation_ : ACTIVATION_SELU,
+            buffer2.data());
 
       const size_t policy_d_model = weights_.ip2_pol_b.size();
 
       for (auto& layer : weights_.pol_encoder) {
-        MakeEncoderLayer(buffer2, buffer1, buffer3, head_buffer, batch_size,
-                         layer, policy_embedding_size,
+        MakeEncoderLayer(buffer2, buffer1, buffer3, head_buffer,
+                         largest_batch_size, batch_size, layer,
+                         policy_embedding_size,
                          weights_.pol_encoder_head_count,
                          attn_body_ ? smolgen_activation_ : ACTIVATION_NONE,
                          attn_body_ ? ffn_activation_ : ACTIVATION_SELU, 1.0f);
       }
 
       // Q
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, policy_embedding_size, policy_d_model,
-          buffer2.data(), weights_.ip2_pol_w.data(), weights_.ip2_pol_b.data(),
-          ACTIVATION_NONE, buffer1.data());
+      Dense(batch_size * kSquares, policy_embedding_size, policy_d_model,
+            buffer2.data(), weights_.ip2_pol_w.data(),
+            weights_.ip2_pol_b.data(), ACTIVATION_NONE, buffer1.data());
       // K
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size * kSquares, policy_embedding_size, policy_d_model,
-          buffer2.data(), weights_.ip3_pol_w.data(), weights_.ip3_pol_b.data(),
-          ACTIVATION_NONE, buffer3.data());
+      Dense(batch_size * kSquares, policy_embedding_size, policy_d_model,
+            buffer2.data(), weights_.ip3_pol_w.data(),
+            weights_.ip3_pol_b.data(), ACTIVATION_NONE, buffer3.data());
       const float scaling = 1.0f / sqrtf(policy_d_model);
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        const float* A = &buffer1[batch * 64 * policy_d_model];
-        const float* B = &buffer3[batch * 64 * policy_d_model];
-        float* C = &head_buffer[batch * (64 * 64 + 8 * 24)];
-        if (use_eigen) {
-          auto C_mat = EigenMatrixMap<float>(C, kSquares, kSquares);
-          C_mat.noalias() =
-              scaling *
-              ConstEigenMatrixMap<float>(B, policy_d_model, kSquares)
-                  .transpose() *
-              ConstEigenMatrixMap<float>(A, policy_d_model, kSquares);
-        } else {
+      if (sparse_policy) {
+        // Only the dot products of the legal moves, and the promotion offsets
+        // of the pawn files if there are promotions.
+        const auto& indices = AttentionPolicyIndices();
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          const float* A = &buffer1[batch * 64 * policy_d_model];
+          const float* B = &buffer3[batch * 64 * policy_d_model];
+          auto dot = [&](int from, int to) {
+            return FullyConnectedLayer<use_eigen>::Forward0D(
+                policy_d_model, &A[from * policy_d_model],
+                &B[to * policy_d_model]);
+          };
+          std::vector<float> policy(num_output_policy);
+          for (auto move : policy_moves_[start + batch]) {
+            const int i = indices[move];
+            if (i < 64 * 64) {
+              policy[move] = scaling * dot(i / 64, i % 64);
+              continue;
+            }
+            const int k = (i - 64 * 64) / 24;
+            const int j = (i - 64 * 64) % 24 / 3;
+            const int c = (i - 64 * 64) % 3;
+            const float* key = &B[(56 + j) * policy_d_model];
+            float offset = 0;
+            float pawn_offset = 0;
+            for (size_t d = 0; d < policy_d_model; d++) {
+              offset += key[d] * weights_.ip4_pol_w[c * policy_d_model + d];
+              pawn_offset +=
+                  key[d] * weights_.ip4_pol_w[3 * policy_d_model + d];
+            }
+            policy[move] =
+                scaling * dot(48 + k, 56 + j) + (offset + pawn_offset);
+          }
+          policies_[start + batch] = std::move(policy);
+        }
+      } else {
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          const float* A = &buffer1[batch * 64 * policy_d_model];
+          const float* B = &buffer3[batch * 64 * policy_d_model];
+          float* C = &head_buffer[batch * (64 * 64 + 8 * 24)];
+          if (use_eigen) {
+            auto C_mat = EigenMatrixMap<float>(C, kSquares, kSquares);
+            C_mat.noalias() =
+                scaling *
+                ConstEigenMatrixMap<float>(B, policy_d_model, kSquares)
+                    .transpose() *
+                ConstEigenMatrixMap<float>(A, policy_d_model, kSquares);
+          } else {
 #ifdef USE_BLAS
-          cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, kSquares,
-                      kSquares, policy_d_model, scaling, A, policy_d_model, B,
-                      policy_d_model, 0.0f, C, 64);
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, kSquares,
+                        kSquares, policy_d_model, scaling, A, policy_d_model, B,
+                        policy_d_model, 0.0f, C, 64);
 #else
-          // Should never get here.
-          throw Exception("Blas backend internal error");
+            // Should never get here.
+            throw Exception("Blas backend internal error");
 #endif
+          }
         }
-      }
-      // Promotion offset calculation.
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        float promotion_offsets[4][8];
-        // This is so small that SGEMM seems slower.
-        for (int i = 0; i < 4; i++) {
-          for (int j = 0; j < 8; j++) {
-            float sum = 0;
-            for (size_t k = 0; k < policy_d_model; k++) {
-              sum += buffer3[batch * kSquares * policy_d_model +
-                             (56 + j) * policy_d_model + k] *
-                     weights_.ip4_pol_w[i * policy_d_model + k];
+        // Promotion offset calculation.
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          float promotion_offsets[4][8];
+          // This is so small that SGEMM seems slower.
+          for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 8; j++) {
+              float sum = 0;
+              for (size_t k = 0; k < policy_d_model; k++) {
+                sum += buffer3[batch * kSquares * policy_d_model +
+                               (56 + j) * policy_d_model + k] *
+                       weights_.ip4_pol_w[i * policy_d_model + k];
+              }
+              promotion_offsets[i][j] = sum;
             }
-            promotion_offsets[i][j] = sum;
           }
-        }
-        for (int i = 0; i < 3; i++) {
-          for (int j = 0; j < 8; j++) {
-            promotion_offsets[i][j] += promotion_offsets[3][j];
+          for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 8; j++) {
+              promotion_offsets[i][j] += promotion_offsets[3][j];
+            }
           }
-        }
-        for (int k = 0; k < 8; k++) {      // y in cuda
-          for (int j = 0; j < 8; j++) {    // w in cuda
-            for (int i = 0; i < 3; i++) {  // c in cuda
-              head_buffer[batch * (64 * 64 + 8 * 24) + 64 * 64 + 24 * k +
-                          3 * j + i] = head_buffer[batch * (64 * 64 + 8 * 24) +
-                                                   (48 + k) * 64 + 56 + j] +
-                                       promotion_offsets[i][j];
+          for (int k = 0; k < 8; k++) {      // y in cuda
+            for (int j = 0; j < 8; j++) {    // w in cuda
+              for (int i = 0; i < 3; i++) {  // c in cuda
+                head_buffer[batch * (64 * 64 + 8 * 24) + 64 * 64 + 24 * k +
+                            3 * j + i] =
+                    head_buffer[batch * (64 * 64 + 8 * 24) + (48 + k) * 64 +
+                                56 + j] +
+                    promotion_offsets[i][j];
+              }
             }
           }
         }
-      }
-      // Mapping from attention policy to lc0 policy
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        std::vector<float> policy(num_output_policy);
-        for (auto i = 0; i < 64 * 64 + 8 * 24; i++) {
-          auto j = kAttnPolicyMap[i];
-          if (j >= 0) {
-            policy[j] = head_buffer[batch * (64 * 64 + 8 * 24) + i];
+        // Mapping from attention policy to lc0 policy
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          std::vector<float> policy(num_output_policy);
+          for (auto i = 0; i < 64 * 64 + 8 * 24; i++) {
+            auto j = kAttnPolicyMap[i];
+            if (j >= 0) {
+              policy[j] = head_buffer[batch * (64 * 64 + 8 * 24) + i];
+            }
           }
+          policies_[start + batch] = std::move(policy);
         }
-        policies_.emplace_back(std::move(policy));
       }
     } else if (conv_policy_) {
       assert(!attn_body_);  // not supported with attention body
+      ConvolutionEpilogue policy1_epilogue;
+      policy1_epilogue.biases = weights_.policy1.biases.data();
+      policy1_epilogue.activation = default_activation_;
       convolve3.Forward(batch_size, output_channels, output_channels,
                         buffer2.data(), weights_.policy1.weights.data(),
-                        buffer1.data());
-
-      BiasActivate(batch_size, output_channels, buffer1.data(),
-                   weights_.policy1.biases.data(), default_activation_);
+                        buffer1.data(), policy1_epilogue,
+                        network_->GetPackedWeights(
+                            weights_.policy1.weights.data()));
 
+      ConvolutionEpilogue policy_epilogue;
+      policy_epilogue.biases = weights_.policy.biases.data();
       convolve3.Forward(batch_size, output_channels, num_policy_input_planes,
                         buffer1.data(), weights_.policy.weights.data(),
-                        head_buffer.data());
-
-      BiasActivate(batch_size, num_policy_input_planes, head_buffer.data(),
-                   weights_.policy.biases.data(), ACTIVATION_NONE);
+                        head_buffer.data(), policy_epilogue,
+                        network_->GetPackedWeights(
+                            weights_.policy.weights.data()));
 
       // Mapping from convolutional policy to lc0 policy
       for (auto batch = size_t{0}; batch < batch_size; batch++) {
@@ -847,7 +1146,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
                 head_buffer[batch * num_policy_input_planes * kSquares + i];
           }
         }
-        policies_.emplace_back(std::move(policy));
+        policies_[start + batch] = std::move(policy);
       }
 
     } else {
@@ -859,42 +1158,45 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       BiasActivate(batch_size, num_policy_input_planes, &head_buffer[0],
                    weights_.policy.biases.data(), default_activation_);
 
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size, num_policy_input_planes * kSquares, num_output_policy,
-          head_buffer.data(), weights_.ip_pol_w.data(),
-          weights_.ip_pol_b.data(),
-          ACTIVATION_NONE,  // Activation Off
-          buffer3.data());
-
-      for (size_t j = 0; j < batch_size; j++) {
-        std::vector<float> policy(num_output_policy);
-
-        // Get the moves
-        policy.assign(buffer3.begin() + j * num_output_policy,
-                      buffer3.begin() + (j + 1) * num_output_policy);
-        policies_.emplace_back(std::move(policy));
+      if (sparse_policy) {
+        // One row of the final layer per legal move.
+        const size_t input_size = num_policy_input_planes * kSquares;
+        for (size_t j = 0; j < batch_size; j++) {
+          std::vector<float> policy(num_output_policy);
+          for (auto move : policy_moves_[start + j]) {
+            policy[move] = FullyConnectedLayer<use_eigen>::Forward0D(
+                               input_size, &head_buffer[j * input_size],
+                               &weights_.ip_pol_w[move * input_size]) +
+                           weights_.ip_pol_b[move];
+          }
+          policies_[start + j] = std::move(policy);
+        }
+      } else {
+        Dense(batch_size, num_policy_input_planes * kSquares,
+              num_output_policy, head_buffer.data(), weights_.ip_pol_w.data(),
+              weights_.ip_pol_b.data(),
+              ACTIVATION_NONE,  // Activation Off
+              buffer3.data());
+
+        for (size_t j = 0; j < batch_size; j++) {
+          std::vector<float> policy(num_output_policy);
+
+          // Get the moves
+          policy.assign(buffer3.begin() + j * num_output_policy,
+                        buffer3.begin() + (j + 1) * num_output_policy);
+          policies_[start + j] = std::move(policy);
+        }
       }
     }
   }
   network_->ReleaseBuffers(std::move(buffers));
 }
 
-template <bool use_eigen>
-void BlasComputation<use_eigen>::EncodePlanes(const InputPlanes& sample,
-                                              float* buffer) {
-  for (const InputPlane& plane : sample) {
-    const float value = plane.value;
-    for (auto i = 0; i < kSquares; i++)
-      *(buffer++) = (plane.mask & (((uint64_t)1) << i)) != 0 ? value : 0;
-  }
-}
-
 template <bool use_eigen>
 BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
                                     const OptionsDict& options)
     : capabilities_{file.format().network_format().input(),
-                    file.format().network_format().moves_left()},
-      weights_(file.weights()) {
+                    file.format().network_format().moves_left()} {
   Numa::Init();
 
   max_batch_size_ =
@@ -937,29 +1239,70 @@ BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
     max_batch_size_ = kHardMaxBatchSize;
   }
 
-  const auto inputChannels = kInputPlanes;
-  const auto channels = static_cast<int>(weights_.input.biases.size());
-  const auto residual_blocks = weights_.residual.size();
-
-  weights_.input.weights =
-      WinogradFilterTransformF(weights_.input.weights, channels, inputChannels);
+  const int threads = options.GetOrDefault<int>("threads", 1);
+  if (threads > 1) {
+    thread_pool_ = std::make_unique<ThreadPool>(threads - 1);
+    CERR << "Splitting batches across " << threads << " threads.";
+  }
 
-  // residual blocks
-  for (size_t i = 0; i < residual_blocks; i++) {
-    auto& residual = weights_.residual[i];
-    auto& conv1 = residual.conv1;
-    auto& conv2 = residual.conv2;
+  BufferPool::Options pool_options;
+  pool_options.max_bytes =
+      size_t{1024 * 1024} * options.GetOrDefault<int>("buffer_pool_mb", 0);
+  pool_options.huge_pages = options.GetOrDefault<bool>("hugepages", false);
+  buffer_pool_ = std::make_unique<BufferPool>(kBuffersPerSet, pool_options);
+  buffer_stats_ = options.GetOrDefault<bool>("buffer_stats", false);
+
+  const bool prepack =
+      use_eigen && options.GetOrDefault<bool>("prepack", true);
+  const bool shared_weights =
+      options.GetOrDefault<bool>("shared_weights", false);
+  std::string shared_dir;
+  uint64_t weights_hash = 0;
+  if (shared_weights) {
+    shared_dir = GetSharedWeightsDirectory(
+        options.GetOrDefault<std::string>("shared_weights_dir", ""));
+    weights_hash = HashWeightsFile(file);
+  }
 
-    conv1.weights = WinogradFilterTransformF(conv1.weights, channels, channels);
-    conv2.weights = WinogradFilterTransformF(conv2.weights, channels, channels);
+  const auto conv_algorithm =
+      options.GetOrDefault<std::string>("conv_algorithm", "auto");
+  if (conv_algorithm == "auto") {
+    if (!attn_body_ && file.weights().residual_size() > 0) {
+      auto tune = [&]() {
+        return TuneConvolution3(
+            LayerAdapter(file.weights().input().biases()).size(), prepack);
+      };
+      if (shared_weights) {
+        // The choice is kept per network and CPU model.
+        uint64_t key = HashCat(weights_hash, 0x74756e65);
+        for (unsigned char c : GetCpuModelName()) key = HashCat(key, c);
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.conv",
+                      static_cast<unsigned long long>(key));
+        conv_algorithm_ =
+            LoadOrStoreConvolution3Algorithm(shared_dir + name, tune);
+      } else {
+        conv_algorithm_ = tune();
+      }
+    }
+  } else {
+    conv_algorithm_ = ParseConvolution3Algorithm(conv_algorithm);
   }
 
-  if (conv_policy_) {
-    weights_.policy1.weights =
-        WinogradFilterTransformF(weights_.policy1.weights, channels, channels);
-    auto pol_channels = weights_.policy.biases.size();
-    weights_.policy.weights = WinogradFilterTransformF(weights_.policy.weights,
-                                                       pol_channels, channels);
+  if (shared_weights) {
+    // The prepared weights depend only on the network and the algorithm.
+    const uint64_t key = HashCat(
+        {weights_hash, 0x626c6173, static_cast<uint64_t>(conv_algorithm_)});
+    shared_weights_ = std::make_unique<SharedWeights>(key, shared_dir, [&]() {
+      LegacyWeights weights(file.weights());
+      PrepareWeights(&weights, conv_policy_, conv_algorithm_);
+      return weights;
+    });
+    weights_ = shared_weights_->weights();
+  } else {
+    owned_weights_ = std::make_unique<LegacyWeights>(file.weights());
+    PrepareWeights(owned_weights_.get(), conv_policy_, conv_algorithm_);
+    weights_ = MakeWeightsView(*owned_weights_);
   }
 
   if (use_eigen) {
@@ -1001,6 +1344,264 @@ BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
 #endif
     CERR << "BLAS max batch size is " << max_batch_size_ << ".";
   }
+
+  const auto weights_type =
+      options.GetOrDefault<std::string>("weights_type", "fp32");
+  if (weights_type == "fp16") {
+    ConvertDenseWeights(HalfFullyConnectedLayer::Type::kFp16);
+  } else if (weights_type == "bf16") {
+    ConvertDenseWeights(HalfFullyConnectedLayer::Type::kBf16);
+  } else if (weights_type != "fp32") {
+    throw Exception("Unknown weights_type " + weights_type +
+                    ", expected fp32, fp16 or bf16.");
+  }
+
+  if (prepack) PackWeights();
+
+  if (options.GetOrDefault<bool>("int8", false)) {
+    if (weights_.encoder.empty()) {
+      CERR << "Int8 mode only applies to attention body networks, ignored.";
+    } else {
+      QuantizeInt8(options.GetOrDefault<std::string>("int8_calibration", ""),
+                   weights_type);
+    }
+  }
+}
+
+template <bool use_eigen>
+BlasNetwork<use_eigen>::~BlasNetwork() {
+  const auto stats = buffer_pool_->GetStats();
+  std::ostringstream report;
+  report << "Buffer pool: " << stats.hits << " hits, " << stats.misses
+         << " misses, " << stats.evictions << " evictions, "
+         << stats.free_sets << " free sets, "
+         << stats.allocated_bytes / (1024 * 1024) << " MiB allocated, "
+         << stats.peak_bytes / (1024 * 1024) << " MiB peak.";
+  if (buffer_stats_) {
+    CERR << report.str();
+  } else {
+    LOGFILE << report.str();
+  }
+}
+
+template <bool use_eigen>
+template <typename F>
+void BlasNetwork<use_eigen>::ForEachDenseLayer(F&& f) const {
+  auto biased = [&](const WeightsSpan& weights, const WeightsSpan& biases) {
+    f(weights, biases.size());
+  };
+  if (attn_body_) {
+    biased(weights_.ip_emb_w, weights_.ip_emb_b);
+    const size_t embedding_size = weights_.ip_emb_b.size();
+    for (const auto& layer : weights_.encoder) {
+      biased(layer.mha.q_w, layer.mha.q_b);
+      biased(layer.mha.k_w, layer.mha.k_b);
+      biased(layer.mha.v_w, layer.mha.v_b);
+      biased(layer.mha.dense_w, layer.mha.dense_b);
+      biased(layer.ffn.dense1_w, layer.ffn.dense1_b);
+      biased(layer.ffn.dense2_w, layer.ffn.dense2_b);
+      if (layer.mha.has_smolgen) {
+        const auto& smolgen = layer.mha.smolgen;
+        f(smolgen.compress, smolgen.compress.size() / embedding_size);
+        biased(smolgen.dense1_w, smolgen.dense1_b);
+        biased(smolgen.dense2_w, smolgen.dense2_b);
+      }
+    }
+    f(weights_.smolgen_w, 64 * 64);
+    biased(weights_.ip_val_w, weights_.ip_val_b);
+    if (moves_left_) biased(weights_.ip_mov_w, weights_.ip_mov_b);
+  }
+  if (attn_policy_) {
+    biased(weights_.ip_pol_w, weights_.ip_pol_b);
+    biased(weights_.ip2_pol_w, weights_.ip2_pol_b);
+    biased(weights_.ip3_pol_w, weights_.ip3_pol_b);
+  } else if (!conv_policy_) {
+    biased(weights_.ip_pol_w, weights_.ip_pol_b);
+  }
+  biased(weights_.ip1_val_w, weights_.ip1_val_b);
+  if (moves_left_) biased(weights_.ip1_mov_w, weights_.ip1_mov_b);
+}
+
+template <bool use_eigen>
+void BlasNetwork<use_eigen>::ConvertDenseWeights(
+    HalfFullyConnectedLayer::Type type) {
+  size_t bytes = 0;
+  ForEachDenseLayer([&](const WeightsSpan& weights, size_t outputs) {
+    if (weights.empty()) return;
+    auto layer = std::make_unique<HalfFullyConnectedLayer>(
+        weights.size() / outputs, outputs, weights.data(), type);
+    bytes += weights.size() * sizeof(uint16_t);
+    half_layers_[weights.data()] = std::move(layer);
+  });
+
+  if (half_layers_.empty()) return;
+  CERR << "Keeping " << half_layers_.size() << " dense layers in "
+       << (type == HalfFullyConnectedLayer::Type::kFp16 ? "fp16" : "bf16")
+       << " (" << bytes / (1024 * 1024) << " MiB), using the "
+       << half_layers_.begin()->second->implementation() << " kernels.";
+}
+
+template <bool use_eigen>
+void BlasNetwork<use_eigen>::PackWeights() {
+  using Layout = PackedGemmWeights::Layout;
+  size_t bytes = 0;
+  ForEachDenseLayer([&](const WeightsSpan& weights, size_t outputs) {
+    if (weights.empty() || half_layers_.count(weights.data())) return;
+    auto& packed = packed_weights_[weights.data()];
+    packed.emplace_back(weights.size() / outputs, outputs, weights.data(),
+                        Layout::kOutputMajor);
+    bytes += packed.back().bytes();
+  });
+  auto pack_convolution = [&](const WeightsView::ConvBlock& conv) {
+    if (conv.weights.empty()) return;
+    auto& packed = packed_weights_[conv.weights.data()];
+    packed = PackConvolution3(conv_algorithm_, conv.weights.data(),
+                              conv.weights.size(), conv.biases.size());
+    for (const auto& matrix : packed) bytes += matrix.bytes();
+  };
+  pack_convolution(weights_.input);
+  for (const auto& residual : weights_.residual) {
+    pack_convolution(residual.conv1);
+    pack_convolution(residual.conv2);
+  }
+  if (conv_policy_) {
+    pack_convolution(weights_.policy1);
+    pack_convolution(weights_.policy);
+  }
+
+  if (packed_weights_.empty()) return;
+  CERR << "Pre-packed " << packed_weights_.size() << " weight matrices ("
+       << bytes / (1024 * 1024) << " MiB) for the "
+       << PackedGemmWeights::implementation() << " GEMM kernels.";
+}
+
+template <bool use_eigen>
+void BlasNetwork<use_eigen>::QuantizeInt8(const std::string& fen_file,
+                                          const std::string& reference_type) {
+  const auto positions =
+      LoadCalibrationPositions(fen_file, capabilities_.input_format);
+
+  calibrating_ = true;
+  const auto reference = EvaluateCalibrationPositions(this, positions);
+  calibrating_ = false;
+
+  // Layers without a measured range fall back to per row ranges.
+  size_t calibrated = 0;
+  auto quantize = [&](const WeightsSpan& weights, const WeightsSpan& biases) {
+    const size_t outputs = biases.size();
+    const float range = input_ranges_[weights.data()];
+    if (range > 0.0f) calibrated++;
+    int8_layers_[weights.data()] = std::make_unique<Int8FullyConnectedLayer>(
+        weights.size() / outputs, outputs, weights.data(), range);
+  };
+  for (const auto& layer : weights_.encoder) {
+    quantize(layer.mha.q_w, layer.mha.q_b);
+    quantize(layer.mha.k_w, layer.mha.k_b);
+    quantize(layer.mha.v_w, layer.mha.v_b);
+    quantize(layer.mha.dense_w, layer.mha.dense_b);
+    quantize(layer.ffn.dense1_w, layer.ffn.dense1_b);
+    quantize(layer.ffn.dense2_w, layer.ffn.dense2_b);
+  }
+  input_ranges_.clear();
+
+  // Accuracy report.
+  const auto error = CompareCalibrationOutputs(
+      reference, EvaluateCalibrationPositions(this, positions));
+  CERR << "Int8 encoder layers (" << GetInt8Implementation() << "), "
+       << calibrated << " of " << int8_layers_.size() << " calibrated on "
+       << positions.size() << " positions.";
+  CERR << "Int8 vs " << reference_type << ": " << error.ToString() << ".";
+}
+
+template <bool use_eigen>
+void BlasNetwork<use_eigen>::PrepareWeights(LegacyWeights* weights,
+                                            bool conv_policy,
+                                            Convolution3Algorithm algorithm) {
+  const auto inputChannels = kInputPlanes;
+  const auto channels = static_cast<int>(weights->input.biases.size());
+  const auto residual_blocks = weights->residual.size();
+  auto prepare = [algorithm](const std::vector<float>& f, size_t outputs,
+                             size_t channels) {
+    return WinogradConvolution3<use_eigen>::PrepareWeights(algorithm, f,
+                                                           outputs, channels);
+  };
+
+  weights->input.weights =
+      prepare(weights->input.weights, channels, inputChannels);
+
+  // residual blocks
+  for (size_t i = 0; i < residual_blocks; i++) {
+    auto& residual = weights->residual[i];
+    auto& conv1 = residual.conv1;
+    auto& conv2 = residual.conv2;
+
+    conv1.weights = prepare(conv1.weights, channels, channels);
+    conv2.weights = prepare(conv2.weights, channels, channels);
+  }
+
+  if (conv_policy) {
+    weights->policy1.weights =
+        prepare(weights->policy1.weights, channels, channels);
+    auto pol_channels = weights->policy.biases.size();
+    weights->policy.weights =
+        prepare(weights->policy.weights, pol_channels, channels);
+  }
+}
+
+template <bool use_eigen>
+Convolution3Algorithm BlasNetwork<use_eigen>::TuneConvolution3(
+    size_t channels, bool prepack) const {
+  // The batch size the search sends most of the time.
+  const size_t batch_size =
+      std::min<size_t>(GetMiniBatchSize(), max_batch_size_);
+  std::mt19937 gen(42);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> filter(channels * channels * 9);
+  for (auto& x : filter) x = dist(gen);
+  constexpr size_t kSquares = 8 * 8;
+  std::vector<float> input(batch_size * channels * kSquares);
+  for (auto& x : input) x = dist(gen);
+  std::vector<float> output(input.size());
+
+  Convolution3Algorithm best = Convolution3Algorithm::kWinogradF2;
+  double best_time = std::numeric_limits<double>::max();
+  std::ostringstream report;
+  for (const auto& entry : kConvolution3Algorithms) {
+    const auto weights = WinogradConvolution3<use_eigen>::PrepareWeights(
+        entry.algorithm, filter, channels, channels);
+    std::vector<PackedGemmWeights> packed;
+    if (prepack) {
+      packed = PackConvolution3(entry.algorithm, weights.data(),
+                                weights.size(), channels);
+    }
+    WinogradConvolution3<use_eigen> convolution(batch_size, channels, channels,
+                                                entry.algorithm);
+    auto run = [&]() {
+      convolution.Forward(batch_size, channels, channels, input.data(),
+                          weights.data(), output.data(), {},
+                          packed.empty() ? nullptr : packed.data());
+    };
+    run();
+    // The best of a few runs filters out most of the noise.
+    double time = std::numeric_limits<double>::max();
+    for (int i = 0; i < 5; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      run();
+      const auto end = std::chrono::steady_clock::now();
+      time = std::min(
+          time, std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    report << (report.tellp() > 0 ? ", " : "") << entry.name << " "
+           << static_cast<int>(time) << " us";
+    if (time < best_time) {
+      best_time = time;
+      best = entry.algorithm;
+    }
+  }
+  CERR << "3x3 convolution at batch size " << batch_size << ": "
+       << report.str() << ", using " << Convolution3AlgorithmName(best)
+       << ".";
+  return best;
 }
 
 template <bool use_eigen>
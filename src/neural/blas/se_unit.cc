@@ -65,14 +65,24 @@ static void apply_se(const size_t channels, const size_t batch_size,
 template <bool use_eigen>
 void ApplySEUnit(const size_t batch_size, const size_t channels,
                  const size_t se_fc_outputs, const float* input,
-                 const float* ch_bias, const float* residual,
-                 const float* weights_w1, const float* weights_b1,
-                 const float* weights_w2, const float* weights_b2,
-                 float* output, const ActivationFunction activation) {
+                 const float* averages, const float* ch_bias,
+                 const float* residual, const float* weights_w1,
+                 const float* weights_b1, const float* weights_w2,
+                 const float* weights_b2, float* output,
+                 const ActivationFunction activation) {
   std::vector<float> pool(2 * channels * batch_size);
   std::vector<float> fc_out1(batch_size * se_fc_outputs);
 
-  global_avg_pooling(batch_size, channels, input, ch_bias, pool.data());
+  if (averages == nullptr) {
+    global_avg_pooling(batch_size, channels, input, ch_bias, pool.data());
+  } else {
+    for (auto b = size_t{0}; b < batch_size; b++) {
+      for (auto ch = size_t{0}; ch < channels; ch++) {
+        auto c = b * channels + ch;
+        pool[c] = averages[c] + ch_bias[ch];
+      }
+    }
+  }
 
   FullyConnectedLayer<use_eigen>::Forward1D(batch_size, channels, se_fc_outputs,
                                             pool.data(), weights_w1, weights_b1,
@@ -92,8 +102,8 @@ void ApplySEUnit(const size_t batch_size, const size_t channels,
 
 template void ApplySEUnit<true>(const size_t batch_size, const size_t channels,
                                 const size_t se_fc_outputs, const float* input,
-                                const float* bias, const float* residual,
-                                const float* weights_w1,
+                                const float* averages, const float* bias,
+                                const float* residual, const float* weights_w1,
                                 const float* weights_b1,
                                 const float* weights_w2,
                                 const float* weights_b2, float* output,
@@ -101,8 +111,8 @@ template void ApplySEUnit<true>(const size_t batch_size, const size_t channels,
 #ifdef USE_BLAS
 template void ApplySEUnit<false>(const size_t batch_size, const size_t channels,
                                  const size_t se_fc_outputs, const float* input,
-                                 const float* bias, const float* residual,
-                                 const float* weights_w1,
+                                 const float* averages, const float* bias,
+                                 const float* residual, const float* weights_w1,
                                  const float* weights_b1,
                                  const float* weights_w2,
                                  const float* weights_b2, float* output,
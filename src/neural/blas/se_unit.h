@@ -24,12 +24,16 @@
 
 namespace lczero {
 
+// Squeeze-excitation of the convolution output @input (without its @bias),
+// added to @residual. @averages are the plane averages of @input if they were
+// computed along with it, or nullptr.
 template <bool use_eigen>
 void ApplySEUnit(const size_t batch_size, const size_t channels,
                  const size_t se_fc_outputs, const float* input,
-                 const float* bias, const float* residual,
-                 const float* weights_w1, const float* weights_b1,
-                 const float* weights_w2, const float* weights_b2,
-                 float* output, const ActivationFunction activation);
+                 const float* averages, const float* bias,
+                 const float* residual, const float* weights_w1,
+                 const float* weights_b1, const float* weights_w2,
+                 const float* weights_b2, float* output,
+                 const ActivationFunction activation);
 
 }  // namespace lczero
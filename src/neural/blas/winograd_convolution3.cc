@@ -18,6 +18,7 @@
 
 #include "neural/blas/winograd_convolution3.h"
 #include "neural/blas/blas.h"
+#include "neural/shared/winograd_filter.h"
 
 #include <algorithm>
 #include <cassert>
@@ -39,23 +40,142 @@ template <typename T>
 using ConstEigenMatrixMap =
     Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>>;
 
+namespace {
+constexpr auto kSquares = 64;
+
+// Applies @epilogue to the @count planes of sample @batch_index starting at
+// channel @first.
+void ApplyEpilogue(const ConvolutionEpilogue& epilogue, size_t channels,
+                   size_t batch_index, size_t first, size_t count,
+                   float* output) {
+  const size_t plane = batch_index * channels + first;
+  float* data = output + plane * kSquares;
+  if (epilogue.averages != nullptr) {
+    for (size_t c = 0; c < count; c++) {
+      auto acc = 0.0f;
+      for (auto i = 0; i < kSquares; i++) acc += data[c * kSquares + i];
+      epilogue.averages[plane + c] = acc / kSquares;
+    }
+  }
+  if (epilogue.biases == nullptr) return;
+  if (epilogue.residual != nullptr) {
+    BiasResidual(1, count, epilogue.residual + plane * kSquares,
+                 epilogue.biases + first, data, epilogue.activation);
+  } else {
+    BiasActivate(1, count, data, epilogue.biases + first,
+                 epilogue.activation);
+  }
+}
+
+#ifndef USE_ISPC
+// Computes transpose(B).x along one dimension of a F(4x4, 3x3) input tile,
+// for the 6 values of @x @stride apart.
+//   transpose(B) = [[4,  0, -5,  0, 1, 0],
+//                   [0, -4, -4,  1, 1, 0],
+//                   [0,  4, -4, -1, 1, 0],
+//                   [0, -2, -1,  2, 1, 0],
+//                   [0,  2, -1, -2, 1, 0],
+//                   [0,  4,  0, -5, 0, 1]]
+inline void InputTransformF4(const float* x, size_t stride, float* y,
+                             size_t y_stride) {
+  const float x0 = x[0], x1 = x[stride], x2 = x[2 * stride],
+              x3 = x[3 * stride], x4 = x[4 * stride], x5 = x[5 * stride];
+  y[0] = 4.0f * x0 - 5.0f * x2 + x4;
+  y[y_stride] = -4.0f * (x1 + x2) + x3 + x4;
+  y[2 * y_stride] = 4.0f * (x1 - x2) - x3 + x4;
+  y[3 * y_stride] = 2.0f * (x3 - x1) - x2 + x4;
+  y[4 * y_stride] = 2.0f * (x1 - x3) - x2 + x4;
+  y[5 * y_stride] = 4.0f * x1 - 5.0f * x3 + x5;
+}
+
+// Computes transpose(A).m along one dimension of a F(4x4, 3x3) output tile.
+//   transpose(A) = [[1, 1,  1, 1,  1, 0],
+//                   [0, 1, -1, 2, -2, 0],
+//                   [0, 1,  1, 4,  4, 0],
+//                   [0, 1, -1, 8, -8, 1]]
+inline void OutputTransformF4(const float* m, size_t stride, float* y,
+                              size_t y_stride) {
+  const float sum12 = m[stride] + m[2 * stride];
+  const float diff12 = m[stride] - m[2 * stride];
+  const float sum34 = m[3 * stride] + m[4 * stride];
+  const float diff34 = m[3 * stride] - m[4 * stride];
+  y[0] = m[0] + sum12 + sum34;
+  y[y_stride] = diff12 + 2.0f * diff34;
+  y[2 * y_stride] = sum12 + 4.0f * sum34;
+  y[3 * y_stride] = diff12 + 8.0f * diff34 + m[5 * stride];
+}
+#endif
+}  // namespace
+
 template <bool use_eigen>
 WinogradConvolution3<use_eigen>::WinogradConvolution3(
     const size_t max_batch_size, const size_t max_input_layers,
-    const size_t max_output_layers)
-    : V_(max_batch_size * kWinogradTile * max_input_layers * kTiles),
-      M_(max_batch_size * kWinogradTile * max_output_layers * kTiles) {}
+    const size_t max_output_layers, Convolution3Algorithm algorithm)
+    : algorithm_(algorithm),
+      tiles_(algorithm == Convolution3Algorithm::kWinogradF4 ? kTilesF4
+                                                             : kTiles),
+      tile_size_(algorithm == Convolution3Algorithm::kWinogradF4
+                     ? kWinogradTileF4
+                     : kWinogradTile),
+      // im2col works on one sample at a time.
+      V_(algorithm == Convolution3Algorithm::kIm2col
+             ? kSquares * 9 * max_input_layers
+             : max_batch_size * tile_size_ * max_input_layers * tiles_),
+      M_(algorithm == Convolution3Algorithm::kIm2col
+             ? kSquares * max_output_layers
+             : max_batch_size * tile_size_ * max_output_layers * tiles_) {}
 
 template <bool use_eigen>
-void WinogradConvolution3<use_eigen>::Forward(const size_t batch_size,
-                                              const size_t input_channels,
-                                              const size_t output_channels,
-                                              const float* input,
-                                              const float* weights,
-                                              float* output) {
-  TransformIn(batch_size, input, input_channels);
-  Sgemm(batch_size, weights, input_channels, output_channels);
-  TransformOut(batch_size, output, output_channels);
+void WinogradConvolution3<use_eigen>::Forward(
+    const size_t batch_size, const size_t input_channels,
+    const size_t output_channels, const float* input, const float* weights,
+    float* output, const ConvolutionEpilogue& epilogue,
+    const PackedGemmWeights* packed) {
+  switch (algorithm_) {
+    case Convolution3Algorithm::kWinogradF2:
+      TransformIn(batch_size, input, input_channels);
+      Sgemm(batch_size, weights, input_channels, output_channels, packed);
+      TransformOut(batch_size, output, output_channels, epilogue);
+      break;
+    case Convolution3Algorithm::kWinogradF4:
+      TransformInF4(batch_size, input, input_channels);
+      Sgemm(batch_size, weights, input_channels, output_channels, packed);
+      TransformOutF4(batch_size, output, output_channels, epilogue);
+      break;
+    case Convolution3Algorithm::kIm2col:
+      Im2colForward(batch_size, input_channels, output_channels, input,
+                    weights, output, epilogue, packed);
+      break;
+  }
+}
+
+template <bool use_eigen>
+std::vector<float> WinogradConvolution3<use_eigen>::PrepareWeights(
+    Convolution3Algorithm algorithm, const std::vector<float>& weights,
+    size_t outputs, size_t channels) {
+  switch (algorithm) {
+    case Convolution3Algorithm::kWinogradF2:
+      return WinogradFilterTransformF(weights, outputs, channels);
+    case Convolution3Algorithm::kWinogradF4:
+      return WinogradFilterTransformF4(weights, outputs, channels);
+    case Convolution3Algorithm::kIm2col:
+      break;
+  }
+  return weights;
+}
+
+template <bool use_eigen>
+size_t WinogradConvolution3<use_eigen>::GemmCount(
+    Convolution3Algorithm algorithm) {
+  switch (algorithm) {
+    case Convolution3Algorithm::kWinogradF2:
+      return kWinogradTile;
+    case Convolution3Algorithm::kWinogradF4:
+      return kWinogradTileF4;
+    case Convolution3Algorithm::kIm2col:
+      break;
+  }
+  return 1;
 }
 
 template <bool use_eigen>
@@ -165,7 +285,8 @@ template <>
 void WinogradConvolution3<false>::Sgemm(const size_t batch_size,
                                         const float* weights,
                                         const size_t input_channels,
-                                        const size_t output_channels) {
+                                        const size_t output_channels,
+                                        const PackedGemmWeights* /*packed*/) {
 #ifdef USE_MKL
 
   /*
@@ -180,22 +301,22 @@ void WinogradConvolution3<false>::Sgemm(const size_t batch_size,
   CBLAS_TRANSPOSE transA = CblasNoTrans;
   CBLAS_TRANSPOSE transB = CblasNoTrans;
   MKL_INT m_array = output_channels;
-  MKL_INT n_array = batch_size * kTiles;
+  MKL_INT n_array = batch_size * tiles_;
   MKL_INT k_array = input_channels;
   float alpha_array = 1.0;
-  const float* a_array[kWinogradTile];
+  const float* a_array[kWinogradTileF4];
   MKL_INT lda_array = output_channels;
-  const float* b_array[kWinogradTile];
+  const float* b_array[kWinogradTileF4];
   MKL_INT ldb_array = input_channels;
-  float* c_array[kWinogradTile];
+  float* c_array[kWinogradTileF4];
   MKL_INT ldc_array = output_channels;
   float beta_array = 0.0;
-  MKL_INT groupSize = kWinogradTile;
+  MKL_INT groupSize = tile_size_;
 
-  for (auto b = 0; b < kWinogradTile; b++) {
+  for (size_t b = 0; b < tile_size_; b++) {
     auto offset_u = b * output_channels * input_channels;
-    auto offset_v = b * batch_size * input_channels * kTiles;
-    auto offset_m = b * batch_size * output_channels * kTiles;
+    auto offset_v = b * batch_size * input_channels * tiles_;
+    auto offset_m = b * batch_size * output_channels * tiles_;
 
     a_array[b] = &weights[offset_u];
     b_array[b] = &V_[offset_v];
@@ -209,7 +330,7 @@ void WinogradConvolution3<false>::Sgemm(const size_t batch_size,
 
 #else
 
-  for (size_t b = 0; b < kWinogradTile; b++) {
+  for (size_t b = 0; b < tile_size_; b++) {
     auto offset_u = b * output_channels * input_channels;
 
     // In col major
@@ -219,13 +340,13 @@ void WinogradConvolution3<false>::Sgemm(const size_t batch_size,
     // cols      tiles                  input_channels              tiles
     // rows   output_channels          output_channels            input_channels
 
-    auto offset_v = b * batch_size * input_channels * kTiles;
-    auto offset_m = b * batch_size * output_channels * kTiles;
+    auto offset_v = b * batch_size * input_channels * tiles_;
+    auto offset_m = b * batch_size * output_channels * tiles_;
     cblas_sgemm(CblasColMajor,               // Row major format
                 CblasNoTrans,                // A no trans
                 CblasNoTrans,                // B no trans
                 (int)output_channels,        // rows W, M
-                (int)(batch_size * kTiles),  // cols V, M
+                (int)(batch_size * tiles_),  // cols V, M
                 (int)input_channels,         // cols W, rows V
                 1.0f,                        // alpha
                 &weights[offset_u],          // W
@@ -243,24 +364,30 @@ template <>
 void WinogradConvolution3<true>::Sgemm(const size_t batch_size,
                                        const float* weights,
                                        const size_t input_channels,
-                                       const size_t output_channels) {
-  for (size_t b = 0; b < kWinogradTile; b++) {
+                                       const size_t output_channels,
+                                       const PackedGemmWeights* packed) {
+  for (size_t b = 0; b < tile_size_; b++) {
     auto offset_u = b * output_channels * input_channels;
-    auto offset_v = b * batch_size * input_channels * kTiles;
-    auto offset_m = b * batch_size * output_channels * kTiles;
+    auto offset_v = b * batch_size * input_channels * tiles_;
+    auto offset_m = b * batch_size * output_channels * tiles_;
+    if (packed != nullptr) {
+      // Columns of V and M are the rows of the packed GEMM.
+      packed[b].Multiply(batch_size * tiles_, &V_[offset_v], &M_[offset_m]);
+      continue;
+    }
     auto C_mat = EigenMatrixMap<float>(&M_[offset_m], output_channels,
-                                       batch_size * kTiles);
+                                       batch_size * tiles_);
     C_mat.noalias() = ConstEigenMatrixMap<float>(
                           &weights[offset_u], output_channels, input_channels) *
                       ConstEigenMatrixMap<float>(&V_[offset_v], input_channels,
-                                                 batch_size * kTiles);
+                                                 batch_size * tiles_);
   }
 }
 
 template <bool use_eigen>
-void WinogradConvolution3<use_eigen>::TransformOut(const size_t batch_size,
-                                                   float* output,
-                                                   const size_t channels) {
+void WinogradConvolution3<use_eigen>::TransformOut(
+    const size_t batch_size, float* output, const size_t channels,
+    const ConvolutionEpilogue& epilogue) {
 #ifndef USE_ISPC
 
   float m[kWinogradTile];
@@ -315,16 +442,193 @@ void WinogradConvolution3<use_eigen>::TransformOut(const size_t batch_size,
           output_channel[(y + 1) * kWidth + (x + 1)] = o22;
         }
       }
+      ApplyEpilogue(epilogue, channels, batch_index, channel, 1, output);
+    }
+  }
+
+#else  // USE_ISPC
+
+  // The transform is vectorized across channels, so the epilogue runs once a
+  // whole sample is done.
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    ispc::winograd_TransformOut_ispc(batch_size, batch_index, &M_[0], channels,
+                                     output);
+    ApplyEpilogue(epilogue, channels, batch_index, 0, channels, output);
+  }
+
+#endif  // USE_ISPC
+}
+
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::TransformInF4(const size_t batch_size,
+                                                    const float* input,
+                                                    const size_t channels) {
+#ifndef USE_ISPC
+
+  const size_t V_incr = channels * kTilesF4 * batch_size;
+  float d[kWinogradAlphaF4][kWinogradAlphaF4];
+  float t[kWinogradAlphaF4][kWinogradAlphaF4];
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    for (size_t channel = 0; channel < channels; channel++) {
+      const float* input_channel =
+          input + (batch_index * channels + channel) * kSquares;
+      for (int block_y = 0; block_y < kWtilesF4; block_y++) {
+        for (int block_x = 0; block_x < kWtilesF4; block_x++) {
+          // Tiles overlap by 2
+          const int yin = 4 * block_y - 1;
+          const int xin = 4 * block_x - 1;
+          for (int i = 0; i < kWinogradAlphaF4; i++) {
+            for (int j = 0; j < kWinogradAlphaF4; j++) {
+              const int y = yin + i;
+              const int x = xin + j;
+              d[i][j] = y >= 0 && x >= 0 && y < kHeight && x < kWidth
+                            ? input_channel[y * kWidth + x]
+                            : 0.0f;
+            }
+          }
+
+          // Calculates transpose(B).d.B, columns then rows.
+          for (int j = 0; j < kWinogradAlphaF4; j++) {
+            InputTransformF4(&d[0][j], kWinogradAlphaF4, &t[0][j],
+                             kWinogradAlphaF4);
+          }
+          float* V_tile = &V_[channels * (kTilesF4 * batch_index +
+                                          block_y * kWtilesF4 + block_x) +
+                              channel];
+          for (int i = 0; i < kWinogradAlphaF4; i++) {
+            InputTransformF4(t[i], 1, V_tile + i * kWinogradAlphaF4 * V_incr,
+                             V_incr);
+          }
+        }
+      }
+    }
+  }
+
+#else  // USE_ISPC
+
+  ispc::winograd_TransformIn_f4_ispc(batch_size, input, channels, &V_[0]);
+
+#endif  // USE_ISPC
+}
+
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::TransformOutF4(
+    const size_t batch_size, float* output, const size_t channels,
+    const ConvolutionEpilogue& epilogue) {
+#ifndef USE_ISPC
+
+  const size_t M_incr = channels * kTilesF4 * batch_size;
+  float m[kWinogradTileF4];
+  float t[4][kWinogradAlphaF4];
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    for (size_t channel = 0; channel < channels; channel++) {
+      float* output_channel =
+          output + (batch_index * channels + channel) * kSquares;
+      for (int block_y = 0; block_y < kWtilesF4; block_y++) {
+        for (int block_x = 0; block_x < kWtilesF4; block_x++) {
+          const float* M_tile =
+              &M_[channels * (kTilesF4 * batch_index + block_y * kWtilesF4 +
+                              block_x) +
+                  channel];
+          for (int i = 0; i < kWinogradTileF4; i++) m[i] = M_tile[i * M_incr];
+
+          // Calculates transpose(A).m.A, columns then rows.
+          for (int j = 0; j < kWinogradAlphaF4; j++) {
+            OutputTransformF4(&m[j], kWinogradAlphaF4, &t[0][j],
+                              kWinogradAlphaF4);
+          }
+          for (int i = 0; i < 4; i++) {
+            OutputTransformF4(
+                t[i], 1,
+                output_channel + (4 * block_y + i) * kWidth + 4 * block_x, 1);
+          }
+        }
+      }
+      ApplyEpilogue(epilogue, channels, batch_index, channel, 1, output);
     }
   }
 
 #else  // USE_ISPC
 
-  ispc::winograd_TransformOut_ispc(batch_size, &M_[0], channels, output);
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    ispc::winograd_TransformOut_f4_ispc(batch_size, batch_index, &M_[0],
+                                        channels, output);
+    ApplyEpilogue(epilogue, channels, batch_index, 0, channels, output);
+  }
 
 #endif  // USE_ISPC
 }
 
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::Im2colForward(
+    const size_t batch_size, const size_t input_channels,
+    const size_t output_channels, const float* input, const float* weights,
+    float* output, const ConvolutionEpilogue& epilogue,
+    const PackedGemmWeights* packed) {
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    const float* input_batch = input + batch_index * kSquares * input_channels;
+    // V_ holds the [square][input channel][3][3] patches of the sample.
+    float* patch = &V_[0];
+    for (int y = 0; y < kHeight; y++) {
+      for (int x = 0; x < kWidth; x++) {
+        for (size_t c = 0; c < input_channels; c++) {
+          const float* plane = input_batch + c * kSquares;
+          for (int ky = y - 1; ky <= y + 1; ky++) {
+            for (int kx = x - 1; kx <= x + 1; kx++) {
+              *patch++ = ky >= 0 && kx >= 0 && ky < kHeight && kx < kWidth
+                             ? plane[ky * kWidth + kx]
+                             : 0.0f;
+            }
+          }
+        }
+      }
+    }
+    Im2colSgemm(input_channels, output_channels, weights,
+                output + batch_index * kSquares * output_channels, packed);
+    ApplyEpilogue(epilogue, output_channels, batch_index, 0, output_channels,
+                  output);
+  }
+}
+
+#ifdef USE_BLAS
+template <>
+void WinogradConvolution3<false>::Im2colSgemm(
+    const size_t input_channels, const size_t output_channels,
+    const float* weights, float* output, const PackedGemmWeights* /*packed*/) {
+  //            output         =        weights        x     transpose(V)
+  //
+  // cols      kSquares           input_channels * 9        kSquares
+  // rows   output_channels         output_channels     input_channels * 9
+  const int patch_size = static_cast<int>(input_channels * 9);
+  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, (int)output_channels,
+              kSquares, patch_size, 1.0f, weights, patch_size, &V_[0],
+              patch_size, 0.0f, output, kSquares);
+}
+#endif
+
+template <>
+void WinogradConvolution3<true>::Im2colSgemm(const size_t input_channels,
+                                             const size_t output_channels,
+                                             const float* weights,
+                                             float* output,
+                                             const PackedGemmWeights* packed) {
+  const size_t patch_size = input_channels * 9;
+  if (packed != nullptr) {
+    // The packed GEMM produces [square][output channel].
+    packed->Multiply(kSquares, &V_[0], &M_[0]);
+    for (size_t o = 0; o < output_channels; o++) {
+      for (int square = 0; square < kSquares; square++) {
+        output[o * kSquares + square] = M_[square * output_channels + o];
+      }
+    }
+    return;
+  }
+  auto C_mat = EigenMatrixMap<float>(output, kSquares, output_channels);
+  C_mat.noalias() =
+      ConstEigenMatrixMap<float>(&V_[0], patch_size, kSquares).transpose() *
+      ConstEigenMatrixMap<float>(weights, patch_size, output_channels);
+}
+
 template class WinogradConvolution3<true>;
 #ifdef USE_BLAS
 template class WinogradConvolution3<false>;
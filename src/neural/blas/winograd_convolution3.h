@@ -21,8 +21,37 @@
 #include <cstddef>
 #include <vector>
 
+#include "neural/shared/activation.h"
+#include "neural/shared/packed_gemm.h"
+
 namespace lczero {
 
+// Work done on every output plane of a convolution right after its output
+// transform, while the plane is still in cache.
+struct ConvolutionEpilogue {
+  // Per output channel biases, nullptr for none.
+  const float* biases = nullptr;
+  // If set, the biased output is added to these planes in place, as
+  // BiasResidual() does. Requires @biases.
+  float* residual = nullptr;
+  ActivationFunction activation = ACTIVATION_NONE;
+  // If set, receives the average of every output plane, before the biases.
+  float* averages = nullptr;
+};
+
+// Algorithms for the 3x3 convolutions, picked at network load. Each needs its
+// own preparation of the weights, see PrepareWeights().
+enum class Convolution3Algorithm {
+  // Winograd F(2x2, 3x3): 16 GEMMs over 16 tiles per board.
+  kWinogradF2,
+  // Winograd F(4x4, 3x3): 36 GEMMs over 4 tiles per board. 44% fewer
+  // multiplications than F(2x2, 3x3), but more expensive transforms.
+  kWinogradF4,
+  // The 3x3 patches of every square unrolled into a matrix (im2col), one
+  // GEMM with the untransformed weights per sample.
+  kIm2col,
+};
+
 // Convolution 3x3 on a 8x8 board using the Winograd algorithm.
 //
 // Ref:
@@ -33,31 +62,63 @@ namespace lczero {
 // https://ai.intel.com/winograd/
 // https://ai.intel.com/winograd-2/
 
-// Convolution 3x3 using the Winograd algorithm
+// Convolution 3x3 using the Winograd algorithm, or im2col for comparison.
 template <bool use_eigen>
 class WinogradConvolution3 {
  public:
   // The instance will allocate memory resources for the
   // largest batch size, and the largest input and output
   // layers.
-  WinogradConvolution3(const size_t max_batch_size,
-                       const size_t max_input_layers,
-                       const size_t max_output_layers);
-
-  // Forward inference, batched.
+  WinogradConvolution3(
+      const size_t max_batch_size, const size_t max_input_layers,
+      const size_t max_output_layers,
+      Convolution3Algorithm algorithm = Convolution3Algorithm::kWinogradF2);
+
+  // Forward inference, batched. @weights are prepared for the algorithm of
+  // the instance. If set, @packed holds the GemmCount() weight matrices
+  // pre-packed for the Eigen version.
   void Forward(const size_t batch_size, const size_t input_channels,
                const size_t output_channels, const float* input,
-               const float* weights, float* output);
+               const float* weights, float* output,
+               const ConvolutionEpilogue& epilogue = {},
+               const PackedGemmWeights* packed = nullptr);
+
+  // Prepares the [outputs][channels][3][3] @weights for @algorithm: the
+  // transformed filter tiles as GemmCount() matrices of outputs x channels
+  // (column major) for Winograd, as is for im2col.
+  static std::vector<float> PrepareWeights(Convolution3Algorithm algorithm,
+                                           const std::vector<float>& weights,
+                                           size_t outputs, size_t channels);
+
+  static size_t GemmCount(Convolution3Algorithm algorithm);
 
  private:
   void TransformIn(const size_t batch_size, const float* input,
                    const size_t channels);
+  void TransformInF4(const size_t batch_size, const float* input,
+                     const size_t channels);
 
   void Sgemm(const size_t batch_size, const float* weights,
-             const size_t input_channels, const size_t output_channels);
+             const size_t input_channels, const size_t output_channels,
+             const PackedGemmWeights* packed);
 
   void TransformOut(const size_t batch_size, float* output,
-                    const size_t channels);
+                    const size_t channels, const ConvolutionEpilogue& epilogue);
+  void TransformOutF4(const size_t batch_size, float* output,
+                      const size_t channels,
+                      const ConvolutionEpilogue& epilogue);
+
+  void Im2colForward(const size_t batch_size, const size_t input_channels,
+                     const size_t output_channels, const float* input,
+                     const float* weights, float* output,
+                     const ConvolutionEpilogue& epilogue,
+                     const PackedGemmWeights* packed);
+
+  // Multiplies the @output_channels x (@input_channels * 9) @weights with the
+  // patches of one sample in V_.
+  void Im2colSgemm(const size_t input_channels, const size_t output_channels,
+                   const float* weights, float* output,
+                   const PackedGemmWeights* packed);
 
   static constexpr auto kWidth = 8;
   static constexpr auto kHeight = 8;
@@ -69,6 +130,18 @@ class WinogradConvolution3 {
   static constexpr auto kWinogradAlpha = 4;
   static constexpr auto kWinogradTile = kWinogradAlpha * kWinogradAlpha;
 
+  // The same for F(4x4, 3x3).
+  static constexpr auto kWtilesF4 = 2;
+  static constexpr auto kTilesF4 = kWtilesF4 * kWtilesF4;  // 4
+  static constexpr auto kWinogradAlphaF4 = 6;
+  static constexpr auto kWinogradTileF4 =
+      kWinogradAlphaF4 * kWinogradAlphaF4;  // 36
+
+  const Convolution3Algorithm algorithm_;
+  // Tiles per board and transformed tile size of the Winograd algorithm.
+  const size_t tiles_;
+  const size_t tile_size_;
+
   std::vector<float> V_;
   std::vector<float> M_;
 };
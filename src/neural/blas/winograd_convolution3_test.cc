@@ -0,0 +1,150 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/blas/winograd_convolution3.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "neural/shared/packed_gemm.h"
+
+namespace lczero {
+
+namespace {
+constexpr size_t kBatchSize = 3;
+constexpr size_t kInputs = 10;
+constexpr size_t kOutputs = 7;
+
+// Direct 3x3 convolution with zero padding, [batch][channel][8][8] planes.
+std::vector<float> Reference(const std::vector<float>& input,
+                             const std::vector<float>& weights) {
+  std::vector<float> output(kBatchSize * kOutputs * 64);
+  for (size_t b = 0; b < kBatchSize; b++) {
+    for (size_t o = 0; o < kOutputs; o++) {
+      for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+          double sum = 0;
+          for (size_t c = 0; c < kInputs; c++) {
+            for (int ky = 0; ky < 3; ky++) {
+              for (int kx = 0; kx < 3; kx++) {
+                const int iy = y + ky - 1;
+                const int ix = x + kx - 1;
+                if (iy < 0 || iy >= 8 || ix < 0 || ix >= 8) continue;
+                sum += input[((b * kInputs + c) * 8 + iy) * 8 + ix] *
+                       weights[((o * kInputs + c) * 3 + ky) * 3 + kx];
+              }
+            }
+          }
+          output[((b * kOutputs + o) * 8 + y) * 8 + x] = sum;
+        }
+      }
+    }
+  }
+  return output;
+}
+
+template <bool use_eigen>
+void CheckAlgorithm(Convolution3Algorithm algorithm, bool prepack) {
+  using Convolution = WinogradConvolution3<use_eigen>;
+  std::mt19937 gen(42);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> weights(kOutputs * kInputs * 9);
+  for (auto& x : weights) x = dist(gen) * 0.2f;
+  std::vector<float> input(kBatchSize * kInputs * 64);
+  for (auto& x : input) x = dist(gen);
+  std::vector<float> biases(kOutputs);
+  for (auto& x : biases) x = dist(gen);
+
+  const auto prepared =
+      Convolution::PrepareWeights(algorithm, weights, kOutputs, kInputs);
+  std::vector<PackedGemmWeights> packed;
+  if (prepack) {
+    const size_t gemms = Convolution::GemmCount(algorithm);
+    const size_t inputs = prepared.size() / gemms / kOutputs;
+    for (size_t g = 0; g < gemms; g++) {
+      packed.emplace_back(
+          inputs, kOutputs, prepared.data() + g * inputs * kOutputs,
+          algorithm == Convolution3Algorithm::kIm2col
+              ? PackedGemmWeights::Layout::kOutputMajor
+              : PackedGemmWeights::Layout::kInputMajor);
+    }
+  }
+
+  ConvolutionEpilogue epilogue;
+  epilogue.biases = biases.data();
+  epilogue.activation = ACTIVATION_RELU;
+  std::vector<float> averages(kBatchSize * kOutputs);
+  epilogue.averages = averages.data();
+
+  Convolution convolution(kBatchSize, kInputs, kOutputs, algorithm);
+  std::vector<float> output(kBatchSize * kOutputs * 64);
+  convolution.Forward(kBatchSize, kInputs, kOutputs, input.data(),
+                      prepared.data(), output.data(), epilogue,
+                      packed.empty() ? nullptr : packed.data());
+
+  const auto expected = Reference(input, weights);
+  for (size_t p = 0; p < kBatchSize * kOutputs; p++) {
+    double average = 0;
+    for (size_t i = 0; i < 64; i++) {
+      const float raw = expected[p * 64 + i];
+      average += raw;
+      ASSERT_NEAR(std::max(0.0f, raw + biases[p % kOutputs]),
+                  output[p * 64 + i], 1e-3)
+          << "plane " << p << " square " << i;
+    }
+    EXPECT_NEAR(average / 64, averages[p], 1e-3) << "plane " << p;
+  }
+}
+}  // namespace
+
+TEST(WinogradConvolution3, WinogradF2MatchesReference) {
+  CheckAlgorithm<false>(Convolution3Algorithm::kWinogradF2, false);
+  CheckAlgorithm<true>(Convolution3Algorithm::kWinogradF2, false);
+  CheckAlgorithm<true>(Convolution3Algorithm::kWinogradF2, true);
+}
+
+TEST(WinogradConvolution3, WinogradF4MatchesReference) {
+  CheckAlgorithm<false>(Convolution3Algorithm::kWinogradF4, false);
+  CheckAlgorithm<true>(Convolution3Algorithm::kWinogradF4, false);
+  CheckAlgorithm<true>(Convolution3Algorithm::kWinogradF4, true);
+}
+
+TEST(WinogradConvolution3, Im2colMatchesReference) {
+  CheckAlgorithm<false>(Convolution3Algorithm::kIm2col, false);
+  CheckAlgorithm<true>(Convolution3Algorithm::kIm2col, false);
+  CheckAlgorithm<true>(Convolution3Algorithm::kIm2col, true);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
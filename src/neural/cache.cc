@@ -29,6 +29,12 @@
 #include <iostream>
 
 namespace lczero {
+NNCache::MemoryUsage GetNNCacheMemoryUsage(const NNCache& cache) {
+  return cache.GetMemoryUsage([](const CachedNNRequest& request) {
+    return request.p.size() * sizeof(CachedNNRequest::IdxAndProb);
+  });
+}
+
 CachingComputation::CachingComputation(
     std::unique_ptr<NetworkComputation> parent, NNCache* cache)
     : parent_(std::move(parent)), cache_(cache) {}
@@ -68,7 +74,8 @@ void CachingComputation::AddInput(
   batch_.back().hash = hash;
   batch_.back().idx_in_parent = parent_->GetBatchSize();
   batch_.back().probabilities_to_cache = probabilities_to_cache;
-  parent_->AddInput(std::move(input));
+  parent_->AddInputWithMoves(std::move(input),
+                             batch_.back().probabilities_to_cache);
 }
 
 void CachingComputation::PopLastInputHit() {
@@ -45,6 +45,9 @@ struct CachedNNRequest {
 typedef HashKeyedCache<CachedNNRequest> NNCache;
 typedef HashKeyedCacheLock<CachedNNRequest> NNCacheLock;
 
+// Returns the bytes used by @cache, including the policy arrays of entries.
+NNCache::MemoryUsage GetNNCacheMemoryUsage(const NNCache& cache);
+
 // Wraps around NetworkComputation and caches result.
 // While it mostly repeats NetworkComputation interface, it's not derived
 // from it, as AddInput() needs hash and index of probabilities to store.
@@ -0,0 +1,81 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "benchmark/microbench.h"
+#include "neural/cache.h"
+
+namespace lczero {
+namespace {
+
+constexpr int kCapacity = 200000;
+// Typical number of legal moves stored per entry.
+constexpr size_t kPolicySize = 32;
+
+// Every thread does @iterations lookups, inserting on a miss like the search
+// does. Keys cover twice the capacity, so about half of the lookups miss and
+// evict an older entry. The result is the time per operation of one thread.
+void LookupOrInsert(int threads, size_t iterations) {
+  NNCache cache(kCapacity);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&cache, iterations, t]() {
+      std::mt19937_64 gen(t);
+      for (size_t n = 0; n < iterations; n++) {
+        const uint64_t key = gen() % (2 * kCapacity);
+        {
+          NNCacheLock lock(&cache, key);
+          if (lock) {
+            DoNotOptimize(lock->q);
+            continue;
+          }
+        }
+        auto entry = std::make_unique<CachedNNRequest>(kPolicySize);
+        entry->q = 0.0f;
+        entry->d = 0.0f;
+        entry->m = 0.0f;
+        cache.Insert(key, std::move(entry));
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+}
+
+void OneThread(size_t iterations) { LookupOrInsert(1, iterations); }
+void FourThreads(size_t iterations) { LookupOrInsert(4, iterations); }
+void SixteenThreads(size_t iterations) { LookupOrInsert(16, iterations); }
+
+}  // namespace
+
+REGISTER_MICROBENCH("NNCache/lookup_or_insert/1_thread", OneThread)
+REGISTER_MICROBENCH("NNCache/lookup_or_insert/4_threads", FourThreads)
+REGISTER_MICROBENCH("NNCache/lookup_or_insert/16_threads", SixteenThreads)
+
+}  // namespace lczero
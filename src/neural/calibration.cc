@@ -0,0 +1,159 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/calibration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "chess/position.h"
+#include "neural/encoder.h"
+#include "utils/exception.h"
+
+namespace lczero {
+namespace {
+
+// Openings, middlegames and endgames, used when no calibration file is given.
+const char* kCalibrationFens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+    "r1bq1rk1/ppp1bppp/2n2n2/3pp3/2PP4/2N1PN2/PP2BPPP/R1BQK2R w KQ - 0 7",
+    "r2q1rk1/1b1nbppp/p2ppn2/1p6/3NPP2/1BN1B3/PPP1Q1PP/R4RK1 b - - 3 12",
+    "2rq1rk1/pp1bppbp/3p1np1/4n3/3NP3/1BN1BP2/PPPQ2PP/2KR3R w - - 7 13",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "3r1rk1/p4ppp/1pn1p3/2p5/2P1P3/P1B2P2/4KPPP/3R3R w - - 0 21",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4kpp1/3p1b2/p6P/2B5/6P1/6K1 b - - 0 47",
+    "6k1/5pp1/7p/8/8/6P1/5PKP/3r4 w - - 0 40",
+    "r1b2rk1/2q1b1pp/p2ppn2/1p6/3QP3/1BN1B3/PPP3PP/R4RK1 w - - 0 1",
+};
+
+}  // namespace
+
+std::vector<CalibrationPosition> LoadCalibrationPositions(
+    const std::string& fen_file,
+    pblczero::NetworkFormat::InputFormat input_format) {
+  std::vector<std::string> fens;
+  if (fen_file.empty()) {
+    fens.assign(std::begin(kCalibrationFens), std::end(kCalibrationFens));
+  } else {
+    std::ifstream file(fen_file);
+    if (!file) throw Exception("Cannot open calibration file " + fen_file);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (!line.empty()) fens.push_back(line);
+    }
+    if (fens.empty()) throw Exception("No positions in " + fen_file);
+  }
+
+  std::vector<CalibrationPosition> positions;
+  for (const auto& fen : fens) {
+    ChessBoard board;
+    int rule50_ply;
+    int moves;
+    board.SetFromFen(fen, &rule50_ply, &moves);
+    PositionHistory history;
+    history.Reset(board, rule50_ply, moves * 2 - (board.flipped() ? 1 : 2));
+    int transform;
+    CalibrationPosition position;
+    position.planes = EncodePositionForNN(
+        input_format, history, 8, FillEmptyHistory::FEN_ONLY, &transform);
+    for (auto move : board.GenerateLegalMoves()) {
+      position.legal_moves.push_back(move.as_nn_index(transform));
+    }
+    positions.push_back(std::move(position));
+  }
+  return positions;
+}
+
+std::vector<CalibrationOutput> EvaluateCalibrationPositions(
+    Network* network, const std::vector<CalibrationPosition>& positions) {
+  auto computation = network->NewComputation();
+  for (const auto& position : positions) {
+    InputPlanes planes = position.planes;
+    computation->AddInput(std::move(planes));
+  }
+  computation->ComputeBlocking();
+  std::vector<CalibrationOutput> outputs(positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    outputs[i].q = computation->GetQVal(i);
+    auto& policy = outputs[i].policy;
+    for (auto index : positions[i].legal_moves) {
+      policy.push_back(computation->GetPVal(i, index));
+    }
+    if (policy.empty()) continue;
+    const float max = *std::max_element(policy.begin(), policy.end());
+    float sum = 0.0f;
+    for (auto& p : policy) {
+      p = std::exp(p - max);
+      sum += p;
+    }
+    for (auto& p : policy) p /= sum;
+  }
+  return outputs;
+}
+
+std::string CalibrationError::ToString() const {
+  std::ostringstream out;
+  out << "Q error max " << max_q << " mean " << mean_q << ", policy error max "
+      << max_policy << " mean " << mean_policy << ", same best move in "
+      << same_best_move << "/" << positions;
+  return out.str();
+}
+
+CalibrationError CompareCalibrationOutputs(
+    const std::vector<CalibrationOutput>& reference,
+    const std::vector<CalibrationOutput>& outputs) {
+  CalibrationError error;
+  error.positions = reference.size();
+  size_t moves = 0;
+  for (size_t i = 0; i < reference.size(); i++) {
+    const float q = std::abs(reference[i].q - outputs[i].q);
+    error.max_q = std::max(error.max_q, q);
+    error.mean_q += q;
+    const auto& a = reference[i].policy;
+    const auto& b = outputs[i].policy;
+    for (size_t j = 0; j < a.size(); j++) {
+      error.max_policy = std::max(error.max_policy, std::abs(a[j] - b[j]));
+      error.mean_policy += std::abs(a[j] - b[j]);
+    }
+    moves += a.size();
+    if (std::max_element(a.begin(), a.end()) - a.begin() ==
+        std::max_element(b.begin(), b.end()) - b.begin()) {
+      error.same_best_move++;
+    }
+  }
+  error.mean_q /= std::max<size_t>(reference.size(), 1);
+  error.mean_policy /= std::max<size_t>(moves, 1);
+  return error;
+}
+
+}  // namespace lczero
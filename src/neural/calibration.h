@@ -0,0 +1,78 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "neural/network.h"
+#include "proto/net.pb.h"
+
+namespace lczero {
+
+// A position to measure a network on, with the policy indices of its legal
+// moves.
+struct CalibrationPosition {
+  InputPlanes planes;
+  std::vector<uint16_t> legal_moves;
+};
+
+// Encodes the positions of @fen_file, one FEN per line, for @input_format. An
+// empty @fen_file gives built in openings, middlegames and endgames.
+std::vector<CalibrationPosition> LoadCalibrationPositions(
+    const std::string& fen_file,
+    pblczero::NetworkFormat::InputFormat input_format);
+
+// Q and the policy over the legal moves of a position.
+struct CalibrationOutput {
+  float q;
+  std::vector<float> policy;
+};
+
+// Evaluates @positions in one batch of @network.
+std::vector<CalibrationOutput> EvaluateCalibrationPositions(
+    Network* network, const std::vector<CalibrationPosition>& positions);
+
+// How far the outputs of an approximated network are from the reference ones.
+struct CalibrationError {
+  float max_q = 0.0f;
+  float mean_q = 0.0f;
+  float max_policy = 0.0f;
+  float mean_policy = 0.0f;
+  size_t same_best_move = 0;
+  size_t positions = 0;
+
+  std::string ToString() const;
+};
+
+CalibrationError CompareCalibrationOutputs(
+    const std::vector<CalibrationOutput>& reference,
+    const std::vector<CalibrationOutput>& outputs);
+
+}  // namespace lczero
@@ -0,0 +1,75 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "benchmark/microbench.h"
+#include "chess/position.h"
+#include "neural/encoder.h"
+
+namespace lczero {
+namespace {
+
+// A game that is long enough to fill all history planes.
+PositionHistory MakeHistory() {
+  PositionHistory history;
+  ChessBoard board;
+  board.SetFromFen(ChessBoard::kStartposFen);
+  history.Reset(board, 0, 1);
+  for (const char* move : {"e2e4", "c7c5", "g1f3", "d7d6", "d2d4", "c5d4",
+                           "f3d4", "g8f6", "b1c3", "a7a6", "c1e3", "e7e5"}) {
+    history.Append(Move(move, history.IsBlackToMove()));
+  }
+  return history;
+}
+
+template <pblczero::NetworkFormat::InputFormat kFormat>
+void Encode(size_t iterations) {
+  const auto history = MakeHistory();
+  for (size_t n = 0; n < iterations; n++) {
+    const auto planes = EncodePositionForNN(
+        kFormat, history, 8, FillEmptyHistory::FEN_ONLY, nullptr);
+    DoNotOptimize(planes[n % planes.size()].mask);
+  }
+}
+
+}  // namespace
+
+REGISTER_MICROBENCH("EncodePositionForNN/classical",
+                    Encode<pblczero::NetworkFormat::INPUT_CLASSICAL_112_PLANE>)
+REGISTER_MICROBENCH(
+    "EncodePositionForNN/castling_plane",
+    Encode<pblczero::NetworkFormat::INPUT_112_WITH_CASTLING_PLANE>)
+REGISTER_MICROBENCH(
+    "EncodePositionForNN/canonicalization",
+    Encode<pblczero::NetworkFormat::INPUT_112_WITH_CANONICALIZATION>)
+REGISTER_MICROBENCH(
+    "EncodePositionForNN/hectoplies",
+    Encode<pblczero::NetworkFormat::INPUT_112_WITH_CANONICALIZATION_HECTOPLIES>)
+REGISTER_MICROBENCH(
+    "EncodePositionForNN/canonicalization_v2",
+    Encode<pblczero::NetworkFormat::INPUT_112_WITH_CANONICALIZATION_V2>)
+
+}  // namespace lczero
@@ -48,6 +48,10 @@ const OptionId NetworkFactory::kBackendOptionsId{
     "Parameters of neural network backend. "
     "Exact parameters differ per backend.",
     'o'};
+const OptionId NetworkFactory::kWeightsCacheId{
+    "weights-cache", "WeightsCache",
+    "Keep decompressed network weights in the user cache directory, so that "
+    "later loads of the same network are faster."};
 const char* kAutoDiscover = "<autodiscover>";
 const char* kEmbed = "<built in>";
 
@@ -71,6 +75,7 @@ void NetworkFactory::PopulateOptions(OptionsParser* options) {
   options->Add<ChoiceOption>(NetworkFactory::kBackendId, backends) =
       backends.empty() ? "<none>" : backends[0];
   options->Add<StringOption>(NetworkFactory::kBackendOptionsId);
+  options->Add<BoolOption>(NetworkFactory::kWeightsCacheId) = false;
 }
 
 void NetworkFactory::RegisterNetwork(const std::string& name,
@@ -125,7 +130,8 @@ std::unique_ptr<Network> NetworkFactory::LoadNetwork(
   }
   std::optional<WeightsFile> weights;
   if (!net_path.empty()) {
-    weights = LoadWeightsFromFile(net_path);
+    weights =
+        LoadWeightsFromFile(net_path, options.Get<bool>(kWeightsCacheId));
   }
 
   OptionsDict network_options(&options);
@@ -74,6 +74,7 @@ class NetworkFactory {
   static const OptionId kWeightsId;
   static const OptionId kBackendId;
   static const OptionId kBackendOptionsId;
+  static const OptionId kWeightsCacheId;
 
   struct BackendConfiguration {
     BackendConfiguration() = default;
@@ -34,9 +34,12 @@
 #include <cctype>
 #include <cstdio>
 #include <fstream>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 
+#include "neural/weights_cache.h"
 #include "proto/net.pb.h"
 #include "utils/commandline.h"
 #include "utils/exception.h"
@@ -142,7 +145,7 @@ void FixOlderWeightsFile(WeightsFile* file) {
   }
 }
 
-WeightsFile ParseWeightsProto(const std::string& buffer) {
+WeightsFile ParseWeightsProto(std::string_view buffer) {
   WeightsFile net;
   net.ParseFromString(buffer);
 
@@ -176,8 +179,14 @@ WeightsFile ParseWeightsProto(const std::string& buffer) {
 
 }  // namespace
 
-WeightsFile LoadWeightsFromFile(const std::string& filename) {
-  FloatVectors vecs;
+WeightsFile LoadWeightsFromFile(const std::string& filename, bool use_cache) {
+  std::optional<uint64_t> source_hash;
+  if (use_cache) source_hash = HashWeightsSource(filename);
+  if (source_hash) {
+    if (const auto proto = LoadCachedWeightsProto(*source_hash)) {
+      return ParseWeightsProto(*proto);
+    }
+  }
   auto buffer = DecompressGzip(filename);
 
   if (buffer.size() < 2) {
@@ -192,7 +201,9 @@ WeightsFile LoadWeightsFromFile(const std::string& filename) {
         "tool to convert it to the new format.");
   }
 
-  return ParseWeightsProto(buffer);
+  auto net = ParseWeightsProto(buffer);
+  if (source_hash) WriteWeightsCache(*source_hash, buffer);
+  return net;
 }
 
 std::string DiscoverWeightsFile() {
@@ -40,8 +40,11 @@ using FloatVectors = std::vector<FloatVector>;
 
 using WeightsFile = pblczero::Net;
 
-// Read weights file and fill the weights structure.
-WeightsFile LoadWeightsFromFile(const std::string& filename);
+// Read weights file and fill the weights structure. With @use_cache, the
+// decompressed weights are kept in a cache file in the user cache directory
+// and used on later loads of the same file.
+WeightsFile LoadWeightsFromFile(const std::string& filename,
+                                bool use_cache = false);
 
 // Tries to find a file which looks like a weights file, and located in
 // directory of binary_name or one of subdirectories. If there are several such
@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -57,6 +58,13 @@ class NetworkComputation {
  public:
   // Adds a sample to the batch.
   virtual void AddInput(InputPlanes&& input) = 0;
+  // Adds a sample to the batch, along with the policy indices (@moves) that
+  // will be queried with GetPVal(). Backends may compute only those, the other
+  // policy values are then undefined. Empty @moves means all of them.
+  virtual void AddInputWithMoves(InputPlanes&& input,
+                                 const std::vector<uint16_t>& /*moves*/) {
+    AddInput(std::move(input));
+  }
   // Do the computation.
   virtual void ComputeBlocking() = 0;
   // Returns how many times AddInput() was called.
@@ -110,6 +118,9 @@ class Network {
   virtual void InitThread(int /*id*/) {}
   virtual bool IsCpu() const { return false; }
   virtual int GetMiniBatchSize() const { return 256; }
+  // Returns the bytes of scratch and I/O buffers the backend currently holds,
+  // or 0 if it doesn't keep track. Weights are not included.
+  virtual size_t GetBufferBytes() const { return 0; }
   virtual ~Network() = default;
 };
 
@@ -366,6 +366,10 @@ class CheckNetwork : public Network {
     return capabilities_;
   }
 
+  size_t GetBufferBytes() const override {
+    return work_net_->GetBufferBytes() + check_net_->GetBufferBytes();
+  }
+
  private:
   CheckParams params_;
 
@@ -40,7 +40,15 @@ class DemuxingComputation : public NetworkComputation {
  public:
   DemuxingComputation(DemuxingNetwork* network) : network_(network) {}
 
-  void AddInput(InputPlanes&& input) override { planes_.emplace_back(input); }
+  void AddInput(InputPlanes&& input) override {
+    AddInputWithMoves(std::move(input), {});
+  }
+
+  void AddInputWithMoves(InputPlanes&& input,
+                         const std::vector<uint16_t>& moves) override {
+    planes_.emplace_back(input);
+    moves_.emplace_back(moves);
+  }
 
   void ComputeBlocking() override;
 
@@ -84,13 +92,14 @@ class DemuxingComputation : public NetworkComputation {
     const int cur_idx = (parents_.size() - 1) * partial_size_;
     for (int i = cur_idx; i < std::min(GetBatchSize(), cur_idx + partial_size_);
          i++) {
-      parents_.back()->AddInput(std::move(planes_[i]));
+      parents_.back()->AddInputWithMoves(std::move(planes_[i]), moves_[i]);
     }
     return parents_.back().get();
   }
 
  private:
   std::vector<InputPlanes> planes_;
+  std::vector<std::vector<uint16_t>> moves_;
   DemuxingNetwork* network_;
   std::vector<std::unique_ptr<NetworkComputation>> parents_;
 
@@ -160,6 +169,12 @@ class DemuxingNetwork : public Network {
 
   bool IsCpu() const override { return is_cpu_; }
 
+  size_t GetBufferBytes() const override {
+    size_t bytes = 0;
+    for (const auto& network : networks_) bytes += network->GetBufferBytes();
+    return bytes;
+  }
+
   void Enqueue(DemuxingComputation* computation) {
     std::lock_guard<std::mutex> lock(mutex_);
     queue_.push(computation);
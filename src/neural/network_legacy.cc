@@ -28,7 +28,8 @@ namespace {
 static constexpr float kEpsilon = 1e-5f;
 }  // namespace
 
-LegacyWeights::LegacyWeights(const pblczero::Weights& weights)
+template <typename VecT>
+BasicLegacyWeights<VecT>::BasicLegacyWeights(const pblczero::Weights& weights)
     : input(weights.input()),
       ip_emb_w(LayerAdapter(weights.ip_emb_w()).as_vector()),
       ip_emb_b(LayerAdapter(weights.ip_emb_b()).as_vector()),
@@ -72,19 +73,24 @@ LegacyWeights::LegacyWeights(const pblczero::Weights& weights)
   }
 }
 
-LegacyWeights::SEunit::SEunit(const pblczero::Weights::SEunit& se)
+template <typename VecT>
+BasicLegacyWeights<VecT>::SEunit::SEunit(const pblczero::Weights::SEunit& se)
     : w1(LayerAdapter(se.w1()).as_vector()),
       b1(LayerAdapter(se.b1()).as_vector()),
       w2(LayerAdapter(se.w2()).as_vector()),
       b2(LayerAdapter(se.b2()).as_vector()) {}
 
-LegacyWeights::Residual::Residual(const pblczero::Weights::Residual& residual)
+template <typename VecT>
+BasicLegacyWeights<VecT>::Residual::Residual(
+    const pblczero::Weights::Residual& residual)
     : conv1(residual.conv1()),
       conv2(residual.conv2()),
       se(residual.se()),
       has_se(residual.has_se()) {}
 
-LegacyWeights::ConvBlock::ConvBlock(const pblczero::Weights::ConvBlock& block)
+template <typename VecT>
+BasicLegacyWeights<VecT>::ConvBlock::ConvBlock(
+    const pblczero::Weights::ConvBlock& block)
     : weights(LayerAdapter(block.weights()).as_vector()),
       biases(LayerAdapter(block.biases()).as_vector()),
       bn_gammas(LayerAdapter(block.bn_gammas()).as_vector()),
@@ -141,7 +147,8 @@ LegacyWeights::ConvBlock::ConvBlock(const pblczero::Weights::ConvBlock& block)
   bn_gammas.clear();
 }
 
-LegacyWeights::MHA::MHA(const pblczero::Weights::MHA& mha)
+template <typename VecT>
+BasicLegacyWeights<VecT>::MHA::MHA(const pblczero::Weights::MHA& mha)
     : q_w(LayerAdapter(mha.q_w()).as_vector()),
       q_b(LayerAdapter(mha.q_b()).as_vector()),
       k_w(LayerAdapter(mha.k_w()).as_vector()),
@@ -153,13 +160,15 @@ LegacyWeights::MHA::MHA(const pblczero::Weights::MHA& mha)
       smolgen(Smolgen(mha.smolgen())),
       has_smolgen(mha.has_smolgen()) {}
 
-LegacyWeights::FFN::FFN(const pblczero::Weights::FFN& ffn)
+template <typename VecT>
+BasicLegacyWeights<VecT>::FFN::FFN(const pblczero::Weights::FFN& ffn)
     : dense1_w(LayerAdapter(ffn.dense1_w()).as_vector()),
       dense1_b(LayerAdapter(ffn.dense1_b()).as_vector()),
       dense2_w(LayerAdapter(ffn.dense2_w()).as_vector()),
       dense2_b(LayerAdapter(ffn.dense2_b()).as_vector()) {}
 
-LegacyWeights::EncoderLayer::EncoderLayer(
+template <typename VecT>
+BasicLegacyWeights<VecT>::EncoderLayer::EncoderLayer(
     const pblczero::Weights::EncoderLayer& encoder)
     : mha(MHA(encoder.mha())),
       ln1_gammas(LayerAdapter(encoder.ln1_gammas()).as_vector()),
@@ -168,7 +177,8 @@ LegacyWeights::EncoderLayer::EncoderLayer(
       ln2_gammas(LayerAdapter(encoder.ln2_gammas()).as_vector()),
       ln2_betas(LayerAdapter(encoder.ln2_betas()).as_vector()) {}
 
-LegacyWeights::Smolgen::Smolgen(
+template <typename VecT>
+BasicLegacyWeights<VecT>::Smolgen::Smolgen(
     const pblczero::Weights::Smolgen& smolgen)
     : compress(LayerAdapter(smolgen.compress()).as_vector()),
       dense1_w(LayerAdapter(smolgen.dense1_w()).as_vector()),
@@ -180,4 +190,6 @@ LegacyWeights::Smolgen::Smolgen(
       ln2_gammas(LayerAdapter(smolgen.ln2_gammas()).as_vector()),
       ln2_betas(LayerAdapter(smolgen.ln2_betas()).as_vector()) {}
 
+template struct BasicLegacyWeights<std::vector<float>>;
+
 }  // namespace lczero
@@ -24,11 +24,18 @@
 
 namespace lczero {
 
-struct LegacyWeights {
-  explicit LegacyWeights(const pblczero::Weights& weights);
-
-  using Vec = std::vector<float>;
+// Network weights decoded to floats. @VecT is std::vector<float> for the
+// weights decoded from the protobuf (LegacyWeights), and may be a read-only
+// view type for weights that live elsewhere, e.g. in a shared mapping. Only
+// the std::vector<float> version can be constructed from the protobuf.
+template <typename VecT>
+struct BasicLegacyWeights {
+  BasicLegacyWeights() = default;
+  explicit BasicLegacyWeights(const pblczero::Weights& weights);
+
+  using Vec = VecT;
   struct ConvBlock {
+    ConvBlock() = default;
     explicit ConvBlock(const pblczero::Weights::ConvBlock& block);
 
     Vec weights;
@@ -40,6 +47,7 @@ struct LegacyWeights {
   };
 
   struct SEunit {
+    SEunit() = default;
     explicit SEunit(const pblczero::Weights::SEunit& se);
     Vec w1;
     Vec b1;
@@ -48,6 +56,7 @@ struct LegacyWeights {
   };
 
   struct Residual {
+    Residual() = default;
     explicit Residual(const pblczero::Weights::Residual& residual);
     ConvBlock conv1;
     ConvBlock conv2;
@@ -56,6 +65,7 @@ struct LegacyWeights {
   };
 
   struct Smolgen {
+    Smolgen() = default;
     explicit Smolgen(const pblczero::Weights::Smolgen& smolgen);
     Vec compress;
     Vec dense1_w;
@@ -69,6 +79,7 @@ struct LegacyWeights {
   };
 
   struct MHA {
+    MHA() = default;
     explicit MHA(const pblczero::Weights::MHA& mha);
     Vec q_w;
     Vec q_b;
@@ -83,6 +94,7 @@ struct LegacyWeights {
   };
 
   struct FFN {
+    FFN() = default;
     explicit FFN(const pblczero::Weights::FFN& mha);
     Vec dense1_w;
     Vec dense1_b;
@@ -91,6 +103,7 @@ struct LegacyWeights {
   };
 
   struct EncoderLayer {
+    EncoderLayer() = default;
     explicit EncoderLayer(const pblczero::Weights::EncoderLayer& encoder);
     MHA mha;
     Vec ln1_gammas;
@@ -158,4 +171,7 @@ struct LegacyWeights {
   bool has_smolgen;
 };
 
+using LegacyWeights = BasicLegacyWeights<std::vector<float>>;
+extern template struct BasicLegacyWeights<std::vector<float>>;
+
 }  // namespace lczero
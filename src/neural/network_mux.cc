@@ -40,7 +40,15 @@ class MuxingComputation : public NetworkComputation {
  public:
   MuxingComputation(MuxingNetwork* network) : network_(network) {}
 
-  void AddInput(InputPlanes&& input) override { planes_.emplace_back(input); }
+  void AddInput(InputPlanes&& input) override {
+    AddInputWithMoves(std::move(input), {});
+  }
+
+  void AddInputWithMoves(InputPlanes&& input,
+                         const std::vector<uint16_t>& moves) override {
+    planes_.emplace_back(input);
+    moves_.emplace_back(moves);
+  }
 
   void ComputeBlocking() override;
 
@@ -66,7 +74,9 @@ class MuxingComputation : public NetworkComputation {
     // Populate our batch into batch of batches.
     parent_ = parent;
     idx_in_parent_ = parent->GetBatchSize();
-    for (auto& x : planes_) parent_->AddInput(std::move(x));
+    for (size_t i = 0; i < planes_.size(); i++) {
+      parent_->AddInputWithMoves(std::move(planes_[i]), moves_[i]);
+    }
   }
 
   void NotifyReady() {
@@ -77,6 +87,7 @@ class MuxingComputation : public NetworkComputation {
 
  private:
   std::vector<InputPlanes> planes_;
+  std::vector<std::vector<uint16_t>> moves_;
   MuxingNetwork* network_;
   std::shared_ptr<NetworkComputation> parent_;
   int idx_in_parent_ = 0;
@@ -150,6 +161,12 @@ class MuxingNetwork : public Network {
 
   bool IsCpu() const override { return is_cpu_; }
 
+  size_t GetBufferBytes() const override {
+    size_t bytes = 0;
+    for (const auto& network : networks_) bytes += network->GetBufferBytes();
+    return bytes;
+  }
+
   void Enqueue(MuxingComputation* computation) {
     std::lock_guard<std::mutex> lock(mutex_);
     queue_.push(computation);
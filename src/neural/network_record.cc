@@ -1,6 +1,6 @@
 /*
   This file is part of Leela Chess Zero.
-  Copyright (C) 2018-2020 The LCZero Authors
+  Copyright (C) 2018-2024 The LCZero Authors
 
   Leela Chess is free software: you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -25,140 +25,430 @@
   Program grant you additional permission to convey the resulting work.
 */
 
-#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
 
 #include "neural/factory.h"
+#include "neural/shared/shared_weights.h"
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/fp16_utils.h"
 #include "utils/hashcat.h"
+#include "utils/logging.h"
 
 namespace lczero {
 namespace {
 
+// Record file layout (native byte order):
+//   RecordFileHeader
+//   records, each:
+//     uint64 input hash
+//     uint16 fp16 Q, D, M
+//     uint16 number of policy entries N
+//     N x {uint16 move_id, uint16 fp16 P}, sorted by move_id
+//   zero padding to a multiple of 8 bytes
+//   index: record_count x IndexEntry, sorted by hash
+// The header is rewritten with the record count and index offset when the
+// recording is closed. A file without an index (e.g. the recording process
+// crashed) is still replayable, the index is then rebuilt by scanning it.
+constexpr char kRecordMagic[8] = {'L', 'c', '0', 'R', 'e', 'c', '2', '\0'};
+constexpr uint32_t kRecordVersion = 1;
+
+struct RecordFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t input_format;
+  uint32_t moves_left;
+  uint32_t reserved;
+  uint64_t weights_hash;
+  uint64_t record_count;
+  uint64_t index_offset;
+};
+
+struct IndexEntry {
+  uint64_t hash;
+  uint64_t offset;
+};
+
+constexpr size_t kRecordFixedSize = sizeof(uint64_t) + 4 * sizeof(uint16_t);
+constexpr size_t kPolicyEntrySize = 2 * sizeof(uint16_t);
+
+uint64_t HashInput(const InputPlanes& input) {
+  std::uint64_t hash = 0x2134435D4534LL;
+  for (const auto& plane : input) {
+    hash = HashCat({hash, plane.mask});
+    std::uint32_t tmp;
+    std::memcpy(&tmp, &plane.value, sizeof(float));
+    const std::uint64_t value_hash = tmp;
+    hash = HashCat({hash, value_hash});
+  }
+  return hash;
+}
+
+uint64_t HashWeights(const std::optional<WeightsFile>& weights) {
+  return weights ? HashWeightsFile(*weights) : 0;
+}
+
+template <typename T>
+void Append(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T Read(const char* ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+// Appends records to the file from a background thread, so that search
+// threads only pay for serializing their batch into memory.
+class RecordWriter {
+ public:
+  RecordWriter(const std::string& filename, const RecordFileHeader& header)
+      : filename_(filename),
+        header_(header),
+        output_(filename, std::ios::binary | std::ios::trunc) {
+    if (!output_) throw Exception("Cannot create record file: " + filename);
+    output_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    offset_ = sizeof(header_);
+    thread_ = std::thread([this]() { Worker(); });
+  }
+
+  ~RecordWriter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    WriteIndex();
+  }
+
+  // @data contains serialized records, @entries their input hashes and
+  // offsets relative to the start of @data.
+  void Submit(std::string&& data, std::vector<IndexEntry>&& entries) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back({std::move(data), std::move(entries)});
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  struct Chunk {
+    std::string data;
+    std::vector<IndexEntry> entries;
+  };
+
+  void Worker() {
+    std::deque<Chunk> chunks;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        chunks.swap(queue_);
+      }
+      for (auto& chunk : chunks) {
+        output_.write(chunk.data.data(), chunk.data.size());
+        for (auto& entry : chunk.entries) {
+          entry.offset += offset_;
+          index_.push_back(entry);
+        }
+        offset_ += chunk.data.size();
+      }
+      chunks.clear();
+    }
+  }
+
+  void WriteIndex() {
+    // Only the first record of a position is kept in the index.
+    std::stable_sort(index_.begin(), index_.end(),
+                     [](const IndexEntry& a, const IndexEntry& b) {
+                       return a.hash < b.hash;
+                     });
+    index_.erase(std::unique(index_.begin(), index_.end(),
+                             [](const IndexEntry& a, const IndexEntry& b) {
+                               return a.hash == b.hash;
+                             }),
+                 index_.end());
+    // Align the index, so that the reader can use it in place.
+    const char padding[alignof(IndexEntry)] = {};
+    const size_t padding_size = -offset_ % alignof(IndexEntry);
+    output_.write(padding, padding_size);
+    offset_ += padding_size;
+    output_.write(reinterpret_cast<const char*>(index_.data()),
+                  index_.size() * sizeof(IndexEntry));
+    header_.record_count = index_.size();
+    header_.index_offset = offset_;
+    output_.seekp(0);
+    output_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    output_.close();
+    if (!output_) CERR << "Error writing record file " << filename_;
+  }
+
+  const std::string filename_;
+  RecordFileHeader header_;
+  std::ofstream output_;
+  // Accessed only by the worker thread, and by WriteIndex() after it's done.
+  uint64_t offset_ = 0;
+  std::vector<IndexEntry> index_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Chunk> queue_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
 class RecordComputation : public NetworkComputation {
  public:
   RecordComputation(std::unique_ptr<NetworkComputation>&& inner,
-                    const std::string& record_file)
-      : inner_(std::move(inner)), record_file_(record_file) {}
-  static uint64_t make_hash(const InputPlanes& input) {
-    std::uint64_t hash = 0x2134435D4534LL;
-    for (const auto& plane : input) {
-      hash = HashCat({hash, plane.mask});
-      std::uint32_t tmp;
-      std::memcpy(&tmp, &plane.value, sizeof(float));
-      const std::uint64_t value_hash = tmp;
-      hash = HashCat({hash, value_hash});
-    }
-    return hash;
-  }
+                    RecordWriter* writer)
+      : inner_(std::move(inner)), writer_(writer) {}
   // Adds a sample to the batch.
   void AddInput(InputPlanes&& input) override {
-    hashes_.push_back(make_hash(input));
-    requests_.emplace_back();
-    q_count_.push_back(0);
+    hashes_.push_back(HashInput(input));
+    policies_.emplace_back();
     inner_->AddInput(std::move(input));
   }
   // Do the computation.
-  void ComputeBlocking() override { inner_->ComputeBlocking(); }
+  void ComputeBlocking() override {
+    inner_->ComputeBlocking();
+    computed_ = true;
+  }
   // Returns how many times AddInput() was called.
   int GetBatchSize() const override { return inner_->GetBatchSize(); }
-  float Capture(float value, int index) const {
-    // Only capture until we see Q again - the rest can be infered from that
-    // set.
-    if (q_count_[index] > 1) return value;
-    requests_[index].push_back(value);
-    return value;
-  }
   // Returns Q value of @sample.
-  float GetQVal(int sample) const override {
-    q_count_[sample]++;
-    return Capture(inner_->GetQVal(sample), sample);
-  }
-  float GetDVal(int sample) const override {
-    return Capture(inner_->GetDVal(sample), sample);
-  }
+  float GetQVal(int sample) const override { return inner_->GetQVal(sample); }
+  float GetDVal(int sample) const override { return inner_->GetDVal(sample); }
   // Returns P value @move_id of @sample.
   float GetPVal(int sample, int move_id) const override {
-    return Capture(inner_->GetPVal(sample, move_id), sample);
-  }
-  float GetMVal(int sample) const override {
-    return Capture(inner_->GetMVal(sample), sample);
+    const float p = inner_->GetPVal(sample, move_id);
+    policies_[sample].push_back(
+        {static_cast<uint16_t>(move_id), FP32toFP16(p)});
+    return p;
   }
-  virtual ~RecordComputation() {
-    Mutex::Lock lock(mutex_);
-    std::fstream output(record_file_, std::ios::app | std::ios_base::binary);
+  float GetMVal(int sample) const override { return inner_->GetMVal(sample); }
+
+  ~RecordComputation() override {
+    if (!computed_ || hashes_.empty()) return;
+    std::string data;
+    std::vector<IndexEntry> entries;
+    entries.reserve(hashes_.size());
     for (size_t i = 0; i < hashes_.size(); i++) {
-      uint64_t value = hashes_[i];
-      output.write(reinterpret_cast<const char*>(&value), sizeof(value));
-      int32_t length = static_cast<int32_t>(requests_[i].size());
-      output.write(reinterpret_cast<const char*>(&length), sizeof(length));
-      for (int j = 0; j < length; j++) {
-        float recorded = requests_[i][j];
-        output.write(reinterpret_cast<const char*>(&recorded),
-                     sizeof(recorded));
+      auto& policy = policies_[i];
+      std::sort(policy.begin(), policy.end(),
+                [](const PolicyEntry& a, const PolicyEntry& b) {
+                  return a.move_id < b.move_id;
+                });
+      policy.erase(std::unique(policy.begin(), policy.end(),
+                               [](const PolicyEntry& a, const PolicyEntry& b) {
+                                 return a.move_id == b.move_id;
+                               }),
+                   policy.end());
+      entries.push_back({hashes_[i], data.size()});
+      Append(&data, hashes_[i]);
+      Append(&data, FP32toFP16(inner_->GetQVal(i)));
+      Append(&data, FP32toFP16(inner_->GetDVal(i)));
+      Append(&data, FP32toFP16(inner_->GetMVal(i)));
+      Append(&data, static_cast<uint16_t>(policy.size()));
+      for (const auto& entry : policy) {
+        Append(&data, entry.move_id);
+        Append(&data, entry.p);
       }
     }
+    writer_->Submit(std::move(data), std::move(entries));
   }
+
+ private:
+  struct PolicyEntry {
+    uint16_t move_id;
+    uint16_t p;
+  };
+
   std::unique_ptr<NetworkComputation> inner_;
-  std::string record_file_;
+  RecordWriter* const writer_;
   std::vector<uint64_t> hashes_;
-  mutable std::vector<int> q_count_;
-  mutable std::vector<std::vector<float>> requests_;
-  static Mutex mutex_;
+  mutable std::vector<std::vector<PolicyEntry>> policies_;
+  bool computed_ = false;
 };
 
-Mutex RecordComputation::mutex_;
+// Memory-mapped record file. Immutable after construction, so lookups from
+// any number of threads need no locking.
+class RecordReader {
+ public:
+  explicit RecordReader(const std::string& filename) : file_(filename) {
+    if (file_.size() < sizeof(RecordFileHeader)) {
+      throw Exception("Record file too short: " + filename);
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, kRecordMagic, sizeof(kRecordMagic)) != 0 ||
+        header_.version != kRecordVersion) {
+      throw Exception("Not a supported record file: " + filename);
+    }
+    if (header_.index_offset == 0) {
+      CERR << "Record file " << filename
+           << " has no index, was the recording interrupted? Scanning it.";
+      RebuildIndex();
+      return;
+    }
+    if (header_.index_offset % alignof(IndexEntry) != 0 ||
+        header_.index_offset < sizeof(RecordFileHeader) ||
+        header_.index_offset > file_.size() ||
+        header_.record_count >
+            (file_.size() - header_.index_offset) / sizeof(IndexEntry)) {
+      throw Exception("Corrupt record file index: " + filename);
+    }
+    index_ = reinterpret_cast<const IndexEntry*>(file_.data() +
+                                                 header_.index_offset);
+    index_size_ = header_.record_count;
+    for (size_t i = 0; i < index_size_; i++) {
+      if (!IsValidEntry(index_[i], header_.index_offset) ||
+          (i > 0 && index_[i - 1].hash > index_[i].hash)) {
+        throw Exception("Corrupt record file index: " + filename);
+      }
+    }
+  }
+
+  const RecordFileHeader& header() const { return header_; }
+
+  // Returns the start of the record for @hash, or nullptr.
+  const char* Find(uint64_t hash) const {
+    const auto* end = index_ + index_size_;
+    const auto* it = std::lower_bound(
+        index_, end, hash,
+        [](const IndexEntry& e, uint64_t h) { return e.hash < h; });
+    if (it == end || it->hash != hash) return nullptr;
+    return file_.data() + it->offset;
+  }
+
+ private:
+  // Whether @entry points to a whole record with its hash before @end.
+  bool IsValidEntry(const IndexEntry& entry, uint64_t end) const {
+    if (entry.offset < sizeof(RecordFileHeader) || entry.offset > end ||
+        end - entry.offset < kRecordFixedSize) {
+      return false;
+    }
+    const char* record = file_.data() + entry.offset;
+    const auto count =
+        Read<uint16_t>(record + kRecordFixedSize - sizeof(uint16_t));
+    return end - entry.offset >= kRecordFixedSize + count * kPolicyEntrySize &&
+           Read<uint64_t>(record) == entry.hash;
+  }
+
+  void RebuildIndex() {
+    const char* data = file_.data();
+    const uint64_t end = file_.size();
+    uint64_t offset = sizeof(RecordFileHeader);
+    while (offset + kRecordFixedSize <= end) {
+      const auto count = Read<uint16_t>(data + offset + kRecordFixedSize -
+                                        sizeof(uint16_t));
+      const uint64_t size = kRecordFixedSize + count * kPolicyEntrySize;
+      // Drop a partially written last record.
+      if (offset + size > end) break;
+      scanned_index_.push_back({Read<uint64_t>(data + offset), offset});
+      offset += size;
+    }
+    std::stable_sort(scanned_index_.begin(), scanned_index_.end(),
+                     [](const IndexEntry& a, const IndexEntry& b) {
+                       return a.hash < b.hash;
+                     });
+    index_ = scanned_index_.data();
+    index_size_ = scanned_index_.size();
+  }
+
+  MappedFile file_;
+  RecordFileHeader header_;
+  const IndexEntry* index_ = nullptr;
+  size_t index_size_ = 0;
+  // Index of a file closed without one, built by RebuildIndex().
+  std::vector<IndexEntry> scanned_index_;
+};
 
 class ReplayComputation : public NetworkComputation {
  public:
-  ReplayComputation(std::unordered_map<uint64_t, std::vector<float>>* lookup)
-      : lookup_(lookup) {}
+  ReplayComputation(const RecordReader* reader) : reader_(reader) {}
   // Adds a sample to the batch.
   void AddInput(InputPlanes&& input) override {
-    hashes_.push_back(RecordComputation::make_hash(input));
-    replay_counter_.push_back(0);
+    records_.push_back(reader_->Find(HashInput(input)));
   }
   // Do the computation.
   void ComputeBlocking() override {}
   // Returns how many times AddInput() was called.
-  int GetBatchSize() const override { return static_cast<int>(hashes_.size()); }
-  float Replay(int index) const {
-    const auto& entry_ptr = lookup_->find(hashes_[index]);
-    if (entry_ptr == lookup_->end()) {
-      return 0.0f;
-    }
-    const auto& entry = entry_ptr->second;
-    size_t counter = replay_counter_[index];
-    if (counter >= entry.size()) {
-      // Second pass reads the same things in the same order as first.
-      counter = counter - entry.size();
-      if (counter >= entry.size()) {
-        // Third pass skips the first 3, then reads the rest in the same order.
-        counter = counter - entry.size() + 3;
-        if (counter >= entry.size()) {
-          return 0.0f;
-        }
+  int GetBatchSize() const override {
+    return static_cast<int>(records_.size());
+  }
+  // Returns Q value of @sample.
+  float GetQVal(int sample) const override { return GetValue(sample, 0); }
+  float GetDVal(int sample) const override { return GetValue(sample, 1); }
+  float GetMVal(int sample) const override { return GetValue(sample, 2); }
+  // Returns P value @move_id of @sample, 0 if it wasn't recorded.
+  float GetPVal(int sample, int move_id) const override {
+    const char* record = records_[sample];
+    if (!record) return 0.0f;
+    const auto count = Read<uint16_t>(record + kRecordFixedSize -
+                                      sizeof(uint16_t));
+    const char* policy = record + kRecordFixedSize;
+    // Binary search over the sorted move ids.
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+      const size_t mid = (lo + hi) / 2;
+      const auto id = Read<uint16_t>(policy + mid * kPolicyEntrySize);
+      if (id == move_id) {
+        return FP16toFP32(Read<uint16_t>(policy + mid * kPolicyEntrySize +
+                                         sizeof(uint16_t)));
+      }
+      if (id < move_id) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
       }
     }
-    replay_counter_[index]++;
-    return entry[counter];
+    return 0.0f;
   }
-  // Returns Q value of @sample.
-  float GetQVal(int sample) const override { return Replay(sample); }
-  float GetDVal(int sample) const override { return Replay(sample); }
-  // Returns P value @move_id of @sample.
-  float GetPVal(int sample, int) const override { return Replay(sample); }
-  float GetMVal(int sample) const override { return Replay(sample); }
-  virtual ~ReplayComputation() {}
 
-  std::unique_ptr<NetworkComputation> inner_;
-  std::vector<uint64_t> hashes_;
-  mutable std::vector<size_t> replay_counter_;
-  std::unordered_map<uint64_t, std::vector<float>>* lookup_;
+ private:
+  float GetValue(int sample, int idx) const {
+    const char* record = records_[sample];
+    if (!record) return 0.0f;
+    return FP16toFP32(Read<uint16_t>(record + sizeof(uint64_t) +
+                                     idx * sizeof(uint16_t)));
+  }
+
+  const RecordReader* const reader_;
+  std::vector<const char*> records_;
 };
 
 class RecordReplayNetwork : public Network {
  public:
   RecordReplayNetwork(const std::optional<WeightsFile>& weights,
                       const OptionsDict& options) {
+    replay_file_ = options.GetOrDefault<std::string>("replay_file", "");
+    record_file_ = options.GetOrDefault<std::string>("record_file", "");
+    if (!replay_file_.empty()) {
+      // Replay doesn't need the real network, or even weights.
+      reader_ = std::make_unique<RecordReader>(replay_file_);
+      const auto& header = reader_->header();
+      capabilities_ = {
+          static_cast<pblczero::NetworkFormat::InputFormat>(
+              header.input_format),
+          static_cast<pblczero::NetworkFormat::MovesLeftFormat>(
+              header.moves_left)};
+      if (weights && header.weights_hash != HashWeights(weights)) {
+        CERR << "Warning: " << replay_file_
+             << " was recorded with different weights.";
+      }
+      return;
+    }
+
     const auto parents = options.ListSubdicts();
     if (parents.empty()) {
       // If options are empty, or multiplexer configured in root object,
@@ -170,31 +460,14 @@ class RecordReplayNetwork : public Network {
     for (const auto& name : parents) {
       AddBackend(name, weights, options.GetSubdict(name));
     }
-    replay_file_ = options.GetOrDefault<std::string>("replay_file", "");
-    record_file_ = options.GetOrDefault<std::string>("record_file", "");
-    if (replay_file_.size() > 0) {
-      lookup_ =
-          std::make_unique<std::unordered_map<uint64_t, std::vector<float>>>();
-      std::ifstream input(replay_file_, std::ios_base::binary);
-      input.seekg(0, input.end);
-      auto file_length = input.tellg();
-      input.seekg(0, input.beg);
-      while (input.tellg() < file_length) {
-        uint64_t value = 0;
-        input.read(reinterpret_cast<char*>(&value), sizeof(value));
-        int32_t length = 0;
-        input.read(reinterpret_cast<char*>(&length), sizeof(length));
-        auto& entry = (*lookup_)[value];
-        // Only use the first recorded value for any hash collisions.
-        bool fill = entry.size() == 0;
-        for (int j = 0; j < length; j++) {
-          float recorded = 0.0f;
-          input.read(reinterpret_cast<char*>(&recorded), sizeof(recorded));
-          if (fill) {
-            entry.push_back(recorded);
-          }
-        }
-      }
+    if (!record_file_.empty()) {
+      RecordFileHeader header{};
+      std::memcpy(header.magic, kRecordMagic, sizeof(kRecordMagic));
+      header.version = kRecordVersion;
+      header.input_format = capabilities_.input_format;
+      header.moves_left = capabilities_.moves_left;
+      header.weights_hash = HashWeights(weights);
+      writer_ = std::make_unique<RecordWriter>(record_file_, header);
     }
   }
 
@@ -214,27 +487,35 @@ class RecordReplayNetwork : public Network {
   }
 
   std::unique_ptr<NetworkComputation> NewComputation() override {
-    if (!lookup_) {
-      const long long val = ++counter_;
-      return std::make_unique<RecordComputation>(
-          networks_[val % networks_.size()]->NewComputation(), record_file_);
-    }
-    return std::make_unique<ReplayComputation>(lookup_.get());
+    if (reader_) return std::make_unique<ReplayComputation>(reader_.get());
+    const long long val = ++counter_;
+    auto computation = networks_[val % networks_.size()]->NewComputation();
+    if (!writer_) return computation;
+    return std::make_unique<RecordComputation>(std::move(computation),
+                                               writer_.get());
   }
 
   const NetworkCapabilities& GetCapabilities() const override {
     return capabilities_;
   }
 
-  ~RecordReplayNetwork() {}
+  size_t GetBufferBytes() const override {
+    size_t bytes = 0;
+    for (const auto& network : networks_) bytes += network->GetBufferBytes();
+    return bytes;
+  }
+
+  // Flushes the pending records and writes the index.
+  ~RecordReplayNetwork() { writer_.reset(); }
 
  private:
   std::vector<std::unique_ptr<Network>> networks_;
-  std::atomic<long long> counter_;
+  std::atomic<long long> counter_ = 0;
   NetworkCapabilities capabilities_;
   std::string replay_file_;
   std::string record_file_;
-  std::unique_ptr<std::unordered_map<uint64_t, std::vector<float>>> lookup_;
+  std::unique_ptr<RecordWriter> writer_;
+  std::unique_ptr<RecordReader> reader_;
 };
 
 std::unique_ptr<Network> MakeRecordReplayNetwork(
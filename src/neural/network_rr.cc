@@ -86,6 +86,12 @@ class RoundRobinNetwork : public Network {
 
   bool IsCpu() const override { return is_cpu_; }
 
+  size_t GetBufferBytes() const override {
+    size_t bytes = 0;
+    for (const auto& network : networks_) bytes += network->GetBufferBytes();
+    return bytes;
+  }
+
   ~RoundRobinNetwork() {}
 
  private:
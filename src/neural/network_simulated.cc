@@ -0,0 +1,248 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "neural/factory.h"
+#include "utils/exception.h"
+#include "utils/logging.h"
+#include "utils/string.h"
+
+namespace lczero {
+namespace {
+
+// Batch latency model of a simulated accelerator. Either a fixed overhead
+// plus a per-sample cost (overhead_us, per_sample_us), or a curve measured
+// with backendbench on the real hardware (curve=<file>). The jitter option is
+// the relative standard deviation of the latency.
+class LatencyModel {
+ public:
+  LatencyModel(const OptionsDict& options)
+      : overhead_us_(options.GetOrDefault<int>("overhead_us", 1000)),
+        per_sample_us_(options.GetOrDefault<int>("per_sample_us", 20)),
+        jitter_(options.GetOrDefault<float>("jitter", 0.0f)) {
+    const auto curve_file = options.GetOrDefault<std::string>("curve", "");
+    if (!curve_file.empty()) LoadCurve(curve_file);
+  }
+
+  // Returns the time it takes to compute a batch of @batch_size, in
+  // microseconds, without jitter.
+  double GetLatencyUs(int batch_size) const {
+    if (curve_.empty()) return overhead_us_ + per_sample_us_ * batch_size;
+    if (curve_.size() == 1 || batch_size <= curve_.front().first) {
+      return curve_.front().second;
+    }
+    // Linear interpolation between the measured batch sizes, extrapolating
+    // the last segment for larger batches.
+    auto it = std::lower_bound(
+        curve_.begin(), curve_.end(), batch_size,
+        [](const std::pair<int, double>& p, int b) { return p.first < b; });
+    if (it == curve_.end()) --it;
+    const auto& lo = *(it - 1);
+    const auto& hi = *it;
+    return lo.second + (hi.second - lo.second) * (batch_size - lo.first) /
+                           (hi.first - lo.first);
+  }
+
+  double GetJitter() const { return jitter_; }
+
+ private:
+  // Reads the results of the backendbench mode, either the "Benchmark batch
+  // size N ... average time T ms" lines of its text output or the rows of its
+  // --output-format=csv output.
+  void LoadCurve(const std::string& filename) {
+    std::ifstream input(filename);
+    if (!input) throw Exception("Cannot open latency curve: " + filename);
+    const std::string kBatchSize = "batch size ";
+    const std::string kTime = "average time ";
+    // Columns of the csv output, found from its header.
+    size_t batch_column = 0;
+    size_t time_column = 0;
+    bool csv = false;
+    std::string line;
+    while (std::getline(input, line)) {
+      const auto fields = StrSplit(Trim(line), ",");
+      if (fields.size() > 1) {
+        const auto batch_it =
+            std::find(fields.begin(), fields.end(), "batch_size");
+        const auto time_it =
+            std::find(fields.begin(), fields.end(), "average_ms");
+        if (batch_it != fields.end() && time_it != fields.end()) {
+          batch_column = batch_it - fields.begin();
+          time_column = time_it - fields.begin();
+          csv = true;
+          continue;
+        }
+      }
+      if (csv && fields.size() > std::max(batch_column, time_column)) {
+        curve_.emplace_back(std::stoi(fields[batch_column]),
+                            std::stod(fields[time_column]) * 1000.0);
+        continue;
+      }
+      const auto batch_pos = line.find(kBatchSize);
+      const auto time_pos = line.find(kTime);
+      if (batch_pos == std::string::npos || time_pos == std::string::npos) {
+        continue;
+      }
+      const int batch_size =
+          std::stoi(line.substr(batch_pos + kBatchSize.size()));
+      const double ms = std::stod(line.substr(time_pos + kTime.size()));
+      curve_.emplace_back(batch_size, ms * 1000.0);
+    }
+    if (curve_.empty()) {
+      throw Exception("No backendbench results in " + filename);
+    }
+    std::sort(curve_.begin(), curve_.end());
+    // A batch size measured several times (e.g. with several thread counts)
+    // keeps its lowest latency, which sorts first.
+    curve_.erase(std::unique(curve_.begin(), curve_.end(),
+                             [](const auto& a, const auto& b) {
+                               return a.first == b.first;
+                             }),
+                 curve_.end());
+    CERR << "Simulated backend loaded " << curve_.size()
+         << " latency points from " << filename;
+  }
+
+  const double overhead_us_;
+  const double per_sample_us_;
+  const double jitter_;
+  // Sorted (batch size, latency in us) pairs.
+  std::vector<std::pair<int, double>> curve_;
+};
+
+class SimulatedNetwork;
+
+class SimulatedComputation : public NetworkComputation {
+ public:
+  SimulatedComputation(std::unique_ptr<NetworkComputation> inner,
+                       SimulatedNetwork* network)
+      : inner_(std::move(inner)), network_(network) {}
+
+  void AddInput(InputPlanes&& input) override {
+    inner_->AddInput(std::move(input));
+  }
+  void ComputeBlocking() override;
+  int GetBatchSize() const override { return inner_->GetBatchSize(); }
+  float GetQVal(int sample) const override { return inner_->GetQVal(sample); }
+  float GetDVal(int sample) const override { return inner_->GetDVal(sample); }
+  float GetPVal(int sample, int move_id) const override {
+    return inner_->GetPVal(sample, move_id);
+  }
+  float GetMVal(int sample) const override { return inner_->GetMVal(sample); }
+
+ private:
+  std::unique_ptr<NetworkComputation> inner_;
+  SimulatedNetwork* const network_;
+};
+
+// Answers from the "random" (or any other) backend, but takes as long as a
+// real accelerator would, according to the latency model. At most
+// max_concurrent batches are "computed" at the same time, the rest queue up
+// like they would for a busy device.
+class SimulatedNetwork : public Network {
+ public:
+  SimulatedNetwork(const std::optional<WeightsFile>& weights,
+                   const OptionsDict& options)
+      : model_(options),
+        max_concurrent_(options.GetOrDefault<int>("max_concurrent", 1)),
+        threads_(options.GetOrDefault<int>("threads", max_concurrent_ + 1)),
+        minibatch_size_(options.GetOrDefault<int>("minibatch_size", 256)),
+        gen_(options.GetOrDefault<int>("jitter_seed", 0)) {
+    if (max_concurrent_ < 1) {
+      throw Exception("max_concurrent must be at least 1");
+    }
+    const auto inner = options.GetOrDefault<std::string>("inner", "random");
+    inner_ = NetworkFactory::Get()->Create(inner, weights, options);
+  }
+
+  std::unique_ptr<NetworkComputation> NewComputation() override {
+    return std::make_unique<SimulatedComputation>(inner_->NewComputation(),
+                                                  this);
+  }
+
+  const NetworkCapabilities& GetCapabilities() const override {
+    return inner_->GetCapabilities();
+  }
+  int GetThreads() const override { return threads_; }
+  int GetMiniBatchSize() const override { return minibatch_size_; }
+
+  // Blocks for the simulated duration of a batch of @batch_size.
+  void Simulate(int batch_size) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&]() { return running_ < max_concurrent_; });
+    ++running_;
+    double us = model_.GetLatencyUs(batch_size);
+    if (model_.GetJitter() > 0) {
+      std::normal_distribution<double> dist(1.0, model_.GetJitter());
+      us *= std::max(0.0, dist(gen_));
+    }
+    lock.unlock();
+
+    std::this_thread::sleep_until(
+        std::chrono::steady_clock::now() +
+        std::chrono::microseconds(static_cast<int64_t>(us)));
+
+    lock.lock();
+    --running_;
+    lock.unlock();
+    cv_.notify_one();
+  }
+
+ private:
+  const LatencyModel model_;
+  const int max_concurrent_;
+  const int threads_;
+  const int minibatch_size_;
+  std::unique_ptr<Network> inner_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  int running_ = 0;
+  std::mt19937 gen_;
+};
+
+void SimulatedComputation::ComputeBlocking() {
+  inner_->ComputeBlocking();
+  network_->Simulate(GetBatchSize());
+}
+
+std::unique_ptr<Network> MakeSimulatedNetwork(
+    const std::optional<WeightsFile>& weights, const OptionsDict& options) {
+  return std::make_unique<SimulatedNetwork>(weights, options);
+}
+
+REGISTER_NETWORK("simulated", MakeSimulatedNetwork, -999)
+
+}  // namespace
+}  // namespace lczero
@@ -71,7 +71,7 @@ void ConvLayer::LoadWeights(dnnl::memory& w1, dnnl::memory& b1,
 void ConvLayer::Eval(int N, dnnl::memory& output, dnnl::memory& input,
                      dnnl::engine& eng, dnnl::stream& stream) {
   std::lock_guard<std::mutex> lock(lock_);
-  if (last_batch_ != N) {
+  if (last_batch_ != N || last_convolution_type_ != convolution_type_) {
     auto t_in_md = dnnl::memory::desc({N, c_input_, H, W}, data_type_,
                                       dnnl::memory::format_tag::any);
 
@@ -155,6 +155,7 @@ void ConvLayer::Eval(int N, dnnl::memory& output, dnnl::memory& input,
     scratchpad_mem = dnnl::memory(scratchpad_md, eng);
 
     last_batch_ = N;
+    last_convolution_type_ = convolution_type_;
   }
 
   if (in_md != input.get_desc()) {
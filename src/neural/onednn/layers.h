@@ -84,8 +84,10 @@ class ConvLayer : public BaseLayer {
   dnnl::memory conv_filter_mem;  // Transformed weights (maybe for Winograd).
   dnnl::memory bias_mem;
 
-  // Cache previous convolution primitive in case the batch size is the same.
+  // Cache previous convolution primitive in case the batch size (and the
+  // convolution algorithm) is the same.
   int last_batch_ = 0;
+  dnnl::algorithm last_convolution_type_ = dnnl::algorithm::undef;
   dnnl::convolution_forward conv_;
   dnnl::eltwise_forward mish_;
   dnnl::reorder in_reorder_;
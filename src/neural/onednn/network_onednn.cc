@@ -26,11 +26,16 @@
 */
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <fstream>
 #include <functional>
+#include <limits>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <sstream>
 
 #include "layers.h"
 #include "neural/factory.h"
@@ -38,7 +43,10 @@
 #include "neural/shared/attention_policy_map.h"
 #include "neural/shared/policy_map.h"
 #include "utils/bititer.h"
+#include "utils/cpu_features.h"
 #include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/logging.h"
 
 #include <omp.h>
 
@@ -47,6 +55,54 @@ using namespace onednn_backend;
 
 static constexpr int kNumOutputPolicy = 1858;
 
+namespace {
+
+// Measured convolution algorithms, one "key<TAB>algorithm" line per setup.
+std::string GetConvolutionTuningFilename() {
+  const std::string cache_dir = GetUserCacheDirectory();
+  if (cache_dir.empty()) return {};
+  return cache_dir + "lc0/onednn_tuning.txt";
+}
+
+std::optional<dnnl::algorithm> ReadConvolutionTuning(const std::string& key) {
+  const std::string filename = GetConvolutionTuningFilename();
+  if (filename.empty()) return std::nullopt;
+  std::ifstream file(filename);
+  std::string line;
+  std::optional<dnnl::algorithm> result;
+  while (std::getline(file, line)) {
+    const auto tab = line.rfind('\t');
+    if (tab == std::string::npos || line.compare(0, tab, key) != 0) continue;
+    // Later lines override earlier ones.
+    const std::string value = line.substr(tab + 1);
+    if (value == "winograd") {
+      result = dnnl::algorithm::convolution_winograd;
+    } else if (value == "direct") {
+      result = dnnl::algorithm::convolution_direct;
+    }
+  }
+  return result;
+}
+
+void WriteConvolutionTuning(const std::string& key, dnnl::algorithm type) {
+  const std::string filename = GetConvolutionTuningFilename();
+  if (filename.empty()) return;
+  try {
+    CreateDirectory(GetUserCacheDirectory() + "lc0");
+  } catch (const Exception& e) {
+    CERR << "Cannot write oneDNN tuning cache: " << e.what();
+    return;
+  }
+  std::ofstream file(filename, std::ios::app);
+  file << key << '\t'
+       << (type == dnnl::algorithm::convolution_winograd ? "winograd"
+                                                           : "direct")
+       << '\n';
+  if (!file) CERR << "Cannot write oneDNN tuning cache " << filename;
+}
+
+}  // namespace
+
 struct InputsOutputs {
   InputsOutputs(int maxBatchSize, bool wdl, bool moves_left) {
     input_masks_mem_ =
@@ -526,17 +582,92 @@ class OnednnNetwork : public Network {
         FCMov2->LoadWeights(w_mem, b_mem, eng_, eng_stream_);
         layers_[idx].emplace_back(std::move(FCMov2));
       }
+    }
+
+    // Initialize layers if batch size fixed. This creates all primitives and
+    // reorders the weights to their preferred format for every batch step, so
+    // that the first search batches don't pay for it.
+    if (options.GetOrDefault<bool>("init", true) && batch_size_ > 0) {
+      // Only tune when the convolution algorithm was not set explicitly.
+      if (options.IsDefault<bool>("winograd") &&
+          options.GetOrDefault<bool>("conv_tuning", true) &&
+          eng_.get_kind() == dnnl::engine::kind::cpu) {
+        TuneConvolutionType(data_type, convolution_type);
+      }
+      for (int idx = 0; idx < steps_; idx++) {
+        const int batchSize = (idx + 1) * batch_size_;
+        const double cold = TimeEval(batchSize);
+        const double warm = TimeEval(batchSize);
+        CERR << "oneDNN batch size " << batchSize << " initialized in " << cold
+             << "ms (" << warm << "ms warm).";
+      }
+    }
+  }
 
-      // Initialize layers if batch size fixed.
-      if (options.GetOrDefault<bool>("init", true) && batch_size_ > 0) {
-        int batchSize = (idx + 1) * batch_size_;
-        InputsOutputs io(batchSize, wdl_, moves_left_);
-        memset(io.input_masks_mem_, 0,
-               batchSize * kInputPlanes * sizeof(uint64_t));
-        memset(io.input_val_mem_, 0, batchSize * kInputPlanes * sizeof(float));
-        forwardEval(&io, batchSize);
+  // Runs an all-zero batch of @batchSize and returns the time it took in ms.
+  double TimeEval(int batchSize) {
+    InputsOutputs io(batchSize, wdl_, moves_left_);
+    memset(io.input_masks_mem_, 0, batchSize * kInputPlanes * sizeof(uint64_t));
+    memset(io.input_val_mem_, 0, batchSize * kInputPlanes * sizeof(float));
+    const auto start = std::chrono::steady_clock::now();
+    forwardEval(&io, batchSize);
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  void SetConvolutionType(dnnl::algorithm type) {
+    for (auto& step : layers_) {
+      for (auto& layer : step) layer->SetConvolutionType(type);
+    }
+  }
+
+  // Times direct and Winograd 3x3 convolutions on the first batch step and
+  // keeps the faster one. oneDNN can't save cpu primitives, but the algorithm
+  // (which determines the weight formats) is remembered per cpu model in the
+  // user cache directory, so the measurement is only done once.
+  void TuneConvolutionType(dnnl::memory::data_type data_type,
+                           dnnl::algorithm heuristic_type) {
+    const dnnl::version_t* version = dnnl::version();
+    std::ostringstream key;
+    key << GetCpuModelName() << ";isa=" << (int)dnnl::get_effective_cpu_isa()
+        << ";type=" << (int)data_type << ";filters=" << numFilters_
+        << ";blocks=" << numBlocks_ << ";se=" << has_se_
+        << ";batch=" << batch_size_ << ";threads=" << omp_get_max_threads()
+        << ";dnnl=" << version->major << "." << version->minor << "."
+        << version->patch;
+
+    const auto cached = ReadConvolutionTuning(key.str());
+    if (cached) {
+      SetConvolutionType(*cached);
+      return;
+    }
+
+    dnnl::algorithm best_type = heuristic_type;
+    double best_time = std::numeric_limits<double>::infinity();
+    for (auto type : {dnnl::algorithm::convolution_direct,
+                      dnnl::algorithm::convolution_winograd}) {
+      SetConvolutionType(type);
+      double time = std::numeric_limits<double>::infinity();
+      try {
+        TimeEval(batch_size_);
+        for (int i = 0; i < 3; i++) {
+          time = std::min(time, TimeEval(batch_size_));
+        }
+      } catch (const dnnl::error&) {
+        // Not all algorithms are implemented for every isa and data type.
+        continue;
+      }
+      if (time < best_time) {
+        best_time = time;
+        best_type = type;
       }
     }
+    SetConvolutionType(best_type);
+    CERR << "oneDNN selected "
+         << (best_type == dnnl::algorithm::convolution_winograd ? "Winograd"
+                                                                 : "direct")
+         << " convolution for this cpu.";
+    WriteConvolutionTuning(key.str(), best_type);
   }
 
   void forwardEval(InputsOutputs* io, int inputBatchSize) {
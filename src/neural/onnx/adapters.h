@@ -119,6 +119,17 @@ class FloatOnnxConst : public GenericOnnxConst<float> {
   }
 };
 
+// GenericOnnxConst for int8 values.
+class Int8OnnxConst : public GenericOnnxConst<int8_t> {
+ public:
+  using GenericOnnxConst<int8_t>::GenericOnnxConst;
+
+ private:
+  pblczero::TensorProto::DataType GetDataType() const override {
+    return pblczero::TensorProto::INT8;
+  }
+};
+
 // GenericOnnxConst for Ort::Float16_t values.
 class Float16OnnxConst : public GenericOnnxConst<uint16_t> {
  public:
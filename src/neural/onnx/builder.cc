@@ -476,4 +476,67 @@ std::string OnnxBuilder::ReduceMean(const std::string& name,
   return out;
 }
 
+void OnnxBuilder::SetContribDomain(pblczero::NodeProto* node) {
+  static const char kDomain[] = "com.microsoft";
+  node->set_domain(kDomain);
+  if (contrib_domain_imported_) return;
+  auto* opset = model_.add_opset_import();
+  opset->set_domain(kDomain);
+  opset->set_version(1);
+  contrib_domain_imported_ = true;
+}
+
+std::string OnnxBuilder::Attention(const std::string& name,
+                                   const std::string& input,
+                                   const OnnxConst& weights,
+                                   const OnnxConst& bias, int num_heads,
+                                   const std::string& relative_position_bias) {
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name, input, "Attention");
+  SetContribDomain(node);
+  node->add_input(AddInitializer(name + "/w/weights", weights));
+  node->add_input(AddInitializer(name + "/w/bias", bias));
+  if (!relative_position_bias.empty()) {
+    // No mask_index and past.
+    node->add_input("");
+    node->add_input("");
+    node->add_input(relative_position_bias);
+  }
+  AddIntAttribute(node, "num_heads", num_heads);
+  return out;
+}
+
+std::string OnnxBuilder::SkipLayerNormalization(
+    const std::string& name, const std::string& input, const std::string& skip,
+    const OnnxConst& gamma, const OnnxConst& beta, const OnnxConst& bias,
+    float epsilon) {
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name, input, "SkipLayerNormalization");
+  SetContribDomain(node);
+  node->add_input(skip);
+  node->add_input(AddInitializer(name + "/w/gamma", gamma));
+  node->add_input(AddInitializer(name + "/w/beta", beta));
+  node->add_input(AddInitializer(name + "/w/bias", bias));
+  AddFloatAttribute(node, "epsilon", epsilon);
+  return out;
+}
+
+std::string OnnxBuilder::DynamicQuantizeMatMul(const std::string& name,
+                                               const std::string& input,
+                                               const OnnxConst& weights,
+                                               const OnnxConst& scales,
+                                               const OnnxConst* bias) {
+  auto* node = model_.mutable_graph()->add_node();
+  auto out = PopulateStdNodeFields(node, name, input, "DynamicQuantizeMatMul");
+  SetContribDomain(node);
+  node->add_input(AddInitializer(name + "/w/weights", weights));
+  node->add_input(AddInitializer(name + "/w/scales", scales));
+  if (bias) {
+    // Symmetric quantization, no zero points.
+    node->add_input("");
+    node->add_input(AddInitializer(name + "/w/bias", *bias));
+  }
+  return out;
+}
+
 }  // namespace lczero
@@ -126,13 +126,41 @@ class OnnxBuilder {
                    pblczero::TensorProto::DataType type);
   std::string ReduceMean(const std::string& name, const std::string& input,
                          std::initializer_list<int> axes);
+
+  // Contrib operators of onnxruntime (com.microsoft domain), for its fused
+  // kernels.
+  // Multi-head self attention with the Q, K and V projections fused in
+  // @weights of [input_hidden, 3 * hidden]. @input is [batch, seq, hidden],
+  // the optional @relative_position_bias [batch, heads, seq, seq].
+  std::string Attention(const std::string& name, const std::string& input,
+                        const OnnxConst& weights, const OnnxConst& bias,
+                        int num_heads,
+                        const std::string& relative_position_bias = "");
+  // LayerNormalization(@input + @skip + @bias) over the last axis.
+  std::string SkipLayerNormalization(const std::string& name,
+                                     const std::string& input,
+                                     const std::string& skip,
+                                     const OnnxConst& gamma,
+                                     const OnnxConst& beta,
+                                     const OnnxConst& bias, float epsilon);
+  // MatMul of float @input and int8 @weights with per column @scales,
+  // quantizing the input at run time. @bias is optional.
+  std::string DynamicQuantizeMatMul(const std::string& name,
+                                    const std::string& input,
+                                    const OnnxConst& weights,
+                                    const OnnxConst& scales,
+                                    const OnnxConst* bias = nullptr);
   // Returns ONNX model as protobuf.
   const pblczero::ModelProto& as_proto() const { return model_; }
   // Returns serialized model.
   std::string OutputAsString() const { return model_.OutputAsString(); }
 
  private:
+  // Puts @node in the com.microsoft domain, importing it on first use.
+  void SetContribDomain(pblczero::NodeProto* node);
+
   const int opset_;
+  bool contrib_domain_imported_ = false;
   pblczero::ModelProto model_;
 };
 
@@ -27,6 +27,7 @@
 
 #include "neural/onnx/converter.h"
 
+#include <algorithm>
 #include <climits>
 #include <cmath>
 #include <cstddef>
@@ -116,13 +117,36 @@ class Converter {
                             const lczero::OnnxConst& gammas,
                             const lczero::OnnxConst& betas, float eps = 1e-6);
 
+  // LayerNormalization(@input + @skip + @biases) of [batch * 64, @size].
+  std::string MakeSkipLayerNorm(OnnxBuilder* builder, const std::string& input,
+                                const std::string& skip,
+                                const std::string& name,
+                                const std::vector<float>& biases,
+                                const std::vector<float>& gammas,
+                                const std::vector<float>& betas, int size);
+
+  // Dense layer with @weights of [outputs][inputs], adding @biases unless
+  // nullptr.
+  std::string MakeDense(OnnxBuilder* builder, const std::string& input,
+                        const std::string& name,
+                        const std::vector<float>& weights,
+                        const std::vector<float>* biases, int inputs,
+                        int outputs, bool int8);
+
+  // Multi-head attention of an encoder as a single Attention operator.
+  std::string MakeFusedAttention(OnnxBuilder* builder,
+                                 const LegacyWeights::EncoderLayer& layer,
+                                 int embedding_size, int heads,
+                                 const std::string& encoder_in,
+                                 const std::string& name);
+
   std::string MakeEncoderLayer(OnnxBuilder* builder,
                                const LegacyWeights::EncoderLayer& layer,
                                int embedding_size, int heads,
                                const std::string& encoder_in,
                                const std::string& name,
                                ActivationFunction activation,
-                               float alpha = 1.0f);
+                               float alpha = 1.0f, bool int8 = false);
 
   std::string MakeAttentionPolicy(OnnxBuilder* builder,
                                   const std::string& input,
@@ -385,67 +409,161 @@ std::string Converter::MakeLayerNorm(OnnxBuilder* builder,
   return flow;
 }
 
-std::string Converter::MakeEncoderLayer(
+std::string Converter::MakeSkipLayerNorm(
+    OnnxBuilder* builder, const std::string& input, const std::string& skip,
+    const std::string& name, const std::vector<float>& biases,
+    const std::vector<float>& gammas, const std::vector<float>& betas,
+    int size) {
+  // The operator wants [batch, sequence, hidden] inputs.
+  auto shape = builder->AddInitializer(
+      "/const" + name + "/shape", Int64OnnxConst({-1, 64, size}, {3}));
+  auto in = builder->Reshape(name + "/input/reshape", input, shape);
+  auto flow = builder->Reshape(name + "/skip/reshape", skip, shape);
+  flow = builder->SkipLayerNormalization(
+      name, in, flow, *GetWeghtsConverter(gammas, {size}),
+      *GetWeghtsConverter(betas, {size}), *GetWeghtsConverter(biases, {size}),
+      1e-6);
+  return builder->Reshape(
+      name + "/reshape", flow,
+      builder->AddInitializer("/const" + name + "/out_shape",
+                              Int64OnnxConst({-1, size}, {2})));
+}
+
+std::string Converter::MakeDense(OnnxBuilder* builder,
+                                 const std::string& input,
+                                 const std::string& name,
+                                 const std::vector<float>& weights,
+                                 const std::vector<float>* biases, int inputs,
+                                 int outputs, bool int8) {
+  if (!int8) {
+    auto flow = builder->MatMul(
+        name + "/w", input,
+        *GetWeghtsConverter(weights, {inputs, outputs}, {1, 0}));
+    if (!biases) return flow;
+    return builder->Add(name + "/b", flow,
+                        *GetWeghtsConverter(*biases, {outputs}));
+  }
+  // Symmetric quantization with a scale per output, transposed to
+  // [inputs][outputs].
+  std::vector<int8_t> quantized(weights.size());
+  std::vector<float> scales(outputs);
+  for (int o = 0; o < outputs; o++) {
+    float max = 0.0f;
+    for (int i = 0; i < inputs; i++) {
+      max = std::max(max, std::abs(weights[o * inputs + i]));
+    }
+    scales[o] = max > 0.0f ? max / 127.0f : 1.0f;
+    for (int i = 0; i < inputs; i++) {
+      quantized[i * outputs + o] = static_cast<int8_t>(
+          std::round(weights[o * inputs + i] / scales[o]));
+    }
+  }
+  std::unique_ptr<OnnxConst> bias;
+  if (biases) bias = GetWeghtsConverter(*biases, {outputs});
+  return builder->DynamicQuantizeMatMul(
+      name + "/int8", input, Int8OnnxConst(quantized, {inputs, outputs}),
+      FloatOnnxConst(scales, {outputs}), bias.get());
+}
+
+std::string Converter::MakeFusedAttention(
     OnnxBuilder* builder, const LegacyWeights::EncoderLayer& layer,
     int embedding_size, int heads, const std::string& encoder_in,
-    const std::string& name, ActivationFunction activation, float alpha) {
+    const std::string& name) {
   const int d_model = layer.mha.q_b.size();
-  const int depth = d_model / heads;
-
-  auto mha_shape =
-      builder->AddInitializer("/const" + name + "/mha/shape",
-                              Int64OnnxConst({-1, 64, heads, depth}, {4}));
-  auto flow = builder->MatMul(
-      name + "/mha/Q/w", encoder_in,
-      *GetWeghtsConverter(layer.mha.q_w, {embedding_size, d_model}, {1, 0}));
-  flow = builder->Add(name + "/mha/Q/b", flow,
-                      *GetWeghtsConverter(layer.mha.q_b, {d_model}));
-  flow = builder->Reshape(name + "/mha/Q/reshape", flow, mha_shape);
-  auto Q = builder->Transpose(name + "/mha/Q/transpose", flow, {0, 2, 1, 3});
-  flow = builder->MatMul(
-      name + "/mha/K/w", encoder_in,
-      *GetWeghtsConverter(layer.mha.k_w, {embedding_size, d_model}, {1, 0}));
-  flow = builder->Add(name + "/mha/K/b", flow,
-                      *GetWeghtsConverter(layer.mha.k_b, {d_model}));
-  flow = builder->Reshape(name + "/mha/K/reshape", flow, mha_shape);
-  auto K = builder->Transpose(name + "/mha/K/transpose", flow, {0, 2, 3, 1});
-  flow = builder->MatMul(
-      name + "/mha/V/w", encoder_in,
-      *GetWeghtsConverter(layer.mha.v_w, {embedding_size, d_model}, {1, 0}));
-  flow = builder->Add(name + "/mha/V/b", flow,
-                      *GetWeghtsConverter(layer.mha.v_b, {d_model}));
-  flow = builder->Reshape(name + "/mha/V/reshape", flow, mha_shape);
-  auto V = builder->Transpose(name + "/mha/V/transpose", flow, {0, 2, 1, 3});
-  flow = builder->MatMul(name + "/mha/QK/matmul", Q, K);
-  std::unique_ptr<OnnxConst> scale;
-  if (GetDataType() == pblczero::TensorProto::FLOAT16) {
-    scale = std::make_unique<Float16OnnxConst>(
-        Float16OnnxConst({FP32toFP16(1.0f / sqrtf(depth))}, {1}));
-  } else {
-    scale = std::make_unique<FloatOnnxConst>(
-        FloatOnnxConst({1.0f / sqrtf(depth)}, {1}));
+  // Q, K and V weights side by side in [embedding_size][3 * d_model].
+  std::vector<float> weights(embedding_size * 3 * d_model);
+  std::vector<float> biases;
+  int offset = 0;
+  for (const auto* w : {&layer.mha.q_w, &layer.mha.k_w, &layer.mha.v_w}) {
+    for (int o = 0; o < d_model; o++) {
+      for (int i = 0; i < embedding_size; i++) {
+        weights[i * 3 * d_model + offset + o] = (*w)[o * embedding_size + i];
+      }
+    }
+    offset += d_model;
   }
-  flow = builder->Mul(name + "/mha/QK/scale", flow, *scale);
+  for (const auto* b : {&layer.mha.q_b, &layer.mha.k_b, &layer.mha.v_b}) {
+    biases.insert(biases.end(), b->begin(), b->end());
+  }
+  // Smolgen is added to the attention logits as a position bias.
+  std::string smolgen_weights;
   if (layer.mha.has_smolgen) {
-    auto smolgen_weights =
+    smolgen_weights =
         MakeSmolgen(builder, layer, embedding_size, heads, encoder_in, name);
-    flow = builder->Add(name + "/smolgen_weights", flow, smolgen_weights);
-  }
-  flow = builder->Softmax(name + "/mha/QK/softmax", flow, 3);
-  flow = builder->MatMul(name + "/mha/QKV/matmul", flow, V);
-  if (heads > 1) {
-    flow = builder->Transpose(name + "/mha/out/transpose", flow, {0, 2, 1, 3});
   }
-  flow = builder->Reshape(
+  auto flow = builder->Reshape(
+      name + "/mha/in/reshape", encoder_in,
+      builder->AddInitializer("/const" + name + "/mha/in/shape",
+                              Int64OnnxConst({-1, 64, embedding_size}, {3})));
+  flow = builder->Attention(
+      name + "/mha/attention", flow,
+      *GetWeghtsConverter(weights, {embedding_size, 3 * d_model}),
+      *GetWeghtsConverter(biases, {3 * d_model}), heads, smolgen_weights);
+  return builder->Reshape(
       name + "/mha/out/reshape", flow,
       builder->AddInitializer("/const" + name + "/mha/out/shape",
                               Int64OnnxConst({-1, d_model}, {2})));
-  flow =
-      builder->MatMul(name + "/mha/out/dense/w", flow,
-                      *GetWeghtsConverter(layer.mha.dense_w,
-                                          {d_model, embedding_size}, {1, 0}));
-  flow = builder->Add(name + "/mha/out/dense/b", flow,
-                      *GetWeghtsConverter(layer.mha.dense_b, {embedding_size}));
+}
+
+std::string Converter::MakeEncoderLayer(
+    OnnxBuilder* builder, const LegacyWeights::EncoderLayer& layer,
+    int embedding_size, int heads, const std::string& encoder_in,
+    const std::string& name, ActivationFunction activation, float alpha,
+    bool int8) {
+  const int d_model = layer.mha.q_b.size();
+  const int depth = d_model / heads;
+
+  std::string flow;
+  if (options_.fused_attention) {
+    flow = MakeFusedAttention(builder, layer, embedding_size, heads,
+                              encoder_in, name);
+  } else {
+    auto mha_shape =
+        builder->AddInitializer("/const" + name + "/mha/shape",
+                                Int64OnnxConst({-1, 64, heads, depth}, {4}));
+    flow = MakeDense(builder, encoder_in, name + "/mha/Q", layer.mha.q_w,
+                     &layer.mha.q_b, embedding_size, d_model, int8);
+    flow = builder->Reshape(name + "/mha/Q/reshape", flow, mha_shape);
+    auto Q = builder->Transpose(name + "/mha/Q/transpose", flow, {0, 2, 1, 3});
+    flow = MakeDense(builder, encoder_in, name + "/mha/K", layer.mha.k_w,
+                     &layer.mha.k_b, embedding_size, d_model, int8);
+    flow = builder->Reshape(name + "/mha/K/reshape", flow, mha_shape);
+    auto K = builder->Transpose(name + "/mha/K/transpose", flow, {0, 2, 3, 1});
+    flow = MakeDense(builder, encoder_in, name + "/mha/V", layer.mha.v_w,
+                     &layer.mha.v_b, embedding_size, d_model, int8);
+    flow = builder->Reshape(name + "/mha/V/reshape", flow, mha_shape);
+    auto V = builder->Transpose(name + "/mha/V/transpose", flow, {0, 2, 1, 3});
+    flow = builder->MatMul(name + "/mha/QK/matmul", Q, K);
+    std::unique_ptr<OnnxConst> scale;
+    if (GetDataType() == pblczero::TensorProto::FLOAT16) {
+      scale = std::make_unique<Float16OnnxConst>(
+          Float16OnnxConst({FP32toFP16(1.0f / sqrtf(depth))}, {1}));
+    } else {
+      scale = std::make_unique<FloatOnnxConst>(
+          FloatOnnxConst({1.0f / sqrtf(depth)}, {1}));
+    }
+    flow = builder->Mul(name + "/mha/QK/scale", flow, *scale);
+    if (layer.mha.has_smolgen) {
+      auto smolgen_weights =
+          MakeSmolgen(builder, layer, embedding_size, heads, encoder_in, name);
+      flow = builder->Add(name + "/smolgen_weights", flow, smolgen_weights);
+    }
+    flow = builder->Softmax(name + "/mha/QK/softmax", flow, 3);
+    flow = builder->MatMul(name + "/mha/QKV/matmul", flow, V);
+    if (heads > 1) {
+      flow =
+          builder->Transpose(name + "/mha/out/transpose", flow, {0, 2, 1, 3});
+    }
+    flow = builder->Reshape(
+        name + "/mha/out/reshape", flow,
+        builder->AddInitializer("/const" + name + "/mha/out/shape",
+                                Int64OnnxConst({-1, d_model}, {2})));
+  }
+  // With the fused layer normalization the biases are added by it.
+  const bool fused_ln = options_.fused_layer_norm;
+  flow = MakeDense(builder, flow, name + "/mha/out/dense", layer.mha.dense_w,
+                   fused_ln ? nullptr : &layer.mha.dense_b, d_model,
+                   embedding_size, int8);
   std::unique_ptr<OnnxConst> alpha_onnx;
   std::string alpha_in;
   if (alpha != 1.0) {
@@ -460,37 +578,41 @@ std::string Converter::MakeEncoderLayer(
   } else {
     alpha_in = encoder_in;
   }
-  flow = builder->Add(name + "/mha/out/skip", flow, alpha_in);
-  auto ffn_in =
-      MakeLayerNorm(builder, flow, name + "/ln1",
-                    *GetWeghtsConverter(layer.ln1_gammas, {embedding_size}),
-                    *GetWeghtsConverter(layer.ln1_betas, {embedding_size}));
+  std::string ffn_in;
+  if (fused_ln) {
+    ffn_in = MakeSkipLayerNorm(builder, flow, alpha_in, name + "/ln1",
+                               layer.mha.dense_b, layer.ln1_gammas,
+                               layer.ln1_betas, embedding_size);
+  } else {
+    flow = builder->Add(name + "/mha/out/skip", flow, alpha_in);
+    ffn_in =
+        MakeLayerNorm(builder, flow, name + "/ln1",
+                      *GetWeghtsConverter(layer.ln1_gammas, {embedding_size}),
+                      *GetWeghtsConverter(layer.ln1_betas, {embedding_size}));
+  }
   const int dff_size = layer.ffn.dense1_b.size();
-  flow =
-      builder->MatMul(name + "/ffn/dense1/w", ffn_in,
-                      *GetWeghtsConverter(layer.ffn.dense1_w,
-                                          {embedding_size, dff_size}, {1, 0}));
-  flow = builder->Add(name + "/ffn/dense1/b", flow,
-                      *GetWeghtsConverter(layer.ffn.dense1_b, {dff_size}));
+  flow = MakeDense(builder, ffn_in, name + "/ffn/dense1", layer.ffn.dense1_w,
+                   &layer.ffn.dense1_b, embedding_size, dff_size, int8);
 
   const auto ffn_activation = static_cast<ActivationFunction>(
       src_.format().network_format().ffn_activation());
   flow = MakeActivation(
       builder, flow, name + "/ffn/dense1",
       ffn_activation == ACTIVATION_DEFAULT ? activation : ffn_activation);
-  flow =
-      builder->MatMul(name + "/ffn/dense2/w", flow,
-                      *GetWeghtsConverter(layer.ffn.dense2_w,
-                                          {dff_size, embedding_size}, {1, 0}));
-  flow =
-      builder->Add(name + "/ffn/dense2/b", flow,
-                   *GetWeghtsConverter(layer.ffn.dense2_b, {embedding_size}));
+  flow = MakeDense(builder, flow, name + "/ffn/dense2", layer.ffn.dense2_w,
+                   fused_ln ? nullptr : &layer.ffn.dense2_b, dff_size,
+                   embedding_size, int8);
   std::string alpha_ffn_in;
   if (alpha != 1.0) {
     alpha_ffn_in = builder->Mul(name + "/alpha*out1", ffn_in, *alpha_onnx);
   } else {
     alpha_ffn_in = ffn_in;
   }
+  if (fused_ln) {
+    return MakeSkipLayerNorm(builder, flow, alpha_ffn_in, name + "/ln2",
+                             layer.ffn.dense2_b, layer.ln2_gammas,
+                             layer.ln2_betas, embedding_size);
+  }
   flow = builder->Add(name + "/ffn/skip", flow, alpha_ffn_in);
   flow = MakeLayerNorm(builder, flow, name + "/ln2",
                        *GetWeghtsConverter(layer.ln2_gammas, {embedding_size}),
@@ -619,9 +741,11 @@ std::string Converter::MakeAttentionBody(OnnxBuilder* builder,
 
   float alpha = std::pow(2.0f * NumEncBlocks(), 0.25f);
   for (size_t i = 0; i < NumEncBlocks(); i++) {
+    const bool int8 =
+        options_.int8 && !options_.float_encoder_layers.count(i);
     flow = MakeEncoderLayer(
         builder, weights.encoder[i], embedding_size, weights.encoder_head_count,
-        flow, "/encoder" + std::to_string(i), default_activation_, alpha);
+        flow, "/encoder" + std::to_string(i), default_activation_, alpha, int8);
   }
   return flow;
 }
@@ -1022,6 +1146,10 @@ void Converter::Convert(pblczero::Net* dst) {
     throw Exception("The network already has ONNX section.");
   }
   CheckSrcFormat(src_.format().network_format());
+  if (options_.int8 &&
+      options_.data_type_ != WeightsToOnnxConverterOptions::DataType::kFloat32) {
+    throw Exception("Int8 quantization needs a float32 model.");
+  }
   CopyGenericFields(dst);
   GenerateOnnx(dst->mutable_onnx_model());
 }
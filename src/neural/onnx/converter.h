@@ -27,6 +27,9 @@
 
 #pragma once
 
+#include <set>
+#include <string>
+
 #include "neural/onnx/onnx.pb.h"
 #include "proto/net.pb.h"
 
@@ -45,6 +48,18 @@ struct WeightsToOnnxConverterOptions {
   int opset = 17;
   bool alt_mish = false;
   bool alternative_layer_normalization = false;
+  // Emit the attention and the layer normalizations after the skip
+  // connections of the encoders as onnxruntime contrib operators (Attention,
+  // SkipLayerNormalization), which have fused kernels.
+  bool fused_attention = false;
+  bool fused_layer_norm = false;
+  // Quantize the dense layers of the body encoders to int8 weights, with the
+  // activations quantized at run time (DynamicQuantizeMatMul). Needs
+  // kFloat32. The Q, K and V projections stay in floating point with
+  // fused_attention.
+  bool int8 = false;
+  // Body encoder layers to keep in floating point with int8.
+  std::set<int> float_encoder_layers;
 };
 
 // Converts "classical" weights file to weights file with embedded ONNX model.
@@ -30,7 +30,10 @@
 #include <fstream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #if __has_include("dml_provider_factory.h")
@@ -43,8 +46,8 @@
 #include "neural/loader.h"
 #include "neural/network.h"
 #include "neural/onnx/converter.h"
+#include "neural/shared/expand_planes.h"
 #include "onnxruntime_cxx_api.h"
-#include "utils/bititer.h"
 #include "utils/exception.h"
 #include "utils/fp16_utils.h"
 #include "utils/logging.h"
@@ -56,10 +59,67 @@ enum class OnnxProvider { CPU, CUDA, DML, ROCM };
 
 class OnnxNetwork;
 
+// Input and output buffers of a computation, pooled in the network so that
+// they are allocated once and reused, with the I/O bindings over them.
+template <typename DataType>
+struct IoBuffers {
+  // Grows the buffers for chunks of up to @chunk samples and outputs of
+  // @samples samples with @output_sizes values each. Growing drops the
+  // bindings to the old memory.
+  void Reserve(size_t chunk, size_t samples,
+               const std::vector<size_t>& output_sizes) {
+    bool grown = false;
+    if (input.size() < chunk * kInputPlanes * 64) {
+      input.resize(chunk * kInputPlanes * 64);
+      grown = true;
+    }
+    outputs.resize(output_sizes.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+      if (outputs[i].size() >= samples * output_sizes[i]) continue;
+      outputs[i].resize(samples * output_sizes[i]);
+      grown = true;
+    }
+    if (grown) {
+      for (auto& binding : bindings) binding.batch = 0;
+    }
+  }
+
+  std::vector<DataType> input;
+  std::vector<std::vector<DataType>> outputs;
+  // Per session and step, the binding and the samples it is bound to.
+  struct Binding {
+    std::unique_ptr<Ort::IoBinding> binding;
+    int start = 0;
+    int batch = 0;
+  };
+  std::vector<Binding> bindings;
+};
+
+template <typename DataType>
+class IoBufferPool {
+ public:
+  std::unique_ptr<IoBuffers<DataType>> Acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) return std::make_unique<IoBuffers<DataType>>();
+    auto buffers = std::move(free_.back());
+    free_.pop_back();
+    return buffers;
+  }
+  void Release(std::unique_ptr<IoBuffers<DataType>> buffers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(buffers));
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<IoBuffers<DataType>>> free_;
+};
+
 template <typename DataType>
 class OnnxComputation : public NetworkComputation {
  public:
   OnnxComputation(OnnxNetwork* network);
+  ~OnnxComputation() override;
   void AddInput(InputPlanes&& input) override;
   int GetBatchSize() const override { return raw_input_.size(); }
   void ComputeBlocking() override;
@@ -70,13 +130,13 @@ class OnnxComputation : public NetworkComputation {
 
  private:
   Ort::Value PrepareInputs(int start, int batch_size);
+  Ort::Value MakeOutputTensor(size_t output, int start, int batch_size);
+  void Run(size_t session, int step, int start, int batch_size);
 
   OnnxNetwork* network_;
   std::vector<InputPlanes> raw_input_;
-  std::vector<DataType> input_tensor_data_;
-  std::vector<Ort::Value> output_tensors_;
-  std::vector<std::vector<DataType>> output_tensors_data_;
-  std::vector<size_t> output_tensors_step_;
+  // Taken from the network pool by the first ComputeBlocking().
+  std::unique_ptr<IoBuffers<DataType>> buffers_;
 };
 
 class OnnxNetwork : public Network {
@@ -100,16 +160,46 @@ class OnnxNetwork : public Network {
   }
   bool IsCpu() const override { return provider_ == OnnxProvider::CPU; }
 
+  // Returns the session slot used by the fewest computations, preferably an
+  // idle one, and marks it used.
+  size_t AcquireSession();
+  void ReleaseSession(size_t slot);
+
+  template <typename DataType>
+  IoBufferPool<DataType>& GetIoBufferPool() {
+    return std::get<IoBufferPool<DataType>>(io_buffer_pools_);
+  }
+
   Ort::Env onnx_env_;
   // Prepare sessions for this many multiples of the batch size;
   int steps_;
-  std::vector<Ort::Session> session_;
+  // Shares the prepacked weights of the CPU provider between the sessions.
+  // Declared before sessions_ since it has to outlive them.
+  Ort::PrepackedWeightsContainer prepacked_weights_;
+  // A session for every step. Computations running concurrently get
+  // different slots while there are enough, so they don't share the scratch
+  // memory and thread pool of a session.
+  struct SessionSlot {
+    std::vector<Ort::Session> steps;
+    int users = 0;
+    // For conditional locking if running the DML or ROCm provider.
+    std::mutex lock;
+  };
+  std::vector<std::unique_ptr<SessionSlot>> sessions_;
+  std::mutex sessions_mutex_;
+  Ort::MemoryInfo memory_info_{nullptr};
+  // Run through I/O bindings rather than passing the tensors to every run.
+  bool io_binding_;
+  std::tuple<IoBufferPool<float>, IoBufferPool<Ort::Float16_t>>
+      io_buffer_pools_;
   std::vector<std::string> inputs_;
   // Points to strings in inputs_.
   std::vector<const char*> inputs_cstr_;
   std::vector<std::string> outputs_;
   // Points to strings in outputs_.
   std::vector<const char*> outputs_cstr_;
+  // Values per sample of every output.
+  std::vector<size_t> output_sizes_;
   // Indices in output_cstr_ vector.
   int policy_head_ = -1;
   int wdl_head_ = -1;
@@ -120,33 +210,32 @@ class OnnxNetwork : public Network {
   // The batch size to use, or -1 for variable.
   int batch_size_;
   static constexpr int max_batch_size_ = 1024;
-  // For conditional locking if running the DML provider.
   OnnxProvider provider_;
-  std::mutex lock_;
 };
 
+size_t OnnxNetwork::AcquireSession() {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  size_t best = 0;
+  for (size_t i = 1; i < sessions_.size(); i++) {
+    if (sessions_[i]->users < sessions_[best]->users) best = i;
+  }
+  sessions_[best]->users++;
+  return best;
+}
+
+void OnnxNetwork::ReleaseSession(size_t slot) {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  sessions_[slot]->users--;
+}
+
 template <typename DataType>
 OnnxComputation<DataType>::OnnxComputation(OnnxNetwork* network)
-    : network_(network) {
-  output_tensors_data_.resize(network_->outputs_.size());
-  output_tensors_step_.resize(network_->outputs_.size());
-  output_tensors_step_[network_->policy_head_] = 1858;
-  output_tensors_data_[network_->policy_head_] =
-      std::vector<DataType>(1858 * network_->max_batch_size_);
-  if (network_->wdl_head_ != -1) {
-    output_tensors_step_[network_->wdl_head_] = 3;
-    output_tensors_data_[network_->wdl_head_] =
-        std::vector<DataType>(3 * network_->max_batch_size_);
-  }
-  if (network_->value_head_ != -1) {
-    output_tensors_step_[network_->value_head_] = 1;
-    output_tensors_data_[network_->value_head_] =
-        std::vector<DataType>(network_->max_batch_size_);
-  }
-  if (network_->mlh_head_ != -1) {
-    output_tensors_step_[network_->mlh_head_] = 1;
-    output_tensors_data_[network_->mlh_head_] =
-        std::vector<DataType>(network_->max_batch_size_);
+    : network_(network) {}
+
+template <typename DataType>
+OnnxComputation<DataType>::~OnnxComputation() {
+  if (buffers_) {
+    network_->GetIoBufferPool<DataType>().Release(std::move(buffers_));
   }
 }
 
@@ -169,10 +258,10 @@ float AsFloat(Ort::Float16_t x) {
 template <typename DataType>
 float OnnxComputation<DataType>::GetQVal(int sample) const {
   if (network_->wdl_head_ != -1) {
-    const auto& data = output_tensors_data_[network_->wdl_head_];
+    const auto& data = buffers_->outputs[network_->wdl_head_];
     return AsFloat(data[sample * 3 + 0]) - AsFloat(data[sample * 3 + 2]);
   } else {
-    const auto& data = output_tensors_data_[network_->value_head_];
+    const auto& data = buffers_->outputs[network_->value_head_];
     return AsFloat(data[sample]);
   }
 }
@@ -180,105 +269,150 @@ float OnnxComputation<DataType>::GetQVal(int sample) const {
 template <typename DataType>
 float OnnxComputation<DataType>::GetDVal(int sample) const {
   if (network_->wdl_head_ == -1) return 0.0f;
-  const auto& data = output_tensors_data_[network_->wdl_head_];
+  const auto& data = buffers_->outputs[network_->wdl_head_];
   return AsFloat(data[sample * 3 + 1]);
 }
 
 template <typename DataType>
 float OnnxComputation<DataType>::GetPVal(int sample, int move_id) const {
-  const auto& data = output_tensors_data_[network_->policy_head_];
+  const auto& data = buffers_->outputs[network_->policy_head_];
   return AsFloat(data[sample * 1858 + move_id]);
 }
 
 template <typename DataType>
 float OnnxComputation<DataType>::GetMVal(int sample) const {
   if (network_->mlh_head_ == -1) return 0.0f;
-  const auto& data = output_tensors_data_[network_->mlh_head_];
+  const auto& data = buffers_->outputs[network_->mlh_head_];
   return AsFloat(data[sample]);
 }
 
-void AsDataType(float x, float* y) { *y = x; }
-void AsDataType(float x, Ort::Float16_t* y) {
-  uint16_t tmp = FP32toFP16(x);
-  std::memcpy(reinterpret_cast<uint16_t*>(y), &tmp, sizeof(uint16_t));
+void ExpandInput(const InputPlanes& planes, float* output) {
+  ExpandPlanes(planes, output);
+}
+void ExpandInput(const InputPlanes& planes, Ort::Float16_t* output) {
+  static_assert(sizeof(Ort::Float16_t) == sizeof(uint16_t));
+  ExpandPlanesFp16(planes, reinterpret_cast<uint16_t*>(output));
 }
 
+// Expands the samples from @start into the input buffer, padded with zeros
+// to @batch_size, and returns the input tensor over it.
 template <typename DataType>
 Ort::Value OnnxComputation<DataType>::PrepareInputs(int start, int batch_size) {
-  input_tensor_data_.clear();
-  input_tensor_data_.resize(batch_size * kInputPlanes * 8 * 8);
-  auto iter = input_tensor_data_.data();
+  auto& input = buffers_->input;
+  const size_t size = batch_size * kInputPlanes * 64;
+  auto iter = input.data();
   int end = std::min(start + batch_size, static_cast<int>(raw_input_.size()));
   for (int i = start; i < end; i++) {
-    for (const auto& plane : raw_input_[i]) {
-      DataType value;
-      AsDataType(plane.value, &value);
-      for (auto bit : IterateBits(plane.mask)) {
-        *(iter + bit) = value;
-      }
-      iter += 64;
-    }
-  }
-  for (int i = end; i < start + batch_size; i++) {
-    for (int j = 0; j < kInputPlanes * 64; j++) {
-      *iter++ = DataType();
-    }
+    ExpandInput(raw_input_[i], iter);
+    iter += kInputPlanes * 64;
   }
+  std::fill(iter, input.data() + size, DataType());
+
+  int64_t dims[] = {batch_size, kInputPlanes, 8, 8};
+  return Ort::Value::CreateTensor<DataType>(network_->memory_info_,
+                                            input.data(), size, dims, 4);
+}
 
-  auto memory_info =
-      Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+template <typename DataType>
+Ort::Value OnnxComputation<DataType>::MakeOutputTensor(size_t output,
+                                                       int start,
+                                                       int batch_size) {
+  const int64_t size = network_->output_sizes_[output];
+  int64_t dims[] = {batch_size, size};
+  return Ort::Value::CreateTensor<DataType>(
+      network_->memory_info_, buffers_->outputs[output].data() + start * size,
+      size * batch_size, dims, 2);
+}
 
-  output_tensors_.clear();
-  for (size_t i = 0; i < output_tensors_step_.size(); i++) {
-    int size = output_tensors_step_[i];
-    int64_t dims[] = {batch_size, size};
-    output_tensors_.emplace_back(Ort::Value::CreateTensor<DataType>(
-        memory_info, output_tensors_data_[i].data() + start * size,
-        size * batch_size, dims, 2));
+template <typename DataType>
+void OnnxComputation<DataType>::Run(size_t session, int step, int start,
+                                    int batch_size) {
+  auto& slot = *network_->sessions_[session];
+  auto input_tensor = PrepareInputs(start, batch_size);
+  // The DML onnxruntime execution provider is documented as not supporting
+  // multi-threaded calls to Run on the same inference session. We found the
+  // same to be true for the ROCm execution provider (at least for CNNs).
+  // TODO: This may be a onnxruntime/ROCm bug, check onnxruntime 1.16 release.
+  std::unique_lock<std::mutex> lock(slot.lock, std::defer_lock);
+  if (network_->provider_ == OnnxProvider::DML ||
+      network_->provider_ == OnnxProvider::ROCM) {
+    lock.lock();
   }
-
-  int64_t dims[] = {batch_size, kInputPlanes, 8, 8};
-  return Ort::Value::CreateTensor<DataType>(memory_info,
-                                            input_tensor_data_.data(),
-                                            input_tensor_data_.size(), dims, 4);
+  if (!network_->io_binding_) {
+    std::vector<Ort::Value> output_tensors;
+    for (size_t i = 0; i < network_->outputs_.size(); i++) {
+      output_tensors.emplace_back(MakeOutputTensor(i, start, batch_size));
+    }
+    slot.steps[step - 1].Run({}, network_->inputs_cstr_.data(),
+                             &input_tensor, 1, network_->outputs_cstr_.data(),
+                             output_tensors.data(), output_tensors.size());
+    return;
+  }
+  auto& bound = buffers_->bindings[session * network_->steps_ + step - 1];
+  if (!bound.binding) {
+    bound.binding = std::make_unique<Ort::IoBinding>(slot.steps[step - 1]);
+  }
+  // BindInput() copies the input to the device for the GPU providers, so the
+  // input is bound for every run.
+  bound.binding->ClearBoundInputs();
+  bound.binding->BindInput(network_->inputs_cstr_[0], input_tensor);
+  // The output bindings stay valid while the buffers don't move, so only a
+  // chunk of a different size or position needs binding again.
+  if (bound.start != start || bound.batch != batch_size) {
+    bound.binding->ClearBoundOutputs();
+    for (size_t i = 0; i < network_->outputs_.size(); i++) {
+      bound.binding->BindOutput(network_->outputs_cstr_[i],
+                                MakeOutputTensor(i, start, batch_size));
+    }
+    bound.start = start;
+    bound.batch = batch_size;
+  }
+  slot.steps[step - 1].Run(Ort::RunOptions{nullptr}, *bound.binding);
 }
 
 template <typename DataType>
 void OnnxComputation<DataType>::ComputeBlocking() {
+  if (raw_input_.empty()) return;
   int batch_size = network_->batch_size_;
   if (batch_size < 0) batch_size = raw_input_.size();
 
-  for (size_t i = 0; i < raw_input_.size();) {
-    int step = (raw_input_.size() - i + batch_size - 1) / batch_size;
+  // Split into chunks of whole steps, and size the buffers for them.
+  std::vector<std::pair<int, int>> chunks;  // Step and first sample.
+  int largest_chunk = 0;
+  int padded_size = 0;
+  while (padded_size < static_cast<int>(raw_input_.size())) {
+    int step = (raw_input_.size() - padded_size + batch_size - 1) / batch_size;
     if (step > network_->steps_) step = network_->steps_;
-    int batch = batch_size * step;
-
-    auto input_tensor = PrepareInputs(i, batch);
-    // The DML onnxruntime execution provider is documented as not supporting
-    // multi-threaded calls to Run on the same inference session. We found the
-    // same to be true for the ROCm execution provider (at least for CNNs).
-    // TODO: This may be a onnxruntime/ROCm bug, check onnxruntime 1.16 release.
-    if (network_->provider_ == OnnxProvider::DML ||
-        network_->provider_ == OnnxProvider::ROCM) {
-      network_->lock_.lock();
-    }
-    network_->session_[step - 1].Run(
-        {}, network_->inputs_cstr_.data(), &input_tensor, 1,
-        network_->outputs_cstr_.data(), output_tensors_.data(),
-        output_tensors_.size());
-    if (network_->provider_ == OnnxProvider::DML ||
-        network_->provider_ == OnnxProvider::ROCM) {
-      network_->lock_.unlock();
+    chunks.emplace_back(step, padded_size);
+    largest_chunk = std::max(largest_chunk, batch_size * step);
+    padded_size += batch_size * step;
+  }
+  if (!buffers_) buffers_ = network_->GetIoBufferPool<DataType>().Acquire();
+  buffers_->bindings.resize(network_->sessions_.size() * network_->steps_);
+  buffers_->Reserve(largest_chunk, padded_size, network_->output_sizes_);
+
+  const size_t session = network_->AcquireSession();
+  try {
+    for (const auto& [step, start] : chunks) {
+      Run(session, step, start, batch_size * step);
     }
-    i += batch;
+  } catch (...) {
+    network_->ReleaseSession(session);
+    throw;
   }
+  network_->ReleaseSession(session);
 }
 
 Ort::SessionOptions GetOptions(OnnxProvider provider, int gpu, int threads,
-                               int batch_size) {
+                               int batch_size,
+                               const std::string& thread_affinities) {
   Ort::SessionOptions options;
   options.SetIntraOpNumThreads(threads);
   options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+  if (!thread_affinities.empty()) {
+    options.AddConfigEntry("session.intra_op_thread_affinities",
+                           thread_affinities.c_str());
+  }
 
   if (batch_size > 0) {
     // Override the default (variable) batch size.
@@ -325,11 +459,29 @@ Ort::SessionOptions GetOptions(OnnxProvider provider, int gpu, int threads,
   return options;
 }
 
-OnnxNetwork::OnnxNetwork(const WeightsFile& file, const OptionsDict&,
+// Returns the intra-op thread affinities pinning the @threads threads of
+// session @slot to consecutive logical processors, the first of them left to
+// the thread calling Run.
+std::string GetThreadAffinities(int slot, int threads) {
+  if (threads <= 1) return "";
+  const int processors = std::max(1u, std::thread::hardware_concurrency());
+  std::string affinities;
+  for (int i = 1; i < threads; i++) {
+    if (!affinities.empty()) affinities += ";";
+    // Onnxruntime numbers the logical processors from 1.
+    affinities += std::to_string((slot * threads + i) % processors + 1);
+  }
+  return affinities;
+}
+
+OnnxNetwork::OnnxNetwork(const WeightsFile& file, const OptionsDict& options,
                          OnnxProvider provider, int gpu, int threads,
                          int batch_size, int steps)
     : onnx_env_(ORT_LOGGING_LEVEL_WARNING, "lc0"),
       steps_(steps),
+      memory_info_(
+          Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+      io_binding_(options.GetOrDefault<bool>("io_binding", true)),
       capabilities_{file.format().network_format().input(),
                     file.format().network_format().moves_left()},
       fp16_(file.onnx_model().data_type() == pblczero::OnnxModel::FLOAT16),
@@ -341,11 +493,28 @@ OnnxNetwork::OnnxNetwork(const WeightsFile& file, const OptionsDict&,
     batch_size_ = max_batch_size_ / steps_;
   }
 
-  for (int step = 1; step <= steps_; step++)
-    session_.emplace_back(
-        onnx_env_, file.onnx_model().model().data(),
-        file.onnx_model().model().size(),
-        GetOptions(provider, gpu, threads, batch_size_ * step));
+  const int sessions = options.GetOrDefault<int>("sessions", 1);
+  if (sessions < 1) throw Exception("The ONNX backend needs a session.");
+  const bool pin_threads = options.GetOrDefault<bool>("pin_threads", false);
+  for (int slot = 0; slot < sessions; slot++) {
+    sessions_.push_back(std::make_unique<SessionSlot>());
+    const std::string affinities =
+        pin_threads ? GetThreadAffinities(slot, threads) : "";
+    for (int step = 1; step <= steps_; step++) {
+      const auto session_options =
+          GetOptions(provider, gpu, threads, batch_size_ * step, affinities);
+      if (provider == OnnxProvider::CPU) {
+        sessions_.back()->steps.emplace_back(
+            onnx_env_, file.onnx_model().model().data(),
+            file.onnx_model().model().size(), session_options,
+            prepacked_weights_);
+      } else {
+        sessions_.back()->steps.emplace_back(
+            onnx_env_, file.onnx_model().model().data(),
+            file.onnx_model().model().size(), session_options);
+      }
+    }
+  }
 
   const auto& md = file.onnx_model();
   if (!md.has_input_planes()) {
@@ -357,18 +526,22 @@ OnnxNetwork::OnnxNetwork(const WeightsFile& file, const OptionsDict&,
   }
   policy_head_ = outputs_.size();
   outputs_.emplace_back(md.output_policy());
+  output_sizes_.push_back(1858);
   if (md.has_output_wdl()) {
     wdl_head_ = outputs_.size();
     outputs_.emplace_back(md.output_wdl());
+    output_sizes_.push_back(3);
   } else if (md.has_output_value()) {
     value_head_ = outputs_.size();
     outputs_.emplace_back(md.output_value());
+    output_sizes_.push_back(1);
   } else {
     throw Exception("NN doesn't have value head.");
   }
   if (md.has_output_mlh()) {
     mlh_head_ = outputs_.size();
     outputs_.emplace_back(md.output_mlh());
+    output_sizes_.push_back(1);
   }
   std::transform(inputs_.begin(), inputs_.end(),
                  std::back_inserter(inputs_cstr_),
@@ -407,8 +580,14 @@ std::unique_ptr<Network> MakeOnnxNetwork(const std::optional<WeightsFile>& w,
     converter_options.opset = opts.GetOrDefault<int>("opset", 17);
     converter_options.alt_mish = opts.GetOrDefault<bool>(
         "alt_mish", kProvider == OnnxProvider::CPU ? true : false);
+    converter_options.fused_attention =
+        opts.GetOrDefault<bool>("fused_attention", false);
+    converter_options.fused_layer_norm =
+        opts.GetOrDefault<bool>("fused_layer_norm", false);
     converter_options.alternative_layer_normalization =
-        opts.GetOrDefault<bool>("alternative_layer_normalization", true);
+        opts.GetOrDefault<bool>("alternative_layer_normalization",
+                                !converter_options.fused_layer_norm);
+    converter_options.int8 = opts.GetOrDefault<bool>("int8", false);
     converter_options.data_type_ =
         fp16 ? WeightsToOnnxConverterOptions::DataType::kFloat16
              : WeightsToOnnxConverterOptions::DataType::kFloat32;
@@ -28,6 +28,7 @@
 #include "neural/opencl/OpenCL.h"
 #include "neural/opencl/OpenCLParams.h"
 #include "neural/shared/activation.h"
+#include "neural/shared/expand_planes.h"
 #include "neural/shared/policy_map.h"
 #include "neural/shared/winograd_filter.h"
 #include "utils/bititer.h"
@@ -107,7 +108,7 @@ class OpenCLComputation : public NetworkComputation {
     for (size_t i = 0; i < plane_count; i += largest_batch_size) {
       const auto batch_size = std::min(plane_count - i, largest_batch_size);
       for (size_t j = 0; j < batch_size; j++) {
-        EncodePlanes(planes_[i + j], &input_data[j * kSquares * kInputPlanes]);
+        ExpandPlanes(planes_[i + j], &input_data[j * kSquares * kInputPlanes]);
       }
 
       buffers_->forward(input_data, output_pol, output_val, output_mov,
@@ -204,8 +205,6 @@ class OpenCLComputation : public NetworkComputation {
   static constexpr auto kHeight = 8;
   static constexpr auto kSquares = kWidth * kHeight;
 
-  void EncodePlanes(const InputPlanes& sample, float* buffer);
-
   const OpenCL_Network& opencl_net_;
   const OpenCLWeights& weights_;
 
@@ -220,15 +219,6 @@ class OpenCLComputation : public NetworkComputation {
   bool moves_left_;
 };
 
-void OpenCLComputation::EncodePlanes(const InputPlanes& sample, float* buffer) {
-  for (const InputPlane& plane : sample) {
-    const float value = plane.value;
-    for (auto i = 0; i < kSquares; i++) {
-      *(buffer++) = (plane.mask & (((uint64_t)1) << i)) != 0 ? value : 0;
-    }
-  }
-}
-
 class OpenCLNetwork : public Network {
  public:
   virtual ~OpenCLNetwork(){};
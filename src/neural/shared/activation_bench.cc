@@ -0,0 +1,75 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <vector>
+
+#include "benchmark/microbench.h"
+#include "neural/shared/activation.h"
+
+namespace lczero {
+namespace {
+
+// One position worth of a 256 filter residual layer. When built with ISPC
+// these go through the ISPC kernels.
+constexpr size_t kSize = 64 * 256;
+
+template <ActivationFunction kActivation>
+void Activation(size_t iterations) {
+  std::vector<float> data(kSize), bias(kSize), output(kSize);
+  for (size_t i = 0; i < kSize; i++) {
+    data[i] = (static_cast<int>(i % 17) - 8) * 0.25f;
+    bias[i] = 0.01f;
+  }
+  for (size_t n = 0; n < iterations; n++) {
+    Activate(kSize, data.data(), bias.data(), output.data(), kActivation);
+    DoNotOptimize(output[n % kSize]);
+  }
+}
+
+void Softmax(size_t iterations) {
+  // An attention policy row.
+  constexpr size_t kRow = 64;
+  std::vector<float> input(kSize), output(kSize);
+  for (size_t i = 0; i < kSize; i++) input[i] = (i % 13) * 0.1f;
+  for (size_t n = 0; n < iterations; n++) {
+    for (size_t row = 0; row < kSize; row += kRow) {
+      SoftmaxActivation(kRow, &input[row], &output[row]);
+    }
+    DoNotOptimize(output[n % kSize]);
+  }
+}
+
+}  // namespace
+
+REGISTER_MICROBENCH("Activation/relu", Activation<ACTIVATION_RELU>)
+REGISTER_MICROBENCH("Activation/mish", Activation<ACTIVATION_MISH>)
+REGISTER_MICROBENCH("Activation/swish", Activation<ACTIVATION_SWISH>)
+REGISTER_MICROBENCH("Activation/relu_2", Activation<ACTIVATION_RELU_2>)
+REGISTER_MICROBENCH("Activation/selu", Activation<ACTIVATION_SELU>)
+REGISTER_MICROBENCH("Activation/softmax", Softmax)
+
+}  // namespace lczero
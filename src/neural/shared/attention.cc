@@ -0,0 +1,206 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/attention.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "utils/cpu_features.h"
+
+// The kernel is compiled once per instruction set below, so everything it
+// calls has to be inlined into the per-target copies.
+#if defined(__GNUC__) || defined(__clang__)
+#define LC0_ATTENTION_INLINE inline __attribute__((always_inline))
+#else
+#define LC0_ATTENTION_INLINE inline
+#endif
+
+namespace lczero {
+namespace {
+
+constexpr int kSquares = 64;
+// Query rows processed together, sharing the loads of K and V.
+constexpr int kTile = 4;
+
+// exp() for x <= 0, written so that the compiler can vectorize the softmax
+// loop (std::exp is a library call). Cephes polynomial, relative error below
+// 2e-7.
+LC0_ATTENTION_INLINE float ExpNonPositive(float x) {
+  x = std::max(x, -87.0f);
+  // Round x / ln(2) to the nearest integer without a rounding call.
+  const float kRound = 12582912.0f;
+  const float n = (x * 1.44269504f + kRound) - kRound;
+  const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  const int32_t bits = (static_cast<int32_t>(n) + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+LC0_ATTENTION_INLINE void SoftmaxRow(float* row) {
+  // Reductions go through kLanes partial results, a strict left to right
+  // reduction would keep the compiler from vectorizing them.
+  constexpr int kLanes = 16;
+  float partial[kLanes];
+  std::copy(row, row + kLanes, partial);
+  for (int j = kLanes; j < kSquares; j += kLanes) {
+    for (int l = 0; l < kLanes; l++) {
+      partial[l] = std::max(partial[l], row[j + l]);
+    }
+  }
+  const float alpha = *std::max_element(partial, partial + kLanes);
+  std::fill(partial, partial + kLanes, 0.0f);
+  for (int j = 0; j < kSquares; j += kLanes) {
+    for (int l = 0; l < kLanes; l++) {
+      row[j + l] = ExpNonPositive(row[j + l] - alpha);
+      partial[l] += row[j + l];
+    }
+  }
+  float denom = 0.0f;
+  for (int l = 0; l < kLanes; l++) denom += partial[l];
+  const float scale = 1.0f / denom;
+  for (int j = 0; j < kSquares; j++) row[j] *= scale;
+}
+
+LC0_ATTENTION_INLINE void AttentionKernel(size_t batch_size, int heads,
+                                          int depth, float scaling,
+                                          const float* q, const float* k,
+                                          const float* v, const float* bias,
+                                          float* output) {
+  const size_t stride = static_cast<size_t>(heads) * depth;
+  // K of one head, transposed to [depth][64] and pre-scaled, so that the
+  // inner loops below run over contiguous keys and vectorize.
+  std::vector<float> kt(depth * kSquares);
+  // Attention output of the current tile of query rows.
+  std::vector<float> acc(kTile * depth);
+  alignas(64) float scores[kTile][kSquares];
+
+  for (size_t batch = 0; batch < batch_size; batch++) {
+    const size_t batch_start = batch * kSquares * stride;
+    for (int h = 0; h < heads; h++) {
+      const float* K = k + batch_start + h * depth;
+      const float* V = v + batch_start + h * depth;
+      for (int j = 0; j < kSquares; j++) {
+        for (int d = 0; d < depth; d++) {
+          kt[d * kSquares + j] = scaling * K[j * stride + d];
+        }
+      }
+      const float* B =
+          bias ? bias + (batch * heads + h) * kSquares * kSquares : nullptr;
+      for (int i0 = 0; i0 < kSquares; i0 += kTile) {
+        const float* Q = q + batch_start + i0 * stride + h * depth;
+        for (int t = 0; t < kTile; t++) {
+          if (B) {
+            std::copy(B + (i0 + t) * kSquares, B + (i0 + t + 1) * kSquares,
+                      scores[t]);
+          } else {
+            std::fill(scores[t], scores[t] + kSquares, 0.0f);
+          }
+        }
+        // Each row of K^T is loaded once for the whole tile.
+        for (int d = 0; d < depth; d++) {
+          const float* kd = &kt[d * kSquares];
+          for (int t = 0; t < kTile; t++) {
+            const float qd = Q[t * stride + d];
+            for (int j = 0; j < kSquares; j++) scores[t][j] += qd * kd[j];
+          }
+        }
+        for (int t = 0; t < kTile; t++) SoftmaxRow(scores[t]);
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int j = 0; j < kSquares; j++) {
+          const float* vj = V + j * stride;
+          for (int t = 0; t < kTile; t++) {
+            const float p = scores[t][j];
+            float* out = &acc[t * depth];
+            for (int d = 0; d < depth; d++) out[d] += p * vj[d];
+          }
+        }
+        // The tile's query rows are fully consumed by now, so @output may
+        // alias @q.
+        for (int t = 0; t < kTile; t++) {
+          std::copy(&acc[t * depth], &acc[(t + 1) * depth],
+                    output + batch_start + (i0 + t) * stride + h * depth);
+        }
+      }
+    }
+  }
+}
+
+void AttentionGeneric(size_t batch_size, int heads, int depth, float scaling,
+                      const float* q, const float* k, const float* v,
+                      const float* bias, float* output) {
+  AttentionKernel(batch_size, heads, depth, scaling, q, k, v, bias, output);
+}
+
+#if defined(LC0_X86_DISPATCH)
+LC0_TARGET("avx2,fma")
+void AttentionAvx2(size_t batch_size, int heads, int depth, float scaling,
+                   const float* q, const float* k, const float* v,
+                   const float* bias, float* output) {
+  AttentionKernel(batch_size, heads, depth, scaling, q, k, v, bias, output);
+}
+
+LC0_TARGET("avx512f")
+void AttentionAvx512(size_t batch_size, int heads, int depth, float scaling,
+                     const float* q, const float* k, const float* v,
+                     const float* bias, float* output) {
+  AttentionKernel(batch_size, heads, depth, scaling, q, k, v, bias, output);
+}
+#endif
+
+}  // namespace
+
+void FusedAttention(size_t batch_size, int heads, int depth, float scaling,
+                    const float* q, const float* k, const float* v,
+                    const float* bias, float* output) {
+  static const FusedAttentionVariant impl = GetFusedAttentionVariants().front();
+  impl.run(batch_size, heads, depth, scaling, q, k, v, bias, output);
+}
+
+std::vector<FusedAttentionVariant> GetFusedAttentionVariants() {
+  std::vector<FusedAttentionVariant> variants;
+#if defined(LC0_X86_DISPATCH)
+  const auto& cpu = GetCpuFeatures();
+  if (cpu.avx512f) variants.push_back({"avx512", AttentionAvx512});
+  if (cpu.avx2 && cpu.fma) variants.push_back({"avx2", AttentionAvx2});
+#endif
+  variants.push_back({"generic", AttentionGeneric});
+  return variants;
+}
+
+}  // namespace lczero
@@ -0,0 +1,58 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace lczero {
+
+// Computes softmax(scaling * Q * K^T + bias) * V for every sample and head of
+// an attention layer without materializing the full score tensor; only one
+// row of 64 scores is live at a time.
+//
+// @q, @k, @v and @output are [batch_size][64][heads * depth], the layout the
+// Q/K/V dense layers produce. @bias is [batch_size][heads][64][64] (smolgen)
+// or nullptr. @output may be the same buffer as @q.
+void FusedAttention(size_t batch_size, int heads, int depth, float scaling,
+                    const float* q, const float* k, const float* v,
+                    const float* bias, float* output);
+
+// One instruction set version of FusedAttention().
+struct FusedAttentionVariant {
+  const char* name;
+  void (*run)(size_t batch_size, int heads, int depth, float scaling,
+              const float* q, const float* k, const float* v,
+              const float* bias, float* output);
+};
+
+// The variants the current CPU can run, best first. The first one is what
+// FusedAttention() uses, the others are there for tests and benchmarks.
+std::vector<FusedAttentionVariant> GetFusedAttentionVariants();
+
+}  // namespace lczero
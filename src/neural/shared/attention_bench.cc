@@ -0,0 +1,102 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "benchmark/microbench.h"
+#include "neural/shared/attention.h"
+
+namespace lczero {
+namespace {
+
+// Roughly the attention body of a BT3 sized net, for one position.
+constexpr int kHeads = 24;
+constexpr int kDepth = 32;
+constexpr size_t kSize = 64 * kHeads * kDepth;
+
+// The unfused sequence: full score tensor, softmax pass, then the V product.
+void Materialized(size_t iterations) {
+  std::vector<float> q(kSize, 0.01f), k(kSize, 0.02f), v(kSize, 0.03f);
+  std::vector<float> scores(kHeads * 64 * 64), output(kSize);
+  const float scaling = 1.0f / std::sqrt(kDepth);
+  const int stride = kHeads * kDepth;
+  for (size_t n = 0; n < iterations; n++) {
+    for (int h = 0; h < kHeads; h++) {
+      float* s = &scores[h * 64 * 64];
+      for (int i = 0; i < 64; i++) {
+        for (int j = 0; j < 64; j++) {
+          float sum = 0.0f;
+          for (int d = 0; d < kDepth; d++) {
+            sum += q[i * stride + h * kDepth + d] *
+                   k[j * stride + h * kDepth + d];
+          }
+          s[i * 64 + j] = scaling * sum;
+        }
+      }
+    }
+    for (size_t row = 0; row < scores.size(); row += 64) {
+      float* s = &scores[row];
+      const float alpha = *std::max_element(s, s + 64);
+      float denom = 0.0f;
+      for (int j = 0; j < 64; j++) denom += (s[j] = std::exp(s[j] - alpha));
+      for (int j = 0; j < 64; j++) s[j] /= denom;
+    }
+    std::fill(output.begin(), output.end(), 0.0f);
+    for (int h = 0; h < kHeads; h++) {
+      for (int i = 0; i < 64; i++) {
+        float* out = &output[i * stride + h * kDepth];
+        for (int j = 0; j < 64; j++) {
+          const float p = scores[(h * 64 + i) * 64 + j];
+          for (int d = 0; d < kDepth; d++) {
+            out[d] += p * v[j * stride + h * kDepth + d];
+          }
+        }
+      }
+    }
+    DoNotOptimize(output[n % output.size()]);
+  }
+}
+
+void Fused(size_t iterations) {
+  std::vector<float> q(kSize, 0.01f), k(kSize, 0.02f), v(kSize, 0.03f);
+  std::vector<float> output(kSize);
+  const float scaling = 1.0f / std::sqrt(kDepth);
+  for (size_t n = 0; n < iterations; n++) {
+    FusedAttention(1, kHeads, kDepth, scaling, q.data(), k.data(), v.data(),
+                   nullptr, output.data());
+    DoNotOptimize(output[n % output.size()]);
+  }
+}
+
+}  // namespace
+
+REGISTER_MICROBENCH("Attention/materialized", Materialized)
+REGISTER_MICROBENCH("Attention/fused", Fused)
+
+}  // namespace lczero
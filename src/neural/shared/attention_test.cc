@@ -0,0 +1,161 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/attention.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace lczero {
+
+namespace {
+std::vector<float> RandomVector(size_t size, std::mt19937* gen) {
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> result(size);
+  for (auto& x : result) x = dist(*gen);
+  return result;
+}
+
+// Straightforward version with the full score matrix, as the backends did it.
+std::vector<float> ReferenceAttention(size_t batch_size, int heads, int depth,
+                                      float scaling,
+                                      const std::vector<float>& q,
+                                      const std::vector<float>& k,
+                                      const std::vector<float>& v,
+                                      const float* bias) {
+  const int stride = heads * depth;
+  std::vector<float> output(q.size());
+  std::vector<double> scores(64 * 64);
+  for (size_t b = 0; b < batch_size; b++) {
+    for (int h = 0; h < heads; h++) {
+      for (int i = 0; i < 64; i++) {
+        double max = -1e30;
+        for (int j = 0; j < 64; j++) {
+          double sum = 0;
+          for (int d = 0; d < depth; d++) {
+            sum += q[(b * 64 + i) * stride + h * depth + d] *
+                   k[(b * 64 + j) * stride + h * depth + d];
+          }
+          sum *= scaling;
+          if (bias) sum += bias[((b * heads + h) * 64 + i) * 64 + j];
+          scores[i * 64 + j] = sum;
+          max = std::max(max, sum);
+        }
+        double denom = 0;
+        for (int j = 0; j < 64; j++) {
+          scores[i * 64 + j] = std::exp(scores[i * 64 + j] - max);
+          denom += scores[i * 64 + j];
+        }
+        for (int d = 0; d < depth; d++) {
+          double sum = 0;
+          for (int j = 0; j < 64; j++) {
+            sum += scores[i * 64 + j] * v[(b * 64 + j) * stride + h * depth + d];
+          }
+          output[(b * 64 + i) * stride + h * depth + d] = sum / denom;
+        }
+      }
+    }
+  }
+  return output;
+}
+
+void ExpectNear(const std::vector<float>& expected,
+                const std::vector<float>& actual, const char* variant) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_NEAR(expected[i], actual[i], 1e-4f) << variant << " index " << i;
+  }
+}
+}  // namespace
+
+TEST(FusedAttention, MatchesReference) {
+  std::mt19937 gen(42);
+  const size_t batch_size = 3;
+  const int heads = 4;
+  const int depth = 12;
+  const float scaling = 1.0f / std::sqrt(depth);
+  const size_t size = batch_size * 64 * heads * depth;
+  const auto q = RandomVector(size, &gen);
+  const auto k = RandomVector(size, &gen);
+  const auto v = RandomVector(size, &gen);
+  const auto expected =
+      ReferenceAttention(batch_size, heads, depth, scaling, q, k, v, nullptr);
+  // Every variant the CPU supports, not only the one FusedAttention() uses.
+  for (const auto& variant : GetFusedAttentionVariants()) {
+    std::vector<float> output(size, -1.0f);
+    variant.run(batch_size, heads, depth, scaling, q.data(), k.data(),
+                v.data(), nullptr, output.data());
+    ExpectNear(expected, output, variant.name);
+  }
+}
+
+TEST(FusedAttention, SmolgenBiasInPlace) {
+  std::mt19937 gen(1234);
+  const size_t batch_size = 2;
+  const int heads = 3;
+  const int depth = 8;
+  const float scaling = 1.0f / std::sqrt(depth);
+  const size_t size = batch_size * 64 * heads * depth;
+  const auto q = RandomVector(size, &gen);
+  const auto k = RandomVector(size, &gen);
+  const auto v = RandomVector(size, &gen);
+  const auto bias = RandomVector(batch_size * heads * 64 * 64, &gen);
+  const auto expected = ReferenceAttention(batch_size, heads, depth, scaling,
+                                           q, k, v, bias.data());
+  for (const auto& variant : GetFusedAttentionVariants()) {
+    // The BLAS backend writes the result over Q.
+    auto output = q;
+    variant.run(batch_size, heads, depth, scaling, output.data(), k.data(),
+                v.data(), bias.data(), output.data());
+    ExpectNear(expected, output, variant.name);
+  }
+}
+
+TEST(FusedAttention, UsesFirstVariant) {
+  std::mt19937 gen(99);
+  const size_t size = 64 * 2 * 8;
+  const auto q = RandomVector(size, &gen);
+  const auto k = RandomVector(size, &gen);
+  const auto v = RandomVector(size, &gen);
+  std::vector<float> output(size);
+  std::vector<float> expected(size);
+  FusedAttention(1, 2, 8, 0.5f, q.data(), k.data(), v.data(), nullptr,
+                 output.data());
+  GetFusedAttentionVariants().front().run(1, 2, 8, 0.5f, q.data(), k.data(),
+                                          v.data(), nullptr, expected.data());
+  EXPECT_EQ(output, expected);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
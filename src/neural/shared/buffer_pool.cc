@@ -0,0 +1,137 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/buffer_pool.h"
+
+#include <algorithm>
+#include <new>
+
+#include "utils/numa.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace lczero {
+namespace {
+
+constexpr size_t kAlignment = 64;
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t SizeClass(size_t batch_size) {
+  size_t size_class = 1;
+  while (size_class < batch_size) size_class *= 2;
+  return size_class;
+}
+
+}  // namespace
+
+BufferPool::Buffers::Buffers(BufferPool* pool, size_t count, size_t size_class,
+                             int node)
+    : vectors_(count, Vector<float>(Allocator<float>(pool))),
+      size_class_(size_class),
+      node_(node) {}
+
+BufferPool::BufferPool(size_t buffers_per_set, const Options& options)
+    : buffers_per_set_(buffers_per_set), options_(options) {}
+
+BufferPool::~BufferPool() {
+  // The sets free their memory through this pool.
+  free_sets_.clear();
+}
+
+void* BufferPool::Allocate(size_t bytes) {
+  const bool huge = options_.huge_pages && bytes >= kHugePageSize;
+  void* p = ::operator new(bytes,
+                           std::align_val_t(huge ? kHugePageSize : kAlignment));
+#ifdef __linux__
+  if (huge) madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+  const size_t total = allocated_bytes_ += bytes;
+  size_t peak = peak_bytes_.load();
+  while (total > peak && !peak_bytes_.compare_exchange_weak(peak, total)) {
+  }
+  return p;
+}
+
+void BufferPool::Free(void* p, size_t bytes) {
+  const bool huge = options_.huge_pages && bytes >= kHugePageSize;
+  ::operator delete(p, std::align_val_t(huge ? kHugePageSize : kAlignment));
+  allocated_bytes_ -= bytes;
+}
+
+std::unique_ptr<BufferPool::Buffers> BufferPool::Acquire(size_t batch_size) {
+  const size_t size_class = SizeClass(batch_size);
+  const int node = Numa::GetCurrentNode();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = free_sets_.find({size_class, node});
+    if (it != free_sets_.end() && !it->second.empty()) {
+      auto buffers = std::move(it->second.back());
+      it->second.pop_back();
+      hits_++;
+      return buffers;
+    }
+    misses_++;
+  }
+  return std::unique_ptr<Buffers>(
+      new Buffers(this, buffers_per_set_, size_class, node));
+}
+
+void BufferPool::Release(std::unique_ptr<Buffers> buffers) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_sets_[{buffers->size_class_, buffers->node_}].push_back(
+      std::move(buffers));
+  EvictLocked();
+}
+
+void BufferPool::EvictLocked() {
+  if (options_.max_bytes == 0) return;
+  for (auto it = free_sets_.rbegin();
+       it != free_sets_.rend() && allocated_bytes_ > options_.max_bytes;
+       ++it) {
+    auto& sets = it->second;
+    while (!sets.empty() && allocated_bytes_ > options_.max_bytes) {
+      sets.pop_back();
+      evictions_++;
+    }
+  }
+}
+
+BufferPool::Stats BufferPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  for (const auto& entry : free_sets_) stats.free_sets += entry.second.size();
+  stats.allocated_bytes = allocated_bytes_;
+  stats.peak_bytes = peak_bytes_;
+  return stats;
+}
+
+}  // namespace lczero
@@ -0,0 +1,142 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace lczero {
+
+// Pool of the scratch buffers of CPU backend computations. Sets of buffers
+// are kept per batch size class (the batch size rounded up to a power of
+// two) and NUMA node, so a small batch doesn't pin buffers grown for a large
+// one, and a thread gets back memory that was first touched on its own node.
+// Allocations are 64 byte aligned, large ones optionally backed by huge
+// pages, and the pool drops free sets while over its memory cap.
+class BufferPool {
+ public:
+  struct Options {
+    // Cap on the memory of all buffers, in bytes. 0 for no cap.
+    size_t max_bytes = 0;
+    // Ask for transparent huge pages for allocations of 2 MiB or more.
+    bool huge_pages = false;
+  };
+
+  struct Stats {
+    // Acquisitions served from the pool and with a new set.
+    size_t hits = 0;
+    size_t misses = 0;
+    // Free sets dropped to stay under the memory cap.
+    size_t evictions = 0;
+    size_t free_sets = 0;
+    size_t allocated_bytes = 0;
+    size_t peak_bytes = 0;
+  };
+
+  // Allocator accounting its memory to the pool.
+  template <typename T>
+  class Allocator {
+   public:
+    using value_type = T;
+    explicit Allocator(BufferPool* pool) : pool_(pool) {}
+    template <typename U>
+    Allocator(const Allocator<U>& other) : pool_(other.pool_) {}
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(pool_->Allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) { pool_->Free(p, n * sizeof(T)); }
+
+    bool operator==(const Allocator& other) const {
+      return pool_ == other.pool_;
+    }
+    bool operator!=(const Allocator& other) const {
+      return pool_ != other.pool_;
+    }
+
+   private:
+    template <typename U>
+    friend class Allocator;
+    BufferPool* pool_;
+  };
+
+  template <typename T>
+  using Vector = std::vector<T, Allocator<T>>;
+
+  // A set of buffers, sized by the user. They keep their capacity while
+  // pooled.
+  class Buffers {
+   public:
+    Vector<float>& operator[](size_t idx) { return vectors_[idx]; }
+
+   private:
+    friend class BufferPool;
+    Buffers(BufferPool* pool, size_t count, size_t size_class, int node);
+
+    std::vector<Vector<float>> vectors_;
+    size_t size_class_;
+    int node_;
+  };
+
+  // Pool of sets of @buffers_per_set buffers.
+  BufferPool(size_t buffers_per_set, const Options& options);
+  ~BufferPool();
+
+  // Returns a set for a batch of @batch_size, preferably one used before for
+  // the same size class on the NUMA node of the calling thread.
+  std::unique_ptr<Buffers> Acquire(size_t batch_size);
+  // Returns @buffers to the pool, or frees them if over the memory cap.
+  void Release(std::unique_ptr<Buffers> buffers);
+
+  Stats GetStats() const;
+
+ private:
+  void* Allocate(size_t bytes);
+  void Free(void* p, size_t bytes);
+  // Drops free sets, largest size class first, until under the cap.
+  void EvictLocked();
+
+  const size_t buffers_per_set_;
+  const Options options_;
+  std::atomic<size_t> allocated_bytes_{0};
+  std::atomic<size_t> peak_bytes_{0};
+  mutable std::mutex mutex_;
+  // Free sets by size class and NUMA node.
+  std::map<std::pair<size_t, int>, std::vector<std::unique_ptr<Buffers>>>
+      free_sets_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  size_t evictions_ = 0;
+};
+
+}  // namespace lczero
@@ -0,0 +1,100 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/buffer_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+namespace lczero {
+
+TEST(BufferPool, ReusesSetsOfTheSameSizeClass) {
+  BufferPool pool(2, {});
+  auto buffers = pool.Acquire(5);
+  (*buffers)[0].resize(1000);
+  (*buffers)[1].resize(10);
+  const float* data = (*buffers)[0].data();
+  pool.Release(std::move(buffers));
+
+  // 5 and 8 are both in the size class 8, 9 is not.
+  auto other = pool.Acquire(9);
+  EXPECT_TRUE((*other)[0].empty());
+  buffers = pool.Acquire(8);
+  EXPECT_EQ(data, (*buffers)[0].data());
+  pool.Release(std::move(buffers));
+  pool.Release(std::move(other));
+
+  const auto stats = pool.GetStats();
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(2u, stats.misses);
+  EXPECT_EQ(2u, stats.free_sets);
+  EXPECT_EQ(1010 * sizeof(float), stats.allocated_bytes);
+}
+
+TEST(BufferPool, AllocationsAreAligned) {
+  BufferPool::Options options;
+  options.huge_pages = true;
+  BufferPool pool(1, options);
+  auto buffers = pool.Acquire(1);
+  for (size_t size : {1, 17, 1 << 20}) {
+    (*buffers)[0].clear();
+    (*buffers)[0].shrink_to_fit();
+    (*buffers)[0].resize(size);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>((*buffers)[0].data()) % 64);
+  }
+  pool.Release(std::move(buffers));
+}
+
+TEST(BufferPool, EvictsFreeSetsOverTheCap) {
+  BufferPool::Options options;
+  options.max_bytes = 1500 * sizeof(float);
+  BufferPool pool(1, options);
+  auto small = pool.Acquire(1);
+  (*small)[0].resize(500);
+  auto large = pool.Acquire(64);
+  (*large)[0].resize(1000);
+  pool.Release(std::move(small));
+  // Over the cap, the largest size class goes first.
+  auto extra = pool.Acquire(2);
+  (*extra)[0].resize(100);
+  pool.Release(std::move(large));
+  pool.Release(std::move(extra));
+
+  const auto stats = pool.GetStats();
+  EXPECT_EQ(1u, stats.evictions);
+  EXPECT_EQ(2u, stats.free_sets);
+  EXPECT_EQ(600 * sizeof(float), stats.allocated_bytes);
+  EXPECT_EQ(1600 * sizeof(float), stats.peak_bytes);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
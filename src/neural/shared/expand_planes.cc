@@ -0,0 +1,212 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/expand_planes.h"
+
+#include "utils/cpu_features.h"
+#include "utils/fp16_utils.h"
+
+#if defined(LC0_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LC0_NEON
+#endif
+
+namespace lczero {
+namespace {
+
+void ExpandPlanesScalar(const InputPlane* planes, size_t count,
+                        float* output) {
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const float value = planes[p].value;
+    for (int i = 0; i < 64; i++) {
+      *(output++) = (mask >> i) & 1 ? value : 0.0f;
+    }
+  }
+}
+
+void ExpandPlanesFp16Scalar(const InputPlane* planes, size_t count,
+                            uint16_t* output) {
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const uint16_t value = FP32toFP16(planes[p].value);
+    for (int i = 0; i < 64; i++) {
+      *(output++) = (mask >> i) & 1 ? value : 0;
+    }
+  }
+}
+
+#if defined(LC0_X86_DISPATCH)
+
+LC0_TARGET("avx2")
+void ExpandPlanesAvx2(const InputPlane* planes, size_t count, float* output) {
+  // Lane j tests bit j of the byte broadcast to all lanes.
+  const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const __m256 value = _mm256_set1_ps(planes[p].value);
+    for (int i = 0; i < 8; i++) {
+      const __m256i byte = _mm256_set1_epi32((mask >> (8 * i)) & 0xff);
+      const __m256i set =
+          _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+      _mm256_storeu_ps(output + 8 * i,
+                       _mm256_and_ps(_mm256_castsi256_ps(set), value));
+    }
+    output += 64;
+  }
+}
+
+LC0_TARGET("avx2")
+void ExpandPlanesFp16Avx2(const InputPlane* planes, size_t count,
+                          uint16_t* output) {
+  const __m256i bits = _mm256_setr_epi16(
+      0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080, 0x0100,
+      0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, short(0x8000));
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const __m256i value = _mm256_set1_epi16(FP32toFP16(planes[p].value));
+    for (int i = 0; i < 4; i++) {
+      const __m256i word =
+          _mm256_set1_epi16(static_cast<short>((mask >> (16 * i)) & 0xffff));
+      const __m256i set =
+          _mm256_cmpeq_epi16(_mm256_and_si256(word, bits), bits);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 16 * i),
+                          _mm256_and_si256(set, value));
+    }
+    output += 64;
+  }
+}
+
+LC0_TARGET("avx512f")
+void ExpandPlanesAvx512(const InputPlane* planes, size_t count,
+                        float* output) {
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const __m512 value = _mm512_set1_ps(planes[p].value);
+    for (int i = 0; i < 4; i++) {
+      _mm512_storeu_ps(output + 16 * i,
+                       _mm512_maskz_mov_ps(
+                           static_cast<__mmask16>(mask >> (16 * i)), value));
+    }
+    output += 64;
+  }
+}
+
+LC0_TARGET("avx512f,avx512bw")
+void ExpandPlanesFp16Avx512(const InputPlane* planes, size_t count,
+                            uint16_t* output) {
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const __m512i value = _mm512_set1_epi16(FP32toFP16(planes[p].value));
+    for (int i = 0; i < 2; i++) {
+      _mm512_storeu_si512(
+          output + 32 * i,
+          _mm512_maskz_mov_epi16(static_cast<__mmask32>(mask >> (32 * i)),
+                                 value));
+    }
+    output += 64;
+  }
+}
+
+#endif
+
+#ifdef LC0_NEON
+
+void ExpandPlanesNeon(const InputPlane* planes, size_t count, float* output) {
+  const uint32_t kBits[4] = {1, 2, 4, 8};
+  const uint32x4_t bits = vld1q_u32(kBits);
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const uint32x4_t value = vreinterpretq_u32_f32(vdupq_n_f32(planes[p].value));
+    for (int i = 0; i < 16; i++) {
+      const uint32x4_t nibble =
+          vdupq_n_u32(static_cast<uint32_t>((mask >> (4 * i)) & 0xf));
+      const uint32x4_t set = vtstq_u32(nibble, bits);
+      vst1q_f32(output + 4 * i, vreinterpretq_f32_u32(vandq_u32(set, value)));
+    }
+    output += 64;
+  }
+}
+
+void ExpandPlanesFp16Neon(const InputPlane* planes, size_t count,
+                          uint16_t* output) {
+  const uint16_t kBits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+  const uint16x8_t bits = vld1q_u16(kBits);
+  for (size_t p = 0; p < count; p++) {
+    const uint64_t mask = planes[p].mask;
+    const uint16x8_t value = vdupq_n_u16(FP32toFP16(planes[p].value));
+    for (int i = 0; i < 8; i++) {
+      const uint16x8_t byte =
+          vdupq_n_u16(static_cast<uint16_t>((mask >> (8 * i)) & 0xff));
+      vst1q_u16(output + 8 * i, vandq_u16(vtstq_u16(byte, bits), value));
+    }
+    output += 64;
+  }
+}
+
+#endif
+
+const ExpandPlanesVariant& GetImplementation() {
+  static const ExpandPlanesVariant impl = GetExpandPlanesVariants().front();
+  return impl;
+}
+
+}  // namespace
+
+void ExpandPlanes(const InputPlane* planes, size_t count, float* output) {
+  GetImplementation().fp32(planes, count, output);
+}
+
+void ExpandPlanesFp16(const InputPlane* planes, size_t count,
+                      uint16_t* output) {
+  GetImplementation().fp16(planes, count, output);
+}
+
+const char* GetExpandPlanesImplementation() {
+  return GetImplementation().name;
+}
+
+std::vector<ExpandPlanesVariant> GetExpandPlanesVariants() {
+  std::vector<ExpandPlanesVariant> variants;
+#if defined(LC0_X86_DISPATCH)
+  const auto& cpu = GetCpuFeatures();
+  if (cpu.avx512f && cpu.avx512bw) {
+    variants.push_back({"avx512", ExpandPlanesAvx512, ExpandPlanesFp16Avx512});
+  }
+  if (cpu.avx2) {
+    variants.push_back({"avx2", ExpandPlanesAvx2, ExpandPlanesFp16Avx2});
+  }
+#elif defined(LC0_NEON)
+  variants.push_back({"neon", ExpandPlanesNeon, ExpandPlanesFp16Neon});
+#endif
+  variants.push_back({"scalar", ExpandPlanesScalar, ExpandPlanesFp16Scalar});
+  return variants;
+}
+
+}  // namespace lczero
@@ -0,0 +1,69 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "neural/network.h"
+
+namespace lczero {
+
+// Expands @count bitboard planes into @count * 64 floats in NCHW order. Square
+// i of a plane gets plane.value if bit i of plane.mask is set, and zero
+// otherwise. Every output value is written, no need to clear @output first.
+void ExpandPlanes(const InputPlane* planes, size_t count, float* output);
+
+// Same as above, but writes IEEE half precision values (as FP32toFP16()).
+void ExpandPlanesFp16(const InputPlane* planes, size_t count,
+                      uint16_t* output);
+
+// Convenience wrappers expanding all planes of one sample.
+inline void ExpandPlanes(const InputPlanes& planes, float* output) {
+  ExpandPlanes(planes.data(), planes.size(), output);
+}
+inline void ExpandPlanesFp16(const InputPlanes& planes, uint16_t* output) {
+  ExpandPlanesFp16(planes.data(), planes.size(), output);
+}
+
+// Name of the instruction set selected for the current CPU, e.g. "avx2".
+const char* GetExpandPlanesImplementation();
+
+// One instruction set version of the functions above.
+struct ExpandPlanesVariant {
+  const char* name;
+  void (*fp32)(const InputPlane* planes, size_t count, float* output);
+  void (*fp16)(const InputPlane* planes, size_t count, uint16_t* output);
+};
+
+// The variants the current CPU can run, best first. The first one is what
+// ExpandPlanes() uses, the others are there for tests and benchmarks.
+std::vector<ExpandPlanesVariant> GetExpandPlanesVariants();
+
+}  // namespace lczero
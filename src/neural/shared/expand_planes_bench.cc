@@ -0,0 +1,102 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include <vector>
+
+#include "benchmark/microbench.h"
+#include "neural/encoder.h"
+#include "neural/shared/expand_planes.h"
+#include "utils/bititer.h"
+
+namespace lczero {
+namespace {
+
+InputPlanes StartposPlanes() {
+  PositionHistory history;
+  ChessBoard board;
+  board.SetFromFen(ChessBoard::kStartposFen);
+  history.Reset(board, 0, 1);
+  return EncodePositionForNN(pblczero::NetworkFormat::INPUT_CLASSICAL_112_PLANE,
+                             history, 8, FillEmptyHistory::ALWAYS, nullptr);
+}
+
+// The per-square loop the backends used before ExpandPlanes().
+void BitLoop(size_t iterations) {
+  const auto planes = StartposPlanes();
+  std::vector<float> output(kInputPlanes * 64);
+  for (size_t n = 0; n < iterations; n++) {
+    float* buffer = output.data();
+    for (const auto& plane : planes) {
+      for (int i = 0; i < 64; i++) {
+        *(buffer++) = (plane.mask & (1ull << i)) != 0 ? plane.value : 0;
+      }
+    }
+    DoNotOptimize(output[n % output.size()]);
+  }
+}
+
+// The set bit iteration used by the onnx and xla backends before.
+void IterateSetBits(size_t iterations) {
+  const auto planes = StartposPlanes();
+  std::vector<float> output(kInputPlanes * 64);
+  for (size_t n = 0; n < iterations; n++) {
+    std::fill(output.begin(), output.end(), 0.0f);
+    float* buffer = output.data();
+    for (const auto& plane : planes) {
+      for (auto bit : IterateBits(plane.mask)) buffer[bit] = plane.value;
+      buffer += 64;
+    }
+    DoNotOptimize(output[n % output.size()]);
+  }
+}
+
+void Expand(size_t iterations) {
+  const auto planes = StartposPlanes();
+  std::vector<float> output(kInputPlanes * 64);
+  for (size_t n = 0; n < iterations; n++) {
+    ExpandPlanes(planes, output.data());
+    DoNotOptimize(output[n % output.size()]);
+  }
+}
+
+void ExpandFp16(size_t iterations) {
+  const auto planes = StartposPlanes();
+  std::vector<uint16_t> output(kInputPlanes * 64);
+  for (size_t n = 0; n < iterations; n++) {
+    ExpandPlanesFp16(planes, output.data());
+    DoNotOptimize(output[n % output.size()]);
+  }
+}
+
+}  // namespace
+
+REGISTER_MICROBENCH("ExpandPlanes/bit_loop", BitLoop)
+REGISTER_MICROBENCH("ExpandPlanes/iterate_bits", IterateSetBits)
+REGISTER_MICROBENCH("ExpandPlanes/simd", Expand)
+REGISTER_MICROBENCH("ExpandPlanes/simd_fp16", ExpandFp16)
+
+}  // namespace lczero
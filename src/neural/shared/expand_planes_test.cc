@@ -0,0 +1,129 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/expand_planes.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "utils/fp16_utils.h"
+
+namespace lczero {
+
+namespace {
+InputPlanes RandomPlanes(std::mt19937_64* gen) {
+  InputPlanes planes(kInputPlanes);
+  for (auto& plane : planes) {
+    plane.mask = (*gen)();
+    plane.value = static_cast<float>((*gen)() % 1000) / 7.0f - 50.0f;
+  }
+  // The corner cases.
+  planes[0].mask = 0;
+  planes[1].SetAll();
+  planes[2].mask = 1ull << 63;
+  planes[3].mask = 1;
+  return planes;
+}
+}  // namespace
+
+// The tests run every variant the CPU supports, not only the selected one.
+
+TEST(ExpandPlanes, MatchesBitLoop) {
+  for (const auto& variant : GetExpandPlanesVariants()) {
+    std::mt19937_64 gen(42);
+    for (int sample = 0; sample < 16; sample++) {
+      const auto planes = RandomPlanes(&gen);
+      std::vector<float> output(kInputPlanes * 64, -1.0f);
+      variant.fp32(planes.data(), planes.size(), output.data());
+      for (int p = 0; p < kInputPlanes; p++) {
+        for (int i = 0; i < 64; i++) {
+          const float expected =
+              (planes[p].mask >> i) & 1 ? planes[p].value : 0.0f;
+          ASSERT_EQ(output[p * 64 + i], expected)
+              << variant.name << " plane " << p << " square " << i;
+        }
+      }
+    }
+  }
+}
+
+TEST(ExpandPlanes, Fp16MatchesBitLoop) {
+  for (const auto& variant : GetExpandPlanesVariants()) {
+    std::mt19937_64 gen(1234);
+    for (int sample = 0; sample < 16; sample++) {
+      const auto planes = RandomPlanes(&gen);
+      std::vector<uint16_t> output(kInputPlanes * 64, 0xffff);
+      variant.fp16(planes.data(), planes.size(), output.data());
+      for (int p = 0; p < kInputPlanes; p++) {
+        for (int i = 0; i < 64; i++) {
+          const uint16_t expected =
+              (planes[p].mask >> i) & 1 ? FP32toFP16(planes[p].value) : 0;
+          ASSERT_EQ(output[p * 64 + i], expected)
+              << variant.name << " plane " << p << " square " << i;
+        }
+      }
+    }
+  }
+}
+
+TEST(ExpandPlanes, PartialPlaneCount) {
+  std::mt19937_64 gen(7);
+  const auto planes = RandomPlanes(&gen);
+  for (const auto& variant : GetExpandPlanesVariants()) {
+    std::vector<float> output(kInputPlanes * 64, -1.0f);
+    variant.fp32(planes.data(), 3, output.data());
+    std::vector<uint16_t> output16(kInputPlanes * 64, 0xffff);
+    variant.fp16(planes.data(), 3, output16.data());
+    // Nothing past the requested planes is touched.
+    for (size_t i = 3 * 64; i < output.size(); i++) {
+      ASSERT_EQ(output[i], -1.0f) << variant.name;
+      ASSERT_EQ(output16[i], 0xffff) << variant.name;
+    }
+  }
+}
+
+TEST(ExpandPlanes, UsesFirstVariant) {
+  EXPECT_STREQ(GetExpandPlanesImplementation(),
+               GetExpandPlanesVariants().front().name);
+  std::mt19937_64 gen(99);
+  const auto planes = RandomPlanes(&gen);
+  std::vector<float> output(kInputPlanes * 64);
+  std::vector<float> expected(kInputPlanes * 64);
+  ExpandPlanes(planes, output.data());
+  GetExpandPlanesVariants().back().fp32(planes.data(), planes.size(),
+                                        expected.data());
+  EXPECT_EQ(output, expected);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
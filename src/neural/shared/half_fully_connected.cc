@@ -0,0 +1,281 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/half_fully_connected.h"
+
+#include <algorithm>
+
+#include "utils/cpu_features.h"
+#include "utils/fp16_utils.h"
+
+#if defined(LC0_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace lczero {
+namespace {
+
+// Rows are padded to 32 elements, the width of one bf16 AVX-512 vector.
+constexpr size_t kPadding = 32;
+// Rows of input kept hot while streaming the weights once.
+constexpr size_t kRowBlock = 32;
+
+using Type = HalfFullyConnectedLayer::Type;
+
+template <Type type>
+inline float Widen(uint16_t value) {
+  return type == Type::kFp16 ? FP16toFP32(value) : BF16toFP32(value);
+}
+
+// Computes the dot products of @kRows input rows (@stride elements apart)
+// with one row of weights. Inputs are floats, except for the native bf16
+// kernel which takes bf16 inputs.
+template <Type type, int kRows>
+void DotGeneric(const void* inputs, size_t stride, const uint16_t* weights,
+                float* out) {
+  const float* a = static_cast<const float*>(inputs);
+  float sums[kRows] = {};
+  for (size_t k = 0; k < stride; k++) {
+    const float w = Widen<type>(weights[k]);
+    for (int t = 0; t < kRows; t++) sums[t] += a[t * stride + k] * w;
+  }
+  for (int t = 0; t < kRows; t++) out[t] = sums[t];
+}
+
+#if defined(LC0_X86_DISPATCH)
+
+LC0_TARGET("avx2")
+inline float HorizontalSumAvx2(__m256 v) {
+  __m128 sum =
+      _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+  return _mm_cvtss_f32(sum);
+}
+
+LC0_TARGET("avx512f")
+inline float HorizontalSumAvx512(__m512 v) {
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, v);
+  float sum = 0.0f;
+  for (int l = 0; l < 16; l++) sum += lanes[l];
+  return sum;
+}
+
+template <Type type>
+LC0_TARGET("avx2,fma,f16c")
+inline __m256 WidenAvx2(const uint16_t* weights) {
+  const __m128i half =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights));
+  if (type == Type::kFp16) return _mm256_cvtph_ps(half);
+  return _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_cvtepu16_epi32(half), 16));
+}
+
+template <Type type, int kRows>
+LC0_TARGET("avx2,fma,f16c")
+void DotAvx2(const void* inputs, size_t stride, const uint16_t* weights,
+             float* out) {
+  const float* a = static_cast<const float*>(inputs);
+  __m256 acc[kRows];
+  for (int t = 0; t < kRows; t++) acc[t] = _mm256_setzero_ps();
+  for (size_t k = 0; k < stride; k += 8) {
+    const __m256 w = WidenAvx2<type>(weights + k);
+    for (int t = 0; t < kRows; t++) {
+      acc[t] = _mm256_fmadd_ps(_mm256_loadu_ps(a + t * stride + k), w, acc[t]);
+    }
+  }
+  for (int t = 0; t < kRows; t++) out[t] = HorizontalSumAvx2(acc[t]);
+}
+
+template <int kRows>
+LC0_TARGET("avx512f")
+void DotFp16Avx512(const void* inputs, size_t stride, const uint16_t* weights,
+                   float* out) {
+  const float* a = static_cast<const float*>(inputs);
+  __m512 acc[kRows];
+  for (int t = 0; t < kRows; t++) acc[t] = _mm512_setzero_ps();
+  for (size_t k = 0; k < stride; k += 16) {
+    // The masked form, the plain one trips -Wmaybe-uninitialized in GCC 12.
+    const __m512 w = _mm512_mask_cvtph_ps(
+        _mm512_setzero_ps(), 0xffff,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + k)));
+    for (int t = 0; t < kRows; t++) {
+      acc[t] = _mm512_fmadd_ps(_mm512_loadu_ps(a + t * stride + k), w, acc[t]);
+    }
+  }
+  for (int t = 0; t < kRows; t++) out[t] = HorizontalSumAvx512(acc[t]);
+}
+
+// vdpbf16ps multiplies pairs of adjacent bf16 values and adds both products
+// to the fp32 lane, so contiguous rows of inputs and weights line up.
+template <int kRows>
+LC0_TARGET("avx512f,avx512bf16")
+void DotBf16Native(const void* inputs, size_t stride, const uint16_t* weights,
+                   float* out) {
+  const uint16_t* a = static_cast<const uint16_t*>(inputs);
+  __m512 acc[kRows];
+  for (int t = 0; t < kRows; t++) acc[t] = _mm512_setzero_ps();
+  for (size_t k = 0; k < stride; k += 32) {
+    const __m512bh w = (__m512bh)_mm512_loadu_si512(weights + k);
+    for (int t = 0; t < kRows; t++) {
+      acc[t] = _mm512_dpbf16_ps(
+          acc[t], (__m512bh)_mm512_loadu_si512(a + t * stride + k), w);
+    }
+  }
+  for (int t = 0; t < kRows; t++) out[t] = HorizontalSumAvx512(acc[t]);
+}
+
+#endif
+
+const HalfFullyConnectedVariant& GetKernels(Type type) {
+  static const HalfFullyConnectedVariant fp16 =
+      GetHalfFullyConnectedVariants(Type::kFp16).front();
+  static const HalfFullyConnectedVariant bf16 =
+      GetHalfFullyConnectedVariants(Type::kBf16).front();
+  return type == Type::kFp16 ? fp16 : bf16;
+}
+
+struct Scratch {
+  std::vector<float> inputs;
+  std::vector<uint16_t> bf16_inputs;
+};
+
+}  // namespace
+
+HalfFullyConnectedLayer::HalfFullyConnectedLayer(size_t input_size,
+                                                 size_t output_size,
+                                                 const float* weights,
+                                                 Type type)
+    : input_size_(input_size),
+      padded_size_((input_size + kPadding - 1) / kPadding * kPadding),
+      output_size_(output_size),
+      type_(type),
+      weights_(padded_size_ * output_size) {
+  for (size_t o = 0; o < output_size; o++) {
+    for (size_t i = 0; i < input_size; i++) {
+      const float w = weights[o * input_size + i];
+      weights_[o * padded_size_ + i] =
+          type == Type::kFp16 ? FP32toFP16(w) : FP32toBF16(w);
+    }
+  }
+}
+
+void HalfFullyConnectedLayer::Forward(size_t batch_size, const float* input,
+                                      float* output) const {
+  Forward(batch_size, input, output, GetKernels(type_));
+}
+
+void HalfFullyConnectedLayer::Forward(
+    size_t batch_size, const float* input, float* output,
+    const HalfFullyConnectedVariant& kernels) const {
+  thread_local Scratch scratch;
+  const void* inputs;
+  if (kernels.bf16_inputs) {
+    scratch.bf16_inputs.assign(batch_size * padded_size_, 0);
+    for (size_t r = 0; r < batch_size; r++) {
+      for (size_t i = 0; i < input_size_; i++) {
+        scratch.bf16_inputs[r * padded_size_ + i] =
+            FP32toBF16(input[r * input_size_ + i]);
+      }
+    }
+    inputs = scratch.bf16_inputs.data();
+  } else if (padded_size_ != input_size_) {
+    scratch.inputs.assign(batch_size * padded_size_, 0.0f);
+    for (size_t r = 0; r < batch_size; r++) {
+      std::copy(input + r * input_size_, input + (r + 1) * input_size_,
+                &scratch.inputs[r * padded_size_]);
+    }
+    inputs = scratch.inputs.data();
+  } else {
+    inputs = input;
+  }
+  const size_t element_size = kernels.bf16_inputs ? 2 : 4;
+  const char* rows = static_cast<const char*>(inputs);
+
+  for (size_t r0 = 0; r0 < batch_size; r0 += kRowBlock) {
+    const size_t r1 = std::min(batch_size, r0 + kRowBlock);
+    for (size_t o = 0; o < output_size_; o++) {
+      const uint16_t* w = &weights_[o * padded_size_];
+      float dots[4];
+      size_t r = r0;
+      for (; r + 4 <= r1; r += 4) {
+        kernels.dot4(rows + r * padded_size_ * element_size, padded_size_, w,
+                     dots);
+        for (int t = 0; t < 4; t++) {
+          output[(r + t) * output_size_ + o] = dots[t];
+        }
+      }
+      for (; r < r1; r++) {
+        kernels.dot1(rows + r * padded_size_ * element_size, padded_size_, w,
+                     dots);
+        output[r * output_size_ + o] = dots[0];
+      }
+    }
+  }
+}
+
+const char* HalfFullyConnectedLayer::implementation() const {
+  return GetKernels(type_).name;
+}
+
+std::vector<HalfFullyConnectedVariant> GetHalfFullyConnectedVariants(
+    Type type) {
+  std::vector<HalfFullyConnectedVariant> variants;
+#if defined(LC0_X86_DISPATCH)
+  const auto& cpu = GetCpuFeatures();
+  if (type == Type::kFp16) {
+    if (cpu.avx512f) {
+      variants.push_back(
+          {"avx512", DotFp16Avx512<4>, DotFp16Avx512<1>, false});
+    }
+    if (cpu.avx2 && cpu.fma && cpu.f16c) {
+      variants.push_back({"avx2", DotAvx2<Type::kFp16, 4>,
+                          DotAvx2<Type::kFp16, 1>, false});
+    }
+  } else {
+    if (cpu.avx512bf16) {
+      variants.push_back(
+          {"avx512bf16", DotBf16Native<4>, DotBf16Native<1>, true});
+    }
+    if (cpu.avx2 && cpu.fma && cpu.f16c) {
+      variants.push_back({"avx2", DotAvx2<Type::kBf16, 4>,
+                          DotAvx2<Type::kBf16, 1>, false});
+    }
+  }
+#endif
+  if (type == Type::kFp16) {
+    variants.push_back({"generic", DotGeneric<Type::kFp16, 4>,
+                        DotGeneric<Type::kFp16, 1>, false});
+  } else {
+    variants.push_back({"generic", DotGeneric<Type::kBf16, 4>,
+                        DotGeneric<Type::kBf16, 1>, false});
+  }
+  return variants;
+}
+
+}  // namespace lczero
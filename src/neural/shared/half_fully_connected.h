@@ -0,0 +1,88 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lczero {
+
+// One instruction set version of the kernels of HalfFullyConnectedLayer.
+struct HalfFullyConnectedVariant {
+  const char* name;
+  // Dot products of 4 (dot4) or 1 (dot1) input rows, @stride elements apart,
+  // with one row of weights.
+  void (*dot4)(const void* inputs, size_t stride, const uint16_t* weights,
+               float* out);
+  void (*dot1)(const void* inputs, size_t stride, const uint16_t* weights,
+               float* out);
+  // Whether the inputs are converted to bf16 first, floats otherwise.
+  bool bf16_inputs;
+};
+
+// Fully connected layer keeping its weights as 16 bit floats, which halves
+// the memory traffic of bandwidth bound (small batch) inference. Weights are
+// widened to fp32 in registers; with bf16 on CPUs with AVX512-BF16 the
+// inputs are rounded to bf16 too and native bf16 dot products are used.
+// Accumulation is always fp32.
+class HalfFullyConnectedLayer {
+ public:
+  enum class Type { kFp16, kBf16 };
+
+  // @weights is [output_size][input_size], as for FullyConnectedLayer.
+  HalfFullyConnectedLayer(size_t input_size, size_t output_size,
+                          const float* weights, Type type);
+
+  // Computes @output = weights x @input for @batch_size rows. Biases and
+  // activation are left to the caller.
+  void Forward(size_t batch_size, const float* input, float* output) const;
+
+  // Same as above, with the kernels of @variant, which has to be one of
+  // GetHalfFullyConnectedVariants() for the type of this layer.
+  void Forward(size_t batch_size, const float* input, float* output,
+               const HalfFullyConnectedVariant& variant) const;
+
+  // Name of the kernels used for this layer, e.g. "avx512bf16".
+  const char* implementation() const;
+
+ private:
+  size_t input_size_;
+  // Input size rounded up to the widest vector, rows are zero padded.
+  size_t padded_size_;
+  size_t output_size_;
+  Type type_;
+  std::vector<uint16_t> weights_;
+};
+
+// The variants the current CPU can run for @type, best first. The first one
+// is what Forward() uses, the others are there for tests and benchmarks.
+std::vector<HalfFullyConnectedVariant> GetHalfFullyConnectedVariants(
+    HalfFullyConnectedLayer::Type type);
+
+}  // namespace lczero
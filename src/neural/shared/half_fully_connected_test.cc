@@ -0,0 +1,113 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/half_fully_connected.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "utils/fp16_utils.h"
+
+namespace lczero {
+
+namespace {
+using Type = HalfFullyConnectedLayer::Type;
+
+float Round(float value, Type type) {
+  return type == Type::kFp16 ? FP16toFP32(FP32toFP16(value))
+                             : BF16toFP32(FP32toBF16(value));
+}
+
+void CheckAgainstReference(Type type) {
+  std::mt19937 gen(42);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  // Odd sizes exercise the row padding and the partial row tiles.
+  const size_t input_size = 100, output_size = 13;
+  std::vector<float> weights(input_size * output_size);
+  for (auto& x : weights) x = dist(gen) * 0.1f;
+  for (size_t batch_size : {1, 7, 45}) {
+    std::vector<float> input(batch_size * input_size);
+    for (auto& x : input) x = dist(gen);
+    HalfFullyConnectedLayer layer(input_size, output_size, weights.data(),
+                                  type);
+    // Every variant the CPU supports, not only the one Forward() uses.
+    for (const auto& variant : GetHalfFullyConnectedVariants(type)) {
+      std::vector<float> output(batch_size * output_size);
+      layer.Forward(batch_size, input.data(), output.data(), variant);
+      for (size_t b = 0; b < batch_size; b++) {
+        for (size_t o = 0; o < output_size; o++) {
+          double expected = 0;
+          for (size_t i = 0; i < input_size; i++) {
+            const float x = input[b * input_size + i];
+            expected += (variant.bf16_inputs ? Round(x, type) : x) *
+                        Round(weights[o * input_size + i], type);
+          }
+          ASSERT_NEAR(expected, output[b * output_size + o], 1e-4)
+              << variant.name << " batch " << batch_size << " row " << b
+              << " output " << o;
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST(HalfFullyConnected, Fp16MatchesReference) {
+  CheckAgainstReference(Type::kFp16);
+}
+
+TEST(HalfFullyConnected, Bf16MatchesReference) {
+  CheckAgainstReference(Type::kBf16);
+}
+
+TEST(HalfFullyConnected, UsesFirstVariant) {
+  const float weights[] = {1.0f};
+  for (auto type : {Type::kFp16, Type::kBf16}) {
+    HalfFullyConnectedLayer layer(1, 1, weights, type);
+    EXPECT_STREQ(layer.implementation(),
+                 GetHalfFullyConnectedVariants(type).front().name);
+  }
+}
+
+TEST(HalfFullyConnected, Bf16Rounding) {
+  EXPECT_EQ(FP32toBF16(1.0f), 0x3f80);
+  EXPECT_EQ(BF16toFP32(0x3f80), 1.0f);
+  // 1 + 2^-8 is halfway between two bf16 values, rounds to even.
+  EXPECT_EQ(FP32toBF16(1.00390625f), 0x3f80);
+  EXPECT_EQ(FP32toBF16(1.01171875f), 0x3f82);
+  EXPECT_EQ(FP32toBF16(-2.0f), 0xc000);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
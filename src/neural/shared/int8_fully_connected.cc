@@ -0,0 +1,252 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/int8_fully_connected.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils/cpu_features.h"
+
+#if defined(LC0_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace lczero {
+namespace {
+
+// Rows are padded to a multiple of the widest vector (AVX-512).
+constexpr size_t kPadding = 64;
+// Rows of input kept hot while streaming the weights once.
+constexpr size_t kRowBlock = 32;
+
+// Computes the dot products of @kRows input rows (@stride bytes apart) with
+// one row of weights.
+template <int kRows>
+void DotGeneric(const int8_t* inputs, size_t stride, const int8_t* weights,
+                int32_t* out) {
+  for (int t = 0; t < kRows; t++) {
+    const int8_t* a = inputs + t * stride;
+    int32_t sum = 0;
+    for (size_t k = 0; k < stride; k++) sum += a[k] * weights[k];
+    out[t] = sum;
+  }
+}
+
+#if defined(LC0_X86_DISPATCH)
+
+LC0_TARGET("avx2")
+inline int32_t HorizontalSumAvx2(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// maddubs multiplies unsigned by signed bytes, so the sign of the weight is
+// moved to the input. Both are within [-127, 127], so the pairwise int16 sums
+// cannot saturate.
+template <int kRows>
+LC0_TARGET("avx2")
+void DotAvx2(const int8_t* inputs, size_t stride, const int8_t* weights,
+             int32_t* out) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc[kRows];
+  for (int t = 0; t < kRows; t++) acc[t] = _mm256_setzero_si256();
+  for (size_t k = 0; k < stride; k += 32) {
+    const __m256i w =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + k));
+    const __m256i w_abs = _mm256_sign_epi8(w, w);
+    for (int t = 0; t < kRows; t++) {
+      const __m256i a = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(inputs + t * stride + k));
+      const __m256i products =
+          _mm256_maddubs_epi16(w_abs, _mm256_sign_epi8(a, w));
+      acc[t] = _mm256_add_epi32(acc[t], _mm256_madd_epi16(products, ones));
+    }
+  }
+  for (int t = 0; t < kRows; t++) out[t] = HorizontalSumAvx2(acc[t]);
+}
+
+// vpdpbusd takes unsigned inputs: they are offset by 128 here, and the
+// caller subtracts 128 * sum(weights) afterwards.
+template <int kRows>
+LC0_TARGET("avx512f,avx512bw,avx512vnni")
+void DotVnni(const int8_t* inputs, size_t stride, const int8_t* weights,
+             int32_t* out) {
+  const __m512i offset = _mm512_set1_epi8(static_cast<char>(0x80));
+  __m512i acc[kRows];
+  for (int t = 0; t < kRows; t++) acc[t] = _mm512_setzero_si512();
+  for (size_t k = 0; k < stride; k += 64) {
+    const __m512i w = _mm512_loadu_si512(weights + k);
+    for (int t = 0; t < kRows; t++) {
+      const __m512i a =
+          _mm512_xor_si512(_mm512_loadu_si512(inputs + t * stride + k), offset);
+      acc[t] = _mm512_dpbusd_epi32(acc[t], a, w);
+    }
+  }
+  for (int t = 0; t < kRows; t++) {
+    alignas(64) int32_t lanes[16];
+    _mm512_store_si512(lanes, acc[t]);
+    int32_t sum = 0;
+    for (int l = 0; l < 16; l++) sum += lanes[l];
+    out[t] = sum;
+  }
+}
+
+#endif
+
+const Int8FullyConnectedVariant& GetKernels() {
+  static const Int8FullyConnectedVariant kernels =
+      GetInt8FullyConnectedVariants().front();
+  return kernels;
+}
+
+int8_t Quantize(float value, float inv_scale) {
+  const float x = std::min(127.0f, std::max(-127.0f, value * inv_scale));
+  return static_cast<int8_t>(x + (x >= 0.0f ? 0.5f : -0.5f));
+}
+
+struct Scratch {
+  std::vector<int8_t> inputs;
+  std::vector<float> row_scales;
+  std::vector<int32_t> results;
+};
+
+}  // namespace
+
+Int8FullyConnectedLayer::Int8FullyConnectedLayer(size_t input_size,
+                                                 size_t output_size,
+                                                 const float* weights,
+                                                 float input_range)
+    : input_size_(input_size),
+      padded_size_((input_size + kPadding - 1) / kPadding * kPadding),
+      output_size_(output_size),
+      input_range_(input_range),
+      weights_(padded_size_ * output_size),
+      weight_scales_(output_size),
+      weight_sums_(output_size) {
+  for (size_t o = 0; o < output_size; o++) {
+    const float* row = weights + o * input_size;
+    float max = 0.0f;
+    for (size_t i = 0; i < input_size; i++) {
+      max = std::max(max, std::abs(row[i]));
+    }
+    const float scale = max > 0.0f ? max / 127.0f : 1.0f;
+    weight_scales_[o] = scale;
+    int32_t sum = 0;
+    for (size_t i = 0; i < input_size; i++) {
+      const int8_t q = Quantize(row[i], 1.0f / scale);
+      weights_[o * padded_size_ + i] = q;
+      sum += q;
+    }
+    weight_sums_[o] = sum;
+  }
+}
+
+void Int8FullyConnectedLayer::Forward(size_t batch_size, const float* input,
+                                      float* output) const {
+  Forward(batch_size, input, output, GetKernels());
+}
+
+void Int8FullyConnectedLayer::Forward(
+    size_t batch_size, const float* input, float* output,
+    const Int8FullyConnectedVariant& kernels) const {
+  thread_local Scratch scratch;
+  scratch.inputs.resize(batch_size * padded_size_);
+  scratch.row_scales.resize(batch_size);
+  scratch.results.resize(batch_size * output_size_);
+
+  for (size_t r = 0; r < batch_size; r++) {
+    const float* row = input + r * input_size_;
+    float range = input_range_;
+    if (range <= 0.0f) {
+      range = 0.0f;
+      for (size_t i = 0; i < input_size_; i++) {
+        range = std::max(range, std::abs(row[i]));
+      }
+    }
+    const float scale = range > 0.0f ? range / 127.0f : 1.0f;
+    scratch.row_scales[r] = scale;
+    int8_t* quantized = &scratch.inputs[r * padded_size_];
+    const float inv_scale = 1.0f / scale;
+    for (size_t i = 0; i < input_size_; i++) {
+      quantized[i] = Quantize(row[i], inv_scale);
+    }
+    std::fill(quantized + input_size_, quantized + padded_size_, 0);
+  }
+
+  const int8_t* inputs = scratch.inputs.data();
+  int32_t* results = scratch.results.data();
+  for (size_t r0 = 0; r0 < batch_size; r0 += kRowBlock) {
+    const size_t r1 = std::min(batch_size, r0 + kRowBlock);
+    for (size_t o = 0; o < output_size_; o++) {
+      const int8_t* w = &weights_[o * padded_size_];
+      int32_t dots[4];
+      size_t r = r0;
+      for (; r + 4 <= r1; r += 4) {
+        kernels.dot4(inputs + r * padded_size_, padded_size_, w, dots);
+        for (int t = 0; t < 4; t++) {
+          results[(r + t) * output_size_ + o] = dots[t];
+        }
+      }
+      for (; r < r1; r++) {
+        kernels.dot1(inputs + r * padded_size_, padded_size_, w, dots);
+        results[r * output_size_ + o] = dots[0];
+      }
+    }
+  }
+
+  for (size_t r = 0; r < batch_size; r++) {
+    const int32_t* result = results + r * output_size_;
+    float* out = output + r * output_size_;
+    const float row_scale = scratch.row_scales[r];
+    for (size_t o = 0; o < output_size_; o++) {
+      const int32_t dot =
+          kernels.offset_inputs ? result[o] - 128 * weight_sums_[o] : result[o];
+      out[o] = dot * row_scale * weight_scales_[o];
+    }
+  }
+}
+
+const char* GetInt8Implementation() { return GetKernels().name; }
+
+std::vector<Int8FullyConnectedVariant> GetInt8FullyConnectedVariants() {
+  std::vector<Int8FullyConnectedVariant> variants;
+#if defined(LC0_X86_DISPATCH)
+  const auto& cpu = GetCpuFeatures();
+  if (cpu.avx512bw && cpu.avx512vnni) {
+    variants.push_back({"avx512vnni", DotVnni<4>, DotVnni<1>, true});
+  }
+  if (cpu.avx2) variants.push_back({"avx2", DotAvx2<4>, DotAvx2<1>, false});
+#endif
+  variants.push_back({"generic", DotGeneric<4>, DotGeneric<1>, false});
+  return variants;
+}
+
+}  // namespace lczero
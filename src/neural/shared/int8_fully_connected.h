@@ -0,0 +1,91 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lczero {
+
+// One instruction set version of the kernels of Int8FullyConnectedLayer.
+struct Int8FullyConnectedVariant {
+  const char* name;
+  // Dot products of 4 (dot4) or 1 (dot1) rows of quantized inputs, @stride
+  // bytes apart, with one row of weights.
+  void (*dot4)(const int8_t* inputs, size_t stride, const int8_t* weights,
+               int32_t* out);
+  void (*dot1)(const int8_t* inputs, size_t stride, const int8_t* weights,
+               int32_t* out);
+  // Whether the kernels read the inputs as unsigned, offset by 128.
+  bool offset_inputs;
+};
+
+// Fully connected layer computed with int8 weights and inputs and int32
+// accumulation. Weights are quantized symmetrically per output channel at
+// construction; inputs are quantized per row on the fly, either against a
+// fixed range found by calibration or against the row's own largest value.
+class Int8FullyConnectedLayer {
+ public:
+  // @weights is [output_size][input_size], as for FullyConnectedLayer.
+  // @input_range is the largest input magnitude expected, values beyond it
+  // are clipped. Zero or less scales every row by its own maximum.
+  Int8FullyConnectedLayer(size_t input_size, size_t output_size,
+                          const float* weights, float input_range);
+
+  size_t input_size() const { return input_size_; }
+  size_t output_size() const { return output_size_; }
+
+  // Computes @output = weights x @input for @batch_size rows. Biases and
+  // activation are left to the caller.
+  void Forward(size_t batch_size, const float* input, float* output) const;
+
+  // Same as above, with the kernels of @variant.
+  void Forward(size_t batch_size, const float* input, float* output,
+               const Int8FullyConnectedVariant& variant) const;
+
+ private:
+  size_t input_size_;
+  // Input size rounded up to the widest vector, rows are zero padded.
+  size_t padded_size_;
+  size_t output_size_;
+  float input_range_;
+  std::vector<int8_t> weights_;
+  std::vector<float> weight_scales_;
+  // Sum of every weight row, to correct for the unsigned inputs of VNNI.
+  std::vector<int32_t> weight_sums_;
+};
+
+// Name of the instruction set used by the int8 kernels, e.g. "avx512vnni".
+const char* GetInt8Implementation();
+
+// The variants the current CPU can run, best first. The first one is what
+// Forward() uses, the others are there for tests and benchmarks.
+std::vector<Int8FullyConnectedVariant> GetInt8FullyConnectedVariants();
+
+}  // namespace lczero
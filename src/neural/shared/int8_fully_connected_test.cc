@@ -0,0 +1,141 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/int8_fully_connected.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace lczero {
+
+namespace {
+// Integer values in [-127, 127] with 127 present in every weight row, so
+// that all scales come out as exactly 1 and the int8 result must be exact.
+std::vector<float> IntegerMatrix(size_t rows, size_t cols, std::mt19937* gen) {
+  std::uniform_int_distribution<int> dist(-127, 127);
+  std::vector<float> result(rows * cols);
+  for (auto& x : result) x = dist(*gen);
+  for (size_t r = 0; r < rows; r++) result[r * cols + r % cols] = 127;
+  return result;
+}
+
+std::vector<float> Reference(size_t batch_size, size_t input_size,
+                             size_t output_size,
+                             const std::vector<float>& input,
+                             const std::vector<float>& weights) {
+  std::vector<float> output(batch_size * output_size);
+  for (size_t b = 0; b < batch_size; b++) {
+    for (size_t o = 0; o < output_size; o++) {
+      double sum = 0;
+      for (size_t i = 0; i < input_size; i++) {
+        sum += input[b * input_size + i] * weights[o * input_size + i];
+      }
+      output[b * output_size + o] = sum;
+    }
+  }
+  return output;
+}
+}  // namespace
+
+TEST(Int8FullyConnected, ExactOnIntegers) {
+  std::mt19937 gen(42);
+  // Odd sizes exercise the row padding and the partial row tiles.
+  for (size_t batch_size : {1, 7, 45}) {
+    const size_t input_size = 100;
+    const size_t output_size = 13;
+    const auto weights = IntegerMatrix(output_size, input_size, &gen);
+    const auto input = IntegerMatrix(batch_size, input_size, &gen);
+    Int8FullyConnectedLayer layer(input_size, output_size, weights.data(),
+                                  127.0f);
+    const auto expected =
+        Reference(batch_size, input_size, output_size, input, weights);
+    // Every variant the CPU supports, not only the one Forward() uses.
+    for (const auto& variant : GetInt8FullyConnectedVariants()) {
+      std::vector<float> output(batch_size * output_size);
+      layer.Forward(batch_size, input.data(), output.data(), variant);
+      for (size_t i = 0; i < output.size(); i++) {
+        ASSERT_EQ(expected[i], output[i])
+            << variant.name << " batch " << batch_size << " index " << i;
+      }
+    }
+  }
+}
+
+TEST(Int8FullyConnected, CloseToFloat) {
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  const size_t batch_size = 9, input_size = 256, output_size = 64;
+  std::vector<float> weights(input_size * output_size);
+  std::vector<float> input(batch_size * input_size);
+  for (auto& x : weights) x = dist(gen) * 0.05f;
+  for (auto& x : input) x = dist(gen);
+  const auto expected =
+      Reference(batch_size, input_size, output_size, input, weights);
+  double scale = 0;
+  for (auto x : expected) scale += x * x;
+  scale = std::sqrt(scale / expected.size());
+
+  // Both a calibrated range and per row scaling.
+  for (float range : {5.0f, 0.0f}) {
+    Int8FullyConnectedLayer layer(input_size, output_size, weights.data(),
+                                  range);
+    for (const auto& variant : GetInt8FullyConnectedVariants()) {
+      std::vector<float> output(batch_size * output_size);
+      layer.Forward(batch_size, input.data(), output.data(), variant);
+      for (size_t i = 0; i < output.size(); i++) {
+        ASSERT_NEAR(expected[i], output[i], 0.05 * scale)
+            << variant.name << " range " << range << " index " << i;
+      }
+    }
+  }
+}
+
+TEST(Int8FullyConnected, ClipsToRange) {
+  const float weights[] = {1.0f, 1.0f};
+  const float input[] = {10.0f, -0.5f};
+  Int8FullyConnectedLayer layer(2, 1, weights, 1.0f);
+  for (const auto& variant : GetInt8FullyConnectedVariants()) {
+    float output;
+    layer.Forward(1, input, &output, variant);
+    EXPECT_NEAR(0.5f, output, 0.01f) << variant.name;
+  }
+}
+
+TEST(Int8FullyConnected, UsesFirstVariant) {
+  EXPECT_STREQ(GetInt8Implementation(),
+               GetInt8FullyConnectedVariants().front().name);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,213 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/packed_gemm.h"
+
+#include <algorithm>
+
+#include "utils/cpu_features.h"
+
+#if defined(LC0_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace lczero {
+namespace {
+
+constexpr size_t kWidth = PackedGemmWeights::kPanelWidth;
+// Most rows of a micro-kernel tile.
+constexpr size_t kMaxRows = 6;
+// Bytes of input rows kept in cache while the panels stream past them.
+constexpr size_t kRowBlockBytes = 256 * 1024;
+
+// Computes a kRows x kWidth tile: @c[r][j] = sum_k @a[r][k] * @panel[k][j],
+// with rows @lda (@ldc) elements apart.
+using KernelFunc = void (*)(size_t depth, const float* a, size_t lda,
+                            const float* panel, float* c, size_t ldc);
+
+template <int kRows>
+void KernelGeneric(size_t depth, const float* a, size_t lda,
+                   const float* panel, float* c, size_t ldc) {
+  float acc[kRows][kWidth] = {};
+  for (size_t k = 0; k < depth; k++) {
+    const float* w = panel + k * kWidth;
+    for (int r = 0; r < kRows; r++) {
+      const float x = a[r * lda + k];
+      for (size_t j = 0; j < kWidth; j++) acc[r][j] += x * w[j];
+    }
+  }
+  for (int r = 0; r < kRows; r++) {
+    std::copy(acc[r], acc[r] + kWidth, c + r * ldc);
+  }
+}
+
+#if defined(LC0_X86_DISPATCH)
+
+// The accumulators of up to 6 x 16 outputs fit in 12 of the 16 ymm
+// registers, so the panel is done in two halves.
+template <int kRows>
+LC0_TARGET("avx2,fma")
+void KernelAvx2(size_t depth, const float* a, size_t lda, const float* panel,
+                float* c, size_t ldc) {
+  for (size_t half = 0; half < kWidth; half += 16) {
+    __m256 acc[kRows][2];
+    for (int r = 0; r < kRows; r++) {
+      acc[r][0] = _mm256_setzero_ps();
+      acc[r][1] = _mm256_setzero_ps();
+    }
+    for (size_t k = 0; k < depth; k++) {
+      const float* w = panel + k * kWidth + half;
+      const __m256 w0 = _mm256_loadu_ps(w);
+      const __m256 w1 = _mm256_loadu_ps(w + 8);
+      for (int r = 0; r < kRows; r++) {
+        const __m256 x = _mm256_broadcast_ss(a + r * lda + k);
+        acc[r][0] = _mm256_fmadd_ps(x, w0, acc[r][0]);
+        acc[r][1] = _mm256_fmadd_ps(x, w1, acc[r][1]);
+      }
+    }
+    for (int r = 0; r < kRows; r++) {
+      _mm256_storeu_ps(c + r * ldc + half, acc[r][0]);
+      _mm256_storeu_ps(c + r * ldc + half + 8, acc[r][1]);
+    }
+  }
+}
+
+template <int kRows>
+LC0_TARGET("avx512f")
+void KernelAvx512(size_t depth, const float* a, size_t lda,
+                  const float* panel, float* c, size_t ldc) {
+  __m512 acc[kRows][2];
+  for (int r = 0; r < kRows; r++) {
+    acc[r][0] = _mm512_setzero_ps();
+    acc[r][1] = _mm512_setzero_ps();
+  }
+  for (size_t k = 0; k < depth; k++) {
+    const __m512 w0 = _mm512_loadu_ps(panel + k * kWidth);
+    const __m512 w1 = _mm512_loadu_ps(panel + k * kWidth + 16);
+    for (int r = 0; r < kRows; r++) {
+      const __m512 x = _mm512_set1_ps(a[r * lda + k]);
+      acc[r][0] = _mm512_fmadd_ps(x, w0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_ps(x, w1, acc[r][1]);
+    }
+  }
+  for (int r = 0; r < kRows; r++) {
+    _mm512_storeu_ps(c + r * ldc, acc[r][0]);
+    _mm512_storeu_ps(c + r * ldc + 16, acc[r][1]);
+  }
+}
+
+#endif
+
+struct GemmKernels {
+  const char* name;
+  // Rows of a full tile.
+  size_t rows;
+  // kernels[n - 1] computes n rows, for n up to @rows.
+  KernelFunc kernels[kMaxRows];
+};
+
+GemmKernels SelectKernels() {
+#if defined(LC0_X86_DISPATCH)
+  const auto& cpu = GetCpuFeatures();
+  if (cpu.avx512f) {
+    return {"avx512",
+            6,
+            {KernelAvx512<1>, KernelAvx512<2>, KernelAvx512<3>,
+             KernelAvx512<4>, KernelAvx512<5>, KernelAvx512<6>}};
+  }
+  if (cpu.avx2 && cpu.fma) {
+    return {"avx2",
+            6,
+            {KernelAvx2<1>, KernelAvx2<2>, KernelAvx2<3>, KernelAvx2<4>,
+             KernelAvx2<5>, KernelAvx2<6>}};
+  }
+#endif
+  return {"generic",
+          4,
+          {KernelGeneric<1>, KernelGeneric<2>, KernelGeneric<3>,
+           KernelGeneric<4>}};
+}
+
+const GemmKernels& GetKernels() {
+  static const GemmKernels kernels = SelectKernels();
+  return kernels;
+}
+
+}  // namespace
+
+PackedGemmWeights::PackedGemmWeights(size_t input_size, size_t output_size,
+                                     const float* weights, Layout layout)
+    : input_size_(input_size),
+      output_size_(output_size),
+      panels_((output_size + kWidth - 1) / kWidth * kWidth * input_size) {
+  for (size_t o = 0; o < output_size; o++) {
+    float* panel = &panels_[o / kWidth * kWidth * input_size + o % kWidth];
+    for (size_t i = 0; i < input_size; i++) {
+      panel[i * kWidth] = layout == Layout::kOutputMajor
+                              ? weights[o * input_size + i]
+                              : weights[i * output_size + o];
+    }
+  }
+}
+
+void PackedGemmWeights::Multiply(size_t rows, const float* input,
+                                 float* output) const {
+  const auto& kernels = GetKernels();
+  const size_t row_block = std::max(
+      kernels.rows,
+      kRowBlockBytes / (input_size_ * sizeof(float)) / kernels.rows *
+          kernels.rows);
+  // The last panel is computed into a full width tile, then cropped.
+  float tile[kMaxRows * kWidth];
+  for (size_t r0 = 0; r0 < rows; r0 += row_block) {
+    const size_t r1 = std::min(rows, r0 + row_block);
+    for (size_t o = 0; o < output_size_; o += kWidth) {
+      const float* panel = &panels_[o * input_size_];
+      const size_t columns = std::min(kWidth, output_size_ - o);
+      for (size_t r = r0; r < r1; r += kernels.rows) {
+        const size_t count = std::min(kernels.rows, r1 - r);
+        const float* a = input + r * input_size_;
+        float* c = output + r * output_size_ + o;
+        if (columns == kWidth) {
+          kernels.kernels[count - 1](input_size_, a, input_size_, panel, c,
+                                     output_size_);
+          continue;
+        }
+        kernels.kernels[count - 1](input_size_, a, input_size_, panel, tile,
+                                   kWidth);
+        for (size_t t = 0; t < count; t++) {
+          std::copy(tile + t * kWidth, tile + t * kWidth + columns,
+                    c + t * output_size_);
+        }
+      }
+    }
+  }
+}
+
+const char* PackedGemmWeights::implementation() { return GetKernels().name; }
+
+}  // namespace lczero
@@ -0,0 +1,73 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace lczero {
+
+// Weights of a GEMM, repacked once at load into the panel layout streamed by
+// the micro-kernels: the outputs are split into panels of kPanelWidth
+// columns, and each panel stores its input_size x kPanelWidth block
+// contiguously. This avoids repacking the (constant) weights on every call,
+// as Eigen does for mapped matrices.
+class PackedGemmWeights {
+ public:
+  static constexpr size_t kPanelWidth = 32;
+
+  enum class Layout {
+    // [output_size][input_size], as FullyConnectedLayer.
+    kOutputMajor,
+    // [input_size][output_size], as the Winograd filter tiles.
+    kInputMajor,
+  };
+
+  PackedGemmWeights(size_t input_size, size_t output_size,
+                    const float* weights, Layout layout);
+
+  // Computes @output[r][o] = sum_i @input[r][i] * weights(i, o) for @rows
+  // rows, with input_size (output_size) elements per row. Biases and
+  // activation are left to the caller.
+  void Multiply(size_t rows, const float* input, float* output) const;
+
+  size_t input_size() const { return input_size_; }
+  size_t output_size() const { return output_size_; }
+  size_t bytes() const { return panels_.size() * sizeof(float); }
+
+  // Name of the micro-kernels used, e.g. "avx512".
+  static const char* implementation();
+
+ private:
+  size_t input_size_;
+  size_t output_size_;
+  // Output columns past output_size_ in the last panel are zero.
+  std::vector<float> panels_;
+};
+
+}  // namespace lczero
@@ -0,0 +1,91 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/packed_gemm.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace lczero {
+
+namespace {
+using Layout = PackedGemmWeights::Layout;
+
+void CheckAgainstReference(size_t input_size, size_t output_size,
+                           Layout layout) {
+  std::mt19937 gen(42);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> weights(input_size * output_size);
+  for (auto& x : weights) x = dist(gen) * 0.1f;
+  const PackedGemmWeights packed(input_size, output_size, weights.data(),
+                                 layout);
+  for (size_t rows : {1, 7, 45, 300}) {
+    std::vector<float> input(rows * input_size);
+    for (auto& x : input) x = dist(gen);
+    std::vector<float> output(rows * output_size);
+    packed.Multiply(rows, input.data(), output.data());
+    for (size_t r = 0; r < rows; r++) {
+      for (size_t o = 0; o < output_size; o++) {
+        double expected = 0;
+        for (size_t i = 0; i < input_size; i++) {
+          const float w = layout == Layout::kOutputMajor
+                              ? weights[o * input_size + i]
+                              : weights[i * output_size + o];
+          expected += input[r * input_size + i] * w;
+        }
+        ASSERT_NEAR(expected, output[r * output_size + o], 1e-4)
+            << PackedGemmWeights::implementation() << " rows " << rows
+            << " row " << r << " output " << o;
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST(PackedGemm, OutputMajorMatchesReference) {
+  // Odd sizes exercise the partial panels and row tiles.
+  CheckAgainstReference(100, 13, Layout::kOutputMajor);
+  CheckAgainstReference(64, 48, Layout::kOutputMajor);
+}
+
+TEST(PackedGemm, InputMajorMatchesReference) {
+  CheckAgainstReference(37, 70, Layout::kInputMajor);
+}
+
+TEST(PackedGemm, LargeInputsAreBlocked) {
+  // Wider than one row block.
+  CheckAgainstReference(1200, 20, Layout::kOutputMajor);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,333 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/shared/shared_weights.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "utils/exception.h"
+#include "utils/hashcat.h"
+#include "utils/logging.h"
+
+namespace lczero {
+namespace {
+
+// Shared weights file layout (native byte order):
+//   FileHeader
+//   scalar_count x int64 (layer counts, head counts and flags)
+//   vector_count x VectorEntry
+//   float data, every vector starting at a multiple of kAlignment
+constexpr char kSharedMagic[8] = {'L', 'c', '0', 'S', 'h', 'W', 't', '\0'};
+constexpr uint32_t kSharedVersion = 1;
+constexpr size_t kAlignment = 64;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t key;
+  uint64_t scalar_count;
+  uint64_t vector_count;
+};
+
+struct VectorEntry {
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Flat list of all vectors and scalars of a weights structure.
+struct WeightsTape {
+  std::vector<int64_t> scalars;
+  std::vector<WeightsSpan> vectors;
+};
+
+// Calls @f on every float vector and scalar of @w, always in the same order.
+// Sizes of layer lists are passed as scalars too, and @w is resized to them
+// when it is not const.
+template <typename W, typename F>
+void VisitWeights(W& w, F&& f) {
+  auto list = [&](auto& layers, auto&& visit) {
+    int64_t count = layers.size();
+    f(count);
+    if constexpr (!std::is_const_v<std::remove_reference_t<decltype(layers)>>) {
+      layers.resize(count);
+    }
+    for (auto& layer : layers) visit(layer);
+  };
+  auto conv = [&](auto& c) {
+    f(c.weights);
+    f(c.biases);
+    f(c.bn_gammas);
+    f(c.bn_betas);
+    f(c.bn_means);
+    f(c.bn_stddivs);
+  };
+  auto encoder = [&](auto& e) {
+    f(e.mha.q_w);
+    f(e.mha.q_b);
+    f(e.mha.k_w);
+    f(e.mha.k_b);
+    f(e.mha.v_w);
+    f(e.mha.v_b);
+    f(e.mha.dense_w);
+    f(e.mha.dense_b);
+    f(e.mha.smolgen.compress);
+    f(e.mha.smolgen.dense1_w);
+    f(e.mha.smolgen.dense1_b);
+    f(e.mha.smolgen.ln1_gammas);
+    f(e.mha.smolgen.ln1_betas);
+    f(e.mha.smolgen.dense2_w);
+    f(e.mha.smolgen.dense2_b);
+    f(e.mha.smolgen.ln2_gammas);
+    f(e.mha.smolgen.ln2_betas);
+    f(e.mha.has_smolgen);
+    f(e.ln1_gammas);
+    f(e.ln1_betas);
+    f(e.ffn.dense1_w);
+    f(e.ffn.dense1_b);
+    f(e.ffn.dense2_w);
+    f(e.ffn.dense2_b);
+    f(e.ln2_gammas);
+    f(e.ln2_betas);
+  };
+
+  conv(w.input);
+  f(w.ip_emb_w);
+  f(w.ip_emb_b);
+  f(w.ip_mult_gate);
+  f(w.ip_add_gate);
+  list(w.encoder, encoder);
+  f(w.encoder_head_count);
+  list(w.residual, [&](auto& r) {
+    conv(r.conv1);
+    conv(r.conv2);
+    f(r.se.w1);
+    f(r.se.b1);
+    f(r.se.w2);
+    f(r.se.b2);
+    f(r.has_se);
+  });
+  conv(w.policy1);
+  conv(w.policy);
+  f(w.ip_pol_w);
+  f(w.ip_pol_b);
+  f(w.ip2_pol_w);
+  f(w.ip2_pol_b);
+  f(w.ip3_pol_w);
+  f(w.ip3_pol_b);
+  f(w.ip4_pol_w);
+  f(w.pol_encoder_head_count);
+  list(w.pol_encoder, encoder);
+  conv(w.value);
+  f(w.ip_val_w);
+  f(w.ip_val_b);
+  f(w.ip1_val_w);
+  f(w.ip1_val_b);
+  f(w.ip2_val_w);
+  f(w.ip2_val_b);
+  conv(w.moves_left);
+  f(w.ip_mov_w);
+  f(w.ip_mov_b);
+  f(w.ip1_mov_w);
+  f(w.ip1_mov_b);
+  f(w.ip2_mov_w);
+  f(w.ip2_mov_b);
+  f(w.smolgen_w);
+  f(w.smolgen_b);
+  f(w.has_smolgen);
+}
+
+WeightsTape Record(const LegacyWeights& weights) {
+  WeightsTape tape;
+  VisitWeights(weights, [&](const auto& field) {
+    using T = std::decay_t<decltype(field)>;
+    if constexpr (std::is_same_v<T, std::vector<float>>) {
+      tape.vectors.emplace_back(field.data(), field.size());
+    } else {
+      tape.scalars.push_back(static_cast<int64_t>(field));
+    }
+  });
+  return tape;
+}
+
+WeightsView Replay(const WeightsTape& tape) {
+  WeightsView view;
+  size_t scalar_idx = 0;
+  size_t vector_idx = 0;
+  VisitWeights(view, [&](auto& field) {
+    using T = std::decay_t<decltype(field)>;
+    if constexpr (std::is_same_v<T, WeightsSpan>) {
+      if (vector_idx >= tape.vectors.size()) {
+        throw Exception("Shared weights: too few vectors");
+      }
+      field = tape.vectors[vector_idx++];
+    } else {
+      if (scalar_idx >= tape.scalars.size()) {
+        throw Exception("Shared weights: too few scalars");
+      }
+      field = static_cast<T>(tape.scalars[scalar_idx++]);
+    }
+  });
+  if (scalar_idx != tape.scalars.size() || vector_idx != tape.vectors.size()) {
+    throw Exception("Shared weights: layout mismatch");
+  }
+  return view;
+}
+
+void WriteSharedWeights(const std::string& filename, uint64_t key,
+                        const LegacyWeights& weights) {
+  const WeightsTape tape = Record(weights);
+  FileHeader header{};
+  std::memcpy(header.magic, kSharedMagic, sizeof(kSharedMagic));
+  header.version = kSharedVersion;
+  header.key = key;
+  header.scalar_count = tape.scalars.size();
+  header.vector_count = tape.vectors.size();
+
+  std::vector<VectorEntry> entries;
+  uint64_t offset = sizeof(header) + tape.scalars.size() * sizeof(int64_t) +
+                    tape.vectors.size() * sizeof(VectorEntry);
+  for (const auto& vec : tape.vectors) {
+    offset = (offset + kAlignment - 1) / kAlignment * kAlignment;
+    entries.push_back({offset, vec.size()});
+    offset += vec.size() * sizeof(float);
+  }
+
+  // Written under a temporary name and renamed, so that other processes
+  // never map a partial file.
+  const std::string tmp_filename =
+      filename + ".tmp" +
+      std::to_string(
+          std::chrono::steady_clock::now().time_since_epoch().count());
+  std::ofstream output(tmp_filename, std::ios::binary | std::ios::trunc);
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.write(reinterpret_cast<const char*>(tape.scalars.data()),
+               tape.scalars.size() * sizeof(int64_t));
+  output.write(reinterpret_cast<const char*>(entries.data()),
+               entries.size() * sizeof(VectorEntry));
+  uint64_t pos = sizeof(header) + tape.scalars.size() * sizeof(int64_t) +
+                 tape.vectors.size() * sizeof(VectorEntry);
+  const char zeros[kAlignment] = {};
+  for (size_t i = 0; i < entries.size(); i++) {
+    output.write(zeros, entries[i].offset - pos);
+    output.write(reinterpret_cast<const char*>(tape.vectors[i].data()),
+                 entries[i].size * sizeof(float));
+    pos = entries[i].offset + entries[i].size * sizeof(float);
+  }
+  output.close();
+  if (!output || std::rename(tmp_filename.c_str(), filename.c_str())) {
+    std::remove(tmp_filename.c_str());
+    throw Exception("Cannot write shared weights " + filename);
+  }
+}
+
+}  // namespace
+
+WeightsView MakeWeightsView(const LegacyWeights& weights) {
+  return Replay(Record(weights));
+}
+
+uint64_t HashWeightsFile(const WeightsFile& file) {
+  const std::string data = file.OutputAsString();
+  uint64_t hash = data.size();
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data.data() + i, sizeof(word));
+    hash = HashCat(hash, word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data.data() + i, data.size() - i);
+  return HashCat(hash, tail);
+}
+
+std::string GetSharedWeightsDirectory(const std::string& directory) {
+  if (!directory.empty()) return directory;
+  std::string dir = GetUserCacheDirectory();
+  if (dir.empty()) {
+    throw Exception("No directory for shared weights, set one explicitly");
+  }
+  dir += "lc0";
+  CreateDirectory(dir);
+  dir += "/shared";
+  CreateDirectory(dir);
+  return dir;
+}
+
+SharedWeights::SharedWeights(uint64_t key, const std::string& directory,
+                             const std::function<LegacyWeights()>& prepare)
+    : key_(key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%016llx.lc0s",
+                static_cast<unsigned long long>(key));
+  filename_ = GetSharedWeightsDirectory(directory) + name;
+
+  if (TryMap()) return;
+  CERR << "Preparing shared weights " << filename_;
+  WriteSharedWeights(filename_, key_, prepare());
+  if (!TryMap()) throw Exception("Cannot map shared weights " + filename_);
+}
+
+bool SharedWeights::TryMap() {
+  if (GetFileSize(filename_) < sizeof(FileHeader)) return false;
+  auto file = std::make_unique<MappedFile>(filename_);
+  FileHeader header;
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kSharedMagic, sizeof(kSharedMagic)) != 0 ||
+      header.version != kSharedVersion || header.key != key_) {
+    return false;
+  }
+  const uint64_t table_end = sizeof(header) +
+                             header.scalar_count * sizeof(int64_t) +
+                             header.vector_count * sizeof(VectorEntry);
+  if (table_end > file->size()) return false;
+
+  WeightsTape tape;
+  tape.scalars.resize(header.scalar_count);
+  std::memcpy(tape.scalars.data(), file->data() + sizeof(header),
+              header.scalar_count * sizeof(int64_t));
+  const char* table = file->data() + sizeof(header) +
+                      header.scalar_count * sizeof(int64_t);
+  for (uint64_t i = 0; i < header.vector_count; i++) {
+    VectorEntry entry;
+    std::memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+    if (entry.offset + entry.size * sizeof(float) > file->size()) return false;
+    tape.vectors.emplace_back(
+        reinterpret_cast<const float*>(file->data() + entry.offset),
+        entry.size);
+  }
+  view_ = Replay(tape);
+  file_ = std::move(file);
+  CERR << "Using shared weights " << filename_;
+  return true;
+}
+
+}  // namespace lczero
@@ -0,0 +1,97 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "neural/loader.h"
+#include "neural/network_legacy.h"
+#include "utils/filesystem.h"
+
+namespace lczero {
+
+// Read-only view of float weights stored elsewhere, with the parts of the
+// std::vector<float> interface that backends use.
+class WeightsSpan {
+ public:
+  WeightsSpan() = default;
+  WeightsSpan(const float* data, size_t size) : data_(data), size_(size) {}
+
+  const float* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const float& operator[](size_t idx) const { return data_[idx]; }
+  const float* begin() const { return data_; }
+  const float* end() const { return data_ + size_; }
+
+ private:
+  const float* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+using WeightsView = BasicLegacyWeights<WeightsSpan>;
+
+// Returns a view of @weights, valid as long as @weights are alive and not
+// modified.
+WeightsView MakeWeightsView(const LegacyWeights& weights);
+
+// Returns a hash identifying the network in @file.
+uint64_t HashWeightsFile(const WeightsFile& file);
+
+// Returns the directory of the shared weights files, @directory or one in the
+// user cache directory if empty, creating the latter. Throws if there is none.
+std::string GetSharedWeightsDirectory(const std::string& directory);
+
+// Backend-prepared weights in a read-only file mapping. All processes opening
+// the same key map the same file, so the page cache holds one physical copy
+// however many engines run on the host.
+class SharedWeights {
+ public:
+  // Maps the weights for @key from @directory (the user cache directory if
+  // empty). If they are not there yet, calls @prepare and writes its result
+  // first. @key must identify both the network and the preparation.
+  SharedWeights(uint64_t key, const std::string& directory,
+                const std::function<LegacyWeights()>& prepare);
+
+  const WeightsView& weights() const { return view_; }
+  const std::string& filename() const { return filename_; }
+
+ private:
+  bool TryMap();
+
+  const uint64_t key_;
+  std::string filename_;
+  std::unique_ptr<MappedFile> file_;
+  WeightsView view_;
+};
+
+}  // namespace lczero
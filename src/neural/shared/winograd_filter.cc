@@ -26,6 +26,41 @@ namespace {
 static constexpr auto kWinogradAlpha = 4;
 static constexpr auto kWinogradTile = kWinogradAlpha * kWinogradAlpha;
 
+// Computes transpose(G.dot(f).dot(G.transpose())) for the @alpha x 3 matrix
+// @G. The U matrix is transposed for better memory layout in SGEMM.
+std::vector<float> TransformFilter(const std::vector<float>& f,
+                                   const size_t outputs, const size_t channels,
+                                   const float* G, const size_t alpha) {
+  auto U = std::vector<float>(alpha * alpha * outputs * channels);
+  auto temp = std::vector<float>(alpha * 3);
+
+  for (size_t o = 0; o < outputs; o++) {
+    for (size_t c = 0; c < channels; c++) {
+      for (size_t i = 0; i < alpha; i++) {
+        for (size_t j = 0; j < 3; j++) {
+          auto acc = 0.0f;
+          for (size_t k = 0; k < 3; k++) {
+            acc += G[i * 3 + k] * f[o * channels * 9 + c * 9 + k * 3 + j];
+          }
+          temp[i * 3 + j] = acc;
+        }
+      }
+
+      for (size_t xi = 0; xi < alpha; xi++) {
+        for (size_t nu = 0; nu < alpha; nu++) {
+          auto acc = 0.0f;
+          for (size_t k = 0; k < 3; k++) {
+            acc += temp[xi * 3 + k] * G[nu * 3 + k];
+          }
+          U[xi * (alpha * outputs * channels) + nu * (outputs * channels) +
+            c * outputs + o] = acc;
+        }
+      }
+    }
+  }
+  return U;
+}
+
 }  // namespace
 
 std::vector<float> WinogradFilterZeropadU(const std::vector<float>& U,
@@ -55,38 +90,22 @@ std::vector<float> WinogradFilterTransformF(const std::vector<float>& f,
                                             const size_t outputs,
                                             const size_t channels) {
   // F(2x2, 3x3) Winograd filter transformation
-  // transpose(G.dot(f).dot(G.transpose()))
-  // U matrix is transposed for better memory layout in SGEMM
-  auto U = std::vector<float>(kWinogradTile * outputs * channels);
-  auto G = std::array<float, kWinogradTile>{1.0, 0.0,  0.0, 0.5, 0.5, 0.5,
-                                            0.5, -0.5, 0.5, 0.0, 0.0, 1.0};
-  auto temp = std::array<float, 12>{};
-
-  for (size_t o = 0; o < outputs; o++) {
-    for (size_t c = 0; c < channels; c++) {
-      for (size_t i = 0; i < 4; i++) {
-        for (size_t j = 0; j < 3; j++) {
-          auto acc = 0.0f;
-          for (size_t k = 0; k < 3; k++) {
-            acc += G[i * 3 + k] * f[o * channels * 9 + c * 9 + k * 3 + j];
-          }
-          temp[i * 3 + j] = acc;
-        }
-      }
+  const float G[] = {1.0, 0.0,  0.0, 0.5, 0.5, 0.5,
+                     0.5, -0.5, 0.5, 0.0, 0.0, 1.0};
+  return TransformFilter(f, outputs, channels, G, kWinogradAlpha);
+}
 
-      for (size_t xi = 0; xi < 4; xi++) {
-        for (size_t nu = 0; nu < 4; nu++) {
-          auto acc = 0.0f;
-          for (size_t k = 0; k < 3; k++) {
-            acc += temp[xi * 3 + k] * G[nu * 3 + k];
-          }
-          U[xi * (4 * outputs * channels) + nu * (outputs * channels) +
-            c * outputs + o] = acc;
-        }
-      }
-    }
-  }
-  return U;
+std::vector<float> WinogradFilterTransformF4(const std::vector<float>& f,
+                                             const size_t outputs,
+                                             const size_t channels) {
+  // F(4x4, 3x3) Winograd filter transformation
+  const float G[] = {1.0f / 4,  0.0f,       0.0f,
+                     -1.0f / 6, -1.0f / 6,  -1.0f / 6,
+                     -1.0f / 6, 1.0f / 6,   -1.0f / 6,
+                     1.0f / 24, 1.0f / 12,  1.0f / 6,
+                     1.0f / 24, -1.0f / 12, 1.0f / 6,
+                     0.0f,      0.0f,       1.0f};
+  return TransformFilter(f, outputs, channels, G, 6);
 }
 
 }  // namespace lczero
@@ -48,4 +48,10 @@ std::vector<float> WinogradFilterTransformF(const std::vector<float>& f,
                                             const size_t outputs,
                                             const size_t channels);
 
+// Same for the F(4x4, 3x3) algorithm, 36 transformed filter tiles instead
+// of 16.
+std::vector<float> WinogradFilterTransformF4(const std::vector<float>& f,
+                                             const size_t outputs,
+                                             const size_t channels);
+
 }  // namespace lczero
@@ -0,0 +1,185 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/weights_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/hashcat.h"
+#include "utils/logging.h"
+#include "utils/mutex.h"
+
+namespace lczero {
+namespace {
+
+// Cache file layout (native byte order):
+//   CacheHeader
+//   decompressed protobuf
+constexpr char kCacheMagic[8] = {'L', 'c', '0', 'W', 'C', 'c', 'h', '\0'};
+constexpr uint32_t kCacheVersion = 3;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t source_hash;
+  uint64_t proto_offset;
+  uint64_t proto_size;
+};
+
+std::string GetCacheFilename(uint64_t source_hash) {
+  const std::string cache_dir = GetUserCacheDirectory();
+  if (cache_dir.empty()) return {};
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.lc0w",
+                static_cast<unsigned long long>(source_hash));
+  return cache_dir + "lc0/weights/" + name;
+}
+
+// Mapped cache files. Files stay mapped until the process exits, backends may
+// be recreated from them at any time.
+class CacheRegistry {
+ public:
+  static CacheRegistry* Get() {
+    static CacheRegistry registry;
+    return &registry;
+  }
+
+  // Maps @cache_filename if not mapped yet, and returns its protobuf.
+  std::optional<std::string_view> Load(uint64_t source_hash,
+                                       const std::string& cache_filename) {
+    Mutex::Lock lock(mutex_);
+    auto it = protos_.find(source_hash);
+    if (it != protos_.end()) return it->second;
+    auto file = std::make_unique<MappedFile>(cache_filename);
+    const size_t file_size = file->size();
+    CacheHeader header;
+    if (file_size < sizeof(header)) return std::nullopt;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+        header.version != kCacheVersion || header.source_hash != source_hash ||
+        header.proto_offset > file_size ||
+        header.proto_size > file_size - header.proto_offset) {
+      return std::nullopt;
+    }
+    const std::string_view proto(file->data() + header.proto_offset,
+                                 header.proto_size);
+    protos_.emplace(source_hash, proto);
+    files_.push_back(std::move(file));
+    return proto;
+  }
+
+ private:
+  Mutex mutex_;
+  std::vector<std::unique_ptr<MappedFile>> files_ GUARDED_BY(mutex_);
+  std::unordered_map<uint64_t, std::string_view> protos_ GUARDED_BY(mutex_);
+};
+
+}  // namespace
+
+std::optional<uint64_t> HashWeightsSource(const std::string& filename) {
+  try {
+    const MappedFile file(filename);
+    uint64_t hash = HashCat(kCacheVersion, file.size());
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= file.size(); i += sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, file.data() + i, sizeof(word));
+      hash = HashCat(hash, word);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, file.data() + i, file.size() - i);
+    return HashCat(hash, tail);
+  } catch (const Exception& e) {
+    CERR << "Cannot use weights cache: " << e.what();
+    return std::nullopt;
+  }
+}
+
+std::optional<std::string_view> LoadCachedWeightsProto(uint64_t source_hash) {
+  try {
+    const std::string cache_filename = GetCacheFilename(source_hash);
+    if (cache_filename.empty() || GetFileSize(cache_filename) == 0) {
+      return std::nullopt;
+    }
+    auto proto = CacheRegistry::Get()->Load(source_hash, cache_filename);
+    if (proto) {
+      CERR << "Using weights cache " << cache_filename;
+    } else {
+      CERR << "Ignoring invalid weights cache " << cache_filename;
+    }
+    return proto;
+  } catch (const Exception& e) {
+    CERR << "Cannot use weights cache: " << e.what();
+    return std::nullopt;
+  }
+}
+
+void WriteWeightsCache(uint64_t source_hash, std::string_view proto) {
+  try {
+    const std::string cache_filename = GetCacheFilename(source_hash);
+    if (cache_filename.empty()) return;
+    CreateDirectory(GetUserCacheDirectory() + "lc0");
+    CreateDirectory(GetUserCacheDirectory() + "lc0/weights");
+
+    CacheHeader header{};
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.source_hash = source_hash;
+    header.proto_offset = sizeof(header);
+    header.proto_size = proto.size();
+
+    // Write to a temporary file first, so that concurrently starting engines
+    // never see a partial cache.
+    const std::string tmp_filename =
+        cache_filename + ".tmp" +
+        std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count());
+    std::ofstream output(tmp_filename, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(proto.data(), proto.size());
+    output.close();
+    if (!output || std::rename(tmp_filename.c_str(), cache_filename.c_str())) {
+      std::remove(tmp_filename.c_str());
+      CERR << "Cannot write weights cache " << cache_filename;
+      return;
+    }
+    CERR << "Wrote weights cache " << cache_filename;
+  } catch (const Exception& e) {
+    CERR << "Cannot write weights cache: " << e.what();
+  }
+}
+
+}  // namespace lczero
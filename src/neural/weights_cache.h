@@ -0,0 +1,56 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lczero {
+
+// Sidecar cache of decompressed network weights, to make engine startup fast.
+// The first load of a weights file writes
+// <user cache dir>/lc0/weights/<content hash>.lc0w holding the protobuf
+// without gzip. Later loads map that file read-only and parse the protobuf
+// from the mapping, skipping gunzip.
+
+// Returns the hash of the contents of @filename that keys its cache file, or
+// nullopt if the file cannot be read.
+std::optional<uint64_t> HashWeightsSource(const std::string& filename);
+
+// Returns the decompressed protobuf of the weights file with @source_hash from
+// its cache file, or nullopt if there is none. The returned view stays valid
+// for the lifetime of the process.
+std::optional<std::string_view> LoadCachedWeightsProto(uint64_t source_hash);
+
+// Writes the cache file of the weights file with @source_hash, containing the
+// decompressed @proto. Errors are logged and otherwise ignored.
+void WriteWeightsCache(uint64_t source_hash, std::string_view proto);
+
+}  // namespace lczero
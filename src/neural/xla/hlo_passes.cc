@@ -0,0 +1,387 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/xla/hlo_passes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "utils/exception.h"
+
+namespace lczero {
+namespace {
+
+size_t NumElements(const pblczero::XlaShapeProto& shape) {
+  size_t result = 1;
+  for (auto dim : shape.dimensions()) result *= dim;
+  return result;
+}
+
+template <typename T>
+std::vector<T>* MutableValues(pblczero::XlaLiteralProto* literal);
+template <>
+std::vector<float>* MutableValues(pblczero::XlaLiteralProto* literal) {
+  return literal->mutable_f32s();
+}
+template <>
+std::vector<int64_t>* MutableValues(pblczero::XlaLiteralProto* literal) {
+  return literal->mutable_s64s();
+}
+
+template <typename T>
+const std::vector<T>& Values(const pblczero::XlaLiteralProto& literal);
+template <>
+const std::vector<float>& Values(const pblczero::XlaLiteralProto& literal) {
+  return literal.f32s();
+}
+template <>
+const std::vector<int64_t>& Values(const pblczero::XlaLiteralProto& literal) {
+  return literal.s64s();
+}
+
+// Computes the value of an instruction with constant operands, for the element
+// type T of the result. Returns nullopt if the instruction is not supported.
+template <typename T>
+std::optional<pblczero::XlaLiteralProto> FoldInstruction(
+    const pblczero::HloInstructionProto& instr,
+    const std::vector<const pblczero::HloInstructionProto*>& operands,
+    size_t max_broadcast_size) {
+  pblczero::XlaLiteralProto result;
+  *result.mutable_shape() = instr.shape();
+  auto* dst = MutableValues<T>(&result);
+  const auto& opcode = instr.opcode();
+  if (opcode == "reshape") {
+    *dst = Values<T>(operands[0]->literal());
+  } else if (opcode == "convert") {
+    const auto& src = operands[0]->literal();
+    switch (src.shape().element_type()) {
+      case pblczero::XlaShapeProto::F32:
+        dst->assign(src.f32s().begin(), src.f32s().end());
+        break;
+      case pblczero::XlaShapeProto::S64:
+        dst->assign(src.s64s().begin(), src.s64s().end());
+        break;
+      default:
+        return std::nullopt;
+    }
+  } else if (opcode == "broadcast") {
+    const size_t size = NumElements(instr.shape());
+    if (size * sizeof(T) > max_broadcast_size) return std::nullopt;
+    const auto& src = Values<T>(operands[0]->literal());
+    const auto& in_dims = operands[0]->shape().dimensions();
+    const auto& out_dims = instr.shape().dimensions();
+    // Strides of the input, zero for the dimensions of size 1 as they are
+    // broadcast too.
+    std::vector<size_t> strides(out_dims.size(), 0);
+    size_t stride = 1;
+    for (size_t i = in_dims.size(); i-- > 0;) {
+      if (in_dims[i] != 1) strides[instr.dimensions(i)] = stride;
+      stride *= in_dims[i];
+    }
+    dst->resize(size);
+    std::vector<int64_t> index(out_dims.size(), 0);
+    for (size_t i = 0; i < size; ++i) {
+      size_t src_idx = 0;
+      for (size_t j = 0; j < index.size(); ++j) src_idx += index[j] * strides[j];
+      (*dst)[i] = src[src_idx];
+      for (size_t j = index.size(); j-- > 0;) {
+        if (++index[j] < out_dims[j]) break;
+        index[j] = 0;
+      }
+    }
+  } else if (opcode == "add" || opcode == "maximum") {
+    const auto& lhs = Values<T>(operands[0]->literal());
+    const auto& rhs = Values<T>(operands[1]->literal());
+    dst->resize(lhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      (*dst)[i] = opcode == "add" ? lhs[i] + rhs[i] : std::max(lhs[i], rhs[i]);
+    }
+  } else if constexpr (std::is_floating_point_v<T>) {
+    if (opcode != "tanh") return std::nullopt;
+    const auto& src = Values<T>(operands[0]->literal());
+    dst->resize(src.size());
+    for (size_t i = 0; i < src.size(); ++i) (*dst)[i] = std::tanh(src[i]);
+  } else {
+    return std::nullopt;
+  }
+  if (dst->size() != NumElements(instr.shape())) return std::nullopt;
+  return result;
+}
+
+// Returns the identity of the computation an instruction performs: everything
+// but its id, name and metadata.
+std::string InstructionKey(const pblczero::HloInstructionProto& instr) {
+  pblczero::HloInstructionProto copy = instr;
+  copy.set_id(0);
+  copy.set_name("");
+  *copy.mutable_metadata() = {};
+  return copy.OutputAsString();
+}
+
+class HloPassRunner {
+ public:
+  HloPassRunner(pblczero::HloComputationProto* computation,
+                const HloPassOptions& options, HloPassStats* stats)
+      : computation_(computation), options_(options), stats_(stats) {}
+
+  void Run() {
+    stats_->instructions_before = computation_->instructions_size();
+    BuildIdMap();
+    // Each pass may open opportunities for the others (e.g. a collapsed
+    // reshape chain becomes foldable, folded constants become identical), so
+    // iterate until nothing changes.
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      if (options_.canonicalize_shapes) {
+        changed |= Sweep(&HloPassRunner::Canonicalize, &stats_->canonicalized);
+      }
+      if (options_.fold_constants) {
+        changed |= Sweep(&HloPassRunner::FoldConstant, &stats_->folded);
+      }
+      if (options_.eliminate_common_subexpressions) {
+        seen_.clear();
+        changed |= Sweep(&HloPassRunner::MergeCommon, &stats_->merged);
+      }
+    }
+    if (options_.eliminate_dead_code) EliminateDeadCode();
+    RenumberInstructions();
+    stats_->instructions_after = computation_->instructions_size();
+  }
+
+ private:
+  using Rewrite = bool (HloPassRunner::*)(pblczero::HloInstructionProto*,
+                                          std::optional<int64_t>*);
+
+  void BuildIdMap() {
+    by_id_.clear();
+    for (auto& instr : *computation_->mutable_instructions()) {
+      by_id_[instr.id()] = &instr;
+    }
+  }
+
+  const pblczero::HloInstructionProto* Operand(
+      const pblczero::HloInstructionProto& instr, size_t idx) const {
+    return by_id_.at(instr.operand_ids(idx));
+  }
+
+  // Applies the rewrite to every live instruction in order. A rewrite either
+  // modifies the instruction in place, or asks to replace all its uses with
+  // another (earlier) instruction. Instructions are in topological order, so
+  // the uses are always updated before they are visited.
+  bool Sweep(Rewrite rewrite, size_t* counter) {
+    std::unordered_map<int64_t, int64_t> replacements;
+    bool changed = false;
+    for (auto& instr : *computation_->mutable_instructions()) {
+      if (replaced_.count(instr.id())) continue;
+      for (auto& id : *instr.mutable_operand_ids()) {
+        auto iter = replacements.find(id);
+        if (iter != replacements.end()) id = iter->second;
+      }
+      std::optional<int64_t> replacement;
+      if (!(this->*rewrite)(&instr, &replacement)) continue;
+      changed = true;
+      ++*counter;
+      if (replacement) {
+        replacements[instr.id()] = *replacement;
+        replaced_.insert(instr.id());
+      }
+    }
+    auto iter = replacements.find(computation_->root_id());
+    if (iter != replacements.end()) computation_->set_root_id(iter->second);
+    return changed;
+  }
+
+  // Removes reshapes and broadcasts to the same shape, and collapses
+  // reshape(reshape(x)) and broadcast(broadcast(x)) chains into a single op.
+  bool Canonicalize(pblczero::HloInstructionProto* instr,
+                    std::optional<int64_t>* replacement) {
+    const auto& opcode = instr->opcode();
+    if (opcode != "reshape" && opcode != "broadcast" && opcode != "convert") {
+      return false;
+    }
+    const auto* input = Operand(*instr, 0);
+    if (opcode == "convert") {
+      if (input->shape().element_type() != instr->shape().element_type()) {
+        return false;
+      }
+      *replacement = input->id();
+      return true;
+    }
+    if (opcode == "reshape") {
+      if (input->shape().dimensions() == instr->shape().dimensions()) {
+        *replacement = input->id();
+        return true;
+      }
+      if (input->opcode() == "reshape") {
+        (*instr->mutable_operand_ids())[0] = input->operand_ids(0);
+        return true;
+      }
+      // Reshape of a broadcast scalar is a broadcast of that scalar.
+      if (input->opcode() == "broadcast" &&
+          Operand(*input, 0)->shape().dimensions_size() == 0) {
+        instr->set_opcode("broadcast");
+        (*instr->mutable_operand_ids())[0] = input->operand_ids(0);
+        return true;
+      }
+      return false;
+    }
+    // Broadcast.
+    if (input->opcode() == "broadcast") {
+      std::vector<int64_t> dims;
+      for (auto dim : input->dimensions()) dims.push_back(instr->dimensions(dim));
+      *instr->mutable_dimensions() = dims;
+      (*instr->mutable_operand_ids())[0] = input->operand_ids(0);
+      return true;
+    }
+    if (input->shape().dimensions() != instr->shape().dimensions()) {
+      return false;
+    }
+    for (size_t i = 0; i < instr->dimensions_size(); ++i) {
+      if (instr->dimensions(i) != static_cast<int64_t>(i)) return false;
+    }
+    *replacement = input->id();
+    return true;
+  }
+
+  // Replaces an instruction whose operands are all constants with a constant.
+  bool FoldConstant(pblczero::HloInstructionProto* instr,
+                    std::optional<int64_t>*) {
+    if (instr->operand_ids_size() == 0 || instr->opcode() == "tuple") {
+      return false;
+    }
+    std::vector<const pblczero::HloInstructionProto*> operands;
+    for (size_t i = 0; i < instr->operand_ids_size(); ++i) {
+      operands.push_back(Operand(*instr, i));
+      if (operands.back()->opcode() != "constant") return false;
+    }
+    std::optional<pblczero::XlaLiteralProto> literal;
+    switch (instr->shape().element_type()) {
+      case pblczero::XlaShapeProto::F32:
+        literal = FoldInstruction<float>(*instr, operands,
+                                         options_.max_folded_constant_size);
+        break;
+      case pblczero::XlaShapeProto::S64:
+        literal = FoldInstruction<int64_t>(*instr, operands,
+                                           options_.max_folded_constant_size);
+        break;
+      default:
+        break;
+    }
+    if (!literal) return false;
+    instr->set_opcode("constant");
+    instr->mutable_operand_ids()->clear();
+    instr->mutable_dimensions()->clear();
+    *instr->mutable_literal() = *literal;
+    return true;
+  }
+
+  // Replaces an instruction with an earlier identical one.
+  bool MergeCommon(pblczero::HloInstructionProto* instr,
+                   std::optional<int64_t>* replacement) {
+    if (instr->opcode() == "parameter") return false;
+    auto [iter, inserted] = seen_.emplace(InstructionKey(*instr), instr->id());
+    if (inserted) return false;
+    *replacement = iter->second;
+    return true;
+  }
+
+  void EliminateDeadCode() {
+    std::unordered_set<int64_t> live;
+    std::vector<int64_t> queue = {computation_->root_id()};
+    while (!queue.empty()) {
+      const int64_t id = queue.back();
+      queue.pop_back();
+      if (!live.insert(id).second) continue;
+      for (auto operand : by_id_.at(id)->operand_ids()) {
+        queue.push_back(operand);
+      }
+    }
+    auto* instructions = computation_->mutable_instructions();
+    const size_t size = instructions->size();
+    instructions->erase(
+        std::remove_if(instructions->begin(), instructions->end(),
+                       [&](const pblczero::HloInstructionProto& instr) {
+                         return instr.opcode() != "parameter" &&
+                                !live.count(instr.id());
+                       }),
+        instructions->end());
+    stats_->removed += size - instructions->size();
+    replaced_.clear();
+    BuildIdMap();
+  }
+
+  // The rest of the code (e.g. the pretty printer) expects the instruction ids
+  // to be their indices in the computation, restore that after removals.
+  void RenumberInstructions() {
+    std::unordered_map<int64_t, int64_t> new_ids;
+    auto* instructions = computation_->mutable_instructions();
+    for (size_t i = 0; i < instructions->size(); ++i) {
+      new_ids[(*instructions)[i].id()] = i;
+      (*instructions)[i].set_id(i);
+    }
+    for (auto& instr : *instructions) {
+      for (auto& id : *instr.mutable_operand_ids()) id = new_ids.at(id);
+    }
+    computation_->set_root_id(new_ids.at(computation_->root_id()));
+    BuildIdMap();
+  }
+
+  pblczero::HloComputationProto* computation_;
+  const HloPassOptions& options_;
+  HloPassStats* stats_;
+  std::unordered_map<int64_t, pblczero::HloInstructionProto*> by_id_;
+  std::unordered_set<int64_t> replaced_;
+  std::unordered_map<std::string, int64_t> seen_;
+};
+
+}  // namespace
+
+std::string HloPassStats::ToString() const {
+  return std::to_string(instructions_before) + " -> " +
+         std::to_string(instructions_after) + " instructions (" +
+         std::to_string(folded) + " folded, " + std::to_string(merged) +
+         " merged, " + std::to_string(canonicalized) + " canonicalized, " +
+         std::to_string(removed) + " removed)";
+}
+
+HloPassStats RunHloPasses(pblczero::HloModuleProto* module,
+                          const HloPassOptions& options) {
+  HloPassStats stats;
+  for (auto& computation : *module->mutable_computations()) {
+    if (computation.id() != module->entry_computation_id()) continue;
+    HloPassRunner(&computation, options, &stats).Run();
+    return stats;
+  }
+  throw Exception("HLO module has no entry computation");
+}
+
+}  // namespace lczero
@@ -0,0 +1,69 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "neural/xla/hlo.pb.h"
+
+namespace lczero {
+
+struct HloPassOptions {
+  // Fold instructions whose operands are all constants (e.g. reshapes and
+  // converts of inlined initializers).
+  bool fold_constants = true;
+  // Folding a broadcast materializes its result, so it's only done when the
+  // result is not larger than this size in bytes.
+  size_t max_folded_constant_size = 1024;
+  // Merge instructions computing the same value from the same operands.
+  bool eliminate_common_subexpressions = true;
+  // Remove no-op reshapes and broadcasts, and collapse chains of them.
+  bool canonicalize_shapes = true;
+  // Remove instructions that don't contribute to the root (parameters are
+  // always kept, as they define the signature of the module).
+  bool eliminate_dead_code = true;
+};
+
+struct HloPassStats {
+  size_t instructions_before = 0;
+  size_t instructions_after = 0;
+  size_t folded = 0;
+  size_t merged = 0;
+  size_t canonicalized = 0;
+  size_t removed = 0;
+
+  std::string ToString() const;
+};
+
+// Simplifies the entry computation of the module in place. Instructions keep
+// their names (ids are renumbered), so the printed HLO before and after the
+// passes can be diffed directly.
+HloPassStats RunHloPasses(pblczero::HloModuleProto* module,
+                          const HloPassOptions& options = {});
+
+}  // namespace lczero
@@ -0,0 +1,199 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "neural/xla/hlo_passes.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "neural/xla/hlo_builder.h"
+#include "neural/xla/print_hlo.h"
+
+namespace lczero {
+namespace {
+
+pblczero::XlaShapeProto MakeShape(const std::vector<int64_t>& dims) {
+  pblczero::XlaShapeProto shape;
+  shape.set_element_type(pblczero::XlaShapeProto::F32);
+  for (auto dim : dims) shape.add_dimensions(dim);
+  ResetXlaShapeProtoLayout(&shape);
+  return shape;
+}
+
+pblczero::XlaLiteralProto MakeLiteral(const std::vector<int64_t>& dims,
+                                      const std::vector<float>& values) {
+  pblczero::XlaLiteralProto literal;
+  *literal.mutable_shape() = MakeShape(dims);
+  *literal.mutable_f32s() = values;
+  return literal;
+}
+
+// The same zero-broadcast sequence onnx2hlo emits for every Relu.
+HloFlow Relu(HloBuilder* builder, HloFlow input) {
+  auto* zero = builder->Constant(MakeLiteral({}, {0.0f}));
+  zero = builder->Broadcast(zero, input->shape(), {});
+  return builder->Maximum(input, zero);
+}
+
+std::string Opcodes(const pblczero::HloModuleProto& module) {
+  std::string result;
+  for (const auto& instr : module.computations(0).instructions()) {
+    if (!result.empty()) result += " ";
+    result += instr.opcode();
+  }
+  return result;
+}
+
+const pblczero::HloInstructionProto& Root(
+    const pblczero::HloModuleProto& module) {
+  const auto& comp = module.computations(0);
+  for (const auto& instr : comp.instructions()) {
+    if (instr.id() == comp.root_id()) return instr;
+  }
+  throw std::runtime_error("No root");
+}
+
+TEST(HloPasses, MergesCommonSubexpressions) {
+  HloBuilder builder;
+  auto* input = builder.Parameter(MakeShape({16, 64}));
+  auto* a = Relu(&builder, input);
+  auto* b = Relu(&builder, input);
+  builder.Tuple({builder.Add(a, b)});
+  auto module = builder.Build("test");
+
+  const auto stats = RunHloPasses(&module);
+  EXPECT_EQ("parameter constant broadcast maximum add tuple", Opcodes(module));
+  EXPECT_EQ(9u, stats.instructions_before);
+  EXPECT_EQ(6u, stats.instructions_after);
+  EXPECT_EQ(3u, stats.merged);
+  EXPECT_EQ(3u, stats.removed);
+  // Both operands of the add are the same instruction now.
+  const auto& add = module.computations(0).instructions(4);
+  EXPECT_EQ(add.operand_ids(0), add.operand_ids(1));
+}
+
+TEST(HloPasses, FoldsConstants) {
+  HloBuilder builder;
+  auto* input = builder.Parameter(MakeShape({2, 2}));
+  auto* weights = builder.Constant(MakeLiteral({4}, {1, -2, 3, -4}));
+  weights = builder.Reshape(weights, MakeShape({2, 2}));
+  auto* bias = builder.Constant(MakeLiteral({2}, {10, 20}));
+  bias = builder.Broadcast(bias, MakeShape({2, 2}), {1});
+  weights = Relu(&builder, builder.Add(weights, bias));
+  builder.Tuple({builder.Add(input, weights)});
+  auto module = builder.Build("test");
+
+  RunHloPasses(&module);
+  EXPECT_EQ("parameter constant add tuple", Opcodes(module));
+  const auto& folded = module.computations(0).instructions(1);
+  EXPECT_EQ(std::vector<int64_t>({2, 2}), folded.shape().dimensions());
+  EXPECT_EQ(std::vector<float>({11, 18, 13, 16}), folded.literal().f32s());
+}
+
+TEST(HloPasses, DoesNotMaterializeLargeBroadcasts) {
+  HloBuilder builder;
+  auto* input = builder.Parameter(MakeShape({64, 64}));
+  builder.Tuple({Relu(&builder, input)});
+  auto module = builder.Build("test");
+
+  HloPassOptions options;
+  options.max_folded_constant_size = 64 * 64 * sizeof(float) - 1;
+  RunHloPasses(&module, options);
+  EXPECT_EQ("parameter constant broadcast maximum tuple", Opcodes(module));
+  options.max_folded_constant_size = 64 * 64 * sizeof(float);
+  RunHloPasses(&module, options);
+  EXPECT_EQ("parameter constant maximum tuple", Opcodes(module));
+}
+
+TEST(HloPasses, CanonicalizesReshapesAndBroadcasts) {
+  HloBuilder builder;
+  auto* input = builder.Parameter(MakeShape({2, 3}));
+  auto* bias = builder.Parameter(MakeShape({3}));
+  // Reshape to the same shape is a no-op, two reshapes are one.
+  auto* flow = builder.Reshape(input, MakeShape({2, 3}));
+  flow = builder.Reshape(flow, MakeShape({6}));
+  flow = builder.Reshape(flow, MakeShape({3, 2}));
+  // broadcast(broadcast(bias)) is a single broadcast.
+  auto* wide = builder.Broadcast(bias, MakeShape({2, 3}), {1});
+  wide = builder.Broadcast(wide, MakeShape({4, 2, 3}), {1, 2});
+  // Identity broadcast.
+  flow = builder.Broadcast(flow, MakeShape({3, 2}), {0, 1});
+  builder.Tuple({flow, wide});
+  auto module = builder.Build("test");
+
+  const auto stats = RunHloPasses(&module);
+  EXPECT_EQ("parameter parameter reshape broadcast tuple", Opcodes(module));
+  const auto& instructions = module.computations(0).instructions();
+  const auto& reshape = instructions[2];
+  EXPECT_EQ(std::vector<int64_t>({input->id()}), reshape.operand_ids());
+  const auto& broadcast = instructions[3];
+  EXPECT_EQ(std::vector<int64_t>({bias->id()}), broadcast.operand_ids());
+  EXPECT_EQ(std::vector<int64_t>({2}), broadcast.dimensions());
+  EXPECT_EQ(std::vector<int64_t>({reshape.id(), broadcast.id()}),
+            Root(module).operand_ids());
+  EXPECT_EQ(0u, stats.merged);
+  EXPECT_EQ(0u, stats.folded);
+}
+
+TEST(HloPasses, KeepsUnusedParameters) {
+  HloBuilder builder;
+  auto* input = builder.Parameter(MakeShape({2}));
+  builder.Parameter(MakeShape({2}));
+  builder.Tuple({builder.Tanh(input)});
+  auto module = builder.Build("test");
+
+  RunHloPasses(&module);
+  EXPECT_EQ("parameter parameter tanh tuple", Opcodes(module));
+  EXPECT_EQ(2u, module.computations(0).program_shape().parameters_size());
+}
+
+TEST(HloPasses, KeepsNamesForDiffing) {
+  HloBuilder builder;
+  auto* input = builder.Parameter(MakeShape({2}));
+  auto* a = builder.Tanh(builder.Reshape(input, MakeShape({2})));
+  auto* b = builder.Tanh(input);
+  builder.Tuple({builder.Add(a, b)});
+  auto module = builder.Build("test");
+
+  RunHloPasses(&module);
+  std::ostringstream stream;
+  PrettyPrintHlo(module, {}, stream);
+  const std::string hlo = stream.str();
+  EXPECT_NE(std::string::npos, hlo.find("%i2 = f32[2] tanh(%i0)")) << hlo;
+  EXPECT_NE(std::string::npos, hlo.find("add(%i2, %i2)")) << hlo;
+  EXPECT_EQ(std::string::npos, hlo.find("%i1 ")) << hlo;
+  EXPECT_EQ(std::string::npos, hlo.find("%i3 ")) << hlo;
+}
+
+}  // namespace
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
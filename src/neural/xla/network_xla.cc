@@ -26,13 +26,16 @@
 */
 
 #include <cassert>
+#include <iostream>
 
 #include "neural/factory.h"
 #include "neural/network.h"
 #include "neural/onnx/converter.h"
+#include "neural/shared/expand_planes.h"
 #include "neural/xla/onnx2hlo.h"
+#include "neural/xla/print_hlo.h"
 #include "neural/xla/xla_runner.h"
-#include "utils/bititer.h"
+#include "utils/filesystem.h"
 
 namespace lczero {
 namespace {
@@ -133,12 +136,7 @@ XlaComputation::XlaComputation(const XlaNetwork* network)
     : network_(network), input_tensor_(network->runner_->GetMaxBatchSize()) {}
 
 void XlaComputation::AddInput(InputPlanes&& input) {
-  float* ptr = input_tensor_.AddBatch();
-  memset(ptr, 0, 8 * 8 * kInputPlanes * sizeof(float));
-  for (const auto& plane : input) {
-    for (auto bit : IterateBits(plane.mask)) ptr[bit] = plane.value;
-    ptr += 8 * 8;
-  }
+  ExpandPlanes(input, input_tensor_.AddBatch());
 }
 
 float XlaComputation::GetQVal(int sample) const {
@@ -196,7 +194,9 @@ XlaNetwork::XlaNetwork(std::unique_ptr<XlaRunner> runner,
 // XlaRunner.
 XlaNetworkOptions FillXlaRunnerFromOnnx(const pblczero::OnnxModel& onnx_model,
                                         XlaRunner* runner,
-                                        size_t max_batch_size, size_t steps) {
+                                        size_t max_batch_size, size_t steps,
+                                        const Onnx2HloOptions& hlo_options,
+                                        bool print_hlo, bool lazy_compile) {
   pblczero::ModelProto onnx;
   onnx.ParseFromString(onnx_model.model());
 
@@ -219,11 +219,18 @@ XlaNetworkOptions FillXlaRunnerFromOnnx(const pblczero::OnnxModel& onnx_model,
   for (size_t i = 0; i < steps; ++i) {
     size_t batch_size = max_batch_size * (i + 1) / steps;
     CERR << "Building HLO for batch size " << batch_size << "...";
-    auto conversion = ConvertOnnxToHlo(onnx, batch_size, {});
+    auto conversion = ConvertOnnxToHlo(onnx, batch_size, hlo_options);
+    if (hlo_options.run_hlo_passes) {
+      CERR << "HLO passes: " << conversion.hlo_pass_stats.ToString();
+    }
+    if (print_hlo) PrettyPrintHlo(conversion.hlo_module, {}, std::cerr);
     add_tensors(conversion.constants, constant_to_parameter_idx);
     add_tensors(conversion.inputs, input_to_parameter_idx);
     add_tensors(conversion.outputs, output_to_parameter_idx);
-    runner->AddModule(batch_size, conversion.hlo_module);
+    // The largest batch size is always compiled, smaller requests can be
+    // padded to it while their own executable is compiled.
+    runner->AddModule(batch_size, conversion.hlo_module,
+                      lazy_compile && i + 1 < steps);
   }
 
   std::vector<std::unique_ptr<XlaTensor>> constants;
@@ -282,17 +289,38 @@ std::unique_ptr<Network> MakeXlaNetwork(const std::optional<WeightsFile>& w,
       device);
   int max_batch_size = opts.GetOrDefault<int>("max_batch", 739);
   int steps = opts.GetOrDefault<int>("steps", 13);
+  Onnx2HloOptions hlo_options;
+  hlo_options.run_hlo_passes = opts.GetOrDefault<bool>("hlo_passes", true);
+  const bool print_hlo = opts.GetOrDefault<bool>("print_hlo", false);
+  const bool lazy_compile = opts.GetOrDefault<bool>("lazy_compile", true);
+  // Compiled executables are cached in <user cache dir>/lc0/xla/ by default,
+  // executable_cache= (empty) disables the cache.
+  std::string cache_dir = GetUserCacheDirectory();
+  if (!cache_dir.empty()) cache_dir += "lc0/xla/";
+  cache_dir = opts.GetOrDefault<std::string>("executable_cache", cache_dir);
+  try {
+    if (cache_dir == GetUserCacheDirectory() + "lc0/xla/") {
+      CreateDirectory(GetUserCacheDirectory() + "lc0");
+    }
+    if (!cache_dir.empty()) CreateDirectory(cache_dir);
+  } catch (const Exception& e) {
+    CERR << "Executable cache disabled: " << e.what();
+    cache_dir.clear();
+  }
+  runner->SetExecutableCacheDirectory(cache_dir);
 
   XlaNetworkOptions options;
   if (w->has_onnx_model()) {
     options = FillXlaRunnerFromOnnx(w->onnx_model(), runner.get(),
-                                    max_batch_size, steps);
+                                    max_batch_size, steps, hlo_options,
+                                    print_hlo, lazy_compile);
   } else {
     CERR << "Converting weights to ONNX first.";
     WeightsToOnnxConverterOptions onnx_converter_options;
     auto converted = ConvertWeightsToOnnx(*w, onnx_converter_options);
     options = FillXlaRunnerFromOnnx(converted.onnx_model(), runner.get(),
-                                    max_batch_size, steps);
+                                    max_batch_size, steps, hlo_options,
+                                    print_hlo, lazy_compile);
   }
 
   return std::make_unique<XlaNetwork>(std::move(runner), options,
@@ -32,7 +32,6 @@
 #include "neural/onnx/onnx.pb.h"
 #include "neural/xla/hlo.pb.h"
 #include "neural/xla/hlo_builder.h"
-#include "neural/xla/print_hlo.h"
 #include "utils/exception.h"
 
 namespace lczero {
@@ -166,12 +165,15 @@ class Onnx2HloConverter {
     // Convert ONNX outputs to HLO result.
     result.outputs = BuildOutputs(onnx_model.graph().output());
     result.hlo_module = builder_.Build("onnx_model");
+    if (options_.run_hlo_passes) {
+      result.hlo_pass_stats =
+          RunHloPasses(&result.hlo_module, options_.hlo_pass_options);
+    }
     for (size_t i = 0; i < params_.size(); ++i) {
       const auto& param = params_[i];
       auto& dst = param.is_constant ? result.constants : result.inputs;
       dst.push_back({i, param.name, param.flow->shape()});
     }
-    // PrettyPrintHlo(result.hlo_module, {}, std::cout);
     return result;
   }
 
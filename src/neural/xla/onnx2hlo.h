@@ -32,6 +32,7 @@
 
 #include "neural/onnx/onnx.pb.h"
 #include "neural/xla/hlo.pb.h"
+#include "neural/xla/hlo_passes.h"
 #include "neural/xla/xla_runner.h"
 
 namespace lczero {
@@ -43,6 +44,9 @@ struct Onnx2HloOptions {
   // The types of input/output tensors (does not affect constants passed as
   // parameters).
   pblczero::XlaShapeProto::Type io_type = pblczero::XlaShapeProto::F32;
+  // Simplify the HLO before handing it to the compiler.
+  bool run_hlo_passes = true;
+  HloPassOptions hlo_pass_options;
 };
 
 struct Onnx2HloResult {
@@ -58,6 +62,7 @@ struct Onnx2HloResult {
   std::vector<NamedTensor> inputs;
   std::vector<NamedTensor> outputs;
   pblczero::HloModuleProto hlo_module;
+  HloPassStats hlo_pass_stats;
 };
 
 // Converts an ONNX model to an HLO module.
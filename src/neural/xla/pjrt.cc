@@ -147,6 +147,27 @@ PjrtExecutable::~PjrtExecutable() {
 
 size_t PjrtExecutable::GetNumOutputs() const { return num_outputs_; }
 
+std::string PjrtExecutable::Serialize() const {
+  auto args = MakeStruct<PJRT_LoadedExecutable_GetExecutable_Args>();
+  args.loaded_executable = executable_;
+  CheckError(api_->PJRT_LoadedExecutable_GetExecutable(&args));
+
+  auto args2 = MakeStruct<PJRT_Executable_Serialize_Args>();
+  args2.executable = args.executable;
+  PJRT_Error* error = api_->PJRT_Executable_Serialize(&args2);
+  std::string result;
+  if (!error) {
+    result.assign(args2.serialized_bytes, args2.serialized_bytes_size);
+    args2.serialized_executable_deleter(args2.serialized_executable);
+  }
+
+  auto args3 = MakeStruct<PJRT_Executable_Destroy_Args>();
+  args3.executable = args.executable;
+  api_->PJRT_Executable_Destroy(&args3);
+  CheckError(error);
+  return result;
+}
+
 std::vector<std::unique_ptr<PjrtDeviceBuffer>> PjrtExecutable::ExecuteBlocking(
     const std::vector<PjrtDeviceBuffer*>& inputs) {
   auto options = MakeStruct<PJRT_ExecuteOptions>();
@@ -227,6 +248,30 @@ std::unique_ptr<PjrtExecutable> PjrtClient::CompileHlo(
   return std::make_unique<PjrtExecutable>(api_, args.executable);
 }
 
+std::unique_ptr<PjrtExecutable> PjrtClient::DeserializeAndLoad(
+    std::string_view serialized) {
+  auto args = MakeStruct<PJRT_Executable_DeserializeAndLoad_Args>();
+  args.client = client_;
+  args.serialized_executable = serialized.data();
+  args.serialized_executable_size = serialized.size();
+  CheckError(api_->PJRT_Executable_DeserializeAndLoad(&args));
+  return std::make_unique<PjrtExecutable>(api_, args.loaded_executable);
+}
+
+std::string PjrtClient::GetPlatformName() const {
+  auto args = MakeStruct<PJRT_Client_PlatformName_Args>();
+  args.client = client_;
+  CheckError(api_->PJRT_Client_PlatformName(&args));
+  return {args.platform_name, args.platform_name_size};
+}
+
+std::string PjrtClient::GetPlatformVersion() const {
+  auto args = MakeStruct<PJRT_Client_PlatformVersion_Args>();
+  args.client = client_;
+  CheckError(api_->PJRT_Client_PlatformVersion(&args));
+  return {args.platform_version, args.platform_version_size};
+}
+
 std::vector<std::unique_ptr<PjrtDevice>> PjrtClient::GetDevices() {
   auto args = MakeStruct<PJRT_Client_Devices_Args>();
   args.client = client_;
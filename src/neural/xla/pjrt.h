@@ -31,6 +31,8 @@
 
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -198,6 +200,10 @@ class PjrtExecutable : protected PjrtCommon {
   std::vector<std::unique_ptr<PjrtDeviceBuffer>> ExecuteBlocking(
       const std::vector<PjrtDeviceBuffer*>& inputs);
   size_t GetNumOutputs() const;
+  // Returns a platform-specific serialization of the compiled executable,
+  // that can be loaded back with PjrtClient::DeserializeAndLoad() by the same
+  // plugin version.
+  std::string Serialize() const;
 
  private:
   PJRT_LoadedExecutable* executable_;
@@ -229,6 +235,11 @@ class PjrtClient : protected PjrtCommon {
   ~PjrtClient();
   std::unique_ptr<PjrtExecutable> CompileHlo(std::string_view hlo,
                                              std::string_view config);
+  std::unique_ptr<PjrtExecutable> DeserializeAndLoad(
+      std::string_view serialized);
+  // E.g. "cuda" and the CUDA/plugin version.
+  std::string GetPlatformName() const;
+  std::string GetPlatformVersion() const;
   std::vector<std::unique_ptr<PjrtDevice>> GetDevices();
   std::unique_ptr<PjrtHostToDeviceTransfer> HostToDevice(
       std::string_view buffer, PjrtType type, const std::vector<int64_t>& dims,
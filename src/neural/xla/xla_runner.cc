@@ -27,9 +27,15 @@
 
 #include "neural/xla/xla_runner.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <numeric>
 
 #include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/hashcat.h"
 #include "utils/logging.h"
 
 namespace lczero {
@@ -62,6 +68,81 @@ std::string AsHexString(std::string_view buf) {
   return result;
 }
 
+// Executable cache file layout: ExecutableCacheHeader, then the serialized
+// executable.
+constexpr char kExecutableCacheMagic[8] = {'L', 'c', '0', 'X', 'l', 'a', 'E',
+                                           '\0'};
+constexpr uint32_t kExecutableCacheVersion = 1;
+
+struct ExecutableCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t key;
+  uint64_t size;
+};
+
+uint64_t HashString(uint64_t hash, std::string_view str) {
+  hash = HashCat(hash, str.size());
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= str.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, str.data() + i, sizeof(word));
+    hash = HashCat(hash, word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, str.data() + i, str.size() - i);
+  return HashCat(hash, tail);
+}
+
+std::string GetExecutableCacheFilename(const std::string& directory,
+                                       uint64_t key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.pjrt",
+                static_cast<unsigned long long>(key));
+  return directory + name;
+}
+
+std::optional<std::string> ReadExecutableCache(const std::string& filename,
+                                               uint64_t key) {
+  if (GetFileSize(filename) == 0) return std::nullopt;
+  const MappedFile file(filename);
+  ExecutableCacheHeader header;
+  if (file.size() < sizeof(header)) return std::nullopt;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, kExecutableCacheMagic,
+                  sizeof(kExecutableCacheMagic)) != 0 ||
+      header.version != kExecutableCacheVersion || header.key != key ||
+      sizeof(header) + header.size != file.size()) {
+    return std::nullopt;
+  }
+  return std::string(file.data() + sizeof(header), header.size);
+}
+
+void WriteExecutableCache(const std::string& filename, uint64_t key,
+                          std::string_view serialized) {
+  ExecutableCacheHeader header{};
+  std::memcpy(header.magic, kExecutableCacheMagic,
+              sizeof(kExecutableCacheMagic));
+  header.version = kExecutableCacheVersion;
+  header.key = key;
+  header.size = serialized.size();
+  // Write to a temporary file first, so that concurrently starting engines
+  // never see a partial executable.
+  const std::string tmp_filename =
+      filename + ".tmp" +
+      std::to_string(
+          std::chrono::steady_clock::now().time_since_epoch().count());
+  std::ofstream output(tmp_filename, std::ios::binary | std::ios::trunc);
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.write(serialized.data(), serialized.size());
+  output.close();
+  if (!output || std::rename(tmp_filename.c_str(), filename.c_str())) {
+    std::remove(tmp_filename.c_str());
+    CERR << "Cannot write executable cache " << filename;
+  }
+}
+
 }  // namespace
 
 std::string XlaTensor::DebugString() {
@@ -99,18 +180,152 @@ XlaRunner::XlaRunner(const char* library_path, int device)
   if (devices_.empty()) {
     throw Exception("No devices available");
   }
-}
-
-void XlaRunner::AddModule(size_t minibatch_size,
-                          const pblczero::HloModuleProto& module) {
   pblczero::CompileOptionsProto options;
   options.mutable_executable_build_options()->set_num_replicas(1);
   options.mutable_executable_build_options()->set_num_partitions(1);
   options.mutable_executable_build_options()->set_device_ordinal(device_);
-  auto executable = pjrt_client_->CompileHlo(module.OutputAsString(),
-                                             options.OutputAsString());
-  executables_.push_back({minibatch_size, std::move(executable)});
-  std::sort(executables_.begin(), executables_.end());
+  compile_options_ = options.OutputAsString();
+  platform_id_ = pjrt_client_->GetPlatformName() + " " +
+                 pjrt_client_->GetPlatformVersion() + " " +
+                 devices_.at(device_)->ToString();
+  compile_thread_ = std::thread([this]() { CompileWorker(); });
+}
+
+XlaRunner::~XlaRunner() {
+  {
+    Mutex::Lock lock(modules_mutex_);
+    stop_ = true;
+  }
+  compile_cv_.notify_all();
+  compile_thread_.join();
+}
+
+void XlaRunner::SetExecutableCacheDirectory(const std::string& directory) {
+  cache_directory_ = directory;
+  if (!cache_directory_.empty() && cache_directory_.back() != '/') {
+    cache_directory_ += '/';
+  }
+}
+
+std::unique_ptr<PjrtExecutable> XlaRunner::Compile(const std::string& hlo) {
+  std::string cache_filename;
+  uint64_t key = 0;
+  if (!cache_directory_.empty()) {
+    key = HashString(HashString(HashString(kExecutableCacheVersion, hlo),
+                                compile_options_),
+                     platform_id_);
+    cache_filename = GetExecutableCacheFilename(cache_directory_, key);
+    try {
+      if (auto serialized = ReadExecutableCache(cache_filename, key)) {
+        auto executable = pjrt_client_->DeserializeAndLoad(*serialized);
+        CERR << "Loaded executable from " << cache_filename;
+        return executable;
+      }
+    } catch (const std::exception& e) {
+      // E.g. the plugin was updated without changing its version string.
+      CERR << "Ignoring executable cache " << cache_filename << ": "
+           << e.what();
+    }
+  }
+  auto executable = pjrt_client_->CompileHlo(hlo, compile_options_);
+  if (!cache_filename.empty()) {
+    try {
+      WriteExecutableCache(cache_filename, key, executable->Serialize());
+    } catch (const std::exception& e) {
+      CERR << "Cannot write executable cache: " << e.what();
+    }
+  }
+  return executable;
+}
+
+void XlaRunner::AddModule(size_t minibatch_size,
+                          const pblczero::HloModuleProto& module, bool lazy) {
+  Module entry;
+  entry.batch_size = minibatch_size;
+  entry.hlo = module.OutputAsString();
+  if (!lazy) {
+    entry.executable = Compile(entry.hlo);
+    entry.hlo.clear();
+  }
+  Mutex::Lock lock(modules_mutex_);
+  if (started_) throw Exception("Cannot add modules after the first request");
+  modules_.push_back(std::move(entry));
+  std::sort(modules_.begin(), modules_.end(),
+            [](const Module& a, const Module& b) {
+              return a.batch_size < b.batch_size;
+            });
+}
+
+void XlaRunner::CompileWorker() {
+  while (true) {
+    size_t batch_size;
+    std::string hlo;
+    {
+      Mutex::Lock lock(modules_mutex_);
+      compile_cv_.wait(lock.get_raw(),
+                       [&]() { return stop_ || !compile_queue_.empty(); });
+      if (stop_) return;
+      const auto& module = modules_[compile_queue_.front()];
+      batch_size = module.batch_size;
+      hlo = module.hlo;
+    }
+    CERR << "Compiling executable for batch size " << batch_size << ".";
+    std::unique_ptr<PjrtExecutable> executable;
+    std::string error;
+    try {
+      executable = Compile(hlo);
+    } catch (const std::exception& e) {
+      error = e.what();
+      CERR << "Cannot compile executable for batch size " << batch_size
+           << ": " << error;
+    }
+    {
+      Mutex::Lock lock(modules_mutex_);
+      auto& module = modules_[compile_queue_.front()];
+      compile_queue_.pop_front();
+      module.executable = std::move(executable);
+      module.error = error;
+      module.hlo.clear();
+    }
+    compile_cv_.notify_all();
+  }
+}
+
+std::pair<PjrtExecutable*, size_t> XlaRunner::GetExecutable(
+    size_t batch_size) {
+  Mutex::Lock lock(modules_mutex_);
+  started_ = true;
+  // Find the smallest batch size that fits the input.
+  auto iter = std::find_if(modules_.begin(), modules_.end(),
+                           [&](const Module& m) {
+                             return m.batch_size >= batch_size &&
+                                    m.error.empty();
+                           });
+  if (iter == modules_.end()) {
+    throw Exception("No executable found for batch size " +
+                    std::to_string(batch_size));
+  }
+  if (iter->executable) return {iter->executable.get(), iter->batch_size};
+  if (!iter->compile_scheduled) {
+    iter->compile_scheduled = true;
+    compile_queue_.push_back(iter - modules_.begin());
+    compile_cv_.notify_all();
+  }
+  // Pad to the next compiled batch size in the meantime.
+  auto compiled = std::find_if(iter, modules_.end(), [](const Module& m) {
+    return m.executable != nullptr;
+  });
+  if (compiled != modules_.end()) {
+    return {compiled->executable.get(), compiled->batch_size};
+  }
+  // Nothing to fall back to, wait for the compilation. Modules are not added
+  // or moved after the first request, so the reference stays valid.
+  const Module& module = *iter;
+  compile_cv_.wait(lock.get_raw(), [&]() {
+    return module.executable != nullptr || !module.error.empty();
+  });
+  if (!module.executable) throw Exception(module.error);
+  return {module.executable.get(), module.batch_size};
 }
 
 void XlaRunner::SetFrozenInputs(
@@ -142,23 +357,17 @@ void XlaRunner::SetFrozenInputs(
   }
 }
 
-size_t XlaRunner::GetMaxBatchSize() const { return executables_.back().first; }
+size_t XlaRunner::GetMaxBatchSize() const {
+  Mutex::Lock lock(modules_mutex_);
+  return modules_.back().batch_size;
+}
 
 std::vector<std::unique_ptr<XlaTensor>> XlaRunner::ExecuteBlocking(
     const std::vector<XlaTensor*>& inputs) {
   if (inputs.size() != 1) {
     throw Exception("Only one input is kinda supported.");
   }
-  // Find the smallest batch size that fits the input.
-  auto iter = std::find_if(
-      executables_.begin(), executables_.end(), [&](const auto& e) {
-        return e.first >= static_cast<size_t>(inputs[0]->shape()[0]);
-      });
-  if (iter == executables_.end()) {
-    throw Exception("No executable found for batch size " +
-                    std::to_string(inputs[0]->shape()[0]));
-  }
-  const size_t batch_size = iter->first;
+  auto [executable, batch_size] = GetExecutable(inputs[0]->shape()[0]);
   // Update the shape to match the rounded up batch size. After growing, the
   // batch size must fit within tensor buffer capacity (it's fine to have
   // garbage in the tail of that buffer).
@@ -182,7 +391,7 @@ std::vector<std::unique_ptr<XlaTensor>> XlaRunner::ExecuteBlocking(
   auto input_buffers = buffers_;
   input_buffers[param_idxs_[0]] = input_buffer.get();
   // Execute!
-  auto outputs = iter->second->ExecuteBlocking(input_buffers);
+  auto outputs = executable->ExecuteBlocking(input_buffers);
 
   // Now we need to transfer the outputs back to the host.
   std::vector<std::unique_ptr<XlaTensor>> result;
@@ -27,14 +27,18 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "neural/xla/hlo.pb.h"
 #include "neural/xla/pjrt.h"
+#include "utils/mutex.h"
 
 namespace lczero {
 
@@ -101,8 +105,18 @@ class XlaRunner {
  public:
   // The library_path is the path to the PJRT library, and device indx.
   XlaRunner(const char* library_path, int device);
-  // Compiles and adds a module for the given batch size.
-  void AddModule(size_t minibatch_size, const pblczero::HloModuleProto& module);
+  ~XlaRunner();
+  // Enables the on-disk cache of compiled executables in the given directory
+  // (empty to disable). Entries are keyed by the HLO module, the compile
+  // options, the plugin version and the device, so they are never reused for
+  // anything else. Must be called before AddModule().
+  void SetExecutableCacheDirectory(const std::string& directory);
+  // Compiles and adds a module for the given batch size. Lazy modules are only
+  // compiled when their batch size is requested for the first time; until then
+  // such requests are padded to the nearest larger compiled batch size (or
+  // compiled synchronously if there is none).
+  void AddModule(size_t minibatch_size, const pblczero::HloModuleProto& module,
+                 bool lazy = false);
   // Transfers inputs to the device and execute the executable corresponding to
   // the batch size. Only non-frozen inputs are passed as arguments.
   // Currnetly only single input is supported (just because we don't need more).
@@ -117,10 +131,39 @@ class XlaRunner {
   size_t GetMaxBatchSize() const;
 
  private:
+  struct Module {
+    size_t batch_size;
+    // Serialized HloModuleProto, kept until the module is compiled.
+    std::string hlo;
+    std::unique_ptr<PjrtExecutable> executable;
+    bool compile_scheduled = false;
+    // Set if the lazy compilation failed.
+    std::string error;
+  };
+
+  // Loads the executable from the cache, or compiles (and caches) it.
+  std::unique_ptr<PjrtExecutable> Compile(const std::string& hlo);
+  // Returns the executable to run the given batch size with, and the batch
+  // size it was compiled for.
+  std::pair<PjrtExecutable*, size_t> GetExecutable(size_t batch_size);
+  void CompileWorker();
+
   std::unique_ptr<PjrtClient> pjrt_client_;
   std::vector<std::unique_ptr<PjrtDevice>> devices_;
-  // Compiled executables per batch size.
-  std::vector<std::pair<size_t, std::unique_ptr<PjrtExecutable>>> executables_;
+  std::string compile_options_;
+  std::string cache_directory_;
+  // Identifies the plugin and device for the executable cache.
+  std::string platform_id_;
+  // Executables per batch size, sorted.
+  mutable Mutex modules_mutex_;
+  std::vector<Module> modules_ GUARDED_BY(modules_mutex_);
+  // Lazy modules waiting for compilation (indices in modules_). Signalled both
+  // when a module is queued and when it's compiled.
+  std::condition_variable compile_cv_;
+  std::deque<size_t> compile_queue_ GUARDED_BY(modules_mutex_);
+  bool started_ GUARDED_BY(modules_mutex_) = false;
+  bool stop_ GUARDED_BY(modules_mutex_) = false;
+  std::thread compile_thread_;
   // Frozen inputs, in no particular order, kept for ownership.
   std::vector<std::unique_ptr<PjrtDeviceBuffer>> owned_buffers_;
   // Vector of pointers to all input buffers, that is passed to PJRT. Frozen
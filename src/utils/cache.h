@@ -210,6 +210,34 @@ class HashKeyedCache {
   int GetCapacity() const { return capacity_.load(std::memory_order_relaxed); }
   static constexpr size_t GetItemStructSize() { return sizeof(Entry); }
 
+  struct MemoryUsage {
+    // The hash table, allocated for the full capacity.
+    size_t table_bytes = 0;
+    // The values, including evicted ones that are still pinned, and their
+    // place in the insertion order. Grows with the number of entries.
+    size_t entry_bytes = 0;
+  };
+
+  // Returns the bytes used by the cache. @payload_bytes(const V&) returns the
+  // heap memory owned by a value. Walks the whole table, so is meant for
+  // occasional reports only.
+  template <typename F>
+  MemoryUsage GetMemoryUsage(F&& payload_bytes) const {
+    SpinMutex::Lock lock(mutex_);
+    MemoryUsage usage;
+    usage.table_bytes =
+        (hash_.capacity() + evicted_.capacity()) * sizeof(Entry);
+    usage.entry_bytes = insertion_order_.size() * sizeof(uint64_t);
+    for (const Entry& item : hash_) {
+      if (!item.in_use) continue;
+      usage.entry_bytes += sizeof(V) + payload_bytes(*item.value);
+    }
+    for (const Entry& item : evicted_) {
+      usage.entry_bytes += sizeof(V) + payload_bytes(*item.value);
+    }
+    return usage;
+  }
+
  private:
   struct Entry {
     Entry() {}
@@ -0,0 +1,168 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "utils/cpu_features.h"
+
+#include <cstring>
+#include <iterator>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(LC0_X86_DISPATCH)
+#include <cpuid.h>
+#endif
+
+#ifdef USE_ISPC
+#include "ispc_target_ispc.h"
+#endif
+
+namespace lczero {
+namespace {
+
+CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features;
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  int regs[4];
+  __cpuid(regs, 0);
+  const int max_leaf = regs[0];
+  __cpuid(regs, 1);
+  features.sse4_1 = regs[2] & (1 << 19);
+  features.fma = regs[2] & (1 << 12);
+  features.f16c = regs[2] & (1 << 29);
+  const bool osxsave = regs[2] & (1 << 27);
+  const bool avx = regs[2] & (1 << 28);
+  // The OS must save the ymm (and zmm) registers on context switch.
+  const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  const bool ymm_enabled = (xcr0 & 0x06) == 0x06;
+  const bool zmm_enabled = (xcr0 & 0xe6) == 0xe6;
+  features.avx = avx && ymm_enabled;
+  features.fma &= features.avx;
+  features.f16c &= features.avx;
+  if (max_leaf >= 7) {
+    __cpuidex(regs, 7, 0);
+    features.avx2 = features.avx && (regs[1] & (1 << 5));
+    features.avx512f = zmm_enabled && (regs[1] & (1 << 16));
+    features.avx512bw = features.avx512f && (regs[1] & (1 << 30));
+    features.avx512vl = features.avx512f && (regs[1] & (1 << 31));
+    features.avx512vnni = features.avx512f && (regs[2] & (1 << 11));
+    if (regs[0] >= 1) {
+      __cpuidex(regs, 7, 1);
+      features.avx512bf16 = features.avx512f && (regs[0] & (1 << 5));
+    }
+  }
+#elif defined(LC0_X86_DISPATCH)
+  __builtin_cpu_init();
+  features.sse4_1 = __builtin_cpu_supports("sse4.1");
+  features.avx = __builtin_cpu_supports("avx");
+  features.avx2 = __builtin_cpu_supports("avx2");
+  features.fma = __builtin_cpu_supports("fma");
+  features.avx512f = __builtin_cpu_supports("avx512f");
+  features.avx512bw = __builtin_cpu_supports("avx512bw");
+  features.avx512vl = __builtin_cpu_supports("avx512vl");
+  features.avx512vnni = __builtin_cpu_supports("avx512vnni");
+  features.avx512bf16 = __builtin_cpu_supports("avx512bf16");
+  // F16C is not queryable through __builtin_cpu_supports(); it's present on
+  // every CPU with AVX2.
+  features.f16c = features.avx2;
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+  features.neon = true;
+#endif
+  return features;
+}
+
+}  // namespace
+
+const CpuFeatures& GetCpuFeatures() {
+  static const CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
+
+std::string DescribeCpuFeatures() {
+  const auto& cpu = GetCpuFeatures();
+  std::string result;
+  auto add = [&](bool present, const char* name) {
+    if (!present) return;
+    if (!result.empty()) result += ' ';
+    result += name;
+  };
+  add(cpu.sse4_1, "sse4.1");
+  add(cpu.avx, "avx");
+  add(cpu.avx2, "avx2");
+  add(cpu.fma, "fma");
+  add(cpu.f16c, "f16c");
+  add(cpu.avx512f, "avx512f");
+  add(cpu.avx512bw, "avx512bw");
+  add(cpu.avx512vl, "avx512vl");
+  add(cpu.avx512vnni, "avx512vnni");
+  add(cpu.avx512bf16, "avx512bf16");
+  add(cpu.neon, "neon");
+  return result.empty() ? "none" : result;
+}
+
+std::string GetCpuModelName() {
+  unsigned int regs[12] = {};
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  int leaf[4];
+  __cpuid(leaf, 0x80000000);
+  if (static_cast<unsigned int>(leaf[0]) < 0x80000004) return "unknown";
+  for (int i = 0; i < 3; i++) {
+    __cpuid(leaf, 0x80000002 + i);
+    std::memcpy(regs + 4 * i, leaf, sizeof(leaf));
+  }
+#elif defined(LC0_X86_DISPATCH)
+  if (__get_cpuid_max(0x80000000, nullptr) < 0x80000004) return "unknown";
+  for (unsigned int i = 0; i < 3; i++) {
+    __get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1],
+                &regs[4 * i + 2], &regs[4 * i + 3]);
+  }
+#else
+  return "unknown";
+#endif
+  std::string name(reinterpret_cast<const char*>(regs), sizeof(regs));
+  name.resize(std::strlen(name.c_str()));
+  // Some vendors pad the brand string with leading spaces.
+  const auto start = name.find_first_not_of(' ');
+  return start == std::string::npos ? "unknown" : name.substr(start);
+}
+
+std::string GetIspcTarget() {
+#ifdef USE_ISPC
+  static const char* kNames[] = {"unknown",   "sse2",      "sse4",
+                                 "avx1",      "avx2",      "avx512knl",
+                                 "avx512skx", "neon"};
+  const int id = ispc::IspcTargetId();
+  const char* name =
+      id >= 0 && id < static_cast<int>(std::size(kNames)) ? kNames[id]
+                                                           : kNames[0];
+  return std::string(name) + "-i32x" + std::to_string(ispc::IspcTargetWidth());
+#else
+  return "none";
+#endif
+}
+
+}  // namespace lczero
@@ -0,0 +1,81 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <string>
+
+// Functions with LC0_TARGET("avx2") etc. may use the intrinsics of the given
+// instruction set even if the rest of the binary is compiled without it. They
+// must only be called after checking GetCpuFeatures() at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define LC0_TARGET(x) __attribute__((target(x)))
+#define LC0_X86_DISPATCH
+#elif defined(_M_X64) || defined(_M_IX86)
+// MSVC allows all intrinsics without any special compiler flags.
+#define LC0_TARGET(x)
+#define LC0_X86_DISPATCH
+#else
+#define LC0_TARGET(x)
+#endif
+
+namespace lczero {
+
+// Instruction set extensions of the CPU the engine is running on, as detected
+// at runtime (as opposed to the ones the compiler was allowed to use).
+struct CpuFeatures {
+  bool sse4_1 = false;
+  bool avx = false;
+  bool avx2 = false;
+  bool fma = false;
+  bool f16c = false;
+  bool avx512f = false;
+  bool avx512bw = false;
+  bool avx512vl = false;
+  bool avx512vnni = false;
+  bool avx512bf16 = false;
+  bool neon = false;
+};
+
+// Returns the features of the current CPU. Detection runs once, the result is
+// cached.
+const CpuFeatures& GetCpuFeatures();
+
+// The features above, as a list of names for the startup messages.
+std::string DescribeCpuFeatures();
+
+// The CPU brand string, e.g. "AMD Ryzen 9 5950X 16-Core Processor", or
+// "unknown" where it can't be queried.
+std::string GetCpuModelName();
+
+// The ISPC target whose kernels run on this CPU, e.g. "avx2-i32x8", or "none"
+// if the binary was built without ISPC. Multi-target ISPC builds pick it at
+// runtime.
+std::string GetIspcTarget();
+
+}  // namespace lczero
@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <ctime>
 #include <string>
@@ -48,6 +49,26 @@ uint64_t GetFileSize(const std::string& filename);
 // Returns modification time of a file, 0 if file doesn't exist or can't be read.
 time_t GetFileTime(const std::string& filename);
 
+// Read-only memory mapping of a whole file. Pages are shared with the page
+// cache, so several processes mapping the same file use one physical copy.
+// Throws exception if the file cannot be opened or mapped.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  // Platform specific mapping handle, unused on posix.
+  void* handle_ = nullptr;
+};
+
 // Returns the base directory relative to which user specific non-essential data
 // files are stored or an empty string if unspecified.
 std::string GetUserCacheDirectory();
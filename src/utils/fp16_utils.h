@@ -109,4 +109,20 @@ inline float FP16toFP32(uint16_t f16) {
 
 #endif
 
+// bfloat16 is the upper half of a float. Rounds to nearest even, NaN payloads
+// are not preserved.
+inline uint16_t FP32toBF16(float f32) {
+  uint32_t x;
+  memcpy(&x, &f32, sizeof(float));
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+inline float BF16toFP32(uint16_t bf16) {
+  const uint32_t x = static_cast<uint32_t>(bf16) << 16;
+  float f;
+  memcpy(&f, &x, sizeof(float));
+  return f;
+}
+
 }  // namespace lczero
@@ -122,6 +122,24 @@ void Histogram::Dump() const {
   Print(" \n");
 }
 
+double Histogram::GetPercentile(double fraction) const {
+  if (total_ == 0) return 0;
+  const double target = fraction * total_;
+  double count = 0;
+  size_t index = 0;
+  for (; index + 1 < buckets_.size(); index++) {
+    count += buckets_[index];
+    if (count >= target && count > 0) break;
+  }
+  // Inverse of GetIndex(), the center of the bucket.
+  if (index == 0) return 0;
+  if (index > static_cast<size_t>(total_scales_ + 1)) {
+    return std::pow(10.0, max_exp_ + 1);
+  }
+  return std::pow(10.0, min_exp_ + (static_cast<double>(index) - 4) /
+                                       minor_scales_);
+}
+
 int Histogram::GetIndex(double val) const {
   if (val <= 0) return 0;
   const double log10 = std::log10(val);
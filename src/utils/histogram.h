@@ -70,6 +70,13 @@ class Histogram {
   // Dumps the histogram to stderr.
   void Dump() const;
 
+  // Number of samples added since the last Clear().
+  size_t GetCount() const { return static_cast<size_t>(total_); }
+
+  // Returns the value below which the @fraction (0..1) of samples lie, at the
+  // resolution of the buckets. Returns 0 for an empty histogram.
+  double GetPercentile(double fraction) const;
+
  private:
   int GetIndex(double val) const;
 
@@ -0,0 +1,64 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "utils/histogram.h"
+
+#include <gtest/gtest.h>
+
+namespace lczero {
+
+TEST(Histogram, EmptyPercentileIsZero) {
+  Histogram histogram;
+  EXPECT_EQ(histogram.GetCount(), 0u);
+  EXPECT_EQ(histogram.GetPercentile(0.5), 0.0);
+}
+
+TEST(Histogram, Percentiles) {
+  // 1% resolution per bucket.
+  Histogram histogram(-1, 3, 100);
+  for (int i = 1; i <= 100; i++) histogram.Add(i);
+  EXPECT_EQ(histogram.GetCount(), 100u);
+  EXPECT_NEAR(histogram.GetPercentile(0.5), 50, 50 * 0.025);
+  EXPECT_NEAR(histogram.GetPercentile(0.9), 90, 90 * 0.025);
+  EXPECT_NEAR(histogram.GetPercentile(0.99), 99, 99 * 0.025);
+  EXPECT_NEAR(histogram.GetPercentile(1.0), 100, 100 * 0.025);
+}
+
+TEST(Histogram, OutliersAreClamped) {
+  Histogram histogram(0, 1, 10);
+  histogram.Add(0);
+  histogram.Add(1e6);
+  EXPECT_EQ(histogram.GetPercentile(0.5), 0.0);
+  EXPECT_EQ(histogram.GetPercentile(1.0), 100.0);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,85 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "utils/memory_usage.h"
+
+#ifdef _WIN32
+#include <windows.h>
+// Must come after windows.h.
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <fstream>
+#endif
+
+namespace lczero {
+
+#ifdef _WIN32
+size_t GetCurrentResidentMemory() {
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.WorkingSetSize;
+}
+
+size_t GetPeakResidentMemory() {
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+}
+#else
+size_t GetCurrentResidentMemory() {
+#ifdef __linux__
+  // The second field is the resident set size in pages.
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  if (statm >> total_pages >> resident_pages) {
+    return resident_pages * sysconf(_SC_PAGESIZE);
+  }
+#endif
+  return 0;
+}
+
+size_t GetPeakResidentMemory() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  // Linux and the BSDs report kilobytes.
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+#endif
+
+}  // namespace lczero
@@ -27,12 +27,21 @@
 
 #include "utils/numa.h"
 
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include "chess/bitboard.h"
 #include "utils/logging.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
 
 namespace lczero {
 
@@ -91,4 +100,72 @@ void Numa::BindThread(int id) {
 #endif
 }
 
+#ifdef __linux__
+namespace {
+// Parses a non-negative number, returns -1 if it isn't one.
+int ParseNumber(const std::string& str) {
+  try {
+    size_t pos;
+    const int value = std::stoi(str, &pos);
+    if (value < 0 || str.find_first_not_of(" \t\n", pos) != std::string::npos) {
+      return -1;
+    }
+    return value;
+  } catch (const std::exception&) {
+    return -1;
+  }
+}
+
+// Node of every cpu, from the cpu lists in sysfs. Cpus that can't be read
+// default to node 0.
+std::vector<int> ReadCpuNodes() {
+  std::vector<int> nodes;
+  const std::string root = "/sys/devices/system/node/";
+  DIR* dir = opendir(root.c_str());
+  if (!dir) return nodes;
+  // Node numbers need not be contiguous, so scan the nodeN directories.
+  while (const dirent* entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.compare(0, 4, "node") != 0) continue;
+    const int node = ParseNumber(name.substr(4));
+    if (node < 0) continue;
+    std::ifstream file(root + name + "/cpulist");
+    if (!file) continue;
+    // Comma separated ranges, e.g. "0-15,32-47". Memory only nodes have an
+    // empty list.
+    std::string range;
+    while (std::getline(file, range, ',')) {
+      if (range.find_first_not_of(" \t\n") == std::string::npos) continue;
+      const auto dash = range.find('-');
+      const int first = ParseNumber(range.substr(0, dash));
+      const int last =
+          dash == std::string::npos ? first : ParseNumber(range.substr(dash + 1));
+      if (first < 0 || last < first) continue;
+      if (nodes.size() <= static_cast<size_t>(last)) nodes.resize(last + 1, 0);
+      for (int cpu = first; cpu <= last; cpu++) nodes[cpu] = node;
+    }
+  }
+  closedir(dir);
+  return nodes;
+}
+}  // namespace
+#endif
+
+int Numa::GetCurrentNode() {
+#if defined(__linux__)
+  static const std::vector<int> nodes = ReadCpuNodes();
+  const int cpu = sched_getcpu();
+  if (cpu < 0 || static_cast<size_t>(cpu) >= nodes.size()) return 0;
+  return nodes[cpu];
+#elif defined(_WIN64) && _WIN32_WINNT >= 0x0601
+  PROCESSOR_NUMBER processor;
+  GetCurrentProcessorNumberEx(&processor);
+  USHORT node;
+  if (!GetNumaProcessorNodeEx(&processor, &node)) return 0;
+  return node;
+#else
+  return 0;
+#endif
+}
+
 }  // namespace lczero
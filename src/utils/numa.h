@@ -39,6 +39,9 @@ class Numa {
   // Bind thread to processor group.
   static void BindThread(int id);
 
+  // NUMA node of the processor running the calling thread, 0 if unknown.
+  static int GetCurrentNode();
+
  private:
   static int threads_per_core_;
 };
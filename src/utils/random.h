@@ -28,6 +28,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <random>
 #include <string>
 #include "utils/mutex.h"
@@ -37,6 +38,8 @@ namespace lczero {
 class Random {
  public:
   static Random& Get();
+  // Restarts the sequence from @seed, for reproducible runs.
+  void Seed(uint64_t seed);
   double GetDouble(double max_val);
   float GetFloat(float max_val);
   double GetGamma(double alpha, double beta);
@@ -0,0 +1,113 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace lczero {
+
+ThreadPool::ThreadPool(int workers) {
+  for (int i = 0; i < workers; i++) {
+    threads_.emplace_back([this]() { Worker(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void ThreadPool::Worker() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [&]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& fn) {
+  if (count <= 0) return;
+  if (count == 1 || threads_.empty()) {
+    for (int i = 0; i < count; i++) fn(i);
+    return;
+  }
+
+  // Helpers may start after all the work is done, so the state they share
+  // with this call has to outlive it.
+  struct State {
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr exception;
+  };
+  auto state = std::make_shared<State>();
+  auto run = [state, count, &fn]() {
+    int i;
+    while ((i = state->next.fetch_add(1)) < count) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->exception) state->exception = std::current_exception();
+      }
+      if (state->done.fetch_add(1) + 1 == count) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->cv.notify_all();
+      }
+    }
+  };
+  // A helper task only touches @fn while it still has an index to run, and
+  // this call doesn't return before every index is done.
+  const int helpers = std::min(count - 1, size());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < helpers; i++) tasks_.push_back(run);
+  }
+  cv_.notify_all();
+  run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&]() { return state->done.load() == count; });
+  if (state->exception) std::rethrow_exception(state->exception);
+}
+
+}  // namespace lczero